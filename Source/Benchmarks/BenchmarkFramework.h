@@ -0,0 +1,61 @@
+//*******************************************************************
+// BenchmarkFramework.h:
+//
+// Registration and timing for the CPU benchmarks of Core, the
+// counterpart of the test framework. BENCHMARK defines a function and
+// registers it with the runner; a benchmark times its variants with
+// TimeMs and prints each with Report, along with any figures derived
+// from them. Only Release numbers mean anything.
+//*******************************************************************
+
+#pragma once
+
+#include "lmpch.h"
+
+namespace Benchmark
+{
+	using BenchmarkFunction = void(*)();
+
+	// Adds a benchmark to the runner during static initialization.
+	struct Registrar
+	{
+		Registrar(const char* name, BenchmarkFunction function);
+	};
+
+	void Report(const char* label, double milliseconds);
+
+	// Prints a derived figure, e.g. a throughput or a byte count, in the
+	// same columns as Report.
+	void Report(const char* label, double value, const char* unit);
+
+	// Average time of run over the iterations, in milliseconds. setup is
+	// called before every run and not timed. One untimed round goes first,
+	// so caches and allocations are warm.
+	template<typename TSetup, typename TRun>
+	double TimeMs(int iterations, const TSetup& setup, const TRun& run)
+	{
+		setup();
+		run();
+
+		std::chrono::steady_clock::duration total(0);
+		for (int i = 0; i < iterations; ++i)
+		{
+			setup();
+			auto start = std::chrono::steady_clock::now();
+			run();
+			total += std::chrono::steady_clock::now() - start;
+		}
+		return std::chrono::duration<double, std::milli>(total).count() / iterations;
+	}
+
+	template<typename TRun>
+	double TimeMs(int iterations, const TRun& run)
+	{
+		return TimeMs(iterations, []() {}, run);
+	}
+}
+
+#define BENCHMARK(name) \
+	static void name(); \
+	static Benchmark::Registrar name##Registrar(#name, name); \
+	static void name()
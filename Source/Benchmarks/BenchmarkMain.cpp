@@ -0,0 +1,64 @@
+//*******************************************************************
+// BenchmarkMain.cpp:
+//
+// Runs every registered benchmark and prints its timings.
+//*******************************************************************
+#include "BenchmarkFramework.h"
+
+#include <iomanip>
+
+namespace
+{
+    struct BenchmarkInfo
+    {
+        const char* Name;
+        Benchmark::BenchmarkFunction Function;
+    };
+
+    // Function local, so registrars in other files find it constructed.
+    std::vector<BenchmarkInfo>& Benchmarks()
+    {
+        static std::vector<BenchmarkInfo> benchmarks;
+        return benchmarks;
+    }
+}
+
+Benchmark::Registrar::Registrar(const char* name, BenchmarkFunction function)
+{
+    Benchmarks().push_back({ name, function });
+}
+
+void Benchmark::Report(const char* label, double milliseconds)
+{
+    Report(label, milliseconds, "ms");
+}
+
+void Benchmark::Report(const char* label, double value, const char* unit)
+{
+    std::cout << "  " << std::left << std::setw(32) << label << std::right << std::fixed << std::setprecision(3)
+        << std::setw(10) << value << " " << unit << std::endl;
+}
+
+// ------------------------------------------------------------------
+// An optional argument runs only the benchmarks whose name contains
+// it.
+// ------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    const char* filter = argc > 1 ? argv[1] : nullptr;
+
+#if defined(DEBUG) || defined(_DEBUG)
+    std::cout << "Debug build: the timings are not representative." << std::endl;
+#endif
+
+    for (const BenchmarkInfo& benchmark : Benchmarks())
+    {
+        if (filter != nullptr && strstr(benchmark.Name, filter) == nullptr)
+            continue;
+
+        std::cout << benchmark.Name << std::endl;
+        benchmark.Function();
+    }
+
+    return 0;
+}
@@ -0,0 +1,99 @@
+//*******************************************************************
+// InstanceDataBenchmarks.cpp:
+//
+// Encoding a frame's worth of instances into the instance buffer, in
+// the 144 byte layout the shaders used to read and in the 64 byte
+// PackedInstanceData. Both are written one element at a time into
+// write-combined memory, as the instance buffers were every frame.
+//*******************************************************************
+#include "BenchmarkFramework.h"
+#include "InstanceStore.h"
+
+using namespace DirectX;
+
+namespace
+{
+    const UINT InstanceCount = 50000;
+    const int Iterations = 16;
+
+    // The layout before the compaction: both matrices in full.
+    struct LegacyInstanceData
+    {
+        XMFLOAT4X4 World;
+        XMFLOAT4X4 TexTransform;
+        UINT MaterialIndex;
+        UINT InstancePad0;
+        UINT InstancePad1;
+        UINT InstancePad2;
+    };
+    static_assert(sizeof(LegacyInstanceData) == 144, "The old instance layout was 144 bytes.");
+    static_assert(sizeof(PackedInstanceData) == 64, "PackedInstanceData should be 64 bytes.");
+
+    std::vector<InstanceData> MakeInstances()
+    {
+        std::vector<InstanceData> instances(InstanceCount);
+        for (UINT i = 0; i < InstanceCount; ++i)
+        {
+            XMMATRIX world = XMMatrixRotationY(i * 0.01f) * XMMatrixTranslation((float)(i % 256), 0.0f, (float)(i / 256));
+            XMStoreFloat4x4(&instances[i].World, world);
+            XMStoreFloat4x4(&instances[i].TexTransform, XMMatrixScaling(2.0f, 2.0f, 1.0f));
+            instances[i].MaterialIndex = i % 16;
+            instances[i].TexTransformIndex = 1;
+        }
+        return instances;
+    }
+
+    // The instance write as it was before the compaction.
+    void WriteLegacy(BYTE* dst, const InstanceData& instance)
+    {
+        LegacyInstanceData data;
+        XMStoreFloat4x4(&data.World, XMMatrixTranspose(XMLoadFloat4x4(&instance.World)));
+        XMStoreFloat4x4(&data.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&instance.TexTransform)));
+        data.MaterialIndex = instance.MaterialIndex;
+        data.InstancePad0 = 0;
+        data.InstancePad1 = 0;
+        data.InstancePad2 = 0;
+        memcpy(dst, &data, sizeof(data));
+    }
+
+    // The encode InstanceStore uses now.
+    void WritePacked(BYTE* dst, const InstanceData& instance)
+    {
+        PackedInstanceData data;
+        InstanceStore::Encode(instance, data);
+        memcpy(dst, &data, sizeof(data));
+    }
+}
+
+BENCHMARK(InstanceDataEncoding)
+{
+    const std::size_t byteSize = (std::size_t)InstanceCount * sizeof(LegacyInstanceData);
+
+    BYTE* mapped = static_cast<BYTE*>(VirtualAlloc(nullptr, byteSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE | PAGE_WRITECOMBINE));
+    if (mapped == nullptr)
+    {
+        std::cout << "  Could not allocate write-combined memory." << std::endl;
+        return;
+    }
+
+    const std::vector<InstanceData> instances = MakeInstances();
+
+    double legacyMs = Benchmark::TimeMs(Iterations, [&]()
+    {
+        for (UINT i = 0; i < InstanceCount; ++i)
+            WriteLegacy(mapped + (std::size_t)i * sizeof(LegacyInstanceData), instances[i]);
+    });
+
+    double packedMs = Benchmark::TimeMs(Iterations, [&]()
+    {
+        for (UINT i = 0; i < InstanceCount; ++i)
+            WritePacked(mapped + (std::size_t)i * sizeof(PackedInstanceData), instances[i]);
+    });
+
+    VirtualFree(mapped, 0, MEM_RELEASE);
+
+    Benchmark::Report("144 byte layout, 50k instances", legacyMs);
+    Benchmark::Report("Packed layout, 50k instances", packedMs);
+    Benchmark::Report("144 byte layout written", InstanceCount * sizeof(LegacyInstanceData) / 1024.0, "KB");
+    Benchmark::Report("Packed layout written", InstanceCount * sizeof(PackedInstanceData) / 1024.0, "KB");
+}
@@ -0,0 +1,59 @@
+//*******************************************************************
+// RecordingBenchmarks.cpp:
+//
+// Recording a frame's passes one after the other and on worker
+// threads, into recording command lists. With the driver out of the
+// way, what is left is the cost of the tracker and of the threading
+// itself.
+//*******************************************************************
+#include "BenchmarkFramework.h"
+#include "ParallelRecorder.h"
+#include "StateTrackingCommandList.h"
+#include "Testing/RecordingCommandList.h"
+
+namespace
+{
+    const UINT PassCount = 4;
+    const UINT DrawsPerPass = 20000;
+    const int Iterations = 16;
+
+    // Draws of a few hundred meshes under a handful of pipelines, in the
+    // order a sorted render queue would give them.
+    void RecordPass(UINT pass, RecordingCommandList& list)
+    {
+        StateTrackingCommandList<RecordingCommandList> cmdList(&list);
+        cmdList.SetGraphicsRootSignature(reinterpret_cast<ID3D12RootSignature*>(0x100));
+        cmdList.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+        for (UINT i = 0; i < DrawsPerPass; ++i)
+        {
+            cmdList.SetPipelineState(reinterpret_cast<ID3D12PipelineState*>((UINT64)0x1000 + i / (DrawsPerPass / 4)));
+
+            D3D12_VERTEX_BUFFER_VIEW vertexBuffer = { 0x10000ull * (pass + 1) + (i / 64) * 256ull, 4096, 32 };
+            cmdList.IASetVertexBuffers(0, 1, &vertexBuffer);
+
+            cmdList.SetGraphicsRootShaderResourceView(0, 0x80000ull + i * 64ull);
+            cmdList.DrawIndexedInstanced(36, 1, 0, 0, 0);
+        }
+    }
+}
+
+BENCHMARK(ParallelRecording)
+{
+    RecordingCommandList lists[PassCount];
+    auto clear = [&]()
+    {
+        for (RecordingCommandList& list : lists)
+            list.Clear();
+    };
+
+    for (bool parallel : { false, true })
+    {
+        double ms = Benchmark::TimeMs(Iterations, clear, [&]()
+        {
+            ParallelRecorder::Record(PassCount, parallel, [&](UINT i) { RecordPass(i, lists[i]); }, []() {});
+        });
+
+        Benchmark::Report(parallel ? "Passes on worker threads" : "Passes on the calling thread", ms);
+    }
+}
@@ -0,0 +1,51 @@
+//*******************************************************************
+// UploadBenchmarks.cpp:
+//
+// Writing instance data into write-combined memory, one memcpy per
+// element as UploadBuffer::CopyData does and in one StreamingCopy as
+// UploadBuffer::CopyRange does. The destination is allocated with
+// PAGE_WRITECOMBINE, the memory type of an upload heap, so no device
+// is needed.
+//*******************************************************************
+#include "BenchmarkFramework.h"
+#include "FrameResource.h"
+#include "Utils/StreamingCopy.h"
+
+namespace
+{
+    const UINT ElementCount = 64 * 1024;
+    const int Iterations = 16;
+}
+
+BENCHMARK(UploadWrites)
+{
+    const std::size_t byteSize = (std::size_t)ElementCount * sizeof(PackedInstanceData);
+
+    BYTE* mapped = static_cast<BYTE*>(VirtualAlloc(nullptr, byteSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE | PAGE_WRITECOMBINE));
+    if (mapped == nullptr)
+    {
+        std::cout << "  Could not allocate write-combined memory." << std::endl;
+        return;
+    }
+
+    std::vector<PackedInstanceData> source(ElementCount);
+
+    double elementwiseMs = Benchmark::TimeMs(Iterations, [&]()
+    {
+        for (UINT i = 0; i < ElementCount; ++i)
+            memcpy(mapped + (std::size_t)i * sizeof(PackedInstanceData), &source[i], sizeof(PackedInstanceData));
+    });
+
+    double streamingMs = Benchmark::TimeMs(Iterations, [&]()
+    {
+        StreamingCopy(mapped, source.data(), byteSize);
+    });
+
+    VirtualFree(mapped, 0, MEM_RELEASE);
+
+    const double megabytes = byteSize / (1024.0 * 1024.0);
+    Benchmark::Report("memcpy per element, 4 MB", elementwiseMs);
+    Benchmark::Report("StreamingCopy, 4 MB", streamingMs);
+    Benchmark::Report("memcpy per element", megabytes * 1000.0 / elementwiseMs, "MB/s");
+    Benchmark::Report("StreamingCopy", megabytes * 1000.0 / streamingMs, "MB/s");
+}
@@ -0,0 +1,322 @@
+//*******************************************************************
+// FrustumCuller.cpp
+//*******************************************************************
+#include "lmpch.h"
+#include "FrustumCuller.h"
+
+#include <immintrin.h>
+
+using namespace DirectX;
+
+namespace
+{
+    // Bit mask of the lanes of a batch starting at base that fall inside
+    // [first, end).
+    inline int LaneMask(UINT base, UINT first, UINT end, UINT width)
+    {
+        UINT lo = first > base ? first - base : 0;
+        UINT hi = MathHelper::Min(end - base, width);
+        return (int)(((1u << hi) - 1) & ~((1u << lo) - 1));
+    }
+
+    // Append base + lane - first for every set bit of mask.
+    inline UINT EmitVisible(int mask, UINT base, UINT first, UINT* outVisible, UINT numVisible)
+    {
+        while (mask != 0)
+        {
+            unsigned long lane;
+            _BitScanForward(&lane, (unsigned long)mask);
+            outVisible[numVisible++] = base + lane - first;
+            mask &= mask - 1;
+        }
+        return numVisible;
+    }
+}
+
+void FrustumCuller::SetViewProj(FXMMATRIX viewProj)
+{
+    // Gribb-Hartmann plane extraction. With row vectors, clip = p * M, so
+    // each clip component is the dot product of p with a column of M. The
+    // transpose turns those columns into rows.
+    XMMATRIX M = XMMatrixTranspose(viewProj);
+
+    XMVECTOR planes[PlaneCount] =
+    {
+        M.r[3] + M.r[0],  // Left:   -w <= x
+        M.r[3] - M.r[0],  // Right:   x <= w
+        M.r[3] + M.r[1],  // Bottom: -w <= y
+        M.r[3] - M.r[1],  // Top:     y <= w
+        M.r[2],           // Near:    0 <= z
+        M.r[3] - M.r[2],  // Far:     z <= w
+    };
+
+    for (int i = 0; i < PlaneCount; ++i)
+        XMStoreFloat4(&mPlanes[i], XMPlaneNormalize(planes[i]));
+}
+
+void FrustumCuller::SetShadowCasterVolume(FXMMATRIX lightViewProj)
+{
+    SetViewProj(lightViewProj);
+
+    // Anything between the light and the volume can still cast into it. A
+    // plane with a zero normal and positive distance accepts every bound.
+    mPlanes[4] = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+void FrustumCuller::SetPlanes(const XMFLOAT4 planes[PlaneCount])
+{
+    for (int i = 0; i < PlaneCount; ++i)
+        mPlanes[i] = planes[i];
+}
+
+UINT FrustumCuller::Cull(const InstanceBounds& bounds, UINT first, UINT count, UINT* outVisible) const
+{
+    assert(first + count <= bounds.Size());
+
+    if (count == 0)
+        return 0;
+
+#if defined(__AVX__)
+    return CullAVX(bounds, first, count, outVisible);
+#else
+    return CullSSE(bounds, first, count, outVisible);
+#endif
+}
+
+// ------------------------------------------------------------------
+// 4-wide test of one batch of bounds against every view. The planes
+// are broadcast up front, the bounds are loaded once per batch.
+// ------------------------------------------------------------------
+void FrustumCuller::CullViews(const FrustumCuller* const* views, UINT viewCount,
+    const InstanceBounds& bounds, UINT first, UINT count, UINT* const* outVisible, UINT* outCounts)
+{
+    assert(viewCount <= MaxViews);
+    assert(first + count <= bounds.Size());
+
+    for (UINT v = 0; v < viewCount; ++v)
+        outCounts[v] = 0;
+
+    if (count == 0)
+        return;
+
+    const UINT end = first + count;
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+
+    struct PlaneBatch
+    {
+        __m128 px, py, pz, pw;
+        __m128 ax, ay, az;
+    };
+    PlaneBatch planes[MaxViews][PlaneCount];
+
+    for (UINT v = 0; v < viewCount; ++v)
+    {
+        for (int i = 0; i < PlaneCount; ++i)
+        {
+            const XMFLOAT4& p = views[v]->mPlanes[i];
+            PlaneBatch& b = planes[v][i];
+            b.px = _mm_set1_ps(p.x);
+            b.py = _mm_set1_ps(p.y);
+            b.pz = _mm_set1_ps(p.z);
+            b.pw = _mm_set1_ps(p.w);
+            b.ax = _mm_andnot_ps(signMask, b.px);
+            b.ay = _mm_andnot_ps(signMask, b.py);
+            b.az = _mm_andnot_ps(signMask, b.pz);
+        }
+    }
+
+    for (UINT base = first & ~3u; base < end; base += 4)
+    {
+        __m128 cx = _mm_load_ps(bounds.CenterX() + base);
+        __m128 cy = _mm_load_ps(bounds.CenterY() + base);
+        __m128 cz = _mm_load_ps(bounds.CenterZ() + base);
+        __m128 negR = _mm_xor_ps(_mm_load_ps(bounds.Radius() + base), signMask);
+        __m128 ex = _mm_load_ps(bounds.ExtentX() + base);
+        __m128 ey = _mm_load_ps(bounds.ExtentY() + base);
+        __m128 ez = _mm_load_ps(bounds.ExtentZ() + base);
+
+        const int laneMask = LaneMask(base, first, end, 4);
+
+        for (UINT v = 0; v < viewCount; ++v)
+        {
+            __m128 outside = _mm_setzero_ps();
+            for (int i = 0; i < PlaneCount; ++i)
+            {
+                const PlaneBatch& b = planes[v][i];
+
+                __m128 dist = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(b.px, cx), _mm_mul_ps(b.py, cy)),
+                    _mm_add_ps(_mm_mul_ps(b.pz, cz), b.pw));
+
+                __m128 negBoxR = _mm_xor_ps(_mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(b.ax, ex), _mm_mul_ps(b.ay, ey)),
+                    _mm_mul_ps(b.az, ez)), signMask);
+
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, negR));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, negBoxR));
+            }
+
+            int mask = ~_mm_movemask_ps(outside) & laneMask;
+            outCounts[v] = EmitVisible(mask, base, first, outVisible[v], outCounts[v]);
+        }
+    }
+}
+
+bool FrustumCuller::IsVisible(const InstanceBounds& bounds, UINT index) const
+{
+    const float cx = bounds.CenterX()[index];
+    const float cy = bounds.CenterY()[index];
+    const float cz = bounds.CenterZ()[index];
+    const float r = bounds.Radius()[index];
+    const float ex = bounds.ExtentX()[index];
+    const float ey = bounds.ExtentY()[index];
+    const float ez = bounds.ExtentZ()[index];
+
+    for (int i = 0; i < PlaneCount; ++i)
+    {
+        const XMFLOAT4& p = mPlanes[i];
+        float dist = p.x * cx + p.y * cy + p.z * cz + p.w;
+
+        // Projected radius of the box onto the plane normal.
+        float boxRadius = fabsf(p.x) * ex + fabsf(p.y) * ey + fabsf(p.z) * ez;
+
+        if (dist < -r || dist < -boxRadius)
+            return false;
+    }
+
+    return true;
+}
+
+bool FrustumCuller::ClassifyBox(const XMFLOAT3& center, const XMFLOAT3& extents, UINT& planeMask) const
+{
+    for (int i = 0; i < PlaneCount; ++i)
+    {
+        if ((planeMask & (1u << i)) == 0)
+            continue;
+
+        const XMFLOAT4& p = mPlanes[i];
+        float dist = p.x * center.x + p.y * center.y + p.z * center.z + p.w;
+        float boxRadius = fabsf(p.x) * extents.x + fabsf(p.y) * extents.y + fabsf(p.z) * extents.z;
+
+        if (dist < -boxRadius)
+            return false;
+
+        // Children of a box that is fully inside a plane are inside it too.
+        if (dist >= boxRadius)
+            planeMask &= ~(1u << i);
+    }
+
+    return true;
+}
+
+// ------------------------------------------------------------------
+// 4-wide kernel. A bound is rejected as soon as either its sphere or
+// its box lies completely behind one of the planes; both volumes are
+// conservative, so the tighter of the two wins per plane.
+// ------------------------------------------------------------------
+UINT FrustumCuller::CullSSE(const InstanceBounds& bounds, UINT first, UINT count, UINT* outVisible) const
+{
+    const UINT end = first + count;
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+
+    __m128 px[PlaneCount], py[PlaneCount], pz[PlaneCount], pw[PlaneCount];
+    __m128 ax[PlaneCount], ay[PlaneCount], az[PlaneCount];
+    for (int i = 0; i < PlaneCount; ++i)
+    {
+        px[i] = _mm_set1_ps(mPlanes[i].x);
+        py[i] = _mm_set1_ps(mPlanes[i].y);
+        pz[i] = _mm_set1_ps(mPlanes[i].z);
+        pw[i] = _mm_set1_ps(mPlanes[i].w);
+        ax[i] = _mm_andnot_ps(signMask, px[i]);
+        ay[i] = _mm_andnot_ps(signMask, py[i]);
+        az[i] = _mm_andnot_ps(signMask, pz[i]);
+    }
+
+    UINT numVisible = 0;
+    for (UINT base = first & ~3u; base < end; base += 4)
+    {
+        __m128 cx = _mm_load_ps(bounds.CenterX() + base);
+        __m128 cy = _mm_load_ps(bounds.CenterY() + base);
+        __m128 cz = _mm_load_ps(bounds.CenterZ() + base);
+        __m128 negR = _mm_xor_ps(_mm_load_ps(bounds.Radius() + base), signMask);
+        __m128 ex = _mm_load_ps(bounds.ExtentX() + base);
+        __m128 ey = _mm_load_ps(bounds.ExtentY() + base);
+        __m128 ez = _mm_load_ps(bounds.ExtentZ() + base);
+
+        __m128 outside = _mm_setzero_ps();
+        for (int i = 0; i < PlaneCount; ++i)
+        {
+            __m128 dist = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(px[i], cx), _mm_mul_ps(py[i], cy)),
+                _mm_add_ps(_mm_mul_ps(pz[i], cz), pw[i]));
+
+            __m128 negBoxR = _mm_xor_ps(_mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(ax[i], ex), _mm_mul_ps(ay[i], ey)),
+                _mm_mul_ps(az[i], ez)), signMask);
+
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, negR));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, negBoxR));
+        }
+
+        int mask = ~_mm_movemask_ps(outside) & LaneMask(base, first, end, 4);
+        numVisible = EmitVisible(mask, base, first, outVisible, numVisible);
+    }
+
+    return numVisible;
+}
+
+#if defined(__AVX__)
+// ------------------------------------------------------------------
+// 8-wide kernel, same test as CullSSE.
+// ------------------------------------------------------------------
+UINT FrustumCuller::CullAVX(const InstanceBounds& bounds, UINT first, UINT count, UINT* outVisible) const
+{
+    const UINT end = first + count;
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+
+    __m256 px[PlaneCount], py[PlaneCount], pz[PlaneCount], pw[PlaneCount];
+    __m256 ax[PlaneCount], ay[PlaneCount], az[PlaneCount];
+    for (int i = 0; i < PlaneCount; ++i)
+    {
+        px[i] = _mm256_set1_ps(mPlanes[i].x);
+        py[i] = _mm256_set1_ps(mPlanes[i].y);
+        pz[i] = _mm256_set1_ps(mPlanes[i].z);
+        pw[i] = _mm256_set1_ps(mPlanes[i].w);
+        ax[i] = _mm256_andnot_ps(signMask, px[i]);
+        ay[i] = _mm256_andnot_ps(signMask, py[i]);
+        az[i] = _mm256_andnot_ps(signMask, pz[i]);
+    }
+
+    UINT numVisible = 0;
+    for (UINT base = first & ~7u; base < end; base += 8)
+    {
+        __m256 cx = _mm256_load_ps(bounds.CenterX() + base);
+        __m256 cy = _mm256_load_ps(bounds.CenterY() + base);
+        __m256 cz = _mm256_load_ps(bounds.CenterZ() + base);
+        __m256 negR = _mm256_xor_ps(_mm256_load_ps(bounds.Radius() + base), signMask);
+        __m256 ex = _mm256_load_ps(bounds.ExtentX() + base);
+        __m256 ey = _mm256_load_ps(bounds.ExtentY() + base);
+        __m256 ez = _mm256_load_ps(bounds.ExtentZ() + base);
+
+        __m256 outside = _mm256_setzero_ps();
+        for (int i = 0; i < PlaneCount; ++i)
+        {
+            __m256 dist = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(px[i], cx), _mm256_mul_ps(py[i], cy)),
+                _mm256_add_ps(_mm256_mul_ps(pz[i], cz), pw[i]));
+
+            __m256 negBoxR = _mm256_xor_ps(_mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(ax[i], ex), _mm256_mul_ps(ay[i], ey)),
+                _mm256_mul_ps(az[i], ez)), signMask);
+
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(dist, negR, _CMP_LT_OQ));
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(dist, negBoxR, _CMP_LT_OQ));
+        }
+
+        int mask = ~_mm256_movemask_ps(outside) & LaneMask(base, first, end, 8);
+        numVisible = EmitVisible(mask, base, first, outVisible, numVisible);
+    }
+
+    return numVisible;
+}
+#endif
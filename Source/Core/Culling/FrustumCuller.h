@@ -0,0 +1,69 @@
+//*******************************************************************
+// FrustumCuller.h:
+//
+// Batch frustum culling over the structure-of-arrays instance bounds.
+// The six world space planes are extracted from the view-projection
+// matrix once per frame, then every bound is tested in world space
+// without transforming the frustum per instance. The SSE kernel tests
+// 4 bounds per instruction; builds with AVX enabled test 8.
+//*******************************************************************
+
+#pragma once
+
+#include "InstanceBounds.h"
+
+class FrustumCuller
+{
+public:
+	static const int PlaneCount = 6;
+	static const UINT AllPlanesMask = (1u << PlaneCount) - 1;
+	static const UINT MaxViews = 4;
+
+	FrustumCuller() = default;
+
+	// Extract the normalized world space planes of a view-projection matrix
+	// (row-vector convention, D3D clip space with z in [0, w]). Plane
+	// normals point into the frustum.
+	void SetViewProj(DirectX::FXMMATRIX viewProj);
+
+	// Planes of the volume that can cast shadows into the orthographic
+	// light volume of a light view-projection matrix: the volume itself,
+	// extruded towards the light by dropping its near plane.
+	void SetShadowCasterVolume(DirectX::FXMMATRIX lightViewProj);
+
+	// Set the planes directly, e.g. for volumes that are not a projection.
+	// Normals must be unit length and point inside.
+	void SetPlanes(const DirectX::XMFLOAT4 planes[PlaneCount]);
+
+	const DirectX::XMFLOAT4& GetPlane(int i) const { return mPlanes[i]; }
+
+	// Test the entries [first, first + count) of the bounds. Writes the
+	// offsets (relative to first) of the visible entries to outVisible, in
+	// ascending order, and returns how many were written. outVisible must
+	// have room for count entries.
+	UINT Cull(const InstanceBounds& bounds, UINT first, UINT count, UINT* outVisible) const;
+
+	// Test the same entries against several views at once, loading each
+	// batch of bounds a single time. outVisible[v] receives the offsets
+	// visible in views[v], and outCounts[v] their number.
+	static void CullViews(const FrustumCuller* const* views, UINT viewCount,
+		const InstanceBounds& bounds, UINT first, UINT count, UINT* const* outVisible, UINT* outCounts);
+
+	// Scalar version of the same test for a single entry.
+	bool IsVisible(const InstanceBounds& bounds, UINT index) const;
+
+	// Classify an axis-aligned box against the planes whose bits are set in
+	// planeMask (bit i = plane i). Returns false if the box is completely
+	// outside. Otherwise clears the bits of the planes the box is fully
+	// inside of, so a mask of 0 means the box is fully inside the frustum.
+	bool ClassifyBox(const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents, UINT& planeMask) const;
+
+private:
+	UINT CullSSE(const InstanceBounds& bounds, UINT first, UINT count, UINT* outVisible) const;
+#if defined(__AVX__)
+	UINT CullAVX(const InstanceBounds& bounds, UINT first, UINT count, UINT* outVisible) const;
+#endif
+
+private:
+	DirectX::XMFLOAT4 mPlanes[PlaneCount];
+};
@@ -0,0 +1,378 @@
+//*******************************************************************
+// InstanceBVH.cpp
+//*******************************************************************
+#include "lmpch.h"
+#include "InstanceBVH.h"
+#include "Memory/FrameArena.h"
+
+using namespace DirectX;
+
+namespace
+{
+    const UINT BinCount = 12;
+
+    struct Aabb
+    {
+        XMFLOAT3 Min = { +FLT_MAX, +FLT_MAX, +FLT_MAX };
+        XMFLOAT3 Max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+        void Grow(const XMFLOAT3& p)
+        {
+            Min = { MathHelper::Min(Min.x, p.x), MathHelper::Min(Min.y, p.y), MathHelper::Min(Min.z, p.z) };
+            Max = { MathHelper::Max(Max.x, p.x), MathHelper::Max(Max.y, p.y), MathHelper::Max(Max.z, p.z) };
+        }
+
+        void Grow(const Aabb& b)
+        {
+            Grow(b.Min);
+            Grow(b.Max);
+        }
+
+        // Half the surface area; only ratios matter to the heuristic.
+        float HalfArea() const
+        {
+            if (Min.x > Max.x)
+                return 0.0f;
+
+            float dx = Max.x - Min.x;
+            float dy = Max.y - Min.y;
+            float dz = Max.z - Min.z;
+            return dx * dy + dy * dz + dz * dx;
+        }
+    };
+
+    inline float Component(const XMFLOAT3& v, int axis)
+    {
+        return (&v.x)[axis];
+    }
+
+    inline Aabb EntryBox(const InstanceBounds& bounds, UINT i)
+    {
+        Aabb box;
+        box.Min = { bounds.CenterX()[i] - bounds.ExtentX()[i], bounds.CenterY()[i] - bounds.ExtentY()[i], bounds.CenterZ()[i] - bounds.ExtentZ()[i] };
+        box.Max = { bounds.CenterX()[i] + bounds.ExtentX()[i], bounds.CenterY()[i] + bounds.ExtentY()[i], bounds.CenterZ()[i] + bounds.ExtentZ()[i] };
+        return box;
+    }
+
+    inline XMFLOAT3 EntryCenter(const InstanceBounds& bounds, UINT i)
+    {
+        return { bounds.CenterX()[i], bounds.CenterY()[i], bounds.CenterZ()[i] };
+    }
+
+    inline void SetNodeBox(InstanceBVH::Node& node, const Aabb& box)
+    {
+        node.Center = { 0.5f * (box.Max.x + box.Min.x), 0.5f * (box.Max.y + box.Min.y), 0.5f * (box.Max.z + box.Min.z) };
+        node.Extents = { 0.5f * (box.Max.x - box.Min.x), 0.5f * (box.Max.y - box.Min.y), 0.5f * (box.Max.z - box.Min.z) };
+    }
+
+    inline Aabb NodeBox(const InstanceBVH::Node& node)
+    {
+        Aabb box;
+        box.Min = { node.Center.x - node.Extents.x, node.Center.y - node.Extents.y, node.Center.z - node.Extents.z };
+        box.Max = { node.Center.x + node.Extents.x, node.Center.y + node.Extents.y, node.Center.z + node.Extents.z };
+        return box;
+    }
+}
+
+void InstanceBVH::Build(const InstanceBounds& bounds, const UINT* indices, UINT count)
+{
+    Clear();
+
+    mPrimIndices.assign(indices, indices + count);
+    mLeafOf.assign(bounds.Size(), InvalidIndex);
+
+    if (count == 0)
+        return;
+
+    // A binary tree with count leaves at most has 2 * count - 1 nodes, so the
+    // node array never reallocates while the recursion holds indices into it.
+    mNodes.reserve(2 * count - 1);
+    mNodes.emplace_back();
+
+    BuildNode(bounds, 0, 0, count);
+
+    mNodeDirty.assign(mNodes.size(), false);
+}
+
+void InstanceBVH::Clear()
+{
+    mNodes.clear();
+    mPrimIndices.clear();
+    mLeafOf.clear();
+    mDirtyNodes.clear();
+    mNodeDirty.clear();
+}
+
+// ------------------------------------------------------------------
+// Fill the node at nodeIndex with the entries mPrimIndices[first,
+// first + count) and split it along the longest centroid axis where
+// the binned surface area heuristic is cheapest. Children are always
+// allocated after their parent, which Refit relies on.
+// ------------------------------------------------------------------
+void InstanceBVH::BuildNode(const InstanceBounds& bounds, UINT nodeIndex, UINT first, UINT count)
+{
+    Aabb nodeBox, centroidBox;
+    for (UINT i = first; i < first + count; ++i)
+    {
+        nodeBox.Grow(EntryBox(bounds, mPrimIndices[i]));
+        centroidBox.Grow(EntryCenter(bounds, mPrimIndices[i]));
+    }
+
+    {
+        Node& node = mNodes[nodeIndex];
+        node.FirstPrim = first;
+        node.PrimCount = count;
+        node.LeftChild = 0;
+        SetNodeBox(node, nodeBox);
+    }
+
+    auto makeLeaf = [&]()
+    {
+        for (UINT i = first; i < first + count; ++i)
+            mLeafOf[mPrimIndices[i]] = nodeIndex;
+    };
+
+    if (count == 1)
+    {
+        makeLeaf();
+        return;
+    }
+
+    XMFLOAT3 centroidSize = {
+        centroidBox.Max.x - centroidBox.Min.x,
+        centroidBox.Max.y - centroidBox.Min.y,
+        centroidBox.Max.z - centroidBox.Min.z };
+
+    int axis = 0;
+    if (centroidSize.y > Component(centroidSize, axis)) axis = 1;
+    if (centroidSize.z > Component(centroidSize, axis)) axis = 2;
+
+    const float axisMin = Component(centroidBox.Min, axis);
+    const float axisSize = Component(centroidSize, axis);
+
+    UINT leftCount = 0;
+
+    if (axisSize > 0.0f)
+    {
+        const float binScale = BinCount / axisSize;
+        auto binOf = [&](UINT prim)
+        {
+            UINT bin = (UINT)((Component(EntryCenter(bounds, prim), axis) - axisMin) * binScale);
+            return MathHelper::Min(bin, BinCount - 1);
+        };
+
+        Aabb binBoxes[BinCount];
+        UINT binCounts[BinCount] = {};
+        for (UINT i = first; i < first + count; ++i)
+        {
+            UINT bin = binOf(mPrimIndices[i]);
+            binBoxes[bin].Grow(EntryBox(bounds, mPrimIndices[i]));
+            ++binCounts[bin];
+        }
+
+        // Sweep from the right to get the area of every right-hand side, then
+        // from the left to evaluate each of the BinCount - 1 split planes.
+        float rightArea[BinCount];
+        UINT rightCount[BinCount];
+        Aabb accum;
+        UINT accumCount = 0;
+        for (UINT b = BinCount - 1; b > 0; --b)
+        {
+            accum.Grow(binBoxes[b]);
+            accumCount += binCounts[b];
+            rightArea[b] = accum.HalfArea();
+            rightCount[b] = accumCount;
+        }
+
+        float bestCost = FLT_MAX;
+        UINT bestSplit = 0;
+        accum = Aabb();
+        accumCount = 0;
+        for (UINT b = 1; b < BinCount; ++b)
+        {
+            accum.Grow(binBoxes[b - 1]);
+            accumCount += binCounts[b - 1];
+
+            if (accumCount == 0 || rightCount[b] == 0)
+                continue;
+
+            float cost = accum.HalfArea() * accumCount + rightArea[b] * rightCount[b];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestSplit = b;
+            }
+        }
+
+        // Testing a node costs about as much as testing one of its entries,
+        // so keep small sets together unless splitting clearly pays off.
+        float leafCost = nodeBox.HalfArea() * count;
+        if (count <= MaxLeafSize && (bestSplit == 0 || bestCost >= leafCost))
+        {
+            makeLeaf();
+            return;
+        }
+
+        if (bestSplit != 0)
+        {
+            auto middle = std::partition(
+                mPrimIndices.begin() + first, mPrimIndices.begin() + first + count,
+                [&](UINT prim) { return binOf(prim) < bestSplit; });
+            leftCount = (UINT)(middle - (mPrimIndices.begin() + first));
+        }
+    }
+    else if (count <= MaxLeafSize)
+    {
+        makeLeaf();
+        return;
+    }
+
+    if (leftCount == 0)
+    {
+        // All centroids fall in one bin; split at the median instead.
+        leftCount = count / 2;
+        std::nth_element(
+            mPrimIndices.begin() + first, mPrimIndices.begin() + first + leftCount, mPrimIndices.begin() + first + count,
+            [&](UINT a, UINT b) { return Component(EntryCenter(bounds, a), axis) < Component(EntryCenter(bounds, b), axis); });
+    }
+
+    UINT leftChild = (UINT)mNodes.size();
+    mNodes.emplace_back();
+    mNodes.emplace_back();
+
+    mNodes[nodeIndex].LeftChild = leftChild;
+    mNodes[leftChild].Parent = nodeIndex;
+    mNodes[leftChild + 1].Parent = nodeIndex;
+
+    BuildNode(bounds, leftChild, first, leftCount);
+    BuildNode(bounds, leftChild + 1, first + leftCount, count - leftCount);
+}
+
+void InstanceBVH::MarkDirty(UINT index)
+{
+    if (index >= mLeafOf.size() || mLeafOf[index] == InvalidIndex)
+        return;
+
+    // Stop at the first node that is already flagged; its ancestors are too.
+    UINT node = mLeafOf[index];
+    while (!mNodeDirty[node])
+    {
+        mNodeDirty[node] = true;
+        mDirtyNodes.push_back(node);
+
+        if (node == 0)
+            break;
+
+        node = mNodes[node].Parent;
+    }
+}
+
+void InstanceBVH::Refit(const InstanceBounds& bounds)
+{
+    if (mDirtyNodes.empty())
+        return;
+
+    // Children have larger indices than their parent, so refitting in
+    // descending order always sees up-to-date child bounds.
+    std::sort(mDirtyNodes.begin(), mDirtyNodes.end(), std::greater<UINT>());
+
+    for (UINT nodeIndex : mDirtyNodes)
+    {
+        Node& node = mNodes[nodeIndex];
+        if (node.IsLeaf())
+            ComputeLeafBounds(bounds, node);
+        else
+            ComputeInnerBounds(node);
+
+        mNodeDirty[nodeIndex] = false;
+    }
+
+    mDirtyNodes.clear();
+}
+
+void InstanceBVH::ComputeLeafBounds(const InstanceBounds& bounds, Node& node) const
+{
+    Aabb box;
+    for (UINT i = node.FirstPrim; i < node.FirstPrim + node.PrimCount; ++i)
+        box.Grow(EntryBox(bounds, mPrimIndices[i]));
+
+    SetNodeBox(node, box);
+}
+
+void InstanceBVH::ComputeInnerBounds(Node& node) const
+{
+    Aabb box = NodeBox(mNodes[node.LeftChild]);
+    box.Grow(NodeBox(mNodes[node.LeftChild + 1]));
+
+    SetNodeBox(node, box);
+}
+
+UINT InstanceBVH::Cull(const FrustumCuller& culler, const InstanceBounds& bounds, UINT* outVisible, CullStats* stats) const
+{
+    CullStats localStats;
+    UINT numVisible = 0;
+
+    if (mNodes.empty())
+    {
+        if (stats)
+            *stats = localStats;
+        return 0;
+    }
+
+    struct StackEntry
+    {
+        UINT Node;
+        UINT PlaneMask;
+    };
+
+    FrameArena::Scope scope;
+    std::pmr::vector<StackEntry> stack(&scope.Arena());
+    stack.reserve(64);
+    stack.push_back({ 0, FrustumCuller::AllPlanesMask });
+
+    while (!stack.empty())
+    {
+        StackEntry entry = stack.back();
+        stack.pop_back();
+
+        const Node& node = mNodes[entry.Node];
+        ++localStats.NodesVisited;
+
+        UINT planeMask = entry.PlaneMask;
+        if (!culler.ClassifyBox(node.Center, node.Extents, planeMask))
+            continue;
+
+        if (planeMask == 0)
+        {
+            // Fully inside: the whole subtree is one contiguous range.
+            std::copy(
+                mPrimIndices.begin() + node.FirstPrim,
+                mPrimIndices.begin() + node.FirstPrim + node.PrimCount,
+                outVisible + numVisible);
+            numVisible += node.PrimCount;
+
+            if (!node.IsLeaf())
+                ++localStats.SubtreesAccepted;
+            continue;
+        }
+
+        if (node.IsLeaf())
+        {
+            ++localStats.LeavesTested;
+            for (UINT i = node.FirstPrim; i < node.FirstPrim + node.PrimCount; ++i)
+            {
+                if (culler.IsVisible(bounds, mPrimIndices[i]))
+                    outVisible[numVisible++] = mPrimIndices[i];
+            }
+            continue;
+        }
+
+        stack.push_back({ node.LeftChild + 1, planeMask });
+        stack.push_back({ node.LeftChild, planeMask });
+    }
+
+    if (stats)
+        *stats = localStats;
+
+    return numVisible;
+}
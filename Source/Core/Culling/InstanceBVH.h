@@ -0,0 +1,89 @@
+//*******************************************************************
+// InstanceBVH.h:
+//
+// Bounding volume hierarchy over a subset of the instance bounds. The
+// tree is built once with a binned surface area heuristic; instances
+// that move afterwards are marked dirty and only the nodes on their
+// path to the root are refit. Frustum traversal carries a plane mask
+// down the tree, so subtrees outside any plane are rejected and
+// subtrees fully inside all planes are accepted without testing their
+// leaves.
+//*******************************************************************
+
+#pragma once
+
+#include "FrustumCuller.h"
+
+class InstanceBVH
+{
+public:
+	// Largest number of instances a leaf is allowed to hold.
+	static const UINT MaxLeafSize = 8;
+
+	struct Node
+	{
+		DirectX::XMFLOAT3 Center;
+		UINT FirstPrim = 0;         // Range of mPrimIndices under this node,
+		DirectX::XMFLOAT3 Extents;
+		UINT PrimCount = 0;         // for leaves and inner nodes alike.
+		UINT LeftChild = 0;         // Right child is LeftChild + 1; 0 for leaves.
+		UINT Parent = 0;
+
+		bool IsLeaf() const { return LeftChild == 0; }
+	};
+
+	struct CullStats
+	{
+		UINT NodesVisited = 0;
+		UINT LeavesTested = 0;      // Leaves whose instances were tested individually.
+		UINT SubtreesAccepted = 0;  // Inner nodes accepted without per-leaf tests.
+	};
+
+	InstanceBVH() = default;
+
+	InstanceBVH(const InstanceBVH& rhs) = delete;
+	InstanceBVH& operator=(const InstanceBVH& rhs) = delete;
+
+	// Build the tree over the given entries of bounds. Any previous tree is
+	// discarded.
+	void Build(const InstanceBounds& bounds, const UINT* indices, UINT count);
+
+	void Clear();
+
+	// Flag an entry whose bounds were updated since the last refit.
+	void MarkDirty(UINT index);
+
+	// Refit the nodes above every dirty entry. Cheap if nothing is dirty.
+	void Refit(const InstanceBounds& bounds);
+
+	// Write the indices of the entries that intersect the frustum to
+	// outVisible and return how many were written. outVisible must have room
+	// for Size() entries. The order is unspecified.
+	UINT Cull(const FrustumCuller& culler, const InstanceBounds& bounds, UINT* outVisible, CullStats* stats = nullptr) const;
+
+	// Number of entries in the tree.
+	UINT Size() const { return (UINT)mPrimIndices.size(); }
+
+	UINT NodeCount() const { return (UINT)mNodes.size(); }
+
+private:
+	void BuildNode(const InstanceBounds& bounds, UINT nodeIndex, UINT first, UINT count);
+
+	void ComputeLeafBounds(const InstanceBounds& bounds, Node& node) const;
+	void ComputeInnerBounds(Node& node) const;
+
+private:
+	static constexpr UINT InvalidIndex = 0xFFFFFFFF;
+
+	std::vector<Node> mNodes;
+
+	// Entries of the bounds, ordered so every node covers a contiguous range.
+	std::vector<UINT> mPrimIndices;
+
+	// Leaf holding each entry of the bounds, or InvalidIndex.
+	std::vector<UINT> mLeafOf;
+
+	// Nodes that need to be refit, and a flag per node to avoid duplicates.
+	std::vector<UINT> mDirtyNodes;
+	std::vector<bool> mNodeDirty;
+};
@@ -0,0 +1,92 @@
+//*******************************************************************
+// InstanceBounds.cpp
+//*******************************************************************
+#include "lmpch.h"
+#include "InstanceBounds.h"
+
+using namespace DirectX;
+
+UINT InstanceBounds::Add(const BoundingBox& localBounds, FXMMATRIX world)
+{
+    UINT index = mCount++;
+
+    if (mCount > PaddedSize())
+    {
+        // Grow by whole batches. Padding lanes get a negative radius and
+        // extents so they fail every plane test without a scalar tail.
+        UINT paddedSize = (mCount + BatchWidth - 1) & ~(BatchWidth - 1);
+
+        mCenterX.resize(paddedSize, 0.0f);
+        mCenterY.resize(paddedSize, 0.0f);
+        mCenterZ.resize(paddedSize, 0.0f);
+        mRadius.resize(paddedSize, -FLT_MAX);
+        mExtentX.resize(paddedSize, -FLT_MAX);
+        mExtentY.resize(paddedSize, -FLT_MAX);
+        mExtentZ.resize(paddedSize, -FLT_MAX);
+    }
+
+    Write(index, localBounds, world);
+
+    return index;
+}
+
+void InstanceBounds::Update(UINT index, const BoundingBox& localBounds, FXMMATRIX world)
+{
+    assert(index < mCount);
+
+    Write(index, localBounds, world);
+}
+
+void InstanceBounds::Clear()
+{
+    mCount = 0;
+
+    mCenterX.clear();
+    mCenterY.clear();
+    mCenterZ.clear();
+    mRadius.clear();
+    mExtentX.clear();
+    mExtentY.clear();
+    mExtentZ.clear();
+}
+
+BoundingBox InstanceBounds::GetBox(UINT index) const
+{
+    assert(index < mCount);
+
+    return BoundingBox(
+        XMFLOAT3(mCenterX[index], mCenterY[index], mCenterZ[index]),
+        XMFLOAT3(mExtentX[index], mExtentY[index], mExtentZ[index]));
+}
+
+BoundingSphere InstanceBounds::GetSphere(UINT index) const
+{
+    assert(index < mCount);
+
+    return BoundingSphere(
+        XMFLOAT3(mCenterX[index], mCenterY[index], mCenterZ[index]),
+        mRadius[index]);
+}
+
+void InstanceBounds::Write(UINT index, const BoundingBox& localBounds, FXMMATRIX world)
+{
+    // The world space AABB encloses the transformed corners of the local box,
+    // and the sphere is scaled by the largest axis of the world matrix. Both
+    // are centered on the transformed box center.
+    BoundingBox worldBox;
+    localBounds.Transform(worldBox, world);
+
+    BoundingSphere localSphere;
+    BoundingSphere::CreateFromBoundingBox(localSphere, localBounds);
+
+    BoundingSphere worldSphere;
+    localSphere.Transform(worldSphere, world);
+
+    mCenterX[index] = worldBox.Center.x;
+    mCenterY[index] = worldBox.Center.y;
+    mCenterZ[index] = worldBox.Center.z;
+    mRadius[index] = worldSphere.Radius;
+    mExtentX[index] = worldBox.Extents.x;
+    mExtentY[index] = worldBox.Extents.y;
+    mExtentZ[index] = worldBox.Extents.z;
+}
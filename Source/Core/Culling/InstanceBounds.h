@@ -0,0 +1,72 @@
+//*******************************************************************
+// InstanceBounds.h:
+//
+// Scene-wide world space bounds of every render-item instance, kept
+// in structure-of-arrays form so visibility tests can load 4 (SSE) or
+// 8 (AVX) bounds per instruction. Each entry stores a bounding sphere
+// and an axis-aligned box that share the same center.
+//*******************************************************************
+
+#pragma once
+
+#include "Utils/AlignedAllocator.h"
+
+class InstanceBounds
+{
+public:
+	// Number of lanes every array is padded to, so the widest kernel can
+	// always read whole batches without a scalar tail.
+	static const UINT BatchWidth = 8;
+
+	InstanceBounds() = default;
+
+	InstanceBounds(const InstanceBounds& rhs) = delete;
+	InstanceBounds& operator=(const InstanceBounds& rhs) = delete;
+
+	// Add the bounds of an instance, given its local space box and world
+	// matrix. Returns the index of the new entry.
+	UINT Add(const DirectX::BoundingBox& localBounds, DirectX::FXMMATRIX world);
+
+	// Recompute the world space bounds of an existing entry, e.g. after the
+	// instance moved.
+	void Update(UINT index, const DirectX::BoundingBox& localBounds, DirectX::FXMMATRIX world);
+
+	void Clear();
+
+	// Number of valid entries.
+	UINT Size() const { return mCount; }
+
+	// Size of the arrays, rounded up to a multiple of BatchWidth. Entries in
+	// [Size(), PaddedSize()) are never visible.
+	UINT PaddedSize() const { return (UINT)mCenterX.size(); }
+
+	DirectX::BoundingBox GetBox(UINT index) const;
+	DirectX::BoundingSphere GetSphere(UINT index) const;
+
+	const float* CenterX() const { return mCenterX.data(); }
+	const float* CenterY() const { return mCenterY.data(); }
+	const float* CenterZ() const { return mCenterZ.data(); }
+	const float* Radius() const { return mRadius.data(); }
+	const float* ExtentX() const { return mExtentX.data(); }
+	const float* ExtentY() const { return mExtentY.data(); }
+	const float* ExtentZ() const { return mExtentZ.data(); }
+
+private:
+	void Write(UINT index, const DirectX::BoundingBox& localBounds, DirectX::FXMMATRIX world);
+
+private:
+	UINT mCount = 0;
+
+	// Shared center of the sphere and the box.
+	AlignedVector<float> mCenterX;
+	AlignedVector<float> mCenterY;
+	AlignedVector<float> mCenterZ;
+
+	// Bounding sphere radius.
+	AlignedVector<float> mRadius;
+
+	// Half extents of the world space axis-aligned box.
+	AlignedVector<float> mExtentX;
+	AlignedVector<float> mExtentY;
+	AlignedVector<float> mExtentZ;
+};
@@ -0,0 +1,283 @@
+//*******************************************************************
+// OcclusionBuffer.cpp
+//*******************************************************************
+#include "lmpch.h"
+#include "OcclusionBuffer.h"
+
+#include <immintrin.h>
+
+using namespace DirectX;
+
+OcclusionBuffer::OcclusionBuffer(UINT width, UINT height) :
+    mWidth(width),
+    mHeight(height),
+    mTilesX(width / TileSize),
+    mTilesY(height / TileSize)
+{
+    assert(width % TileSize == 0 && height % TileSize == 0);
+
+    mDepth.resize(mWidth * mHeight, 1.0f);
+    mTileMaxDepth.resize(mTilesX * mTilesY, 1.0f);
+}
+
+void OcclusionBuffer::Begin(FXMMATRIX viewProj)
+{
+    XMStoreFloat4x4(&mViewProj, viewProj);
+
+    std::fill(mDepth.begin(), mDepth.end(), 1.0f);
+    std::fill(mTileMaxDepth.begin(), mTileMaxDepth.end(), 1.0f);
+
+    mTrianglesDrawn = 0;
+}
+
+void OcclusionBuffer::DrawIndexed(
+    const void* vertices, UINT vertexStride,
+    const void* indices, bool indices32, UINT indexCount,
+    int baseVertex, FXMMATRIX world)
+{
+    XMMATRIX worldViewProj = XMMatrixMultiply(world, XMLoadFloat4x4(&mViewProj));
+
+    const BYTE* vertexBytes = static_cast<const BYTE*>(vertices);
+    const UINT16* indices16 = static_cast<const UINT16*>(indices);
+    const UINT32* indices32Ptr = static_cast<const UINT32*>(indices);
+
+    auto loadClip = [&](UINT i)
+    {
+        UINT index = indices32 ? indices32Ptr[i] : indices16[i];
+        const XMFLOAT3* pos = reinterpret_cast<const XMFLOAT3*>(vertexBytes + (size_t)(index + baseVertex) * vertexStride);
+        return XMVector3Transform(XMLoadFloat3(pos), worldViewProj);
+    };
+
+    for (UINT i = 0; i + 2 < indexCount; i += 3)
+        DrawClippedTriangle(loadClip(i), loadClip(i + 1), loadClip(i + 2));
+}
+
+// ------------------------------------------------------------------
+// Clip a clip space triangle against the near plane (z >= 0) and
+// rasterize the resulting fan. The other planes need no clipping:
+// the rasterizer clamps its bounding box to the screen.
+// ------------------------------------------------------------------
+void OcclusionBuffer::DrawClippedTriangle(FXMVECTOR c0, FXMVECTOR c1, FXMVECTOR c2)
+{
+    XMVECTOR in[3] = { c0, c1, c2 };
+    XMVECTOR out[4];
+    UINT outCount = 0;
+
+    for (UINT i = 0; i < 3; ++i)
+    {
+        XMVECTOR a = in[i];
+        XMVECTOR b = in[(i + 1) % 3];
+        float za = XMVectorGetZ(a);
+        float zb = XMVectorGetZ(b);
+
+        if (za >= 0.0f)
+            out[outCount++] = a;
+
+        if ((za >= 0.0f) != (zb >= 0.0f))
+            out[outCount++] = XMVectorLerp(a, b, za / (za - zb));
+    }
+
+    if (outCount < 3)
+        return;
+
+    ++mTrianglesDrawn;
+
+    ScreenVertex s0 = ToScreen(out[0]);
+    for (UINT i = 1; i + 1 < outCount; ++i)
+        RasterizeTriangle(s0, ToScreen(out[i]), ToScreen(out[i + 1]));
+}
+
+OcclusionBuffer::ScreenVertex OcclusionBuffer::ToScreen(FXMVECTOR clip) const
+{
+    XMFLOAT4 c;
+    XMStoreFloat4(&c, clip);
+
+    float invW = 1.0f / c.w;
+    return {
+        (0.5f + 0.5f * c.x * invW) * mWidth,
+        (0.5f - 0.5f * c.y * invW) * mHeight,
+        c.z * invW };
+}
+
+// ------------------------------------------------------------------
+// Half-space rasterization sampled at pixel centers. The three edge
+// functions and the depth are all affine in screen space, so each row
+// steps them 4 pixels at a time. Either winding is accepted, since
+// occluders are only ever used for their nearest surface.
+// ------------------------------------------------------------------
+void OcclusionBuffer::RasterizeTriangle(ScreenVertex v0, ScreenVertex v1, ScreenVertex v2)
+{
+    float area = (v1.X - v0.X) * (v2.Y - v0.Y) - (v1.Y - v0.Y) * (v2.X - v0.X);
+    if (fabsf(area) < 1e-8f)
+        return;
+
+    if (area < 0.0f)
+    {
+        std::swap(v1, v2);
+        area = -area;
+    }
+
+    // Bounding box in pixels, clamped to the screen. x starts on a multiple
+    // of 4 so every row can use aligned loads; the edge tests mask the extra
+    // pixels.
+    int minX = MathHelper::Max((int)floorf(MathHelper::Min(v0.X, MathHelper::Min(v1.X, v2.X))), 0);
+    int maxX = MathHelper::Min((int)ceilf(MathHelper::Max(v0.X, MathHelper::Max(v1.X, v2.X))), (int)mWidth - 1);
+    int minY = MathHelper::Max((int)floorf(MathHelper::Min(v0.Y, MathHelper::Min(v1.Y, v2.Y))), 0);
+    int maxY = MathHelper::Min((int)ceilf(MathHelper::Max(v0.Y, MathHelper::Max(v1.Y, v2.Y))), (int)mHeight - 1);
+
+    if (minX > maxX || minY > maxY)
+        return;
+
+    minX &= ~3;
+
+    // Edge i is opposite vertex i: E(p) = A * p.x + B * p.y + C, positive
+    // inside.
+    const ScreenVertex* v[3] = { &v0, &v1, &v2 };
+    float edgeA[3], edgeB[3], edgeC[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        const ScreenVertex& a = *v[(i + 1) % 3];
+        const ScreenVertex& b = *v[(i + 2) % 3];
+        edgeA[i] = a.Y - b.Y;
+        edgeB[i] = b.X - a.X;
+        edgeC[i] = -(edgeA[i] * a.X + edgeB[i] * a.Y);
+    }
+
+    // Depth plane from the normalized edge functions (barycentrics).
+    float invArea = 1.0f / area;
+    float zA = (edgeA[0] * v0.Z + edgeA[1] * v1.Z + edgeA[2] * v2.Z) * invArea;
+    float zB = (edgeB[0] * v0.Z + edgeB[1] * v1.Z + edgeB[2] * v2.Z) * invArea;
+    float zC = (edgeC[0] * v0.Z + edgeC[1] * v1.Z + edgeC[2] * v2.Z) * invArea;
+
+    const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 zero = _mm_setzero_ps();
+
+    __m128 stepA[3], vA[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        vA[i] = _mm_set1_ps(edgeA[i]);
+        stepA[i] = _mm_set1_ps(edgeA[i] * 4.0f);
+    }
+    const __m128 vzA = _mm_set1_ps(zA);
+    const __m128 zStep = _mm_set1_ps(zA * 4.0f);
+
+    const __m128 startX = _mm_add_ps(_mm_set1_ps((float)minX), laneOffsets);
+
+    for (int y = minY; y <= maxY; ++y)
+    {
+        const float py = y + 0.5f;
+
+        __m128 e[3];
+        for (int i = 0; i < 3; ++i)
+            e[i] = _mm_add_ps(_mm_mul_ps(vA[i], startX), _mm_set1_ps(edgeB[i] * py + edgeC[i]));
+        __m128 z = _mm_add_ps(_mm_mul_ps(vzA, startX), _mm_set1_ps(zB * py + zC));
+
+        float* row = mDepth.data() + y * mWidth;
+        for (int x = minX; x <= maxX; x += 4)
+        {
+            __m128 inside = _mm_and_ps(
+                _mm_and_ps(_mm_cmpge_ps(e[0], zero), _mm_cmpge_ps(e[1], zero)),
+                _mm_cmpge_ps(e[2], zero));
+
+            if (_mm_movemask_ps(inside) != 0)
+            {
+                __m128 depth = _mm_load_ps(row + x);
+                __m128 nearer = _mm_min_ps(depth, z);
+                _mm_store_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, depth)));
+            }
+
+            for (int i = 0; i < 3; ++i)
+                e[i] = _mm_add_ps(e[i], stepA[i]);
+            z = _mm_add_ps(z, zStep);
+        }
+    }
+}
+
+void OcclusionBuffer::End()
+{
+    for (UINT ty = 0; ty < mTilesY; ++ty)
+    {
+        for (UINT tx = 0; tx < mTilesX; ++tx)
+        {
+            __m128 tileMax = _mm_setzero_ps();
+            for (UINT y = 0; y < TileSize; ++y)
+            {
+                const float* row = mDepth.data() + (ty * TileSize + y) * mWidth + tx * TileSize;
+                tileMax = _mm_max_ps(tileMax, _mm_max_ps(_mm_load_ps(row), _mm_load_ps(row + 4)));
+            }
+
+            tileMax = _mm_max_ps(tileMax, _mm_shuffle_ps(tileMax, tileMax, _MM_SHUFFLE(1, 0, 3, 2)));
+            tileMax = _mm_max_ps(tileMax, _mm_shuffle_ps(tileMax, tileMax, _MM_SHUFFLE(2, 3, 0, 1)));
+            mTileMaxDepth[ty * mTilesX + tx] = _mm_cvtss_f32(tileMax);
+        }
+    }
+}
+
+bool OcclusionBuffer::IsVisible(const XMFLOAT3& center, const XMFLOAT3& extents) const
+{
+    XMMATRIX viewProj = XMLoadFloat4x4(&mViewProj);
+
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+    float minZ = FLT_MAX;
+
+    for (int i = 0; i < 8; ++i)
+    {
+        XMVECTOR corner = XMVectorSet(
+            center.x + ((i & 1) ? extents.x : -extents.x),
+            center.y + ((i & 2) ? extents.y : -extents.y),
+            center.z + ((i & 4) ? extents.z : -extents.z),
+            1.0f);
+
+        XMFLOAT4 clip;
+        XMStoreFloat4(&clip, XMVector4Transform(corner, viewProj));
+
+        // A box crossing the near plane covers an unbounded screen area.
+        if (clip.z < 0.0f || clip.w <= 0.0f)
+            return true;
+
+        ScreenVertex s = ToScreen(XMLoadFloat4(&clip));
+        minX = MathHelper::Min(minX, s.X);
+        maxX = MathHelper::Max(maxX, s.X);
+        minY = MathHelper::Min(minY, s.Y);
+        maxY = MathHelper::Max(maxY, s.Y);
+        minZ = MathHelper::Min(minZ, s.Z);
+    }
+
+    // Every pixel the projected box touches, not just the covered centers.
+    int x0 = MathHelper::Max((int)floorf(minX), 0);
+    int x1 = MathHelper::Min((int)ceilf(maxX) - 1, (int)mWidth - 1);
+    int y0 = MathHelper::Max((int)floorf(minY), 0);
+    int y1 = MathHelper::Min((int)ceilf(maxY) - 1, (int)mHeight - 1);
+
+    // Off screen entirely; that is for the frustum test to decide.
+    if (x0 > x1 || y0 > y1)
+        return true;
+
+    for (int ty = y0 / (int)TileSize; ty <= y1 / (int)TileSize; ++ty)
+    {
+        for (int tx = x0 / (int)TileSize; tx <= x1 / (int)TileSize; ++tx)
+        {
+            if (minZ > mTileMaxDepth[ty * mTilesX + tx])
+                continue;
+
+            // The tile alone cannot reject the box; look at the pixels of the
+            // tile that the box overlaps.
+            int px0 = MathHelper::Max(x0, tx * (int)TileSize);
+            int px1 = MathHelper::Min(x1, tx * (int)TileSize + (int)TileSize - 1);
+            int py0 = MathHelper::Max(y0, ty * (int)TileSize);
+            int py1 = MathHelper::Min(y1, ty * (int)TileSize + (int)TileSize - 1);
+
+            for (int y = py0; y <= py1; ++y)
+            {
+                const float* row = mDepth.data() + y * mWidth;
+                for (int x = px0; x <= px1; ++x)
+                {
+                    if (minZ <= row[x])
+                        return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
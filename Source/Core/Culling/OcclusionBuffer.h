@@ -0,0 +1,85 @@
+//*******************************************************************
+// OcclusionBuffer.h:
+//
+// Low resolution software depth buffer for CPU occlusion culling. A
+// small set of occluder meshes is rasterized with an SSE scanline
+// rasterizer, 4 pixels per instruction. The farthest depth of every
+// 8x8 tile is then kept in a coarse level, and world space boxes are
+// tested against the tiles first and only refined per pixel where a
+// tile cannot reject them. Nothing here touches the GPU, so the buffer
+// can be driven and inspected headlessly.
+//
+// Depth follows the D3D convention: z / w in [0, 1], 0 at the near
+// plane, and the buffer is cleared to 1.
+//*******************************************************************
+
+#pragma once
+
+#include "Utils/AlignedAllocator.h"
+
+class OcclusionBuffer
+{
+public:
+	static const UINT TileSize = 8;
+
+	// Width and height must be multiples of TileSize.
+	OcclusionBuffer(UINT width = 256, UINT height = 128);
+
+	OcclusionBuffer(const OcclusionBuffer& rhs) = delete;
+	OcclusionBuffer& operator=(const OcclusionBuffer& rhs) = delete;
+
+	// Start a new frame: reset every pixel to the far plane and set the
+	// view-projection matrix (row-vector convention) used by the following
+	// draws and tests.
+	void Begin(DirectX::FXMMATRIX viewProj);
+
+	// Rasterize an indexed triangle list. The position of each vertex is the
+	// XMFLOAT3 at the start of every vertexStride bytes; indices are 16 or
+	// 32-bit and offset by baseVertex, as in DrawIndexedInstanced.
+	void DrawIndexed(
+		const void* vertices, UINT vertexStride,
+		const void* indices, bool indices32, UINT indexCount,
+		int baseVertex, DirectX::FXMMATRIX world);
+
+	// Compute the per-tile farthest depth. Call after the last occluder and
+	// before any IsVisible.
+	void End();
+
+	// Conservative test of a world space axis-aligned box. Returns false only
+	// if every pixel the box can cover already holds a nearer occluder.
+	bool IsVisible(const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents) const;
+
+	UINT Width() const { return mWidth; }
+	UINT Height() const { return mHeight; }
+
+	// Row-major depth values, Width() * Height() of them.
+	const float* GetDepth() const { return mDepth.data(); }
+
+	UINT TrianglesDrawn() const { return mTrianglesDrawn; }
+
+private:
+	struct ScreenVertex
+	{
+		float X, Y, Z;
+	};
+
+	void DrawClippedTriangle(DirectX::FXMVECTOR c0, DirectX::FXMVECTOR c1, DirectX::FXMVECTOR c2);
+	void RasterizeTriangle(ScreenVertex v0, ScreenVertex v1, ScreenVertex v2);
+
+	ScreenVertex ToScreen(DirectX::FXMVECTOR clip) const;
+
+private:
+	UINT mWidth;
+	UINT mHeight;
+	UINT mTilesX;
+	UINT mTilesY;
+
+	DirectX::XMFLOAT4X4 mViewProj = MathHelper::Identity4x4();
+
+	AlignedVector<float> mDepth;
+
+	// Farthest depth of every TileSize x TileSize block of mDepth.
+	std::vector<float> mTileMaxDepth;
+
+	UINT mTrianglesDrawn = 0;
+};
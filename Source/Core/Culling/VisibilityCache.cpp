@@ -0,0 +1,238 @@
+//*******************************************************************
+// VisibilityCache.cpp
+//*******************************************************************
+#include "lmpch.h"
+#include "VisibilityCache.h"
+
+using namespace DirectX;
+
+namespace
+{
+    inline float DistanceSq(const XMFLOAT3& a, const XMFLOAT3& b)
+    {
+        float dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+        return dx * dx + dy * dy + dz * dz;
+    }
+}
+
+void VisibilityCache::Resize(UINT count)
+{
+    mVisible.assign(count, 0);
+    mValid.assign(count, 0);
+    mSlack.assign(count, 0.0f);
+    mReach.assign(count, 0.0f);
+    mTestFrame.assign(count, 0);
+    mEntryRange.assign(count, InvalidRange);
+
+    mRanges.clear();
+}
+
+void VisibilityCache::Invalidate()
+{
+    std::fill(mValid.begin(), mValid.end(), (UINT8)0);
+
+    for (Range& range : mRanges)
+        range.Valid = false;
+}
+
+void VisibilityCache::MarkMoved(UINT index)
+{
+    assert(index < mValid.size());
+
+    mValid[index] = 0;
+    if (mEntryRange[index] != InvalidRange)
+        mRanges[mEntryRange[index]].Valid = false;
+}
+
+void VisibilityCache::BeginFrame(const FrustumCuller& culler, const CameraPose& pose)
+{
+    mCuller = &culler;
+    mStats = Stats();
+
+    ++mFrame;
+    mPoses[mFrame % PoseRingSize] = pose;
+
+    // For every rotation R, |Rv - v| of a unit vector is at most the chord
+    // 2 sin(theta / 2), and the squared chords of the three basis vectors
+    // sum to twice its square.
+    for (UINT i = 0; i < PoseRingSize; ++i)
+    {
+        const CameraPose& old = mPoses[i];
+        mTranslation[i] = sqrtf(DistanceSq(pose.Position, old.Position));
+        mRotation[i] = sqrtf(0.5f * (
+            DistanceSq(pose.Right, old.Right) +
+            DistanceSq(pose.Up, old.Up) +
+            DistanceSq(pose.Look, old.Look)));
+    }
+}
+
+float VisibilityCache::Displacement(UINT frame, float distance) const
+{
+    UINT slot = frame % PoseRingSize;
+    return mTranslation[slot] + mRotation[slot] * distance;
+}
+
+// ------------------------------------------------------------------
+// A range normally owns its first entry, which finds it directly. The
+// search is for new ranges and for ones that lost their first entry
+// to an overlapping range.
+// ------------------------------------------------------------------
+UINT VisibilityCache::FindRange(UINT first, UINT count)
+{
+    UINT rangeIndex = mEntryRange[first];
+    if (rangeIndex == InvalidRange || mRanges[rangeIndex].First != first)
+    {
+        auto it = std::find_if(mRanges.begin(), mRanges.end(), [first](const Range& range) { return range.First == first; });
+        if (it == mRanges.end())
+        {
+            Range range;
+            range.First = first;
+            range.Count = count;
+            mRanges.push_back(std::move(range));
+            return (UINT)mRanges.size() - 1;
+        }
+        rangeIndex = (UINT)(it - mRanges.begin());
+    }
+
+    // Same start, different length: its results say nothing about this one.
+    Range& range = mRanges[rangeIndex];
+    if (range.Count != count)
+    {
+        range.Count = count;
+        range.Valid = false;
+    }
+    return rangeIndex;
+}
+
+// ------------------------------------------------------------------
+// Camera motion since the last walk of a range adds to the motion
+// since each entry's own test, so the range's results all hold while
+// that motion, at the farthest reach of any entry, stays below the
+// smallest margin left over at the walk.
+// ------------------------------------------------------------------
+UINT VisibilityCache::Cull(const InstanceBounds& bounds, UINT first, UINT count, UINT* outVisible, bool& changed)
+{
+    assert(mCuller != nullptr);
+    assert(first + count <= mValid.size());
+
+    if (count == 0)
+        return 0;
+
+    const UINT rangeIndex = FindRange(first, count);
+    {
+        Range& range = mRanges[rangeIndex];
+        if (range.Valid
+            && mFrame - range.Frame < BucketCount
+            && Displacement(range.Frame, range.MaxReach) < range.MinMargin)
+        {
+            std::copy(range.Visible.begin(), range.Visible.end(), outVisible);
+            mStats.Hits += count;
+            ++mStats.RangesSkipped;
+            return (UINT)range.Visible.size();
+        }
+    }
+
+    const UINT bucket = mFrame % BucketCount;
+
+    float minMargin = FLT_MAX;
+    float maxReach = 0.0f;
+
+    UINT numVisible = 0;
+    for (UINT i = 0; i < count; ++i)
+    {
+        const UINT index = first + i;
+
+        bool retest = !mValid[index]
+            || index % BucketCount == bucket
+            || mFrame - mTestFrame[index] >= PoseRingSize
+            || Displacement(mTestFrame[index], mReach[index]) >= mSlack[index];
+
+        bool visible;
+        if (retest)
+        {
+            bool wasValid = mValid[index] != 0;
+            bool wasVisible = mVisible[index] != 0;
+
+            visible = Test(bounds, index);
+            ++mStats.Misses;
+
+            if (!wasValid || visible != wasVisible)
+                changed = true;
+            if (wasValid && visible != wasVisible)
+                ++mStats.Changes;
+        }
+        else
+        {
+            visible = mVisible[index] != 0;
+            ++mStats.Hits;
+        }
+
+        if (visible)
+            outVisible[numVisible++] = i;
+
+        minMargin = MathHelper::Min(minMargin, mSlack[index] - Displacement(mTestFrame[index], mReach[index]));
+        maxReach = MathHelper::Max(maxReach, mReach[index]);
+
+        // An entry belongs to the range that walked it last. The range that
+        // walked it before can no longer tell when it moves.
+        if (mEntryRange[index] != rangeIndex)
+        {
+            if (mEntryRange[index] != InvalidRange)
+                mRanges[mEntryRange[index]].Valid = false;
+            mEntryRange[index] = rangeIndex;
+        }
+    }
+
+    Range& range = mRanges[rangeIndex];
+    range.Valid = true;
+    range.Frame = mFrame;
+    range.MinMargin = minMargin;
+    range.MaxReach = maxReach;
+    range.Visible.assign(outVisible, outVisible + numVisible);
+
+    return numVisible;
+}
+
+// ------------------------------------------------------------------
+// Same test as FrustumCuller::IsVisible. The margin of a plane is how
+// far the bounds are from being rejected by it. A visible entry stays
+// visible until the smallest margin reaches zero; a culled entry stays
+// culled until its most negative margin does. Either way, the slack is
+// the absolute value of the smallest margin.
+// ------------------------------------------------------------------
+bool VisibilityCache::Test(const InstanceBounds& bounds, UINT index)
+{
+    const float cx = bounds.CenterX()[index];
+    const float cy = bounds.CenterY()[index];
+    const float cz = bounds.CenterZ()[index];
+    const float r = bounds.Radius()[index];
+    const float ex = bounds.ExtentX()[index];
+    const float ey = bounds.ExtentY()[index];
+    const float ez = bounds.ExtentZ()[index];
+
+    float minMargin = FLT_MAX;
+    for (int i = 0; i < FrustumCuller::PlaneCount; ++i)
+    {
+        const XMFLOAT4& p = mCuller->GetPlane(i);
+        float dist = p.x * cx + p.y * cy + p.z * cz + p.w;
+        float boxRadius = fabsf(p.x) * ex + fabsf(p.y) * ey + fabsf(p.z) * ez;
+
+        minMargin = MathHelper::Min(minMargin, dist + MathHelper::Min(r, boxRadius));
+    }
+
+    // Rotating the frustum also changes each projected box radius, by at
+    // most the rotation chord times the length of the extents.
+    const XMFLOAT3& eye = mPoses[mFrame % PoseRingSize].Position;
+    float centerDistance = sqrtf(DistanceSq(XMFLOAT3(cx, cy, cz), eye));
+    float extentLength = sqrtf(ex * ex + ey * ey + ez * ez);
+
+    bool visible = minMargin >= 0.0f;
+
+    mVisible[index] = visible ? 1 : 0;
+    mValid[index] = 1;
+    mSlack[index] = fabsf(minMargin);
+    mReach[index] = centerDistance + MathHelper::Max(r, extentLength);
+    mTestFrame[index] = mFrame;
+
+    return visible;
+}
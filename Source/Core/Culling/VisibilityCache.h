@@ -0,0 +1,130 @@
+//*******************************************************************
+// VisibilityCache.h:
+//
+// Frame-to-frame cache of frustum culling results. Every test records
+// the result together with its slack: how far the bounds could move
+// relative to the frustum before the result could flip. On later
+// frames the result is reused as long as the camera has not moved
+// (translation plus rotation at the instance's distance) by more than
+// that slack since the test. Instances near a plane, instances that
+// moved, and one round-robin bucket per frame are re-tested.
+//
+// Each range culled, i.e. the instances of one render item, also keeps
+// its visible list and how far the camera may move before any of its
+// results could flip. While the camera stays within that and none of
+// the range's bounds moved, Cull returns the list without looking at
+// the entries.
+//*******************************************************************
+
+#pragma once
+
+#include "FrustumCuller.h"
+
+class VisibilityCache
+{
+public:
+	// Every frame the entries of one bucket are re-tested regardless of
+	// their slack. A range is walked at least every BucketCount frames, so
+	// no cached result is older than about twice that.
+	static const UINT BucketCount = 8;
+
+	struct CameraPose
+	{
+		DirectX::XMFLOAT3 Position;
+		DirectX::XMFLOAT3 Right;
+		DirectX::XMFLOAT3 Up;
+		DirectX::XMFLOAT3 Look;
+	};
+
+	struct Stats
+	{
+		UINT Hits = 0;          // Results reused from an earlier frame.
+		UINT Misses = 0;        // Entries tested this frame.
+		UINT Changes = 0;       // Entries whose visibility flipped.
+		UINT RangesSkipped = 0; // Ranges answered without walking their entries.
+	};
+
+	VisibilityCache() = default;
+
+	VisibilityCache(const VisibilityCache& rhs) = delete;
+	VisibilityCache& operator=(const VisibilityCache& rhs) = delete;
+
+	// Match the number of entries of the bounds. Invalidates everything.
+	void Resize(UINT count);
+
+	// Forget every cached result, e.g. after the projection changed.
+	void Invalidate();
+
+	// Force a re-test of an entry whose bounds were updated.
+	void MarkMoved(UINT index);
+
+	// Start a frame. The culler must already hold the planes of pose.
+	void BeginFrame(const FrustumCuller& culler, const CameraPose& pose);
+
+	// Same contract as FrustumCuller::Cull. Sets changed if the visibility
+	// of any entry in the range differs from the previous frame. Ranges
+	// are expected to be the same from frame to frame.
+	UINT Cull(const InstanceBounds& bounds, UINT first, UINT count, UINT* outVisible, bool& changed);
+
+	// Counters since the last BeginFrame.
+	const Stats& GetStats() const { return mStats; }
+
+private:
+	static constexpr UINT InvalidRange = 0xFFFFFFFF;
+
+	struct Range
+	{
+		UINT First = 0;
+		UINT Count = 0;
+
+		// Cleared when an entry of the range moved or was taken over by
+		// another range.
+		bool Valid = false;
+
+		// Frame of the last walk, and what it found: how far the camera could
+		// still move from there before a result flips, at a distance of at
+		// most MaxReach.
+		UINT Frame = 0;
+		float MinMargin = 0.0f;
+		float MaxReach = 0.0f;
+		std::vector<UINT> Visible;
+	};
+
+	// The range starting at first with count entries, added if new.
+	UINT FindRange(UINT first, UINT count);
+
+	// Test one entry against the planes and record its result and slack.
+	bool Test(const InstanceBounds& bounds, UINT index);
+
+	// Upper bound of how far the camera motion since the pose of the given
+	// frame can have moved a point at the given distance relative to the
+	// frustum planes.
+	float Displacement(UINT frame, float distance) const;
+
+private:
+	// A ring slot survives longer than any entry can go untested, so the
+	// pose an entry was tested against is always still available.
+	static const UINT PoseRingSize = BucketCount + 1;
+
+	const FrustumCuller* mCuller = nullptr;
+
+	UINT mFrame = 0;
+	CameraPose mPoses[PoseRingSize];
+
+	// Change of the camera basis since each ring slot, precomputed once per
+	// frame: translation distance and rotation chord per unit of distance.
+	float mTranslation[PoseRingSize] = {};
+	float mRotation[PoseRingSize] = {};
+
+	// Per entry, structure-of-arrays.
+	std::vector<UINT8> mVisible;
+	std::vector<UINT8> mValid;
+	std::vector<float> mSlack;
+	std::vector<float> mReach;     // Distance from the camera to the far side of the bounds.
+	std::vector<UINT> mTestFrame;
+	std::vector<UINT> mEntryRange;	// Range that last walked the entry.
+
+	std::vector<Range> mRanges;
+
+	Stats mStats;
+};
@@ -6,27 +6,26 @@
 
 using Microsoft::WRL::ComPtr;
 
-DescriptorHeapWrapper::DescriptorHeapWrapper()
-{
-	memset(this, 0, sizeof(*this));
-}
-
-HRESULT DescriptorHeapWrapper::Create(ComPtr<ID3D12Device> pDevice, D3D12_DESCRIPTOR_HEAP_TYPE heapType, UINT numDescriptors, bool bShaderVisible)
+HRESULT DescriptorHeapWrapper::Create(ComPtr<ID3D12Device> pDevice, D3D12_DESCRIPTOR_HEAP_TYPE heapType, UINT numDescriptors, bool bShaderVisible, UINT numTransientDescriptors)
 {
 	this->heapDesc.Type = heapType;
-	this->heapDesc.NumDescriptors = numDescriptors;
+	this->heapDesc.NumDescriptors = numDescriptors + numTransientDescriptors;
 	this->heapDesc.Flags = (bShaderVisible ? D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE : D3D12_DESCRIPTOR_HEAP_FLAG_NONE);
-	this->lastDescIndex = 0;
 
 	ThrowIfFailed(pDevice->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&pDH)));
 
-	cpuHandle = pDH->GetCPUDescriptorHandleForHeapStart();
-	gpuHandle = pDH->GetGPUDescriptorHandleForHeapStart();
-
 	// Get the increment size of a descriptor in this heap type. This is 
 	// hardware specific, so we have to query this information.
 	descriptorSize = pDevice->GetDescriptorHandleIncrementSize(heapDesc.Type);
 
+	// Descriptors are handed out one by one, so the granularity is 1.
+	persistentCount = numDescriptors;
+	persistentAllocator = std::make_unique<TlsfAllocator>(numDescriptors, 1);
+	allocations.clear();
+	pendingFrees.clear();
+
+	transientRing = numTransientDescriptors != 0 ? std::make_unique<RingAllocator>(numTransientDescriptors) : nullptr;
+
 	return S_OK;
 }
 
@@ -35,11 +34,6 @@ ID3D12DescriptorHeap* DescriptorHeapWrapper::GetHeapPtr()
 	return pDH.Get();
 }
 
-UINT DescriptorHeapWrapper::GetLastDescIndex()
-{
-	return this->lastDescIndex;
-}
-
 CD3DX12_CPU_DESCRIPTOR_HANDLE DescriptorHeapWrapper::GetCPUHandle(UINT index)
 {
 	CD3DX12_CPU_DESCRIPTOR_HANDLE offsettedCPUHandle(pDH->GetCPUDescriptorHandleForHeapStart(), index, descriptorSize);
@@ -52,7 +46,79 @@ CD3DX12_GPU_DESCRIPTOR_HANDLE DescriptorHeapWrapper::GetGPUHandle(UINT index)
 	return offsettedGPUHandle;
 }
 
-void DescriptorHeapWrapper::CreateSrvDescriptor(ComPtr<ID3D12Device> pDevice, ID3D12Resource* resource, const D3D12_SRV_DIMENSION& dimension, const SRV_TYPE& type)
+UINT DescriptorHeapWrapper::Allocate(UINT count)
+{
+	TlsfAllocator::Allocation allocation = persistentAllocator->Allocate(count, 1);
+	if (!allocation.IsValid())
+		ThrowIfFailed(E_OUTOFMEMORY);
+
+	UINT index = (UINT)allocation.Offset;
+	allocations[index] = allocation;
+	return index;
+}
+
+void DescriptorHeapWrapper::Free(UINT index)
+{
+	auto it = allocations.find(index);
+	assert(it != allocations.end());
+
+	pendingFrees.emplace_back(frameFence, it->second);
+	allocations.erase(it);
+}
+
+UINT DescriptorHeapWrapper::AllocateTransient(UINT count)
+{
+	assert(transientRing != nullptr);
+
+	// The ring cannot grow: a new heap would have to be bound part way
+	// through the frame. Size it for the frames in flight.
+	UINT64 offset = transientRing->Allocate(count, 1);
+	if (offset == RingAllocator::InvalidOffset)
+		ThrowIfFailed(E_OUTOFMEMORY);
+
+	return persistentCount + (UINT)offset;
+}
+
+void DescriptorHeapWrapper::BeginFrame(UINT64 completedFence, UINT64 nextFrameFence)
+{
+	while (!pendingFrees.empty() && pendingFrees.front().first <= completedFence)
+	{
+		persistentAllocator->Free(pendingFrees.front().second);
+		pendingFrees.pop_front();
+	}
+
+	if (transientRing != nullptr)
+	{
+		transientRing->EndFrame(frameFence);
+		transientRing->Reclaim(completedFence);
+	}
+
+	frameFence = nextFrameFence;
+}
+
+UINT DescriptorHeapWrapper::GetUsedCount() const
+{
+	return (UINT)persistentAllocator->UsedSize();
+}
+
+UINT DescriptorHeapWrapper::GetTransientCount() const
+{
+	return transientRing != nullptr ? (UINT)transientRing->Size() : 0;
+}
+
+UINT DescriptorHeapWrapper::GetTransientUsedCount() const
+{
+	return transientRing != nullptr ? (UINT)transientRing->UsedSize() : 0;
+}
+
+UINT DescriptorHeapWrapper::CreateSrvDescriptor(ComPtr<ID3D12Device> pDevice, ID3D12Resource* resource, const D3D12_SRV_DIMENSION& dimension, const SRV_TYPE& type)
+{
+	UINT index = Allocate();
+	CreateSrvDescriptor(pDevice, resource, dimension, type, index);
+	return index;
+}
+
+void DescriptorHeapWrapper::CreateSrvDescriptor(ComPtr<ID3D12Device> pDevice, ID3D12Resource* resource, const D3D12_SRV_DIMENSION& dimension, const SRV_TYPE& type, UINT index)
 {
 	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 
@@ -107,9 +173,6 @@ void DescriptorHeapWrapper::CreateSrvDescriptor(ComPtr<ID3D12Device> pDevice, ID
 	srvDesc.Texture2D.MostDetailedMip = 0;
 	srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
 
-	pDevice->CreateShaderResourceView(resource, &srvDesc, GetCPUHandle(lastDescIndex));
-
-	// Increment descriptor handle
-	lastDescIndex++;
+	pDevice->CreateShaderResourceView(resource, &srvDesc, GetCPUHandle(index));
 }
 
@@ -6,6 +6,8 @@
 #pragma once
 
 #include "Utils/DXUtil.h"
+#include "Memory/TlsfAllocator.h"
+#include "Memory/RingAllocator.h"
 
 enum RESOURCE_VIEW_TYPE
 {
@@ -24,32 +26,75 @@ enum SRV_TYPE
 	SHADOW_MAP,
 };
 
+// Descriptors are allocated from the first NumDescriptors of the heap in
+// ranges, kept in TLSF free lists so freed ranges are reused without the
+// heap fragmenting. Freed ranges may still be referenced by frames in
+// flight, so they only return once the fence of the frame they were
+// freed in has completed. The rest of the heap is a ring for transient
+// tables, written every frame and reclaimed the same way.
 class DescriptorHeapWrapper
 {
 public:
-	DescriptorHeapWrapper();
+	static const UINT InvalidIndex = ~0u;
+
+	DescriptorHeapWrapper() = default;
+
+	DescriptorHeapWrapper(const DescriptorHeapWrapper& rhs) = delete;
+	DescriptorHeapWrapper& operator=(const DescriptorHeapWrapper& rhs) = delete;
 
 	HRESULT Create(
 		Microsoft::WRL::ComPtr<ID3D12Device> pDevice,
 		D3D12_DESCRIPTOR_HEAP_TYPE Type,
 		UINT NumDescriptors,
-		bool bShaderVisible = false);
+		bool bShaderVisible = false,
+		UINT NumTransientDescriptors = 0);
 
 	ID3D12DescriptorHeap* GetHeapPtr();
 
-	UINT GetLastDescIndex();
-
 	CD3DX12_CPU_DESCRIPTOR_HANDLE GetCPUHandle(UINT index);
 	CD3DX12_GPU_DESCRIPTOR_HANDLE GetGPUHandle(UINT index);
 
-	void CreateSrvDescriptor(Microsoft::WRL::ComPtr<ID3D12Device> pDevice,
+	// Index of the first of count contiguous descriptors that stay until
+	// freed. Throws when the heap has no such range left.
+	UINT Allocate(UINT count = 1);
+	void Free(UINT index);
+
+	// Index of the first of count contiguous descriptors for this frame
+	// only.
+	UINT AllocateTransient(UINT count);
+
+	// Called at the start of every frame, like GpuMemoryAllocator::BeginFrame:
+	// descriptors freed and transient tables written in frames up to
+	// completedFence are reused, and what is freed or written from now on
+	// waits for nextFrameFence.
+	void BeginFrame(UINT64 completedFence, UINT64 nextFrameFence);
+
+	// Write the view into a new descriptor and return its index.
+	UINT CreateSrvDescriptor(Microsoft::WRL::ComPtr<ID3D12Device> pDevice,
 		ID3D12Resource* resource, const D3D12_SRV_DIMENSION& dimension, const SRV_TYPE& type);
 
+	// Write the view into the descriptor at index.
+	void CreateSrvDescriptor(Microsoft::WRL::ComPtr<ID3D12Device> pDevice,
+		ID3D12Resource* resource, const D3D12_SRV_DIMENSION& dimension, const SRV_TYPE& type, UINT index);
+
+	UINT GetPersistentCount() const { return persistentCount; }
+	UINT GetUsedCount() const;
+	UINT GetTransientCount() const;
+	UINT GetTransientUsedCount() const;
+	UINT GetPendingFreeCount() const { return (UINT)pendingFrees.size(); }
+
 private:
-	D3D12_DESCRIPTOR_HEAP_DESC heapDesc;
+	D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
 	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> pDH;
-	CD3DX12_CPU_DESCRIPTOR_HANDLE cpuHandle;
-	CD3DX12_GPU_DESCRIPTOR_HANDLE gpuHandle;
-	UINT descriptorSize;
-	UINT lastDescIndex;
+	UINT descriptorSize = 0;
+
+	UINT persistentCount = 0;
+	std::unique_ptr<TlsfAllocator> persistentAllocator;
+	std::unordered_map<UINT, TlsfAllocator::Allocation> allocations;
+
+	// Freed ranges in free order, with the fence they wait for.
+	std::deque<std::pair<UINT64, TlsfAllocator::Allocation>> pendingFrees;
+
+	std::unique_ptr<RingAllocator> transientRing;
+	UINT64 frameFence = 0;
 };
\ No newline at end of file
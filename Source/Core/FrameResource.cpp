@@ -5,24 +5,35 @@
 #include "FrameResource.h"
 
 // Constructor
-FrameResource::FrameResource(ID3D12Device* device, UINT passCount, std::vector<UINT> maxInstanceCounts, UINT materialCount, UINT waveVertCount)
+FrameResource::FrameResource(ID3D12Device* device, std::vector<UINT> maxInstanceCounts, UINT materialCount, UINT recordingPassCount, GpuMemoryAllocator* allocator)
 {
 	ThrowIfFailed(device->CreateCommandAllocator(
 		D3D12_COMMAND_LIST_TYPE_DIRECT,
 		IID_PPV_ARGS(CmdListAlloc.GetAddressOf())));
 
-	PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
-	MaterialBuffer = std::make_unique<UploadBuffer<MaterialData>>(device, materialCount, false);
+	PassCmdListAllocs.resize(recordingPassCount);
+	for (UINT i = 0; i < recordingPassCount; ++i)
+	{
+		ThrowIfFailed(device->CreateCommandAllocator(
+			D3D12_COMMAND_LIST_TYPE_DIRECT,
+			IID_PPV_ARGS(PassCmdListAllocs[i].GetAddressOf())));
+	}
+
+	ThrowIfFailed(device->CreateCommandAllocator(
+		D3D12_COMMAND_LIST_TYPE_DIRECT,
+		IID_PPV_ARGS(UploadCmdListAlloc.GetAddressOf())));
+
+	MaterialBuffer = std::make_unique<UploadBuffer<MaterialData>>(device, materialCount, false, allocator);
 
 	// InstanceBuffer is not a constant buffer, so we specify false for the
 	// last parameter.
+	UINT totalInstanceCount = 0;
 	for (int i = 0; i < maxInstanceCounts.size(); i++)
 	{
-		InstanceBuffer.push_back(std::make_unique<UploadBuffer<InstanceData>>(device, maxInstanceCounts[i], false));
+		VisibleInstanceBuffer.push_back(std::make_unique<UploadBuffer<UINT>>(device, maxInstanceCounts[i], false, allocator));
+		totalInstanceCount += maxInstanceCounts[i];
 	}
-
-	if (waveVertCount != 0)
-		WavesVB = std::make_unique<UploadBuffer<Vertex>>(device, waveVertCount, false);
+	InstanceBuffer = std::make_unique<UploadBuffer<PackedInstanceData>>(device, totalInstanceCount, false, allocator);
 }
 
 FrameResource::~FrameResource()
@@ -13,15 +13,38 @@
 
 #include "Material.h"
 
-// Stores data that varies per-instance.
+// Stores data that varies per-instance. This is the system memory copy;
+// the GPU reads the compact PackedInstanceData encoded from it.
 struct InstanceData
 {
     DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
     DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
-    UINT MaterialIndex;
+    UINT MaterialIndex = 0;
+
+    // Per-instance flags, stored above the material index on the GPU. None
+    // are defined yet.
+    UINT Flags = 0;
+
+    // Index of TexTransform in the shared texture transform table, assigned
+    // once the render items are built.
+    UINT TexTransformIndex = 0;
+};
+
+// Per-instance data as laid out in the instance structured buffers, 64
+// bytes instead of the two full matrices. World holds the first three
+// columns of the affine world matrix, i.e. the rows of its transpose; the
+// last column is always (0, 0, 0, 1). Texture transforms are shared by
+// many instances and live in their own buffer.
+struct PackedInstanceData
+{
+    static const UINT MaterialIndexBits = 16;
+    static const UINT MaterialIndexMask = (1u << MaterialIndexBits) - 1;
+
+    DirectX::XMFLOAT4 World[3];
+    UINT TexTransformIndex;
+    UINT MaterialAndFlags;      // Material index in the low 16 bits, flags above.
     UINT InstancePad0;
     UINT InstancePad1;
-    UINT InstancePad2;
 };
 
 // Stores constant data that is fixed over a given rendering pass.
@@ -69,6 +92,14 @@ struct Vertex
     DirectX::XMFLOAT3 TangentU;
 };
 
+// Views that draw the scene from their own lists of visible instances.
+enum class InstanceView : int
+{
+    Camera = 0,
+    Shadow,
+    Count
+};
+
 // Stores the resources needed for the CPU to build the command lists
 // for a frame.
 struct FrameResource
@@ -76,7 +107,8 @@ struct FrameResource
 public:
 
     // Constructors
-    FrameResource(ID3D12Device* device, UINT passCount, std::vector<UINT> maxInstanceCounts, UINT materialCount, UINT waveVertCount = 0);
+    FrameResource(ID3D12Device* device, std::vector<UINT> maxInstanceCounts, UINT materialCount, UINT recordingPassCount = 0,
+        GpuMemoryAllocator* allocator = nullptr);
 
     FrameResource(const FrameResource& rhs) = delete;
 	FrameResource& operator=(const FrameResource& rhs) = delete;
@@ -86,28 +118,28 @@ public:
 	// commands. So each frame needs their own allocator.
 	Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
 
-	// We cannot update a cbuffer until the GPU is done processing the
-	// commands that reference it. So each frame needs their own cbuffers.
-    std::unique_ptr<UploadBuffer<PassConstants>> PassCB = nullptr;
+	// Allocators of the passes recorded in parallel. An allocator must not
+	// be used by two threads at once, so each pass has its own.
+	std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> PassCmdListAllocs;
+
+	// Allocator of the copies staged in the upload batch, which are
+	// submitted ahead of the passes.
+	Microsoft::WRL::ComPtr<ID3D12CommandAllocator> UploadCmdListAlloc;
+
+	// Data rewritten from scratch every frame (pass constants, shadow and
+	// batch instance lists, draw arguments, wave vertices) comes from the
+	// shared UploadRing. What is left here is updated only where it changed
+	// since the frame resource was last used, so it has to persist.
     std::unique_ptr<UploadBuffer<MaterialData>> MaterialBuffer = nullptr;
 
-    // In this demo, we instance only one render-item, so we only have one 
-    // structured buffer to store instancing data.
-    // To make this more general (i.e., to support instancing multiple render-
-    // items), you would need to have a structured buffer for each render-item,
-    // and allocate each buffer with enough room for the maximum number of 
-    // instances you would ever draw.
-    // This sounds like a lot, but it is actually no more than the amount of 
-    // per-object constant data we would need if we were not using instancing.
-    // For example, if we were drawing 1000 objects without instancing, we 
-    // would create a constant buffer with enough room for a 1000 objects.
-    // With instancing, we would just create a structured buffer large enough 
-    // to store the instance data for 1000 instances.  
-    std::vector<std::unique_ptr<UploadBuffer<InstanceData>>> InstanceBuffer;
-
-    // We cannot update a dynamic vertex buffer until the GPU is done processing
-    // the commands that reference it.  So each frame needs their own.
-    std::unique_ptr<UploadBuffer<Vertex>> WavesVB = nullptr;
+    // Per-instance data of the whole scene, one persistent slot per
+    // instance. Kept up to date by the InstanceStore.
+    std::unique_ptr<UploadBuffer<PackedInstanceData>> InstanceBuffer = nullptr;
+
+    // One structured buffer per render-item, listing the instance slots the
+    // camera draws. Each is allocated with room for every instance of its
+    // render-item, and only rewritten when the visible set changes.
+    std::vector<std::unique_ptr<UploadBuffer<UINT>>> VisibleInstanceBuffer;
 
     // Fence value to mark commands up to this fence point. This lets us
     // check if these frame resources are still in use by the GPU.
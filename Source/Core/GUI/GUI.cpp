@@ -56,10 +56,12 @@ void GUI::SetupWndProcHandler(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 
 void GUI::SetupRenderer(ID3D12Device* device, DescriptorHeapWrapper* descHeap)
 {
+    // The font texture SRV lives as long as the GUI.
+    UINT fontSrvIndex = descHeap->Allocate();
     ImGui_ImplDX12_Init(device, gNumFrameResources,
         DXGI_FORMAT_R8G8B8A8_UNORM, descHeap->GetHeapPtr(),
-        descHeap->GetCPUHandle(descHeap->GetLastDescIndex()),
-        descHeap->GetGPUHandle(descHeap->GetLastDescIndex()));
+        descHeap->GetCPUHandle(fontSrvIndex),
+        descHeap->GetGPUHandle(fontSrvIndex));
 }
 
 
@@ -3,10 +3,114 @@
 //*******************************************************************
 #include "lmpch.h"
 #include "GeoBuilder.h"
+#include "MeshSimplifier.h"
+#include "Memory/GpuMemoryAllocator.h"
+#include "Memory/UploadBatch.h"
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
 
+ComPtr<ID3D12Resource> GeoBuilder::CreateDefaultBuffer(ID3D12Device* pDevice, ID3D12GraphicsCommandList* pCommandList,
+    const void* data, UINT64 byteSize, ComPtr<ID3D12Resource>& uploader)
+{
+    if (mUploads != nullptr)
+        return mUploads->CreateBuffer(data, byteSize);
+
+    return DXUtil::CreateDefaultBuffer(pDevice, pCommandList, data, byteSize, uploader, mAllocator);
+}
+
+// ------------------------------------------------------------------
+// Give geo the buffers of its blobs. With an upload batch it goes into
+// the pool of its vertex format, and its draw arguments are moved to
+// where its ranges start; the pool keeps the only system memory copy.
+// ------------------------------------------------------------------
+void GeoBuilder::AddGeometry(std::unique_ptr<MeshGeometry> geo, ID3D12Device* pDevice, ID3D12GraphicsCommandList* pCommandList)
+{
+    if (mUploads == nullptr)
+    {
+        geo->VertexBufferGPU = CreateDefaultBuffer(pDevice, pCommandList,
+            geo->VertexBufferCPU->GetBufferPointer(), geo->VertexBufferByteSize, geo->VertexBufferUploader);
+        geo->IndexBufferGPU = CreateDefaultBuffer(pDevice, pCommandList,
+            geo->IndexBufferCPU->GetBufferPointer(), geo->IndexBufferByteSize, geo->IndexBufferUploader);
+
+        mGeometries[geo->Name] = std::move(geo);
+        return;
+    }
+
+    auto& pool = mPools[geo->VertexByteStride];
+    if (pool == nullptr)
+        pool = std::make_unique<GeometryPool>(pDevice, geo->VertexByteStride, mUploads, mAllocator);
+
+    bool indices32 = geo->IndexFormat == DXGI_FORMAT_R32_UINT;
+    UINT indexSize = indices32 ? sizeof(std::uint32_t) : sizeof(std::uint16_t);
+    geo->PoolMesh = pool->Add(geo->VertexBufferCPU->GetBufferPointer(), geo->VertexBufferByteSize / geo->VertexByteStride,
+        geo->IndexBufferCPU->GetBufferPointer(), geo->IndexBufferByteSize / indexSize, indices32);
+    geo->Pool = pool.get();
+
+    const GeometryPool::Mesh& mesh = pool->GetMesh(geo->PoolMesh);
+    for (auto& drawArgs : geo->DrawArgs)
+        RebaseSubmesh(drawArgs.second, (INT)mesh.BaseVertex, (INT)mesh.StartIndex);
+
+    geo->VertexBufferCPU = nullptr;
+    geo->IndexBufferCPU = nullptr;
+    geo->IndexFormat = DXGI_FORMAT_R32_UINT;
+    geo->IndexBufferByteSize = mesh.IndexCount * sizeof(std::uint32_t);
+
+    mGeometries[geo->Name] = std::move(geo);
+}
+
+void GeoBuilder::RebaseSubmesh(SubmeshGeometry& submesh, INT vertexDelta, INT indexDelta)
+{
+    submesh.BaseVertexLocation += vertexDelta;
+    submesh.StartIndexLocation += indexDelta;
+    for (SubmeshLOD& lod : submesh.LODs)
+        lod.StartIndexLocation += indexDelta;
+}
+
+void GeoBuilder::Compact()
+{
+    std::vector<std::pair<MeshGeometry*, GeometryPool::Mesh>> before;
+    for (auto& geo : mGeometries)
+    {
+        if (geo.second->Pool != nullptr)
+            before.emplace_back(geo.second.get(), geo.second->Pool->GetMesh(geo.second->PoolMesh));
+    }
+
+    for (auto& pool : mPools)
+        pool.second->Compact();
+
+    for (auto& moved : before)
+    {
+        const GeometryPool::Mesh& after = moved.first->Pool->GetMesh(moved.first->PoolMesh);
+        for (auto& drawArgs : moved.first->DrawArgs)
+        {
+            RebaseSubmesh(drawArgs.second, (INT)after.BaseVertex - (INT)moved.second.BaseVertex,
+                (INT)after.StartIndex - (INT)moved.second.StartIndex);
+        }
+    }
+}
+
+void GeoBuilder::BeginFrame(UINT64 completedFence, UINT64 frameFence)
+{
+    for (auto& pool : mPools)
+        pool.second->BeginFrame(completedFence, frameFence);
+}
+
+void GeoBuilder::DisposeUploaders()
+{
+    for (auto& geo : mGeometries)
+    {
+        if (mAllocator != nullptr)
+        {
+            if (geo.second->VertexBufferUploader != nullptr)
+                mAllocator->Release(geo.second->VertexBufferUploader.Get());
+            if (geo.second->IndexBufferUploader != nullptr)
+                mAllocator->Release(geo.second->IndexBufferUploader.Get());
+        }
+        geo.second->DisposeUploaders();
+    }
+}
+
 void GeoBuilder::CreateWaves(int m, int n, float dx, float dt, float speed, float damping)
 {
     mWaves = std::make_unique<Waves>(m, n, dx, dt, speed, damping);
@@ -53,12 +157,6 @@ void GeoBuilder::BuildLandGeometry(ComPtr<ID3D12Device> pDevice, ComPtr<ID3D12Gr
     ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
     CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-    geo->VertexBufferGPU = DXUtil::CreateDefaultBuffer(pDevice.Get(),
-        pCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-    geo->IndexBufferGPU = DXUtil::CreateDefaultBuffer(pDevice.Get(),
-        pCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
     geo->VertexByteStride = sizeof(Vertex);
     geo->VertexBufferByteSize = vbByteSize;
     geo->IndexFormat = DXGI_FORMAT_R16_UINT;
@@ -71,7 +169,7 @@ void GeoBuilder::BuildLandGeometry(ComPtr<ID3D12Device> pDevice, ComPtr<ID3D12Gr
 
     geo->DrawArgs["grid"] = submesh;
 
-    mGeometries[geoName] = std::move(geo);
+    AddGeometry(std::move(geo), pDevice.Get(), pCommandList.Get());
 }
 
 // ------------------------------------------------------------------
@@ -119,7 +217,7 @@ void GeoBuilder::BuildWavesGeometry(Microsoft::WRL::ComPtr<ID3D12Device> pDevice
     ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
     CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-    geo->IndexBufferGPU = DXUtil::CreateDefaultBuffer(pDevice.Get(),
+    geo->IndexBufferGPU = CreateDefaultBuffer(pDevice.Get(),
         pCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
 
     geo->VertexByteStride = sizeof(Vertex);
@@ -302,12 +400,6 @@ void GeoBuilder::BuildShapeGeometry(Microsoft::WRL::ComPtr<ID3D12Device> pDevice
     ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
     CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-    geo->VertexBufferGPU = DXUtil::CreateDefaultBuffer(pDevice.Get(),
-        pCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-    geo->IndexBufferGPU = DXUtil::CreateDefaultBuffer(pDevice.Get(),
-        pCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
     geo->VertexByteStride = sizeof(Vertex);
     geo->VertexBufferByteSize = vbByteSize;
     geo->IndexFormat = DXGI_FORMAT_R16_UINT;
@@ -318,10 +410,10 @@ void GeoBuilder::BuildShapeGeometry(Microsoft::WRL::ComPtr<ID3D12Device> pDevice
     geo->DrawArgs["grid"] = gridSubmesh;
     geo->DrawArgs["cylinder"] = cylinderSubmesh;
 
-    mGeometries[geoName] = std::move(geo);
+    AddGeometry(std::move(geo), pDevice.Get(), pCommandList.Get());
 }
 
-void GeoBuilder::BuildGeometryFromText(const std::string& path, Microsoft::WRL::ComPtr<ID3D12Device> pDevice, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> pCommandList, std::string geoName)
+void GeoBuilder::BuildGeometryFromText(const std::string& path, Microsoft::WRL::ComPtr<ID3D12Device> pDevice, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> pCommandList, std::string geoName, UINT lodCount)
 {
     std::string fullPath = pathPrefix;
     fullPath.append(path);
@@ -389,7 +481,7 @@ void GeoBuilder::BuildGeometryFromText(const std::string& path, Microsoft::WRL::
     fin >> ignore;
     fin >> ignore;
 
-    std::vector<std::int32_t> indices(3 * tcount);
+    std::vector<std::uint32_t> indices(3 * tcount);
     for (UINT i = 0; i < tcount; ++i)
     {
         fin >> indices[i * 3 + 0] >> indices[i * 3 + 1] >> indices[i * 3 + 2];
@@ -397,13 +489,29 @@ void GeoBuilder::BuildGeometryFromText(const std::string& path, Microsoft::WRL::
 
     fin.close();
 
+    //
+    // Generate the coarser levels of detail. They reuse the vertices, so only
+    // their indices are appended after the full resolution ones.
+    //
+
+    std::vector<SubmeshLOD> lods;
+    if (lodCount > 1)
+    {
+        std::vector<XMFLOAT3> positions(vcount);
+        for (UINT i = 0; i < vcount; ++i)
+            positions[i] = vertices[i].Pos;
+
+        float radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.Extents)));
+        lods = MeshSimplifier::BuildLODChain(positions, indices, lodCount, radius);
+    }
+
     //
     // Pack the indices of all the meshes into one index buffer.
     //
 
     const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
 
-    const UINT ibByteSize = (UINT)indices.size() * sizeof(std::int32_t);
+    const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint32_t);
 
     auto geo = std::make_unique<MeshGeometry>();
     geo->Name = geoName;
@@ -414,26 +522,21 @@ void GeoBuilder::BuildGeometryFromText(const std::string& path, Microsoft::WRL::
     ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
     CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-    geo->VertexBufferGPU = DXUtil::CreateDefaultBuffer(pDevice.Get(),
-        pCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-    geo->IndexBufferGPU = DXUtil::CreateDefaultBuffer(pDevice.Get(),
-        pCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
     geo->VertexByteStride = sizeof(Vertex);
     geo->VertexBufferByteSize = vbByteSize;
     geo->IndexFormat = DXGI_FORMAT_R32_UINT;
     geo->IndexBufferByteSize = ibByteSize;
 
     SubmeshGeometry submesh;
-    submesh.IndexCount = (UINT)indices.size();
+    submesh.IndexCount = 3 * tcount;
     submesh.StartIndexLocation = 0;
     submesh.BaseVertexLocation = 0;
     submesh.Bounds = bounds;
+    submesh.LODs = std::move(lods);
 
     geo->DrawArgs[geoName] = submesh;
 
-    mGeometries[geo->Name] = std::move(geo);
+    AddGeometry(std::move(geo), pDevice.Get(), pCommandList.Get());
 }
 
 // ------------------------------------------------------------------
@@ -9,6 +9,7 @@
 
 #include "GameTimer.h"
 #include "FrameResource.h"
+#include "Memory/GeometryPool.h"
 
 // Waves Class
 // Performs the calculations for the wave simulation. After the simulation has 
@@ -187,7 +188,12 @@ private:
 class GeoBuilder
 {
 public:
-	GeoBuilder() {}
+	// Buffers are placed in heaps of allocator and staged through uploads,
+	// for each one that is given. With uploads, the static geometries share
+	// a GeometryPool per vertex format and their DrawArgs hold absolute
+	// offsets into it.
+	explicit GeoBuilder(GpuMemoryAllocator* allocator = nullptr, UploadBatch* uploads = nullptr) :
+		mAllocator(allocator), mUploads(uploads) {}
 
 	void CreateWaves(int m, int n, float dx, float dt, float speed, float damping);
 	Waves* GetWaves() { return mWaves.get(); }
@@ -197,15 +203,45 @@ public:
 	void BuildLandGeometry(Microsoft::WRL::ComPtr<ID3D12Device> pDevice, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> pCommandList, std::string geoName);
 	void BuildWavesGeometry(Microsoft::WRL::ComPtr<ID3D12Device> pDevice, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> pCommandList, std::string geoName);
 	void BuildShapeGeometry(Microsoft::WRL::ComPtr<ID3D12Device> pDevice, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> pCommandList, std::string geoName);
-	void BuildGeometryFromText(const std::string& path, Microsoft::WRL::ComPtr<ID3D12Device> pDevice, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> pCommandList, std::string geoName);
+	// lodCount > 1 appends simplified levels to the index buffer, each with
+	// half the triangles of the previous one.
+	void BuildGeometryFromText(const std::string& path, Microsoft::WRL::ComPtr<ID3D12Device> pDevice, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> pCommandList, std::string geoName, UINT lodCount = 1);
+
+	// Drop the upload buffers of geometries built without an upload batch,
+	// once the copies have executed.
+	void DisposeUploaders();
+
+	// Pack the meshes of every pool and move their DrawArgs along. Anything
+	// copied from DrawArgs before has to be moved the same way.
+	void Compact();
+
+	// Called at the start of every frame, like GeometryPool::BeginFrame.
+	void BeginFrame(UINT64 completedFence, UINT64 frameFence);
+
+	// Pools by vertex stride, the only thing telling the vertex formats
+	// apart here.
+	const std::map<UINT, std::unique_ptr<GeometryPool>>& GetPools() const { return mPools; }
+
+	// Move the ranges of submesh by the offsets its geometry moved by.
+	static void RebaseSubmesh(SubmeshGeometry& submesh, INT vertexDelta, INT indexDelta);
 
 protected:
 	float GetHillsHeight(float x, float z)const;
 	DirectX::XMFLOAT3 GetHillsNormal(float x, float z)const;
 
+	// Store geo, with buffers of its own or in a pool.
+	void AddGeometry(std::unique_ptr<MeshGeometry> geo, ID3D12Device* pDevice, ID3D12GraphicsCommandList* pCommandList);
+
+	// A default buffer holding data, through the upload batch if there is one.
+	Microsoft::WRL::ComPtr<ID3D12Resource> CreateDefaultBuffer(ID3D12Device* pDevice, ID3D12GraphicsCommandList* pCommandList,
+		const void* data, UINT64 byteSize, Microsoft::WRL::ComPtr<ID3D12Resource>& uploader);
+
 private:
 	std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
 	std::unique_ptr<Waves> mWaves;
+	std::map<UINT, std::unique_ptr<GeometryPool>> mPools;
+	GpuMemoryAllocator* mAllocator = nullptr;
+	UploadBatch* mUploads = nullptr;
 
     std::string pathPrefix = "../../Assets/Models/";
 };
\ No newline at end of file
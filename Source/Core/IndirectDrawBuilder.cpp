@@ -0,0 +1,90 @@
+//*******************************************************************
+// IndirectDrawBuilder.cpp
+//*******************************************************************
+#include "lmpch.h"
+#include "IndirectDrawBuilder.h"
+
+static_assert(sizeof(IndirectDrawCommand) % 8 == 0, "Indirect draw records must keep their addresses aligned");
+static_assert(sizeof(IndirectDrawCommand) == 64, "Indirect draw records must be one cache line; the command signature stride is their size");
+
+void IndirectDrawBuilder::DescribeCommandSignature(UINT visibleInstancesParameter,
+    D3D12_INDIRECT_ARGUMENT_DESC (&arguments)[ArgumentCount], D3D12_COMMAND_SIGNATURE_DESC& desc)
+{
+    arguments[0] = {};
+    arguments[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_VERTEX_BUFFER_VIEW;
+    arguments[0].VertexBuffer.Slot = 0;
+
+    arguments[1] = {};
+    arguments[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_INDEX_BUFFER_VIEW;
+
+    arguments[2] = {};
+    arguments[2].Type = D3D12_INDIRECT_ARGUMENT_TYPE_SHADER_RESOURCE_VIEW;
+    arguments[2].ShaderResourceView.RootParameterIndex = visibleInstancesParameter;
+
+    // The draw has to come last.
+    arguments[3] = {};
+    arguments[3].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+
+    desc = {};
+    desc.ByteStride = sizeof(IndirectDrawCommand);
+    desc.NumArgumentDescs = ArgumentCount;
+    desc.pArgumentDescs = arguments;
+    desc.NodeMask = 0;
+}
+
+void IndirectDrawBuilder::Clear()
+{
+    mCommands.clear();
+    mRanges.clear();
+    mGroupBegin = 0;
+}
+
+void IndirectDrawBuilder::BeginGroup()
+{
+    mGroupBegin = (UINT)mRanges.size();
+}
+
+IndirectDrawBuilder::Group IndirectDrawBuilder::EndGroup()
+{
+    Group group;
+    group.FirstRange = mGroupBegin;
+    group.RangeCount = (UINT)mRanges.size() - mGroupBegin;
+
+    mGroupBegin = (UINT)mRanges.size();
+    return group;
+}
+
+void IndirectDrawBuilder::AddDraw(const D3D12_VERTEX_BUFFER_VIEW& vertexBuffer, const D3D12_INDEX_BUFFER_VIEW& indexBuffer,
+    D3D12_PRIMITIVE_TOPOLOGY topology, D3D12_GPU_VIRTUAL_ADDRESS visibleInstances, UINT indexCount,
+    UINT instanceCount, UINT startIndexLocation, INT baseVertexLocation)
+{
+    if (instanceCount == 0)
+        return;
+
+    // A topology change ends the range; ranges never reach back into an
+    // earlier group.
+    if (mRanges.size() == mGroupBegin || mRanges.back().Topology != topology)
+    {
+        Range range;
+        range.First = (UINT)mCommands.size();
+        range.Topology = topology;
+        mRanges.push_back(range);
+    }
+    ++mRanges.back().Count;
+
+    IndirectDrawCommand command;
+    command.VertexBuffer = vertexBuffer;
+    command.IndexBuffer = indexBuffer;
+    command.VisibleInstances = visibleInstances;
+
+    // SV_InstanceID restarts at 0 for every draw either way; the list
+    // address carries the offset into the instances.
+    command.Draw.IndexCountPerInstance = indexCount;
+    command.Draw.InstanceCount = instanceCount;
+    command.Draw.StartIndexLocation = startIndexLocation;
+    command.Draw.BaseVertexLocation = baseVertexLocation;
+    command.Draw.StartInstanceLocation = 0;
+    command.Pad = 0;
+
+    mCommands.push_back(command);
+}
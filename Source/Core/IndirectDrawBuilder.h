@@ -0,0 +1,89 @@
+//*******************************************************************
+// IndirectDrawBuilder.h:
+//
+// Builds the argument records of indexed draws for ExecuteIndirect.
+// Each record sets the vertex and index buffers and the visible
+// instance list of one draw before its draw arguments, so a single
+// ExecuteIndirect can submit the draws of a whole layer even when
+// they use different geometry.
+//
+// The records are collected in system memory in ranges, one per
+// ExecuteIndirect, and copied to an upload buffer in one go. The
+// primitive topology cannot be set by a record, so a range only holds
+// draws of one topology, and draws added as one group are split into
+// as many ranges as it takes. The builder does not touch the device,
+// so anything that produces draws, e.g. a compute culling pass later
+// on, can emit the same records.
+//*******************************************************************
+
+#pragma once
+
+#include "Utils/DXUtil.h"
+
+// One draw as ExecuteIndirect reads it. The layout follows the order
+// of the arguments in the command signature.
+struct IndirectDrawCommand
+{
+	D3D12_VERTEX_BUFFER_VIEW VertexBuffer;
+	D3D12_INDEX_BUFFER_VIEW IndexBuffer;
+	D3D12_GPU_VIRTUAL_ADDRESS VisibleInstances;
+	D3D12_DRAW_INDEXED_ARGUMENTS Draw;
+	UINT Pad;   // Keeps the stride a multiple of 8 for the addresses.
+};
+
+class IndirectDrawBuilder
+{
+public:
+	static const UINT ArgumentCount = 4;
+
+	// Records [First, First + Count) of the builder, all drawn with
+	// Topology.
+	struct Range
+	{
+		UINT First = 0;
+		UINT Count = 0;
+		D3D12_PRIMITIVE_TOPOLOGY Topology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+	};
+
+	// Ranges [FirstRange, FirstRange + RangeCount) of the builder.
+	struct Group
+	{
+		UINT FirstRange = 0;
+		UINT RangeCount = 0;
+	};
+
+	IndirectDrawBuilder() = default;
+
+	IndirectDrawBuilder(const IndirectDrawBuilder& rhs) = delete;
+	IndirectDrawBuilder& operator=(const IndirectDrawBuilder& rhs) = delete;
+
+	// Arguments and description of the command signature matching the
+	// records. The visible instance list is bound as the root SRV at
+	// visibleInstancesParameter of the root signature.
+	static void DescribeCommandSignature(UINT visibleInstancesParameter,
+		D3D12_INDIRECT_ARGUMENT_DESC (&arguments)[ArgumentCount], D3D12_COMMAND_SIGNATURE_DESC& desc);
+
+	void Clear();
+	void Reserve(UINT count) { mCommands.reserve(count); }
+
+	// Draws added between BeginGroup and EndGroup form one group, a range
+	// for every run of draws of the same topology.
+	void BeginGroup();
+	Group EndGroup();
+
+	// Draws without instances are left out.
+	void AddDraw(const D3D12_VERTEX_BUFFER_VIEW& vertexBuffer, const D3D12_INDEX_BUFFER_VIEW& indexBuffer,
+		D3D12_PRIMITIVE_TOPOLOGY topology, D3D12_GPU_VIRTUAL_ADDRESS visibleInstances, UINT indexCount,
+		UINT instanceCount, UINT startIndexLocation, INT baseVertexLocation);
+
+	UINT Size() const { return (UINT)mCommands.size(); }
+	const IndirectDrawCommand* Data() const { return mCommands.data(); }
+
+	UINT RangeCount() const { return (UINT)mRanges.size(); }
+	const Range& GetRange(UINT index) const { return mRanges[index]; }
+
+private:
+	std::vector<IndirectDrawCommand> mCommands;
+	std::vector<Range> mRanges;
+	UINT mGroupBegin = 0;
+};
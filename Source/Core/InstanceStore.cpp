@@ -0,0 +1,79 @@
+//*******************************************************************
+// InstanceStore.cpp
+//*******************************************************************
+#include "lmpch.h"
+#include "InstanceStore.h"
+
+using namespace DirectX;
+
+void InstanceStore::Resize(UINT count)
+{
+    mData.assign(count, PackedInstanceData());
+    mFramesDirty.assign(count, (UINT8)gNumFrameResources);
+
+    mDirtySlots.resize(count);
+    for (UINT i = 0; i < count; ++i)
+        mDirtySlots[i] = i;
+}
+
+void InstanceStore::Set(UINT slot, const InstanceData& instance)
+{
+    assert(slot < mData.size());
+
+    Encode(instance, mData[slot]);
+
+    if (mFramesDirty[slot] == 0)
+        mDirtySlots.push_back(slot);
+    mFramesDirty[slot] = (UINT8)gNumFrameResources;
+}
+
+void InstanceStore::Encode(const InstanceData& instance, PackedInstanceData& data)
+{
+    assert(instance.MaterialIndex <= PackedInstanceData::MaterialIndexMask);
+
+    // The last row of the transposed world matrix is always (0, 0, 0, 1)
+    // and is dropped; the other three are stored as they come out of the
+    // transpose, without any scalar shuffling.
+    XMMATRIX world = XMMatrixTranspose(XMLoadFloat4x4(&instance.World));
+
+    XMStoreFloat4(&data.World[0], world.r[0]);
+    XMStoreFloat4(&data.World[1], world.r[1]);
+    XMStoreFloat4(&data.World[2], world.r[2]);
+    data.TexTransformIndex = instance.TexTransformIndex;
+    data.MaterialAndFlags = instance.MaterialIndex | (instance.Flags << PackedInstanceData::MaterialIndexBits);
+    data.InstancePad0 = 0;
+    data.InstancePad1 = 0;
+}
+
+void InstanceStore::Upload(UploadBuffer<PackedInstanceData>& buffer)
+{
+    mStats = Stats();
+
+    if (mDirtySlots.empty())
+        return;
+
+    std::sort(mDirtySlots.begin(), mDirtySlots.end());
+
+    UINT stillDirty = 0;
+    for (size_t i = 0; i < mDirtySlots.size();)
+    {
+        // Extend the range over consecutive dirty slots.
+        const UINT first = mDirtySlots[i];
+        UINT end = first + 1;
+        for (++i; i < mDirtySlots.size() && mDirtySlots[i] == end; ++i)
+            ++end;
+
+        buffer.CopyRange(first, &mData[first], end - first);
+
+        for (UINT slot = first; slot < end; ++slot)
+        {
+            if (--mFramesDirty[slot] > 0)
+                mDirtySlots[stillDirty++] = slot;
+        }
+
+        mStats.BytesWritten += (end - first) * sizeof(PackedInstanceData);
+        ++mStats.RangesWritten;
+    }
+
+    mDirtySlots.resize(stillDirty);
+}
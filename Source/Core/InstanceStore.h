@@ -0,0 +1,61 @@
+//*******************************************************************
+// InstanceStore.h:
+//
+// Persistent GPU copy of the per-instance data of the whole scene.
+// Every instance owns a fixed slot, and a slot is only written again
+// when its data changes. Since each frame resource has its own buffer,
+// a change is carried into each of them in turn; the slots that still
+// need copying are coalesced into contiguous ranges. What is drawn is
+// chosen by separate lists of slot indices, so a static scene uploads
+// nothing here.
+//*******************************************************************
+
+#pragma once
+
+#include "FrameResource.h"
+
+class InstanceStore
+{
+public:
+	struct Stats
+	{
+		UINT BytesWritten = 0;
+		UINT RangesWritten = 0;
+	};
+
+	InstanceStore() = default;
+
+	InstanceStore(const InstanceStore& rhs) = delete;
+	InstanceStore& operator=(const InstanceStore& rhs) = delete;
+
+	// Set the number of slots. Every slot starts out dirty.
+	void Resize(UINT count);
+
+	UINT Size() const { return (UINT)mData.size(); }
+
+	// Encode an instance into its slot, to be copied into the buffer of
+	// every frame resource.
+	void Set(UINT slot, const InstanceData& instance);
+
+	const PackedInstanceData& Get(UINT slot) const { return mData[slot]; }
+
+	// The encoding Set stores, for writers that place the data themselves.
+	static void Encode(const InstanceData& instance, PackedInstanceData& data);
+
+	// Bring the buffer of the current frame resource up to date. Must be
+	// called once per frame, in frame resource order.
+	void Upload(UploadBuffer<PackedInstanceData>& buffer);
+
+	// Counters of the last Upload.
+	const Stats& GetStats() const { return mStats; }
+
+private:
+	std::vector<PackedInstanceData> mData;
+
+	// Number of frame resources each slot still has to be copied into, and
+	// the list of slots where that is not zero.
+	std::vector<UINT8> mFramesDirty;
+	std::vector<UINT> mDirtySlots;
+
+	Stats mStats;
+};
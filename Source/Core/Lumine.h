@@ -3,8 +3,27 @@
 #include "DXCore.h"
 #include "UploadBuffer.h"
 #include "Camera.h"
+#include "InstanceStore.h"
+#include "RenderQueue.h"
+#include "IndirectDrawBuilder.h"
+#include "ShaderCache.h"
+#include "ShaderPermutations.h"
+#include "PipelineStateCache.h"
+#include "Memory/GpuMemoryAllocator.h"
+#include "Memory/UploadRing.h"
+#include "Memory/UploadBatch.h"
+#include "Memory/FrameArena.h"
+#include "Memory/HeapAllocationCounter.h"
+#include "StateTrackingCommandList.h"
+#include "ParallelRecorder.h"
 
 #include "RenderPasses/ShadowMap.h"
+#include "RenderPasses/RenderGraph.h"
+
+#include "Culling/FrustumCuller.h"
+#include "Culling/InstanceBVH.h"
+#include "Culling/OcclusionBuffer.h"
+#include "Culling/VisibilityCache.h"
 
 #include "GeoBuilder.h"
 #include "Material.h"
@@ -28,7 +28,7 @@ MaterialData Material::GetMaterialData()
 	matData.FresnelR0 = mFresnelR0;
 	matData.Roughness = mRoughness;
 	XMStoreFloat4x4(&matData.MatTransform, XMMatrixTranspose(matTransform));
-	matData.DiffuseMapIndex = mDiffuseSrvHeapIndex;
+	matData.DiffuseMapIndex = mDiffuseTexture;
 
 	return matData;
 }
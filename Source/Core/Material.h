@@ -50,17 +50,17 @@ public:
 	/* Get the index into constant buffer corresponding to this material.*/
 	int GetMatCBIndex() const { return mMatCBIndex; }
 
-	/* Set the index into SRV heap for diffuse texture.*/
-	void SetDiffuseSrvHeapIndex(int index) { mDiffuseSrvHeapIndex = index; }
+	/* Set the bindless texture handle of the diffuse texture.*/
+	void SetDiffuseTexture(UINT handle) { mDiffuseTexture = handle; mNumFramesDirty = gNumFrameResources; }
 
-	/* Get the index into SRV heap for diffuse texture.*/
-	int GetDiffuseSrvHeapIndex() const { return mDiffuseSrvHeapIndex; }
+	/* Get the bindless texture handle of the diffuse texture.*/
+	UINT GetDiffuseTexture() const { return mDiffuseTexture; }
 
-	/* Set the index into SRV heap for diffuse texture.*/
-	void SetNormalSrvHeapIndex(int index) { mNormalSrvHeapIndex = index; }
+	/* Set the bindless texture handle of the normal texture.*/
+	void SetNormalTexture(UINT handle) { mNormalTexture = handle; mNumFramesDirty = gNumFrameResources; }
 
-	/* Get the index into SRV heap for diffuse texture.*/
-	int GetNormalSrvHeapIndex() const { return mNormalSrvHeapIndex; }
+	/* Get the bindless texture handle of the normal texture.*/
+	UINT GetNormalTexture() const { return mNormalTexture; }
 
 
 	/* Set the base color.*/
@@ -113,11 +113,10 @@ private:
 	// Index into constant buffer corresponding to this material.
 	int mMatCBIndex = -1;
 
-	// Index into SRV heap for diffuse texture.
-	int mDiffuseSrvHeapIndex = -1;
-
-	// Index into SRV heap for normal texture.
-	int mNormalSrvHeapIndex = -1;
+	// Handles into the bindless texture table, from TextureWrapper. 0 is a
+	// null texture.
+	UINT mDiffuseTexture = 0;
+	UINT mNormalTexture = 0;
 
 	// Dirty flag indicating the material has changed and we need to update the
 	// constant buffer. Because we have a material constant buffer for each 
@@ -141,7 +140,7 @@ public:
 
 	void AddMaterial(const Material::SharedPtr& pMaterial);
 	
-	std::unordered_map<std::string, Material::SharedPtr> GetTable() const { return mMaterialsTable; }
+	const std::unordered_map<std::string, Material::SharedPtr>& GetTable() const { return mMaterialsTable; }
 	Material::SharedPtr GetMaterial(const std::string& name);
 	UINT GetSize() { return (UINT)mMaterialsTable.size(); }
 
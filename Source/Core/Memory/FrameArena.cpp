@@ -0,0 +1,143 @@
+//*******************************************************************
+// FrameArena.cpp
+//*******************************************************************
+#include "lmpch.h"
+#include "FrameArena.h"
+
+namespace
+{
+    // Bumped by BeginFrame; an arena behind it is emptied on its next use.
+    std::atomic<UINT64> sFrame(0);
+}
+
+FrameArena::FrameArena(size_t blockSize) :
+    mBlockSize(blockSize)
+{
+}
+
+FrameArena& FrameArena::Get()
+{
+    thread_local FrameArena arena;
+
+    UINT64 frame = sFrame.load(std::memory_order_acquire);
+    if (arena.mFrame != frame)
+    {
+        arena.Reset();
+        arena.mFrame = frame;
+    }
+
+    return arena;
+}
+
+void FrameArena::BeginFrame()
+{
+    sFrame.fetch_add(1, std::memory_order_release);
+}
+
+void* FrameArena::Allocate(size_t size, size_t alignment)
+{
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+
+    // Aligned in memory, not just within the block.
+    if (mBlock < mBlocks.size())
+    {
+        Block& block = mBlocks[mBlock];
+        uintptr_t start = reinterpret_cast<uintptr_t>(block.Data.get());
+        size_t offset = (size_t)(((start + mOffset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - start);
+        if (offset + size <= block.Size)
+        {
+            mOffset = offset + size;
+            mPeakSize = std::max(mPeakSize, UsedSize());
+            return block.Data.get() + offset;
+        }
+    }
+
+    NextBlock(size, alignment);
+
+    Block& block = mBlocks[mBlock];
+    uintptr_t start = reinterpret_cast<uintptr_t>(block.Data.get());
+    size_t offset = (size_t)(((start + alignment - 1) & ~(uintptr_t)(alignment - 1)) - start);
+    assert(offset + size <= block.Size);
+
+    mOffset = offset + size;
+    mPeakSize = std::max(mPeakSize, UsedSize());
+    return block.Data.get() + offset;
+}
+
+// ------------------------------------------------------------------
+// The rest of the current block is left unused. Blocks too small for
+// the request are skipped over rather than searched for a gap.
+// ------------------------------------------------------------------
+void FrameArena::NextBlock(size_t size, size_t alignment)
+{
+    const size_t required = size + alignment - 1;
+
+    if (mBlock < mBlocks.size())
+    {
+        mBlockBase += mBlocks[mBlock].Size;
+        ++mBlock;
+    }
+
+    while (mBlock < mBlocks.size() && mBlocks[mBlock].Size < required)
+    {
+        mBlockBase += mBlocks[mBlock].Size;
+        ++mBlock;
+    }
+
+    if (mBlock == mBlocks.size())
+    {
+        Block block;
+        block.Size = std::max(mBlockSize, required);
+        block.Data.reset(new BYTE[block.Size]);
+        mCapacity += block.Size;
+        mBlocks.push_back(std::move(block));
+    }
+
+    mOffset = 0;
+}
+
+void FrameArena::Rewind(const Marker& marker)
+{
+    assert(marker.Block < mBlocks.size() || (marker.Block == 0 && marker.Offset == 0));
+    assert(marker.BlockBase + marker.Offset <= UsedSize());
+
+    mBlock = marker.Block;
+    mOffset = marker.Offset;
+    mBlockBase = marker.BlockBase;
+}
+
+void FrameArena::Reset()
+{
+    mLastFrameSize = mPeakSize;
+
+    // One block the size of them all, so a frame like the last one fits
+    // without moving between blocks.
+    if (mBlocks.size() > 1)
+    {
+        Block block;
+        block.Size = mCapacity;
+        mBlocks.clear();
+        block.Data.reset(new BYTE[block.Size]);
+        mBlocks.push_back(std::move(block));
+    }
+
+    mBlock = 0;
+    mOffset = 0;
+    mBlockBase = 0;
+    mPeakSize = 0;
+}
+
+void* FrameArena::do_allocate(size_t bytes, size_t alignment)
+{
+    return Allocate(bytes, alignment);
+}
+
+void FrameArena::do_deallocate(void*, size_t, size_t)
+{
+    // Memory comes back when the arena is rewound.
+}
+
+bool FrameArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+}
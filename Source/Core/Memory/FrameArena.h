@@ -0,0 +1,112 @@
+//*******************************************************************
+// FrameArena.h:
+//
+// Linear allocator for CPU temporaries that do not outlive the frame.
+// Allocating bumps an offset in a block and freeing does nothing; the
+// whole arena is rewound at once, either to a marker taken earlier or
+// to empty at the start of the next frame. Blocks are kept from frame
+// to frame, so once the arena has seen its largest frame it stops
+// touching the heap.
+//
+// Every thread has an arena of its own, so workers recording passes
+// allocate without locking. It is a std::pmr::memory_resource, which
+// lets std::pmr containers put their storage in it.
+//*******************************************************************
+
+#pragma once
+
+class FrameArena : public std::pmr::memory_resource
+{
+public:
+	static const size_t DefaultBlockSize = 256 * 1024;
+
+	// Position in the arena to rewind to.
+	struct Marker
+	{
+		UINT Block = 0;
+		size_t Offset = 0;
+		size_t BlockBase = 0;
+	};
+
+	// Gives back everything allocated while it is alive. Containers using
+	// the arena must be declared after the scope, so they are gone first.
+	class Scope
+	{
+	public:
+		explicit Scope(FrameArena& arena = FrameArena::Get()) : mArena(arena), mMarker(arena.GetMarker()) {}
+		~Scope() { mArena.Rewind(mMarker); }
+
+		Scope(const Scope& rhs) = delete;
+		Scope& operator=(const Scope& rhs) = delete;
+
+		FrameArena& Arena() const { return mArena; }
+
+	private:
+		FrameArena& mArena;
+		Marker mMarker;
+	};
+
+	explicit FrameArena(size_t blockSize = DefaultBlockSize);
+
+	FrameArena(const FrameArena& rhs) = delete;
+	FrameArena& operator=(const FrameArena& rhs) = delete;
+
+	// The arena of the calling thread. The first call in a frame empties
+	// it of whatever the thread allocated in an earlier one.
+	static FrameArena& Get();
+
+	// Start a new frame for the arenas of every thread. Called on the main
+	// thread before anything allocates from them, and while nothing
+	// allocated in the last frame is still in use.
+	static void BeginFrame();
+
+	void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+	// Uninitialized room for count objects of T.
+	template<typename T>
+	T* AllocateArray(size_t count) { return static_cast<T*>(Allocate(count * sizeof(T), alignof(T))); }
+
+	Marker GetMarker() const { return { mBlock, mOffset, mBlockBase }; }
+	void Rewind(const Marker& marker);
+
+	// Rewind to empty. Blocks added in the last frame are merged into one
+	// that fits it all.
+	void Reset();
+
+	size_t UsedSize() const { return mBlockBase + mOffset; }
+	size_t PeakSize() const { return mPeakSize; }			// Since the last reset
+	size_t LastFrameSize() const { return mLastFrameSize; }	// Peak of the frame before
+	size_t Capacity() const { return mCapacity; }
+	UINT BlockCount() const { return (UINT)mBlocks.size(); }
+
+protected:
+	void* do_allocate(size_t bytes, size_t alignment) override;
+	void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+private:
+	struct Block
+	{
+		std::unique_ptr<BYTE[]> Data;
+		size_t Size = 0;
+	};
+
+	// Move to the next block with room for size bytes at alignment, adding
+	// one when none is left.
+	void NextBlock(size_t size, size_t alignment);
+
+private:
+	size_t mBlockSize;
+
+	std::vector<Block> mBlocks;
+	UINT mBlock = 0;
+	size_t mOffset = 0;
+	size_t mBlockBase = 0;	// Sizes of the blocks before mBlock
+
+	size_t mCapacity = 0;
+	size_t mPeakSize = 0;
+	size_t mLastFrameSize = 0;
+
+	// Frame the arena was last reset for, checked by Get.
+	UINT64 mFrame = 0;
+};
@@ -0,0 +1,255 @@
+//*******************************************************************
+// GeometryPool.cpp
+//*******************************************************************
+#include "lmpch.h"
+#include "GeometryPool.h"
+#include "GpuMemoryAllocator.h"
+#include "UploadBatch.h"
+
+using Microsoft::WRL::ComPtr;
+
+GeometryPool::GeometryPool(ID3D12Device* device, UINT vertexStride, UploadBatch* uploads, GpuMemoryAllocator* allocator,
+    UINT vertexCapacity, UINT indexCapacity) :
+    mDevice(device),
+    mVertexStride(vertexStride),
+    mUploads(uploads),
+    mAllocator(allocator),
+    mVertexData((size_t)vertexCapacity * vertexStride),
+    mIndexData(indexCapacity),
+    mVertexAllocator(vertexCapacity, 1),
+    mIndexAllocator(indexCapacity, 1)
+{
+    assert(mUploads != nullptr);
+
+    mVertexBuffer = CreateBuffer((UINT64)vertexCapacity * vertexStride);
+    mIndexBuffer = CreateBuffer((UINT64)indexCapacity * sizeof(UINT32));
+}
+
+GeometryPool::~GeometryPool()
+{
+    if (mAllocator == nullptr)
+        return;
+
+    for (auto& retired : mRetiredBuffers)
+        mAllocator->Release(retired.second.Get());
+    mAllocator->Release(mVertexBuffer.Get());
+    mAllocator->Release(mIndexBuffer.Get());
+}
+
+ComPtr<ID3D12Resource> GeometryPool::CreateBuffer(UINT64 byteSize)
+{
+    // Created in the common state, which the first copy of the upload batch
+    // leaves for good; from then on read as vertices and indices, and only
+    // written by the copies of the upload batch.
+    ComPtr<ID3D12Resource> buffer;
+    if (mAllocator != nullptr)
+    {
+        buffer = mAllocator->CreateResource(D3D12_HEAP_TYPE_DEFAULT,
+            CD3DX12_RESOURCE_DESC::Buffer(byteSize), D3D12_RESOURCE_STATE_COMMON);
+    }
+    else
+    {
+        ThrowIfFailed(mDevice->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+            D3D12_HEAP_FLAG_NONE,
+            &CD3DX12_RESOURCE_DESC::Buffer(byteSize),
+            D3D12_RESOURCE_STATE_COMMON,
+            nullptr,
+            IID_PPV_ARGS(&buffer)));
+    }
+
+    return buffer;
+}
+
+void GeometryPool::RetireBuffer(ComPtr<ID3D12Resource>& buffer)
+{
+    mRetiredBuffers.emplace_back(mFrameFence, buffer);
+    buffer = nullptr;
+}
+
+UINT GeometryPool::Add(const void* vertices, UINT vertexCount, const void* indices, UINT indexCount, bool indices32)
+{
+    assert(vertexCount > 0 && indexCount > 0);
+
+    TlsfAllocator::Allocation vertexBlock = mVertexAllocator.Allocate(vertexCount, 1);
+    TlsfAllocator::Allocation indexBlock = mIndexAllocator.Allocate(indexCount, 1);
+    if (!vertexBlock.IsValid() || !indexBlock.IsValid())
+    {
+        if (vertexBlock.IsValid())
+            mVertexAllocator.Free(vertexBlock);
+        if (indexBlock.IsValid())
+            mIndexAllocator.Free(indexBlock);
+
+        // Packed, the free space is in one piece at the end, so only grow
+        // when the total is too small.
+        UINT vertexCapacity = VertexCapacity();
+        UINT indexCapacity = IndexCapacity();
+        while (vertexCapacity - UsedVertexCount() < vertexCount)
+            vertexCapacity *= 2;
+        while (indexCapacity - UsedIndexCount() < indexCount)
+            indexCapacity *= 2;
+
+        if (vertexCapacity != VertexCapacity() || indexCapacity != IndexCapacity())
+            ++mGrowCount;
+        Repack(vertexCapacity, indexCapacity);
+
+        vertexBlock = mVertexAllocator.Allocate(vertexCount, 1);
+        indexBlock = mIndexAllocator.Allocate(indexCount, 1);
+        assert(vertexBlock.IsValid() && indexBlock.IsValid());
+    }
+
+    UINT handle;
+    if (!mFreeMeshes.empty())
+    {
+        handle = mFreeMeshes.back();
+        mFreeMeshes.pop_back();
+    }
+    else
+    {
+        handle = (UINT)mMeshes.size();
+        mMeshes.emplace_back();
+    }
+
+    MeshSlot& slot = mMeshes[handle];
+    slot.Vertices = vertexBlock;
+    slot.Indices = indexBlock;
+    slot.Ranges.BaseVertex = (UINT)vertexBlock.Offset;
+    slot.Ranges.VertexCount = vertexCount;
+    slot.Ranges.StartIndex = (UINT)indexBlock.Offset;
+    slot.Ranges.IndexCount = indexCount;
+    slot.Live = true;
+    ++mMeshCount;
+
+    BYTE* vertexData = &mVertexData[(size_t)slot.Ranges.BaseVertex * mVertexStride];
+    UINT32* indexData = &mIndexData[slot.Ranges.StartIndex];
+    memcpy(vertexData, vertices, (size_t)vertexCount * mVertexStride);
+    if (indices32)
+    {
+        memcpy(indexData, indices, indexCount * sizeof(UINT32));
+    }
+    else
+    {
+        const UINT16* indices16 = static_cast<const UINT16*>(indices);
+        std::copy(indices16, indices16 + indexCount, indexData);
+    }
+
+    mUploads->WriteBuffer(mVertexBuffer.Get(), (UINT64)slot.Ranges.BaseVertex * mVertexStride,
+        vertexData, (UINT64)vertexCount * mVertexStride, mBufferState);
+    mUploads->WriteBuffer(mIndexBuffer.Get(), (UINT64)slot.Ranges.StartIndex * sizeof(UINT32),
+        indexData, (UINT64)indexCount * sizeof(UINT32), mBufferState);
+    mBufferState = D3D12_RESOURCE_STATE_GENERIC_READ;
+
+    return handle;
+}
+
+void GeometryPool::Free(UINT mesh)
+{
+    assert(mesh < mMeshes.size() && mMeshes[mesh].Live);
+
+    mMeshes[mesh].Live = false;
+    --mMeshCount;
+    mPendingFrees.emplace_back(mFrameFence, mesh);
+}
+
+void GeometryPool::Compact()
+{
+    Repack(VertexCapacity(), IndexCapacity());
+}
+
+// ------------------------------------------------------------------
+// A fresh allocator hands out ranges front to back, so the live meshes
+// end up packed from offset 0 and one copy per buffer uploads them all.
+// ------------------------------------------------------------------
+void GeometryPool::Repack(UINT vertexCapacity, UINT indexCapacity)
+{
+    std::vector<BYTE> vertexData((size_t)vertexCapacity * mVertexStride);
+    std::vector<UINT32> indexData(indexCapacity);
+    TlsfAllocator vertexAllocator(vertexCapacity, 1);
+    TlsfAllocator indexAllocator(indexCapacity, 1);
+
+    // Meshes waiting to be freed are only drawn by frames in flight, which
+    // keep using the old buffers.
+    for (auto& pending : mPendingFrees)
+        mFreeMeshes.push_back(pending.second);
+    mPendingFrees.clear();
+
+    for (MeshSlot& slot : mMeshes)
+    {
+        if (!slot.Live)
+            continue;
+
+        slot.Vertices = vertexAllocator.Allocate(slot.Ranges.VertexCount, 1);
+        slot.Indices = indexAllocator.Allocate(slot.Ranges.IndexCount, 1);
+        assert(slot.Vertices.IsValid() && slot.Indices.IsValid());
+
+        memcpy(&vertexData[(size_t)slot.Vertices.Offset * mVertexStride],
+            &mVertexData[(size_t)slot.Ranges.BaseVertex * mVertexStride], (size_t)slot.Ranges.VertexCount * mVertexStride);
+        std::copy_n(&mIndexData[slot.Ranges.StartIndex], slot.Ranges.IndexCount, &indexData[(size_t)slot.Indices.Offset]);
+
+        slot.Ranges.BaseVertex = (UINT)slot.Vertices.Offset;
+        slot.Ranges.StartIndex = (UINT)slot.Indices.Offset;
+    }
+
+    mVertexData.swap(vertexData);
+    mIndexData.swap(indexData);
+    mVertexAllocator = std::move(vertexAllocator);
+    mIndexAllocator = std::move(indexAllocator);
+
+    RetireBuffer(mVertexBuffer);
+    RetireBuffer(mIndexBuffer);
+    mVertexBuffer = CreateBuffer((UINT64)vertexCapacity * mVertexStride);
+    mIndexBuffer = CreateBuffer((UINT64)indexCapacity * sizeof(UINT32));
+    mBufferState = D3D12_RESOURCE_STATE_COMMON;
+
+    // Every mesh has vertices and indices, so both buffers are written or
+    // neither is.
+    if (UsedVertexCount() > 0)
+    {
+        mUploads->WriteBuffer(mVertexBuffer.Get(), 0, mVertexData.data(), (UINT64)UsedVertexCount() * mVertexStride,
+            mBufferState);
+        mUploads->WriteBuffer(mIndexBuffer.Get(), 0, mIndexData.data(), (UINT64)UsedIndexCount() * sizeof(UINT32),
+            mBufferState);
+        mBufferState = D3D12_RESOURCE_STATE_GENERIC_READ;
+    }
+}
+
+void GeometryPool::BeginFrame(UINT64 completedFence, UINT64 frameFence)
+{
+    while (!mPendingFrees.empty() && mPendingFrees.front().first <= completedFence)
+    {
+        MeshSlot& slot = mMeshes[mPendingFrees.front().second];
+        mVertexAllocator.Free(slot.Vertices);
+        mIndexAllocator.Free(slot.Indices);
+        mFreeMeshes.push_back(mPendingFrees.front().second);
+        mPendingFrees.pop_front();
+    }
+
+    while (!mRetiredBuffers.empty() && mRetiredBuffers.front().first <= completedFence)
+    {
+        if (mAllocator != nullptr)
+            mAllocator->Release(mRetiredBuffers.front().second.Get());
+        mRetiredBuffers.pop_front();
+    }
+
+    mFrameFence = frameFence;
+}
+
+D3D12_VERTEX_BUFFER_VIEW GeometryPool::VertexBufferView() const
+{
+    D3D12_VERTEX_BUFFER_VIEW vbv;
+    vbv.BufferLocation = mVertexBuffer->GetGPUVirtualAddress();
+    vbv.StrideInBytes = mVertexStride;
+    vbv.SizeInBytes = VertexCapacity() * mVertexStride;
+
+    return vbv;
+}
+
+D3D12_INDEX_BUFFER_VIEW GeometryPool::IndexBufferView() const
+{
+    D3D12_INDEX_BUFFER_VIEW ibv;
+    ibv.BufferLocation = mIndexBuffer->GetGPUVirtualAddress();
+    ibv.Format = DXGI_FORMAT_R32_UINT;
+    ibv.SizeInBytes = IndexCapacity() * sizeof(UINT32);
+
+    return ibv;
+}
@@ -0,0 +1,128 @@
+//*******************************************************************
+// GeometryPool.h:
+//
+// One vertex buffer and one index buffer shared by every mesh of a
+// vertex format. Meshes take ranges of both, found by TlsfAllocator in
+// units of vertices and indices, and draw with the absolute offsets of
+// their ranges, so everything in the pool binds its buffers once.
+// Indices are all stored as 32 bits, so meshes built with 16 bit
+// indices draw with the same index buffer as the rest.
+//
+// The pool keeps a copy of its data in system memory. Growing and
+// compacting pack the meshes that are left into new buffers filled
+// from that copy through the upload batch, which moves their ranges;
+// the old buffers stay until the frames using them have completed.
+// Freed ranges are reused once the frame they were freed in completes.
+//*******************************************************************
+
+#pragma once
+
+#include "Utils/DXUtil.h"
+#include "TlsfAllocator.h"
+
+class GeometryPool
+{
+public:
+	static const UINT DefaultVertexCapacity = 1u << 16;
+	static const UINT DefaultIndexCapacity = 1u << 18;
+	static const UINT InvalidMesh = ~0u;
+
+	// Ranges of a mesh, in vertices and indices from the start of the buffers.
+	struct Mesh
+	{
+		UINT BaseVertex = 0;
+		UINT VertexCount = 0;
+		UINT StartIndex = 0;
+		UINT IndexCount = 0;
+	};
+
+	// Data goes through uploads; the buffers are placed in heaps of
+	// allocator, if one is given.
+	GeometryPool(ID3D12Device* device, UINT vertexStride, UploadBatch* uploads, GpuMemoryAllocator* allocator = nullptr,
+		UINT vertexCapacity = DefaultVertexCapacity, UINT indexCapacity = DefaultIndexCapacity);
+	~GeometryPool();
+
+	GeometryPool(const GeometryPool& rhs) = delete;
+	GeometryPool& operator=(const GeometryPool& rhs) = delete;
+
+	// Copy a mesh into the pool and return its handle. Indices are relative
+	// to the first of its vertices. Grows the buffers when no range fits,
+	// which moves the other meshes.
+	UINT Add(const void* vertices, UINT vertexCount, const void* indices, UINT indexCount, bool indices32);
+
+	// Give the ranges of mesh back once the GPU is done with the current frame.
+	void Free(UINT mesh);
+
+	// Pack the meshes to the front of new buffers, leaving the free space in
+	// one piece. Every mesh may move; read the ranges again after.
+	void Compact();
+
+	// Called at the start of every frame, like UploadBatch::BeginFrame.
+	void BeginFrame(UINT64 completedFence, UINT64 frameFence);
+
+	const Mesh& GetMesh(UINT mesh) const { return mMeshes[mesh].Ranges; }
+
+	// Views of the whole buffers, for every mesh in the pool.
+	D3D12_VERTEX_BUFFER_VIEW VertexBufferView() const;
+	D3D12_INDEX_BUFFER_VIEW IndexBufferView() const;
+
+	// The system memory copy of the buffers.
+	const BYTE* VertexData() const { return mVertexData.data(); }
+	const UINT32* IndexData() const { return mIndexData.data(); }
+
+	UINT VertexStride() const { return mVertexStride; }
+	UINT VertexCapacity() const { return (UINT)mVertexAllocator.Size(); }
+	UINT IndexCapacity() const { return (UINT)mIndexAllocator.Size(); }
+	UINT UsedVertexCount() const { return (UINT)mVertexAllocator.UsedSize(); }
+	UINT UsedIndexCount() const { return (UINT)mIndexAllocator.UsedSize(); }
+	UINT MeshCount() const { return mMeshCount; }
+	float Fragmentation() const { return std::max(mVertexAllocator.Fragmentation(), mIndexAllocator.Fragmentation()); }
+	UINT GrowCount() const { return mGrowCount; }
+
+private:
+	struct MeshSlot
+	{
+		Mesh Ranges;
+		TlsfAllocator::Allocation Vertices;
+		TlsfAllocator::Allocation Indices;
+		bool Live = false;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> CreateBuffer(UINT64 byteSize);
+	void RetireBuffer(Microsoft::WRL::ComPtr<ID3D12Resource>& buffer);
+
+	// Move the live meshes to the front of new buffers of the capacities.
+	void Repack(UINT vertexCapacity, UINT indexCapacity);
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12Device> mDevice;
+	UINT mVertexStride;
+	UploadBatch* mUploads;
+	GpuMemoryAllocator* mAllocator;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> mVertexBuffer;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mIndexBuffer;
+
+	// State both buffers are in when the next write is staged: common until
+	// the first write, generic read after it. Writes staged after the first
+	// one of a batch share its barriers.
+	D3D12_RESOURCE_STATES mBufferState = D3D12_RESOURCE_STATE_COMMON;
+
+	std::vector<BYTE> mVertexData;
+	std::vector<UINT32> mIndexData;
+
+	TlsfAllocator mVertexAllocator;
+	TlsfAllocator mIndexAllocator;
+
+	// Meshes by handle, and handles free to reuse.
+	std::vector<MeshSlot> mMeshes;
+	std::vector<UINT> mFreeMeshes;
+	UINT mMeshCount = 0;
+
+	// Freed meshes and buffers packed out of, with the fence they wait for.
+	std::deque<std::pair<UINT64, UINT>> mPendingFrees;
+	std::deque<std::pair<UINT64, Microsoft::WRL::ComPtr<ID3D12Resource>>> mRetiredBuffers;
+
+	UINT64 mFrameFence = 0;
+	UINT mGrowCount = 0;
+};
@@ -0,0 +1,192 @@
+//*******************************************************************
+// GpuMemoryAllocator.cpp
+//*******************************************************************
+#include "lmpch.h"
+#include "GpuMemoryAllocator.h"
+
+using Microsoft::WRL::ComPtr;
+
+GpuMemoryAllocator::GpuMemoryAllocator(ID3D12Device* device, UINT64 heapSize) :
+    mDevice(device),
+    mHeapSize((heapSize + D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT - 1) & ~(UINT64)(D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT - 1))
+{
+}
+
+GpuMemoryAllocator::HeapKind GpuMemoryAllocator::GetHeapKind(const D3D12_RESOURCE_DESC& desc)
+{
+    if (desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+        return HeapKind::Buffers;
+
+    if (desc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL))
+        return HeapKind::RenderTargets;
+
+    return HeapKind::Textures;
+}
+
+D3D12_RESOURCE_ALLOCATION_INFO GpuMemoryAllocator::GetAllocationInfo(D3D12_RESOURCE_DESC& desc) const
+{
+    // Small textures may be placed at 4 KB, if the device agrees for the
+    // one at hand; otherwise they take the default alignment.
+    if (GetHeapKind(desc) == HeapKind::Textures && desc.SampleDesc.Count <= 1)
+    {
+        desc.Alignment = D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT;
+        D3D12_RESOURCE_ALLOCATION_INFO info = mDevice->GetResourceAllocationInfo(0, 1, &desc);
+        if (info.Alignment == D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT)
+            return info;
+    }
+
+    desc.Alignment = 0;
+    return mDevice->GetResourceAllocationInfo(0, 1, &desc);
+}
+
+UINT GpuMemoryAllocator::AddHeap(D3D12_HEAP_TYPE heapType, HeapKind kind)
+{
+    static const D3D12_HEAP_FLAGS heapFlags[] =
+    {
+        D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS,
+        D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES,
+        D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES,
+    };
+
+    // Multisampled targets need their heap at 4 MB.
+    UINT64 alignment = kind == HeapKind::RenderTargets ?
+        D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT : D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+
+    auto heap = std::make_unique<Heap>(heapType, kind, mHeapSize);
+    CD3DX12_HEAP_DESC heapDesc(mHeapSize, heapType, alignment, heapFlags[(int)kind]);
+    ThrowIfFailed(mDevice->CreateHeap(&heapDesc, IID_PPV_ARGS(&heap->Resource)));
+
+    mHeaps.push_back(std::move(heap));
+    return (UINT)mHeaps.size() - 1;
+}
+
+// ------------------------------------------------------------------
+// Resources
+// ------------------------------------------------------------------
+ComPtr<ID3D12Resource> GpuMemoryAllocator::CreateResource(D3D12_HEAP_TYPE heapType, const D3D12_RESOURCE_DESC& resourceDesc,
+    D3D12_RESOURCE_STATES initialState, const D3D12_CLEAR_VALUE* clearValue)
+{
+    D3D12_RESOURCE_DESC desc = resourceDesc;
+    D3D12_RESOURCE_ALLOCATION_INFO info = GetAllocationInfo(desc);
+    HeapKind kind = GetHeapKind(desc);
+
+    ComPtr<ID3D12Resource> resource;
+    if (info.SizeInBytes > mHeapSize)
+    {
+        desc.Alignment = resourceDesc.Alignment;
+        ThrowIfFailed(mDevice->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(heapType), D3D12_HEAP_FLAG_NONE,
+            &desc, initialState, clearValue, IID_PPV_ARGS(&resource)));
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        ++mCommittedCount;
+        return resource;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    Placement placement;
+    placement.Heap = (UINT)mHeaps.size();
+    for (UINT i = 0; i < (UINT)mHeaps.size(); ++i)
+    {
+        Heap& heap = *mHeaps[i];
+        if (heap.Type != heapType || heap.Kind != kind)
+            continue;
+
+        placement.Block = heap.Allocator.Allocate(info.SizeInBytes, info.Alignment);
+        if (placement.Block.IsValid())
+        {
+            placement.Heap = i;
+            break;
+        }
+    }
+
+    if (placement.Heap == (UINT)mHeaps.size())
+    {
+        placement.Heap = AddHeap(heapType, kind);
+        placement.Block = mHeaps[placement.Heap]->Allocator.Allocate(info.SizeInBytes, info.Alignment);
+        assert(placement.Block.IsValid());
+    }
+
+    Heap& heap = *mHeaps[placement.Heap];
+    HRESULT hr = mDevice->CreatePlacedResource(heap.Resource.Get(), placement.Block.Offset,
+        &desc, initialState, clearValue, IID_PPV_ARGS(&resource));
+    if (FAILED(hr))
+        heap.Allocator.Free(placement.Block);
+    ThrowIfFailed(hr);
+
+    mPlacements[resource.Get()] = placement;
+    return resource;
+}
+
+void GpuMemoryAllocator::Release(ID3D12Resource* resource)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    // Committed resources free their own memory.
+    auto placement = mPlacements.find(resource);
+    if (placement == mPlacements.end())
+        return;
+
+    mPendingReleases.emplace_back(mFrameFence, placement->second);
+    mPlacements.erase(placement);
+}
+
+void GpuMemoryAllocator::BeginFrame(UINT64 completedFence, UINT64 frameFence)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    // Releases are queued with increasing fences.
+    while (!mPendingReleases.empty() && mPendingReleases.front().first <= completedFence)
+    {
+        const Placement& placement = mPendingReleases.front().second;
+        mHeaps[placement.Heap]->Allocator.Free(placement.Block);
+        mPendingReleases.pop_front();
+    }
+
+    mFrameFence = frameFence;
+}
+
+// ------------------------------------------------------------------
+// Statistics
+// ------------------------------------------------------------------
+std::pmr::vector<GpuMemoryAllocator::HeapStats> GpuMemoryAllocator::GetHeapStats(std::pmr::memory_resource* memory) const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    std::pmr::vector<HeapStats> stats(memory);
+    stats.reserve(mHeaps.size());
+    for (const auto& heap : mHeaps)
+    {
+        HeapStats heapStats;
+        heapStats.Type = heap->Type;
+        heapStats.Size = heap->Allocator.Size();
+        heapStats.UsedSize = heap->Allocator.UsedSize();
+        heapStats.LargestFreeBlock = heap->Allocator.LargestFreeBlock();
+        heapStats.AllocationCount = heap->Allocator.AllocationCount();
+        heapStats.Fragmentation = heap->Allocator.Fragmentation();
+        stats.push_back(heapStats);
+    }
+    return stats;
+}
+
+UINT GpuMemoryAllocator::PlacedCount() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return (UINT)mPlacements.size();
+}
+
+UINT GpuMemoryAllocator::CommittedCount() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mCommittedCount;
+}
+
+UINT64 GpuMemoryAllocator::PendingReleaseSize() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    UINT64 size = 0;
+    for (const auto& release : mPendingReleases)
+        size += release.second.Block.Size;
+    return size;
+}
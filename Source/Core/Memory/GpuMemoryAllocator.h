@@ -0,0 +1,112 @@
+//*******************************************************************
+// GpuMemoryAllocator.h:
+//
+// Places resources in a few large heaps instead of giving each its own
+// committed heap. Every heap is split up by a TlsfAllocator; resources
+// take the size and alignment the device asks for, 64 KB for buffers
+// and most textures, 4 KB for small textures, 4 MB for MSAA targets.
+// Heaps hold one kind of resource each (buffers, textures, or render
+// target and depth textures), which every resource heap tier accepts.
+//
+// Released resources may still be used by frames in flight, so their
+// memory only returns to the heap once the fence of the frame they
+// were released in has completed.
+//*******************************************************************
+
+#pragma once
+
+#include "Utils/DXUtil.h"
+#include "TlsfAllocator.h"
+
+class GpuMemoryAllocator
+{
+public:
+	static const UINT64 DefaultHeapSize = 64ull << 20;
+
+	struct HeapStats
+	{
+		D3D12_HEAP_TYPE Type;
+		UINT64 Size;
+		UINT64 UsedSize;
+		UINT64 LargestFreeBlock;
+		UINT AllocationCount;
+		float Fragmentation;
+	};
+
+	GpuMemoryAllocator(ID3D12Device* device, UINT64 heapSize = DefaultHeapSize);
+
+	GpuMemoryAllocator(const GpuMemoryAllocator& rhs) = delete;
+	GpuMemoryAllocator& operator=(const GpuMemoryAllocator& rhs) = delete;
+
+	// Create a resource placed in a heap of heapType, adding a heap when
+	// none has room. Resources larger than a heap are committed.
+	Microsoft::WRL::ComPtr<ID3D12Resource> CreateResource(D3D12_HEAP_TYPE heapType, const D3D12_RESOURCE_DESC& desc,
+		D3D12_RESOURCE_STATES initialState, const D3D12_CLEAR_VALUE* clearValue = nullptr);
+
+	// Give back the memory of a resource created here, once the GPU is done
+	// with the current frame. The caller drops its references as usual;
+	// memory of resources that are never released stays in use.
+	void Release(ID3D12Resource* resource);
+
+	// Called at the start of every frame: memory released in frames up to
+	// completedFence becomes free, and releases from now on wait for
+	// frameFence, the fence the frame will signal. Releases before the
+	// first call wait for nothing, so initialization has to be flushed.
+	void BeginFrame(UINT64 completedFence, UINT64 frameFence);
+
+	// The list is allocated from memory, which the GUI points at the frame
+	// arena.
+	std::pmr::vector<HeapStats> GetHeapStats(std::pmr::memory_resource* memory = std::pmr::get_default_resource()) const;
+	UINT PlacedCount() const;
+	UINT CommittedCount() const;	// Created too large for a heap
+	UINT64 PendingReleaseSize() const;
+
+private:
+	enum class HeapKind : int
+	{
+		Buffers = 0,
+		Textures,
+		RenderTargets,
+		Count
+	};
+
+	struct Heap
+	{
+		Microsoft::WRL::ComPtr<ID3D12Heap> Resource;
+		D3D12_HEAP_TYPE Type;
+		HeapKind Kind;
+		TlsfAllocator Allocator;
+
+		Heap(D3D12_HEAP_TYPE type, HeapKind kind, UINT64 size) :
+			Type(type), Kind(kind), Allocator(size, D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT) {}
+	};
+
+	struct Placement
+	{
+		UINT Heap;
+		TlsfAllocator::Allocation Block;
+	};
+
+	static HeapKind GetHeapKind(const D3D12_RESOURCE_DESC& desc);
+
+	// Size and alignment of desc, with the small alignment where the
+	// device allows it. desc.Alignment is set to what was used.
+	D3D12_RESOURCE_ALLOCATION_INFO GetAllocationInfo(D3D12_RESOURCE_DESC& desc) const;
+
+	UINT AddHeap(D3D12_HEAP_TYPE heapType, HeapKind kind);
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12Device> mDevice;
+	UINT64 mHeapSize;
+
+	// Resources may be created and released on any thread.
+	mutable std::mutex mMutex;
+
+	std::vector<std::unique_ptr<Heap>> mHeaps;
+	std::unordered_map<ID3D12Resource*, Placement> mPlacements;
+	UINT mCommittedCount = 0;
+
+	// Released placements in release order, with the fence they wait for.
+	std::deque<std::pair<UINT64, Placement>> mPendingReleases;
+	UINT64 mFrameFence = 0;
+};
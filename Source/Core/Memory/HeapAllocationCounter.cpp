@@ -0,0 +1,77 @@
+//*******************************************************************
+// HeapAllocationCounter.cpp
+//*******************************************************************
+#include "lmpch.h"
+#include "HeapAllocationCounter.h"
+
+#if defined(DEBUG) || defined(_DEBUG)
+
+namespace
+{
+    std::atomic<UINT64> sCount(0);
+
+    void* CountedMalloc(size_t size, size_t alignment) noexcept
+    {
+        sCount.fetch_add(1, std::memory_order_relaxed);
+
+        // Every allocation gets an address of its own, even an empty one.
+        size = std::max<size_t>(size, 1);
+        if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+            return _aligned_malloc(size, alignment);
+        return malloc(size);
+    }
+
+    void* CountedNew(size_t size, size_t alignment)
+    {
+        void* p = CountedMalloc(size, alignment);
+        if (p == nullptr)
+            throw std::bad_alloc();
+        return p;
+    }
+}
+
+UINT64 HeapAllocationCounter::Count()
+{
+    return sCount.load(std::memory_order_relaxed);
+}
+
+void* operator new(size_t size) { return CountedNew(size, 0); }
+void* operator new[](size_t size) { return CountedNew(size, 0); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return CountedMalloc(size, 0); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return CountedMalloc(size, 0); }
+
+void* operator new(size_t size, std::align_val_t alignment) { return CountedNew(size, (size_t)alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return CountedNew(size, (size_t)alignment); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return CountedMalloc(size, (size_t)alignment); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return CountedMalloc(size, (size_t)alignment); }
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { free(p); }
+
+// Over-aligned blocks came from _aligned_malloc.
+void operator delete(void* p, std::align_val_t alignment) noexcept
+{
+    if ((size_t)alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+        _aligned_free(p);
+    else
+        free(p);
+}
+
+void operator delete[](void* p, std::align_val_t alignment) noexcept { operator delete(p, alignment); }
+void operator delete(void* p, size_t, std::align_val_t alignment) noexcept { operator delete(p, alignment); }
+void operator delete[](void* p, size_t, std::align_val_t alignment) noexcept { operator delete(p, alignment); }
+void operator delete(void* p, std::align_val_t alignment, const std::nothrow_t&) noexcept { operator delete(p, alignment); }
+void operator delete[](void* p, std::align_val_t alignment, const std::nothrow_t&) noexcept { operator delete(p, alignment); }
+
+#else
+
+UINT64 HeapAllocationCounter::Count()
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,25 @@
+//*******************************************************************
+// HeapAllocationCounter.h:
+//
+// Counts the calls to operator new made by the engine, to check that a
+// steady frame leaves the heap alone. Debug builds replace the global
+// operator new and delete for this; release builds keep the ones of
+// the runtime and count nothing. Allocations made inside the D3D12 and
+// DXGI runtimes go through their own and are never counted.
+//*******************************************************************
+
+#pragma once
+
+class HeapAllocationCounter
+{
+public:
+#if defined(DEBUG) || defined(_DEBUG)
+	static const bool Enabled = true;
+#else
+	static const bool Enabled = false;
+#endif
+
+	// Allocations on every thread since startup. Linking this in is what
+	// brings in the replaced operators.
+	static UINT64 Count();
+};
@@ -0,0 +1,64 @@
+//*******************************************************************
+// RingAllocator.cpp
+//*******************************************************************
+#include "lmpch.h"
+#include "RingAllocator.h"
+
+RingAllocator::RingAllocator(UINT64 size) :
+    mSize(size)
+{
+}
+
+UINT64 RingAllocator::Allocate(UINT64 size, UINT64 alignment)
+{
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    assert(mSize % alignment == 0);
+
+    // Empty allocations take a byte, so every allocation has an address
+    // inside the ring.
+    size = std::max<UINT64>(size, 1);
+    if (size > mSize)
+        return InvalidOffset;
+
+    // An empty ring starts over at the front, so nothing is lost to
+    // wrapping.
+    if (mHead == mTail)
+    {
+        mHead = (mHead + mSize - 1) / mSize * mSize;
+        mTail = mHead;
+    }
+
+    UINT64 offset = mHead % mSize;
+    UINT64 alignedOffset = (offset + alignment - 1) & ~(alignment - 1);
+    UINT64 padding = alignedOffset - offset;
+
+    // Skip to the front, which is aligned to anything.
+    if (alignedOffset + size > mSize)
+    {
+        padding = mSize - offset;
+        alignedOffset = 0;
+    }
+
+    if (mHead + padding + size - mTail > mSize)
+        return InvalidOffset;
+
+    mHead += padding + size;
+    return alignedOffset;
+}
+
+void RingAllocator::EndFrame(UINT64 fence)
+{
+    assert(mFrames.empty() || mFrames.back().first <= fence);
+
+    mFrames.emplace_back(fence, mHead);
+}
+
+void RingAllocator::Reclaim(UINT64 completedFence)
+{
+    while (!mFrames.empty() && mFrames.front().first <= completedFence)
+    {
+        // The head may have moved on past an empty ring restarting.
+        mTail = std::max(mTail, mFrames.front().second);
+        mFrames.pop_front();
+    }
+}
@@ -0,0 +1,45 @@
+//*******************************************************************
+// RingAllocator.h:
+//
+// Bump allocator over a range of offsets that is reused in a circle.
+// Allocations are made at the head and only ever freed a whole frame
+// at a time, from the tail, once the fence of that frame has completed.
+// An allocation that does not fit before the end of the range skips the
+// rest and wraps to the front. Like TlsfAllocator it never touches the
+// memory it hands out.
+//*******************************************************************
+
+#pragma once
+
+class RingAllocator
+{
+public:
+	static const UINT64 InvalidOffset = ~0ull;
+
+	explicit RingAllocator(UINT64 size);
+
+	// alignment is a power of two the size is a multiple of. Returns
+	// InvalidOffset when the frames in flight leave no room for size.
+	UINT64 Allocate(UINT64 size, UINT64 alignment);
+
+	// Everything allocated since the last call belongs to the frame that
+	// signals fence.
+	void EndFrame(UINT64 fence);
+
+	// Free the frames whose fence has completed.
+	void Reclaim(UINT64 completedFence);
+
+	UINT64 Size() const { return mSize; }
+	UINT64 UsedSize() const { return mHead - mTail; }	// Wasted ends included
+	UINT FramesInFlight() const { return (UINT)mFrames.size(); }
+
+private:
+	UINT64 mSize;
+
+	// Positions only ever grow; the offset of one is it modulo the size.
+	UINT64 mHead = 0;
+	UINT64 mTail = 0;
+
+	// Fence and head position at the end of every frame in flight.
+	std::deque<std::pair<UINT64, UINT64>> mFrames;
+};
@@ -0,0 +1,418 @@
+//*******************************************************************
+// TlsfAllocator.cpp
+//*******************************************************************
+#include "lmpch.h"
+#include "TlsfAllocator.h"
+
+namespace
+{
+    UINT64 AlignUp(UINT64 value, UINT64 alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    bool IsPowerOfTwo(UINT64 value)
+    {
+        return value != 0 && (value & (value - 1)) == 0;
+    }
+
+    UINT Log2(UINT64 value)
+    {
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return (UINT)index;
+    }
+}
+
+TlsfAllocator::TlsfAllocator(UINT64 size, UINT64 granularity) :
+    mSize(size & ~(granularity - 1)),
+    mGranularity(granularity)
+{
+    assert(IsPowerOfTwo(granularity));
+
+    for (auto& lists : mFreeLists)
+    {
+        for (UINT& list : lists)
+            list = NullBlock;
+    }
+
+    if (mSize != 0)
+    {
+        UINT block = NewBlock();
+        mBlocks[block].Size = mSize;
+        InsertFreeBlock(block);
+    }
+}
+
+// ------------------------------------------------------------------
+// Size classes. Sizes are mapped in units of the granularity, so the
+// finest classes are not spent on sizes that never occur.
+// ------------------------------------------------------------------
+void TlsfAllocator::MapInsert(UINT64 size, UINT& firstLevel, UINT& secondLevel)
+{
+    if (size < SecondLevelCount)
+    {
+        firstLevel = 0;
+        secondLevel = (UINT)size;
+        return;
+    }
+
+    UINT log = Log2(size);
+    firstLevel = log - SecondLevelBits + 1;
+    secondLevel = (UINT)(size >> (log - SecondLevelBits)) - SecondLevelCount;
+}
+
+void TlsfAllocator::MapSearch(UINT64 size, UINT& firstLevel, UINT& secondLevel)
+{
+    // Round up to the next class boundary, so every block of the class
+    // found is large enough.
+    if (size >= SecondLevelCount)
+        size += (1ull << (Log2(size) - SecondLevelBits)) - 1;
+
+    MapInsert(size, firstLevel, secondLevel);
+}
+
+// ------------------------------------------------------------------
+// Allocation
+// ------------------------------------------------------------------
+TlsfAllocator::Allocation TlsfAllocator::Allocate(UINT64 size, UINT64 alignment)
+{
+    assert(IsPowerOfTwo(alignment));
+
+    size = AlignUp(std::max<UINT64>(size, 1), mGranularity);
+    alignment = std::max(alignment, mGranularity);
+
+    // Any block of at least this size can hold the allocation at the
+    // alignment, whatever its offset.
+    UINT64 searchSize = size + alignment - mGranularity;
+    if (size > mSize || searchSize > mSize)
+        return Allocation();
+
+    UINT shift = Log2(mGranularity);
+    UINT firstLevel, secondLevel;
+    MapSearch(searchSize >> shift, firstLevel, secondLevel);
+
+    UINT block = FindFreeBlock(firstLevel, secondLevel);
+    if (block == NullBlock)
+    {
+        // The search rounds up to the next class, which skips blocks of
+        // the request's own class that may still fit. Nearly full
+        // allocators depend on those, so try them one by one.
+        MapInsert(size >> shift, firstLevel, secondLevel);
+        for (UINT candidate = mFreeLists[firstLevel][secondLevel]; candidate != NullBlock; candidate = mBlocks[candidate].NextFree)
+        {
+            const Block& b = mBlocks[candidate];
+            if (AlignUp(b.Offset, alignment) + size <= b.Offset + b.Size)
+            {
+                block = candidate;
+                break;
+            }
+        }
+
+        if (block == NullBlock)
+            return Allocation();
+    }
+
+    RemoveFreeBlock(block);
+
+    // The block before a free block is in use, so the padding in front
+    // stays a free block of its own.
+    UINT64 padding = AlignUp(mBlocks[block].Offset, alignment) - mBlocks[block].Offset;
+    if (padding != 0)
+        InsertFreeBlock(SplitFront(block, padding));
+
+    // The rest goes back to the free lists.
+    if (mBlocks[block].Size > size)
+    {
+        UINT front = SplitFront(block, size);
+        InsertFreeBlock(block);
+        block = front;
+    }
+
+    mUsedSize += mBlocks[block].Size;
+    ++mAllocationCount;
+
+    Allocation allocation;
+    allocation.Offset = mBlocks[block].Offset;
+    allocation.Size = mBlocks[block].Size;
+    allocation.Block = block;
+    return allocation;
+}
+
+void TlsfAllocator::Free(const Allocation& allocation)
+{
+    assert(allocation.IsValid());
+
+    UINT block = allocation.Block;
+    assert(block < mBlocks.size() && !mBlocks[block].Free && mBlocks[block].Offset == allocation.Offset);
+
+    mUsedSize -= mBlocks[block].Size;
+    --mAllocationCount;
+
+    UINT prev = mBlocks[block].PrevPhysical;
+    if (prev != NullBlock && mBlocks[prev].Free)
+    {
+        RemoveFreeBlock(prev);
+        MergeNext(prev);
+        block = prev;
+    }
+
+    UINT next = mBlocks[block].NextPhysical;
+    if (next != NullBlock && mBlocks[next].Free)
+    {
+        RemoveFreeBlock(next);
+        MergeNext(block);
+    }
+
+    InsertFreeBlock(block);
+}
+
+// ------------------------------------------------------------------
+// Free lists
+// ------------------------------------------------------------------
+UINT TlsfAllocator::FindFreeBlock(UINT firstLevel, UINT secondLevel) const
+{
+    if (firstLevel >= FirstLevelCount)
+        return NullBlock;
+
+    unsigned long index;
+    UINT secondLevelMap = mSecondLevelMaps[firstLevel] & (~0u << secondLevel);
+    if (secondLevelMap == 0)
+    {
+        // No class of this level is large enough; take the first level
+        // above with any free block.
+        if (firstLevel + 1 >= FirstLevelCount)
+            return NullBlock;
+
+        UINT64 firstLevelMap = mFirstLevelMap & (~0ull << (firstLevel + 1));
+        if (firstLevelMap == 0)
+            return NullBlock;
+
+        _BitScanForward64(&index, firstLevelMap);
+        firstLevel = (UINT)index;
+        secondLevelMap = mSecondLevelMaps[firstLevel];
+    }
+
+    _BitScanForward(&index, secondLevelMap);
+    return mFreeLists[firstLevel][index];
+}
+
+void TlsfAllocator::InsertFreeBlock(UINT block)
+{
+    UINT firstLevel, secondLevel;
+    MapInsert(mBlocks[block].Size >> Log2(mGranularity), firstLevel, secondLevel);
+
+    UINT& head = mFreeLists[firstLevel][secondLevel];
+
+    Block& b = mBlocks[block];
+    b.Free = true;
+    b.PrevFree = NullBlock;
+    b.NextFree = head;
+    if (head != NullBlock)
+        mBlocks[head].PrevFree = block;
+    head = block;
+
+    mSecondLevelMaps[firstLevel] |= 1u << secondLevel;
+    mFirstLevelMap |= 1ull << firstLevel;
+}
+
+void TlsfAllocator::RemoveFreeBlock(UINT block)
+{
+    UINT firstLevel, secondLevel;
+    MapInsert(mBlocks[block].Size >> Log2(mGranularity), firstLevel, secondLevel);
+
+    Block& b = mBlocks[block];
+    if (b.PrevFree != NullBlock)
+        mBlocks[b.PrevFree].NextFree = b.NextFree;
+    else
+        mFreeLists[firstLevel][secondLevel] = b.NextFree;
+    if (b.NextFree != NullBlock)
+        mBlocks[b.NextFree].PrevFree = b.PrevFree;
+
+    b.Free = false;
+    b.PrevFree = NullBlock;
+    b.NextFree = NullBlock;
+
+    if (mFreeLists[firstLevel][secondLevel] == NullBlock)
+    {
+        mSecondLevelMaps[firstLevel] &= ~(1u << secondLevel);
+        if (mSecondLevelMaps[firstLevel] == 0)
+            mFirstLevelMap &= ~(1ull << firstLevel);
+    }
+}
+
+// ------------------------------------------------------------------
+// Blocks
+// ------------------------------------------------------------------
+UINT TlsfAllocator::NewBlock()
+{
+    if (!mUnusedBlocks.empty())
+    {
+        UINT block = mUnusedBlocks.back();
+        mUnusedBlocks.pop_back();
+        mBlocks[block] = Block();
+        return block;
+    }
+
+    mBlocks.emplace_back();
+    return (UINT)mBlocks.size() - 1;
+}
+
+void TlsfAllocator::DeleteBlock(UINT block)
+{
+    mBlocks[block] = Block();
+    mUnusedBlocks.push_back(block);
+}
+
+UINT TlsfAllocator::SplitFront(UINT block, UINT64 size)
+{
+    assert(size < mBlocks[block].Size);
+
+    // May grow mBlocks, so no references are taken before.
+    UINT front = NewBlock();
+
+    Block& b = mBlocks[block];
+    Block& f = mBlocks[front];
+    f.Offset = b.Offset;
+    f.Size = size;
+    f.PrevPhysical = b.PrevPhysical;
+    f.NextPhysical = block;
+    if (b.PrevPhysical != NullBlock)
+        mBlocks[b.PrevPhysical].NextPhysical = front;
+
+    b.PrevPhysical = front;
+    b.Offset += size;
+    b.Size -= size;
+
+    return front;
+}
+
+void TlsfAllocator::MergeNext(UINT block)
+{
+    UINT next = mBlocks[block].NextPhysical;
+
+    Block& b = mBlocks[block];
+    const Block& n = mBlocks[next];
+    b.Size += n.Size;
+    b.NextPhysical = n.NextPhysical;
+    if (n.NextPhysical != NullBlock)
+        mBlocks[n.NextPhysical].PrevPhysical = block;
+
+    DeleteBlock(next);
+}
+
+// ------------------------------------------------------------------
+// Statistics
+// ------------------------------------------------------------------
+UINT64 TlsfAllocator::LargestFreeBlock() const
+{
+    if (mFirstLevelMap == 0)
+        return 0;
+
+    unsigned long firstLevel, secondLevel;
+    _BitScanReverse64(&firstLevel, mFirstLevelMap);
+    _BitScanReverse(&secondLevel, mSecondLevelMaps[firstLevel]);
+
+    // Sizes within a class differ, so look at all of its blocks.
+    UINT64 largest = 0;
+    for (UINT block = mFreeLists[firstLevel][secondLevel]; block != NullBlock; block = mBlocks[block].NextFree)
+        largest = std::max(largest, mBlocks[block].Size);
+    return largest;
+}
+
+float TlsfAllocator::Fragmentation() const
+{
+    UINT64 freeSize = FreeSize();
+    if (freeSize == 0)
+        return 0.0f;
+
+    return 1.0f - (float)((double)LargestFreeBlock() / (double)freeSize);
+}
+
+bool TlsfAllocator::Validate() const
+{
+    std::vector<bool> unused(mBlocks.size(), false);
+    for (UINT block : mUnusedBlocks)
+        unused[block] = true;
+
+    // Physical order: the blocks tile the range without gaps, and free
+    // blocks are never adjacent.
+    UINT head = NullBlock;
+    UINT liveCount = 0;
+    for (UINT i = 0; i < (UINT)mBlocks.size(); ++i)
+    {
+        if (unused[i])
+            continue;
+
+        ++liveCount;
+        if (mBlocks[i].PrevPhysical == NullBlock)
+        {
+            if (head != NullBlock)
+                return false;
+            head = i;
+        }
+    }
+    if (mSize == 0)
+        return liveCount == 0;
+    if (head == NullBlock)
+        return false;
+
+    UINT64 offset = 0;
+    UINT64 usedSize = 0;
+    UINT visited = 0;
+    UINT allocationCount = 0;
+    UINT freeCount = 0;
+    for (UINT block = head, prev = NullBlock; block != NullBlock; prev = block, block = mBlocks[block].NextPhysical)
+    {
+        const Block& b = mBlocks[block];
+        if (unused[block] || b.PrevPhysical != prev || b.Offset != offset || b.Size == 0 || (b.Size & (mGranularity - 1)) != 0)
+            return false;
+        if (b.Free && prev != NullBlock && mBlocks[prev].Free)
+            return false;
+
+        if (b.Free)
+        {
+            ++freeCount;
+        }
+        else
+        {
+            usedSize += b.Size;
+            ++allocationCount;
+        }
+
+        offset += b.Size;
+        if (++visited > liveCount)
+            return false;
+    }
+    if (offset != mSize || visited != liveCount || usedSize != mUsedSize || allocationCount != mAllocationCount)
+        return false;
+
+    // Free lists: every free block is in the list of its class, and the
+    // bitmaps mark exactly the lists that are not empty.
+    UINT listedCount = 0;
+    for (UINT firstLevel = 0; firstLevel < FirstLevelCount; ++firstLevel)
+    {
+        if (((mFirstLevelMap >> firstLevel) & 1) != (mSecondLevelMaps[firstLevel] != 0 ? 1u : 0u))
+            return false;
+
+        for (UINT secondLevel = 0; secondLevel < SecondLevelCount; ++secondLevel)
+        {
+            UINT list = mFreeLists[firstLevel][secondLevel];
+            if (((mSecondLevelMaps[firstLevel] >> secondLevel) & 1) != (list != NullBlock ? 1u : 0u))
+                return false;
+
+            for (UINT block = list, prev = NullBlock; block != NullBlock; prev = block, block = mBlocks[block].NextFree)
+            {
+                const Block& b = mBlocks[block];
+                UINT f, s;
+                MapInsert(b.Size >> Log2(mGranularity), f, s);
+                if (unused[block] || !b.Free || b.PrevFree != prev || f != firstLevel || s != secondLevel)
+                    return false;
+                if (++listedCount > freeCount)
+                    return false;
+            }
+        }
+    }
+
+    return listedCount == freeCount;
+}
@@ -0,0 +1,109 @@
+//*******************************************************************
+// TlsfAllocator.h:
+//
+// Two-level segregated fit allocator over a range of offsets. It never
+// touches the memory it hands out, so it can manage a GPU heap as well
+// as anything else addressed by offset.
+//
+// Free blocks are kept in lists by size class: a first level per power
+// of two, split linearly into SecondLevelCount classes. Two bitmaps
+// tell which lists are non-empty, so finding a free block that fits
+// and returning one are constant time. Free neighbours are merged on
+// the spot, so no two free blocks are ever adjacent.
+//*******************************************************************
+
+#pragma once
+
+class TlsfAllocator
+{
+public:
+	static const UINT64 InvalidOffset = ~0ull;
+
+	struct Allocation
+	{
+		UINT64 Offset = InvalidOffset;
+		UINT64 Size = 0;	// Rounded up to the granularity
+		UINT Block = ~0u;
+
+		bool IsValid() const { return Offset != InvalidOffset; }
+	};
+
+	// Sizes and offsets are handed out in multiples of granularity, a
+	// power of two.
+	TlsfAllocator(UINT64 size, UINT64 granularity);
+
+	// alignment is a power of two. Returns an invalid allocation when no
+	// free block can hold the size at that alignment.
+	Allocation Allocate(UINT64 size, UINT64 alignment);
+	void Free(const Allocation& allocation);
+
+	UINT64 Size() const { return mSize; }
+	UINT64 UsedSize() const { return mUsedSize; }
+	UINT64 FreeSize() const { return mSize - mUsedSize; }
+	UINT AllocationCount() const { return mAllocationCount; }
+	UINT64 LargestFreeBlock() const;
+
+	// Share of the free memory that is not in the largest free block: 0
+	// when it is all in one piece, approaching 1 as it is scattered.
+	float Fragmentation() const;
+
+	// Walk every block and free list and check they agree. Slow; meant for
+	// stress tests and debugging.
+	bool Validate() const;
+
+private:
+	static const UINT SecondLevelBits = 4;
+	static const UINT SecondLevelCount = 1u << SecondLevelBits;
+	static const UINT FirstLevelCount = 64 - SecondLevelBits + 1;
+	static const UINT NullBlock = ~0u;
+
+	struct Block
+	{
+		UINT64 Offset = 0;
+		UINT64 Size = 0;
+
+		// Neighbours in address order.
+		UINT PrevPhysical = NullBlock;
+		UINT NextPhysical = NullBlock;
+
+		// Neighbours in the free list of the size class, if free.
+		UINT PrevFree = NullBlock;
+		UINT NextFree = NullBlock;
+
+		bool Free = false;
+	};
+
+	// Size class of a block of size.
+	static void MapInsert(UINT64 size, UINT& firstLevel, UINT& secondLevel);
+
+	// First size class all of whose blocks can hold size.
+	static void MapSearch(UINT64 size, UINT& firstLevel, UINT& secondLevel);
+
+	UINT FindFreeBlock(UINT firstLevel, UINT secondLevel) const;
+	void InsertFreeBlock(UINT block);
+	void RemoveFreeBlock(UINT block);
+
+	UINT NewBlock();
+	void DeleteBlock(UINT block);
+
+	// Carve a block of size off the front of block, which keeps the rest.
+	// Returns the new block in front.
+	UINT SplitFront(UINT block, UINT64 size);
+
+	// Merge next into block, which must be its physical predecessor.
+	void MergeNext(UINT block);
+
+private:
+	UINT64 mSize;
+	UINT64 mGranularity;
+	UINT64 mUsedSize = 0;
+	UINT mAllocationCount = 0;
+
+	// Blocks are referred to by index; unused slots are recycled.
+	std::vector<Block> mBlocks;
+	std::vector<UINT> mUnusedBlocks;
+
+	UINT64 mFirstLevelMap = 0;
+	UINT mSecondLevelMaps[FirstLevelCount] = {};
+	UINT mFreeLists[FirstLevelCount][SecondLevelCount];
+};
@@ -0,0 +1,250 @@
+//*******************************************************************
+// UploadBatch.cpp
+//*******************************************************************
+#include "lmpch.h"
+#include "UploadBatch.h"
+#include "GpuMemoryAllocator.h"
+#include "FrameArena.h"
+
+using Microsoft::WRL::ComPtr;
+
+UploadBatch::UploadBatch(ID3D12Device* device, GpuMemoryAllocator* allocator, UINT64 pageSize) :
+    mDevice(device),
+    mAllocator(allocator),
+    mPageSize(pageSize)
+{
+}
+
+UploadBatch::~UploadBatch()
+{
+    for (auto& retired : mRetiredPages)
+        ReleasePage(retired.second);
+    for (auto& page : mPages)
+        ReleasePage(page);
+}
+
+// ------------------------------------------------------------------
+// Pages are only ever bumped through; a request that does not fit in
+// the last one opens a new page, large enough if it is a big texture.
+// ------------------------------------------------------------------
+UploadBatch::Page& UploadBatch::Allocate(UINT64 size, UINT64 alignment, UINT64& offset)
+{
+    if (!mPages.empty())
+    {
+        Page& page = mPages.back();
+        offset = (page.UsedSize + alignment - 1) & ~(alignment - 1);
+        if (offset + size <= page.Size)
+        {
+            page.UsedSize = offset + size;
+            return page;
+        }
+    }
+
+    Page page;
+    page.Size = std::max(mPageSize, (size + D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT - 1) &
+        ~(UINT64)(D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT - 1));
+
+    if (mAllocator != nullptr)
+    {
+        page.Resource = mAllocator->CreateResource(D3D12_HEAP_TYPE_UPLOAD,
+            CD3DX12_RESOURCE_DESC::Buffer(page.Size), D3D12_RESOURCE_STATE_GENERIC_READ);
+    }
+    else
+    {
+        ThrowIfFailed(mDevice->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+            D3D12_HEAP_FLAG_NONE,
+            &CD3DX12_RESOURCE_DESC::Buffer(page.Size),
+            D3D12_RESOURCE_STATE_GENERIC_READ,
+            nullptr,
+            IID_PPV_ARGS(&page.Resource)));
+    }
+
+    CD3DX12_RANGE readRange(0, 0);
+    ThrowIfFailed(page.Resource->Map(0, &readRange, reinterpret_cast<void**>(&page.MappedData)));
+
+    offset = 0;
+    page.UsedSize = size;
+    mStagingSize += page.Size;
+    mPages.push_back(page);
+    return mPages.back();
+}
+
+void UploadBatch::ReleasePage(Page& page)
+{
+    page.Resource->Unmap(0, nullptr);
+    if (mAllocator != nullptr)
+        mAllocator->Release(page.Resource.Get());
+
+    mStagingSize -= page.Size;
+    page.Resource = nullptr;
+    page.MappedData = nullptr;
+}
+
+void UploadBatch::AddDestination(ID3D12Resource* resource, D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after)
+{
+    // A resource may only be transitioned from the state it is in, so
+    // repeated writes to one share its barriers.
+    for (const Destination& destination : mDestinations)
+    {
+        if (destination.Resource.Get() == resource)
+        {
+            assert(destination.StateAfter == after);
+            return;
+        }
+    }
+
+    mDestinations.push_back({ resource, before, after });
+}
+
+ComPtr<ID3D12Resource> UploadBatch::CreateBuffer(const void* data, UINT64 byteSize, D3D12_RESOURCE_STATES finalState)
+{
+    ComPtr<ID3D12Resource> buffer;
+    if (mAllocator != nullptr)
+    {
+        buffer = mAllocator->CreateResource(D3D12_HEAP_TYPE_DEFAULT,
+            CD3DX12_RESOURCE_DESC::Buffer(byteSize), D3D12_RESOURCE_STATE_COMMON);
+    }
+    else
+    {
+        ThrowIfFailed(mDevice->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+            D3D12_HEAP_FLAG_NONE,
+            &CD3DX12_RESOURCE_DESC::Buffer(byteSize),
+            D3D12_RESOURCE_STATE_COMMON,
+            nullptr,
+            IID_PPV_ARGS(&buffer)));
+    }
+
+    UINT64 offset;
+    Page& page = Allocate(byteSize, 16, offset);
+    memcpy(page.MappedData + offset, data, (size_t)byteSize);
+
+    Copy copy = {};
+    copy.Destination = buffer.Get();
+    copy.Source = page.Resource.Get();
+    copy.SourceOffset = offset;
+    copy.Size = byteSize;
+    mCopies.push_back(copy);
+
+    AddDestination(buffer.Get(), D3D12_RESOURCE_STATE_COMMON, finalState);
+    mUploadedSize += byteSize;
+
+    return buffer;
+}
+
+void UploadBatch::WriteBuffer(ID3D12Resource* buffer, UINT64 offset, const void* data, UINT64 byteSize,
+    D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after)
+{
+    UINT64 sourceOffset;
+    Page& page = Allocate(byteSize, 16, sourceOffset);
+    memcpy(page.MappedData + sourceOffset, data, (size_t)byteSize);
+
+    Copy copy = {};
+    copy.Destination = buffer;
+    copy.Source = page.Resource.Get();
+    copy.SourceOffset = sourceOffset;
+    copy.DestinationOffset = offset;
+    copy.Size = byteSize;
+    mCopies.push_back(copy);
+
+    AddDestination(buffer, before, after);
+    mUploadedSize += byteSize;
+}
+
+void UploadBatch::UploadTexture(ID3D12Resource* texture, UINT firstSubresource, UINT numSubresources,
+    const D3D12_SUBRESOURCE_DATA* data, D3D12_RESOURCE_STATES finalState)
+{
+    // Laid out the way the copy expects, rows 256 byte aligned.
+    FrameArena::Scope scope;
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT* layouts = scope.Arena().AllocateArray<D3D12_PLACED_SUBRESOURCE_FOOTPRINT>(numSubresources);
+    UINT* numRows = scope.Arena().AllocateArray<UINT>(numSubresources);
+    UINT64* rowSizes = scope.Arena().AllocateArray<UINT64>(numSubresources);
+    UINT64 totalSize = 0;
+
+    D3D12_RESOURCE_DESC desc = texture->GetDesc();
+    mDevice->GetCopyableFootprints(&desc, firstSubresource, numSubresources, 0,
+        layouts, numRows, rowSizes, &totalSize);
+
+    UINT64 offset;
+    Page& page = Allocate(totalSize, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT, offset);
+
+    for (UINT i = 0; i < numSubresources; ++i)
+    {
+        D3D12_MEMCPY_DEST dest = { page.MappedData + offset + layouts[i].Offset,
+            layouts[i].Footprint.RowPitch, (SIZE_T)layouts[i].Footprint.RowPitch * numRows[i] };
+        MemcpySubresource(&dest, &data[i], (SIZE_T)rowSizes[i], numRows[i], layouts[i].Footprint.Depth);
+
+        Copy copy = {};
+        copy.Destination = texture;
+        copy.Source = page.Resource.Get();
+        copy.SourceOffset = offset;
+        copy.IsTexture = true;
+        copy.Subresource = firstSubresource + i;
+        copy.Footprint = layouts[i];
+        copy.Footprint.Offset += offset;
+        mCopies.push_back(copy);
+    }
+
+    AddDestination(texture, D3D12_RESOURCE_STATE_COMMON, finalState);
+    mUploadedSize += totalSize;
+}
+
+void UploadBatch::Flush(ID3D12GraphicsCommandList* cmdList)
+{
+    if (mCopies.empty())
+        return;
+
+    FrameArena::Scope scope;
+    std::pmr::vector<D3D12_RESOURCE_BARRIER> barriers(&scope.Arena());
+    barriers.reserve(mDestinations.size());
+    for (const Destination& destination : mDestinations)
+    {
+        barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(destination.Resource.Get(),
+            destination.StateBefore, D3D12_RESOURCE_STATE_COPY_DEST));
+    }
+    cmdList->ResourceBarrier((UINT)barriers.size(), barriers.data());
+
+    for (const Copy& copy : mCopies)
+    {
+        if (copy.IsTexture)
+        {
+            CD3DX12_TEXTURE_COPY_LOCATION dst(copy.Destination, copy.Subresource);
+            CD3DX12_TEXTURE_COPY_LOCATION src(copy.Source, copy.Footprint);
+            cmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+        }
+        else
+        {
+            cmdList->CopyBufferRegion(copy.Destination, copy.DestinationOffset, copy.Source, copy.SourceOffset, copy.Size);
+        }
+    }
+
+    barriers.clear();
+    for (const Destination& destination : mDestinations)
+    {
+        barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(destination.Resource.Get(),
+            D3D12_RESOURCE_STATE_COPY_DEST, destination.StateAfter));
+    }
+    cmdList->ResourceBarrier((UINT)barriers.size(), barriers.data());
+
+    // The command list references the destinations from now on.
+    mDestinations.clear();
+    mCopies.clear();
+}
+
+void UploadBatch::BeginFrame(UINT64 completedFence, UINT64 frameFence)
+{
+    assert(mCopies.empty());
+
+    for (auto& page : mPages)
+        mRetiredPages.emplace_back(mFrameFence, page);
+    mPages.clear();
+
+    while (!mRetiredPages.empty() && mRetiredPages.front().first <= completedFence)
+    {
+        ReleasePage(mRetiredPages.front().second);
+        mRetiredPages.pop_front();
+    }
+
+    mFrameFence = frameFence;
+}
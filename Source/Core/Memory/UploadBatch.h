@@ -0,0 +1,117 @@
+//*******************************************************************
+// UploadBatch.h:
+//
+// Stages the initial data of default heap buffers and textures, and
+// later writes to parts of buffers. The data is copied into large
+// upload pages shared by every resource instead of an upload buffer
+// each, and the copies are recorded together on Flush: one barrier
+// batch into COPY_DEST, every copy, and one barrier batch into the
+// states the resources are used in. The list flushed into has to
+// execute before anything reads the destinations.
+//
+// Pages staged into during a frame are released once its fence has
+// completed, so nothing has to hold on to upload buffers and no memory
+// stays behind once loading is done. Not thread safe.
+//*******************************************************************
+
+#pragma once
+
+#include "Utils/DXUtil.h"
+
+class UploadBatch
+{
+public:
+	static const UINT64 DefaultPageSize = 16ull << 20;
+
+	// Resources and pages are placed in heaps of allocator, if one is given.
+	UploadBatch(ID3D12Device* device, GpuMemoryAllocator* allocator = nullptr, UINT64 pageSize = DefaultPageSize);
+	~UploadBatch();
+
+	UploadBatch(const UploadBatch& rhs) = delete;
+	UploadBatch& operator=(const UploadBatch& rhs) = delete;
+
+	// Create a default heap buffer that holds data once the batch is
+	// flushed and executed, and is then in finalState.
+	Microsoft::WRL::ComPtr<ID3D12Resource> CreateBuffer(const void* data, UINT64 byteSize,
+		D3D12_RESOURCE_STATES finalState = D3D12_RESOURCE_STATE_GENERIC_READ);
+
+	// Write data over byteSize bytes of buffer from offset. The buffer is in
+	// state before, and in state after once the batch has executed.
+	void WriteBuffer(ID3D12Resource* buffer, UINT64 offset, const void* data, UINT64 byteSize,
+		D3D12_RESOURCE_STATES before = D3D12_RESOURCE_STATE_GENERIC_READ,
+		D3D12_RESOURCE_STATES after = D3D12_RESOURCE_STATE_GENERIC_READ);
+
+	// Stage numSubresources subresources of texture, which must be in the
+	// common state, from firstSubresource on.
+	void UploadTexture(ID3D12Resource* texture, UINT firstSubresource, UINT numSubresources,
+		const D3D12_SUBRESOURCE_DATA* data, D3D12_RESOURCE_STATES finalState = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+
+	// Record the copies staged since the last flush into cmdList.
+	void Flush(ID3D12GraphicsCommandList* cmdList);
+
+	// Called at the start of every frame, like UploadRing::BeginFrame. The
+	// pages of the last frame wait for its fence; everything staged then
+	// must have been flushed.
+	void BeginFrame(UINT64 completedFence, UINT64 frameFence);
+
+	UINT64 StagingSize() const { return mStagingSize; }		// Pages alive, in flight included
+	UINT PageCount() const { return (UINT)(mPages.size() + mRetiredPages.size()); }
+	UINT PendingCopyCount() const { return (UINT)mCopies.size(); }
+	UINT64 UploadedSize() const { return mUploadedSize; }	// Every byte ever staged
+
+private:
+	struct Page
+	{
+		Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+		BYTE* MappedData = nullptr;
+		UINT64 Size = 0;
+		UINT64 UsedSize = 0;
+	};
+
+	struct Destination
+	{
+		Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+		D3D12_RESOURCE_STATES StateBefore;
+		D3D12_RESOURCE_STATES StateAfter;
+	};
+
+	struct Copy
+	{
+		ID3D12Resource* Destination;	// Kept alive by mDestinations
+		ID3D12Resource* Source;			// Kept alive by its page
+		UINT64 SourceOffset;
+
+		// Buffers copy Size bytes to DestinationOffset, textures one
+		// subresource laid out as Footprint.
+		UINT64 DestinationOffset;
+		UINT64 Size;
+		bool IsTexture;
+		UINT Subresource;
+		D3D12_PLACED_SUBRESOURCE_FOOTPRINT Footprint;
+	};
+
+	// Room for size bytes at alignment in the last page, or a new one.
+	Page& Allocate(UINT64 size, UINT64 alignment, UINT64& offset);
+
+	void ReleasePage(Page& page);
+
+	// Transition resource around the copies, once however many there are.
+	void AddDestination(ID3D12Resource* resource, D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after);
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12Device> mDevice;
+	GpuMemoryAllocator* mAllocator;
+	UINT64 mPageSize;
+
+	// Pages of this frame, and those of frames in flight with their fence.
+	std::vector<Page> mPages;
+	std::deque<std::pair<UINT64, Page>> mRetiredPages;
+
+	// Resources copied to since the last flush.
+	std::vector<Destination> mDestinations;
+	std::vector<Copy> mCopies;
+
+	UINT64 mFrameFence = 0;
+	UINT64 mStagingSize = 0;
+	UINT64 mUploadedSize = 0;
+};
@@ -0,0 +1,133 @@
+//*******************************************************************
+// UploadRing.cpp
+//*******************************************************************
+#include "lmpch.h"
+#include "UploadRing.h"
+#include "GpuMemoryAllocator.h"
+
+namespace
+{
+    // Upload buffers created on the device, or placed in a heap of the
+    // allocator if there is one.
+    class DeviceBufferFactory : public UploadRing::BufferFactory
+    {
+    public:
+        DeviceBufferFactory(ID3D12Device* device, GpuMemoryAllocator* allocator) :
+            mDevice(device),
+            mAllocator(allocator)
+        {
+        }
+
+        UploadRing::Buffer CreateBuffer(UINT64 size) override
+        {
+            UploadRing::Buffer buffer;
+            if (mAllocator != nullptr)
+            {
+                buffer.Resource = mAllocator->CreateResource(D3D12_HEAP_TYPE_UPLOAD,
+                    CD3DX12_RESOURCE_DESC::Buffer(size), D3D12_RESOURCE_STATE_GENERIC_READ);
+            }
+            else
+            {
+                ThrowIfFailed(mDevice->CreateCommittedResource(
+                    &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+                    D3D12_HEAP_FLAG_NONE,
+                    &CD3DX12_RESOURCE_DESC::Buffer(size),
+                    D3D12_RESOURCE_STATE_GENERIC_READ,
+                    nullptr,
+                    IID_PPV_ARGS(&buffer.Resource)));
+            }
+
+            // Mapped for as long as the buffer lives. An empty read range
+            // tells the driver the CPU never reads the data.
+            CD3DX12_RANGE readRange(0, 0);
+            ThrowIfFailed(buffer.Resource->Map(0, &readRange, reinterpret_cast<void**>(&buffer.MappedData)));
+            buffer.GpuAddress = buffer.Resource->GetGPUVirtualAddress();
+
+            return buffer;
+        }
+
+        void ReleaseBuffer(UploadRing::Buffer& buffer) override
+        {
+            buffer.Resource->Unmap(0, nullptr);
+            if (mAllocator != nullptr)
+                mAllocator->Release(buffer.Resource.Get());
+        }
+
+    private:
+        Microsoft::WRL::ComPtr<ID3D12Device> mDevice;
+        GpuMemoryAllocator* mAllocator;
+    };
+}
+
+UploadRing::UploadRing(ID3D12Device* device, UINT64 size, GpuMemoryAllocator* allocator) :
+    UploadRing(std::make_unique<DeviceBufferFactory>(device, allocator), size)
+{
+}
+
+UploadRing::UploadRing(std::unique_ptr<BufferFactory> factory, UINT64 size) :
+    mFactory(std::move(factory)),
+    mRing((size + D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT - 1) & ~(UINT64)(D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT - 1))
+{
+    mBuffer = mFactory->CreateBuffer(mRing.Size());
+}
+
+UploadRing::~UploadRing()
+{
+    for (auto& retired : mRetiredBuffers)
+        mFactory->ReleaseBuffer(retired.second);
+    mFactory->ReleaseBuffer(mBuffer);
+}
+
+// ------------------------------------------------------------------
+// The frames that allocated from the old buffer may still be in flight,
+// so it is kept until the current one, the last to use it, completes.
+// ------------------------------------------------------------------
+void UploadRing::Grow(UINT64 size)
+{
+    UINT64 newSize = mRing.Size() * 2;
+    while (newSize < size)
+        newSize *= 2;
+
+    mRetiredBuffers.emplace_back(mFrameFence, mBuffer);
+    mBuffer = mFactory->CreateBuffer(newSize);
+    mRing = RingAllocator(newSize);
+    ++mGrowCount;
+}
+
+UploadRing::Allocation UploadRing::Allocate(UINT64 size, UINT64 alignment)
+{
+    assert(alignment <= D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+
+    UINT64 offset = mRing.Allocate(size, alignment);
+    if (offset == RingAllocator::InvalidOffset)
+    {
+        Grow(size);
+        offset = mRing.Allocate(size, alignment);
+        assert(offset != RingAllocator::InvalidOffset);
+    }
+
+    mFrameSize += size;
+
+    Allocation allocation;
+    allocation.CpuAddress = mBuffer.MappedData + offset;
+    allocation.GpuAddress = mBuffer.GpuAddress + offset;
+    allocation.Resource = mBuffer.Resource.Get();
+    allocation.Offset = offset;
+    return allocation;
+}
+
+void UploadRing::BeginFrame(UINT64 completedFence, UINT64 frameFence)
+{
+    mRing.EndFrame(mFrameFence);
+    mRing.Reclaim(completedFence);
+
+    while (!mRetiredBuffers.empty() && mRetiredBuffers.front().first <= completedFence)
+    {
+        mFactory->ReleaseBuffer(mRetiredBuffers.front().second);
+        mRetiredBuffers.pop_front();
+    }
+
+    mFrameFence = frameFence;
+    mLastFrameSize = mFrameSize;
+    mFrameSize = 0;
+}
@@ -0,0 +1,131 @@
+//*******************************************************************
+// UploadRing.h:
+//
+// One persistently mapped upload buffer shared by the frames in flight
+// for everything the CPU writes for a single frame: pass constants,
+// instance lists, draw arguments, dynamic vertices. Data is bump
+// allocated by a RingAllocator and reclaimed as the frames that used it
+// complete, so nothing has to be sized up front. When the frames in
+// flight fill the buffer, a larger one takes its place and the old one
+// is kept until the GPU is done with it.
+//
+// Allocations are only valid for the frame they were made in. Not
+// thread safe; allocate from the thread that updates the frame.
+//*******************************************************************
+
+#pragma once
+
+#include "Utils/DXUtil.h"
+#include "Utils/StreamingCopy.h"
+#include "UploadBuffer.h"
+#include "RingAllocator.h"
+
+class UploadRing
+{
+public:
+	static const UINT64 DefaultSize = 8ull << 20;
+
+	// Structured buffers and vertices only need 4 bytes; 16 keeps every
+	// element of a float4 aligned.
+	static const UINT64 DataAlignment = 16;
+
+	struct Allocation
+	{
+		BYTE* CpuAddress = nullptr;
+		D3D12_GPU_VIRTUAL_ADDRESS GpuAddress = 0;
+
+		// Buffer and offset in it, for calls taking those instead.
+		ID3D12Resource* Resource = nullptr;
+		UINT64 Offset = 0;
+	};
+
+	// A mapped buffer of the ring.
+	struct Buffer
+	{
+		Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+		BYTE* MappedData = nullptr;
+		D3D12_GPU_VIRTUAL_ADDRESS GpuAddress = 0;
+	};
+
+	// Makes the buffers the ring grows into. The ring creates upload
+	// buffers on a device itself; the tests give it one without a device.
+	class BufferFactory
+	{
+	public:
+		virtual ~BufferFactory() = default;
+
+		// A buffer of size bytes, mapped until it is released.
+		virtual Buffer CreateBuffer(UINT64 size) = 0;
+		virtual void ReleaseBuffer(Buffer& buffer) = 0;
+	};
+
+	// The buffers are placed in a heap of allocator, if one is given.
+	UploadRing(ID3D12Device* device, UINT64 size = DefaultSize, GpuMemoryAllocator* allocator = nullptr);
+	UploadRing(std::unique_ptr<BufferFactory> factory, UINT64 size = DefaultSize);
+	~UploadRing();
+
+	UploadRing(const UploadRing& rhs) = delete;
+	UploadRing& operator=(const UploadRing& rhs) = delete;
+
+	// alignment is a power of two up to 64 KB. Grows the ring when the
+	// frames in flight leave no room.
+	Allocation Allocate(UINT64 size, UINT64 alignment);
+
+	// Called at the start of every frame, like GpuMemoryAllocator::BeginFrame:
+	// memory of frames up to completedFence is reused, and what is allocated
+	// from now on waits for frameFence.
+	void BeginFrame(UINT64 completedFence, UINT64 frameFence);
+
+	// Copy data into a constant buffer of its own and return its address.
+	template<typename T>
+	D3D12_GPU_VIRTUAL_ADDRESS CopyConstants(const T& data)
+	{
+		Allocation allocation = Allocate(DXUtil::CalcConstantBufferByteSize(sizeof(T)), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+		memcpy(allocation.CpuAddress, &data, sizeof(T));
+		return allocation.GpuAddress;
+	}
+
+	// Copy count tightly packed elements in one streaming pass.
+	template<typename T>
+	Allocation CopyRange(const T* data, UINT count)
+	{
+		Allocation allocation = Allocate((UINT64)count * sizeof(T), DataAlignment);
+		StreamingCopy(allocation.CpuAddress, data, (std::size_t)count * sizeof(T));
+		return allocation;
+	}
+
+	// Write-only view of count new elements, for data generated element by
+	// element.
+	template<typename T>
+	typename UploadBuffer<T>::Span WriteSpan(UINT count, Allocation& allocation)
+	{
+		allocation = Allocate((UINT64)count * sizeof(T), DataAlignment);
+		return typename UploadBuffer<T>::Span(allocation.CpuAddress, sizeof(T), count);
+	}
+
+	UINT64 Size() const { return mRing.Size(); }
+	UINT64 UsedSize() const { return mRing.UsedSize(); }
+	UINT GrowCount() const { return mGrowCount; }
+
+	// Bytes asked for in the last complete frame.
+	UINT64 FrameSize() const { return mLastFrameSize; }
+
+private:
+	// Replace the buffer with one at least twice as large and with room
+	// for size.
+	void Grow(UINT64 size);
+
+private:
+	std::unique_ptr<BufferFactory> mFactory;
+
+	Buffer mBuffer;
+	RingAllocator mRing;
+
+	// Buffers grown out of, with the fence of the last frame using them.
+	std::deque<std::pair<UINT64, Buffer>> mRetiredBuffers;
+
+	UINT64 mFrameFence = 0;
+	UINT64 mFrameSize = 0;
+	UINT64 mLastFrameSize = 0;
+	UINT mGrowCount = 0;
+};
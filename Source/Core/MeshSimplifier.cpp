@@ -0,0 +1,277 @@
+//*******************************************************************
+// MeshSimplifier.cpp
+//*******************************************************************
+#include "lmpch.h"
+#include "MeshSimplifier.h"
+
+using namespace DirectX;
+
+namespace
+{
+    // Open boundaries get extra planes at right angles to their triangles so
+    // collapses do not eat into the silhouette of the mesh.
+    const double BoundaryWeight = 8.0;
+
+    // A collapse is rejected if it turns a triangle by more than about 78
+    // degrees.
+    const float MinNormalCosine = 0.2f;
+
+    inline XMVECTOR TriangleNormal(const XMFLOAT3& p0, const XMFLOAT3& p1, const XMFLOAT3& p2)
+    {
+        XMVECTOR a = XMLoadFloat3(&p0);
+        XMVECTOR b = XMLoadFloat3(&p1);
+        XMVECTOR c = XMLoadFloat3(&p2);
+        return XMVector3Cross(XMVectorSubtract(b, a), XMVectorSubtract(c, a));
+    }
+}
+
+void MeshSimplifier::Quadric::AddPlane(double a, double b, double c, double d, double weight)
+{
+    A[0] += weight * a * a; A[1] += weight * a * b; A[2] += weight * a * c; A[3] += weight * a * d;
+    A[4] += weight * b * b; A[5] += weight * b * c; A[6] += weight * b * d;
+    A[7] += weight * c * c; A[8] += weight * c * d;
+    A[9] += weight * d * d;
+}
+
+MeshSimplifier::Quadric& MeshSimplifier::Quadric::operator+=(const Quadric& rhs)
+{
+    for (int i = 0; i < 10; ++i)
+        A[i] += rhs.A[i];
+    return *this;
+}
+
+double MeshSimplifier::Quadric::Evaluate(const XMFLOAT3& p) const
+{
+    double x = p.x, y = p.y, z = p.z;
+    return A[0] * x * x + 2.0 * A[1] * x * y + 2.0 * A[2] * x * z + 2.0 * A[3] * x
+         + A[4] * y * y + 2.0 * A[5] * y * z + 2.0 * A[6] * y
+         + A[7] * z * z + 2.0 * A[8] * z
+         + A[9];
+}
+
+std::vector<SubmeshLOD> MeshSimplifier::BuildLODChain(const std::vector<XMFLOAT3>& positions,
+    std::vector<std::uint32_t>& indices, UINT lodCount, float radius)
+{
+    std::vector<SubmeshLOD> lods;
+    if (lodCount < 2)
+        return lods;
+
+    const UINT triangleCount = (UINT)indices.size() / 3;
+    lods.push_back({ (UINT)indices.size(), 0, 0.0f });
+
+    // Each level continues from the one before.
+    MeshSimplifier simplifier(positions, indices);
+    std::vector<std::uint32_t> lodIndices;
+    for (UINT level = 1; level < lodCount; ++level)
+    {
+        simplifier.Simplify(triangleCount >> level);
+        simplifier.GetIndices(lodIndices);
+
+        lods.push_back({ (UINT)lodIndices.size(), (UINT)indices.size(), simplifier.MaxError() / radius });
+        indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+    }
+
+    return lods;
+}
+
+MeshSimplifier::MeshSimplifier(const std::vector<XMFLOAT3>& positions, const std::vector<std::uint32_t>& indices) :
+    mPositions(positions),
+    mIndices(indices)
+{
+    const UINT vertexCount = (UINT)mPositions.size();
+    const UINT triangleCount = (UINT)mIndices.size() / 3;
+
+    mQuadrics.resize(vertexCount);
+    mVersions.resize(vertexCount, 0);
+    mVertexTriangles.resize(vertexCount);
+    mTriangleRemoved.resize(triangleCount, false);
+    mLiveTriangleCount = triangleCount;
+
+    // Number of triangles on each edge, to find the open boundaries.
+    std::unordered_map<std::uint64_t, UINT> edgeUse;
+    auto edgeKey = [](UINT a, UINT b)
+    {
+        return ((std::uint64_t)MathHelper::Min(a, b) << 32) | MathHelper::Max(a, b);
+    };
+
+    for (UINT t = 0; t < triangleCount; ++t)
+    {
+        const UINT* tri = &mIndices[t * 3];
+
+        XMVECTOR n = XMVector3Normalize(TriangleNormal(mPositions[tri[0]], mPositions[tri[1]], mPositions[tri[2]]));
+        XMFLOAT3 normal;
+        XMStoreFloat3(&normal, n);
+
+        // Degenerate triangles normalize to zero and add no plane.
+        double d = -(normal.x * mPositions[tri[0]].x + normal.y * mPositions[tri[0]].y + normal.z * mPositions[tri[0]].z);
+
+        for (int i = 0; i < 3; ++i)
+        {
+            mQuadrics[tri[i]].AddPlane(normal.x, normal.y, normal.z, d, 1.0);
+            mVertexTriangles[tri[i]].push_back(t);
+            ++edgeUse[edgeKey(tri[i], tri[(i + 1) % 3])];
+        }
+    }
+
+    for (UINT t = 0; t < triangleCount; ++t)
+    {
+        const UINT* tri = &mIndices[t * 3];
+        XMVECTOR n = XMVector3Normalize(TriangleNormal(mPositions[tri[0]], mPositions[tri[1]], mPositions[tri[2]]));
+
+        for (int i = 0; i < 3; ++i)
+        {
+            UINT a = tri[i];
+            UINT b = tri[(i + 1) % 3];
+
+            if (edgeUse[edgeKey(a, b)] == 1)
+            {
+                XMVECTOR pa = XMLoadFloat3(&mPositions[a]);
+                XMVECTOR edge = XMVectorSubtract(XMLoadFloat3(&mPositions[b]), pa);
+                XMVECTOR side = XMVector3Normalize(XMVector3Cross(edge, n));
+
+                XMFLOAT3 s;
+                XMStoreFloat3(&s, side);
+                double d = -(s.x * mPositions[a].x + s.y * mPositions[a].y + s.z * mPositions[a].z);
+
+                mQuadrics[a].AddPlane(s.x, s.y, s.z, d, BoundaryWeight);
+                mQuadrics[b].AddPlane(s.x, s.y, s.z, d, BoundaryWeight);
+            }
+        }
+    }
+
+    for (const auto& edge : edgeUse)
+        PushEdge((UINT)(edge.first >> 32), (UINT)(edge.first & 0xFFFFFFFF));
+}
+
+void MeshSimplifier::PushEdge(UINT a, UINT b)
+{
+    Quadric q = mQuadrics[a];
+    q += mQuadrics[b];
+
+    double costA = q.Evaluate(mPositions[a]);
+    double costB = q.Evaluate(mPositions[b]);
+
+    // Keep the endpoint that the merged quadric favors.
+    if (costA <= costB)
+        mQueue.push({ MathHelper::Max(costA, 0.0), b, a, mVersions[b], mVersions[a] });
+    else
+        mQueue.push({ MathHelper::Max(costB, 0.0), a, b, mVersions[a], mVersions[b] });
+}
+
+void MeshSimplifier::Simplify(UINT targetTriangleCount)
+{
+    while (mLiveTriangleCount > targetTriangleCount && !mQueue.empty())
+    {
+        Collapse c = mQueue.top();
+        mQueue.pop();
+
+        // Either endpoint changed since this entry was queued.
+        if (c.FromVersion != mVersions[c.From] || c.ToVersion != mVersions[c.To])
+            continue;
+
+        if (FlipsTriangle(c.From, c.To))
+            continue;
+
+        ApplyCollapse(c.From, c.To);
+        mMaxCost = MathHelper::Max(mMaxCost, c.Cost);
+    }
+}
+
+bool MeshSimplifier::FlipsTriangle(UINT from, UINT to) const
+{
+    for (UINT t : mVertexTriangles[from])
+    {
+        if (mTriangleRemoved[t])
+            continue;
+
+        const UINT* tri = &mIndices[t * 3];
+        if (tri[0] == to || tri[1] == to || tri[2] == to)
+            continue;
+
+        XMFLOAT3 p[3];
+        for (int i = 0; i < 3; ++i)
+            p[i] = mPositions[tri[i]];
+
+        XMVECTOR before = TriangleNormal(p[0], p[1], p[2]);
+        for (int i = 0; i < 3; ++i)
+        {
+            if (tri[i] == from)
+                p[i] = mPositions[to];
+        }
+        XMVECTOR after = TriangleNormal(p[0], p[1], p[2]);
+
+        float lengths = XMVectorGetX(XMVector3Length(before)) * XMVectorGetX(XMVector3Length(after));
+        if (lengths <= 0.0f || XMVectorGetX(XMVector3Dot(before, after)) < MinNormalCosine * lengths)
+            return true;
+    }
+
+    return false;
+}
+
+void MeshSimplifier::ApplyCollapse(UINT from, UINT to)
+{
+    std::vector<UINT>& toTriangles = mVertexTriangles[to];
+
+    for (UINT t : mVertexTriangles[from])
+    {
+        if (mTriangleRemoved[t])
+            continue;
+
+        UINT* tri = &mIndices[t * 3];
+        if (tri[0] == to || tri[1] == to || tri[2] == to)
+        {
+            // The collapsed edge belongs to this triangle.
+            mTriangleRemoved[t] = true;
+            --mLiveTriangleCount;
+            continue;
+        }
+
+        for (int i = 0; i < 3; ++i)
+        {
+            if (tri[i] == from)
+                tri[i] = to;
+        }
+        toTriangles.push_back(t);
+    }
+
+    mVertexTriangles[from].clear();
+    mVertexTriangles[from].shrink_to_fit();
+
+    toTriangles.erase(
+        std::remove_if(toTriangles.begin(), toTriangles.end(), [this](UINT t) { return mTriangleRemoved[t]; }),
+        toTriangles.end());
+
+    mQuadrics[to] += mQuadrics[from];
+    ++mVersions[from];
+    ++mVersions[to];
+
+    // Only the edges around the kept vertex changed cost.
+    std::vector<UINT> neighbors;
+    for (UINT t : toTriangles)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            UINT v = mIndices[t * 3 + i];
+            if (v != to)
+                neighbors.push_back(v);
+        }
+    }
+
+    std::sort(neighbors.begin(), neighbors.end());
+    neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+
+    for (UINT v : neighbors)
+        PushEdge(to, v);
+}
+
+void MeshSimplifier::GetIndices(std::vector<std::uint32_t>& indices) const
+{
+    indices.clear();
+    indices.reserve(mLiveTriangleCount * 3);
+
+    for (UINT t = 0; t < (UINT)mTriangleRemoved.size(); ++t)
+    {
+        if (!mTriangleRemoved[t])
+            indices.insert(indices.end(), mIndices.begin() + t * 3, mIndices.begin() + t * 3 + 3);
+    }
+}
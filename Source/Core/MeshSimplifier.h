@@ -0,0 +1,87 @@
+//*******************************************************************
+// MeshSimplifier.h:
+//
+// Edge collapse mesh simplification driven by quadric error metrics
+// (Garland and Heckbert). Every vertex accumulates the planes of the
+// triangles around it; collapsing an edge keeps whichever endpoint
+// has the smaller quadric error for the merged set. Vertices are only
+// ever removed, never moved, so every level of detail produced from
+// the same simplifier can index the original vertex buffer.
+//*******************************************************************
+
+#pragma once
+
+#include "Utils/DXUtil.h"
+
+class MeshSimplifier
+{
+public:
+	// Build a level of detail chain of lodCount levels for the triangles in
+	// indices, level i aiming at 1 / 2^i of their number, and append the
+	// indices of the coarser levels after them. Returns the chain, finest
+	// first, with the errors relative to radius; empty for fewer than 2
+	// levels.
+	static std::vector<SubmeshLOD> BuildLODChain(const std::vector<DirectX::XMFLOAT3>& positions,
+		std::vector<std::uint32_t>& indices, UINT lodCount, float radius);
+
+	MeshSimplifier(const std::vector<DirectX::XMFLOAT3>& positions, const std::vector<std::uint32_t>& indices);
+
+	MeshSimplifier(const MeshSimplifier& rhs) = delete;
+	MeshSimplifier& operator=(const MeshSimplifier& rhs) = delete;
+
+	// Collapse edges, cheapest first, until at most targetTriangleCount
+	// triangles remain or no collapse is left that keeps the surface from
+	// folding over. Can be called again with a smaller target to continue.
+	void Simplify(UINT targetTriangleCount);
+
+	UINT TriangleCount() const { return mLiveTriangleCount; }
+
+	// Largest error of any collapse so far, as a distance in the units of
+	// the positions.
+	float MaxError() const { return sqrtf(mMaxCost); }
+
+	// Index list of the remaining triangles, into the original vertices.
+	void GetIndices(std::vector<std::uint32_t>& indices) const;
+
+private:
+	// Symmetric 4x4 matrix, upper triangle only.
+	struct Quadric
+	{
+		double A[10] = {};
+
+		void AddPlane(double a, double b, double c, double d, double weight);
+		Quadric& operator+=(const Quadric& rhs);
+		double Evaluate(const DirectX::XMFLOAT3& p) const;
+	};
+
+	struct Collapse
+	{
+		double Cost;
+		UINT From;
+		UINT To;
+		UINT FromVersion;
+		UINT ToVersion;
+
+		bool operator>(const Collapse& rhs) const { return Cost > rhs.Cost; }
+	};
+
+	void PushEdge(UINT a, UINT b);
+	bool FlipsTriangle(UINT from, UINT to) const;
+	void ApplyCollapse(UINT from, UINT to);
+
+private:
+	std::vector<DirectX::XMFLOAT3> mPositions;
+	std::vector<std::uint32_t> mIndices;
+
+	std::vector<Quadric> mQuadrics;
+	std::vector<UINT> mVersions;
+
+	// Triangles around each vertex. Entries may refer to removed triangles.
+	std::vector<std::vector<UINT>> mVertexTriangles;
+	std::vector<bool> mTriangleRemoved;
+
+	std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> mQueue;
+
+	UINT mLiveTriangleCount = 0;
+	double mMaxCost = 0.0;
+};
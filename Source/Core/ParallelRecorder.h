@@ -0,0 +1,58 @@
+//*******************************************************************
+// ParallelRecorder.h:
+//
+// Fork-join recording of the passes of a frame. Every pass is recorded
+// by a task of its own, into a command list of its own, while the
+// calling thread records what has to stay on it, e.g. the GUI. The
+// task handles live in the calling thread's frame arena, so starting
+// the tasks does not allocate.
+//
+// Nothing here knows what a pass records into: the recording functions
+// are template parameters, so the same threading can drive recording
+// command lists in place of D3D ones. The tasks run on the PPL
+// scheduler (concurrency::task_group), like the rest of Core's
+// threading, so this is Windows only, as are its tests.
+//*******************************************************************
+
+#pragma once
+
+#include "Memory/FrameArena.h"
+
+class ParallelRecorder
+{
+public:
+	// Call recordPass(i) for every i below passCount and recordOnCaller()
+	// on the calling thread, and return once they are all done. With
+	// parallel false, everything runs on the calling thread in order, the
+	// passes first. recordPass is called from several threads at once.
+	template<typename TRecordPass, typename TRecordOnCaller>
+	static void Record(UINT passCount, bool parallel, const TRecordPass& recordPass, const TRecordOnCaller& recordOnCaller)
+	{
+		if (!parallel)
+		{
+			for (UINT i = 0; i < passCount; ++i)
+				recordPass(i);
+
+			recordOnCaller();
+			return;
+		}
+
+		// The group puts a lambda it is given on the heap, so it runs handles
+		// kept in the arena instead.
+		auto makeTask = [&recordPass](UINT i) { return [&recordPass, i]() { recordPass(i); }; };
+		using RecordTask = concurrency::task_handle<decltype(makeTask(0))>;
+
+		FrameArena::Scope scope;
+		RecordTask* tasks = scope.Arena().AllocateArray<RecordTask>(passCount);
+
+		concurrency::task_group passes;
+		for (UINT i = 0; i < passCount; ++i)
+			passes.run(*new (&tasks[i]) RecordTask(makeTask(i)));
+
+		recordOnCaller();
+		passes.wait();
+
+		for (UINT i = 0; i < passCount; ++i)
+			tasks[i].~RecordTask();
+	}
+};
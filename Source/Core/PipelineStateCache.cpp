@@ -0,0 +1,584 @@
+//*******************************************************************
+// PipelineStateCache.cpp
+//*******************************************************************
+#include "lmpch.h"
+#include "PipelineStateCache.h"
+#include "ShaderCache.h"
+
+using Microsoft::WRL::ComPtr;
+namespace fs = std::filesystem;
+
+namespace
+{
+    // Bump when the hash changes, so the library names change with it.
+    const UINT HashVersion = 2;
+
+    // Descriptions are hashed field by field; hashing whole structures
+    // would take their padding bytes along.
+    template<typename T>
+    UINT64 HashValue(const T& value, UINT64 hash)
+    {
+        static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "Hash structures by their fields");
+        return ShaderCache::Hash(&value, sizeof(value), hash);
+    }
+
+    UINT64 HashString(const char* str, UINT64 hash)
+    {
+        if (str == nullptr)
+            return HashValue(0u, hash);
+
+        // Include the terminator, so "ab" + "c" and "a" + "bc" differ.
+        return ShaderCache::Hash(str, strlen(str) + 1, hash);
+    }
+
+    UINT64 HashShader(const D3D12_SHADER_BYTECODE& shader, UINT64 hash)
+    {
+        hash = HashValue((UINT64)shader.BytecodeLength, hash);
+        return ShaderCache::Hash(shader.pShaderBytecode, shader.BytecodeLength, hash);
+    }
+
+    UINT64 HashStencilOp(const D3D12_DEPTH_STENCILOP_DESC& op, UINT64 hash)
+    {
+        hash = HashValue(op.StencilFailOp, hash);
+        hash = HashValue(op.StencilDepthFailOp, hash);
+        hash = HashValue(op.StencilPassOp, hash);
+        return HashValue(op.StencilFunc, hash);
+    }
+
+    // Blending of a target that has it turned off, with the write mask
+    // left to the caller.
+    D3D12_RENDER_TARGET_BLEND_DESC DisabledBlend(UINT8 writeMask)
+    {
+        D3D12_RENDER_TARGET_BLEND_DESC blend = CD3DX12_BLEND_DESC(D3D12_DEFAULT).RenderTarget[0];
+        blend.RenderTargetWriteMask = writeMask;
+        return blend;
+    }
+}
+
+PipelineStateCache::PipelineStateCache(ID3D12Device* device, const std::wstring& libraryFile) :
+    mDevice(device),
+    mLibraryFile(libraryFile)
+{
+    // Pipeline libraries come with ID3D12Device1. Without one, every
+    // pipeline is compiled by the driver.
+    ComPtr<ID3D12Device1> device1;
+    if (FAILED(device->QueryInterface(IID_PPV_ARGS(&device1))))
+        return;
+
+    std::ifstream fin(mLibraryFile, std::ios::binary);
+    if (fin)
+        mLibraryData.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+
+    // A library written by another driver or adapter, or cut short, is
+    // rejected and started over.
+    if (!mLibraryData.empty() &&
+        FAILED(device1->CreatePipelineLibrary(mLibraryData.data(), mLibraryData.size(), IID_PPV_ARGS(&mLibrary))))
+    {
+        mLibrary = nullptr;
+        mLibraryData.clear();
+    }
+
+    // Drivers may not support libraries at all.
+    if (mLibrary == nullptr && FAILED(device1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&mLibrary))))
+        mLibrary = nullptr;
+
+    std::error_code error;
+    fs::create_directories(mLibraryFile.parent_path(), error);
+}
+
+PipelineStateCache::~PipelineStateCache()
+{
+    Save();
+}
+
+// ------------------------------------------------------------------
+// Normalization and hashing
+// ------------------------------------------------------------------
+void PipelineStateCache::Normalize(D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+{
+    for (D3D12_SHADER_BYTECODE* shader : { &desc.VS, &desc.PS, &desc.DS, &desc.HS, &desc.GS })
+    {
+        if (shader->pShaderBytecode == nullptr || shader->BytecodeLength == 0)
+            *shader = {};
+    }
+
+    if (desc.InputLayout.NumElements == 0)
+        desc.InputLayout.pInputElementDescs = nullptr;
+    if (desc.StreamOutput.NumEntries == 0)
+        desc.StreamOutput = {};
+
+    // A cached blob only speeds the creation up.
+    desc.CachedPSO = {};
+
+    // Without independent blending only the first target's blend state is
+    // used, and with a single target the two are the same.
+    if (desc.NumRenderTargets <= 1)
+        desc.BlendState.IndependentBlendEnable = FALSE;
+
+    UINT blendTargets = desc.BlendState.IndependentBlendEnable ? desc.NumRenderTargets : 1;
+    for (UINT i = 0; i < D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT; ++i)
+    {
+        D3D12_RENDER_TARGET_BLEND_DESC& blend = desc.BlendState.RenderTarget[i];
+        if (i >= blendTargets)
+        {
+            blend = DisabledBlend(D3D12_COLOR_WRITE_ENABLE_ALL);
+            continue;
+        }
+
+        if (!blend.BlendEnable)
+        {
+            D3D12_RENDER_TARGET_BLEND_DESC disabled = DisabledBlend(blend.RenderTargetWriteMask);
+            disabled.LogicOpEnable = blend.LogicOpEnable;
+            disabled.LogicOp = blend.LogicOp;
+            blend = disabled;
+        }
+        if (!blend.LogicOpEnable)
+            blend.LogicOp = D3D12_LOGIC_OP_NOOP;
+    }
+
+    for (UINT i = desc.NumRenderTargets; i < D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT; ++i)
+        desc.RTVFormats[i] = DXGI_FORMAT_UNKNOWN;
+
+    // Disabled depth testing writes no depth either.
+    D3D12_DEPTH_STENCIL_DESC& depthStencil = desc.DepthStencilState;
+    const D3D12_DEPTH_STENCIL_DESC defaultDepthStencil = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+    if (!depthStencil.DepthEnable)
+    {
+        depthStencil.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO;
+        depthStencil.DepthFunc = defaultDepthStencil.DepthFunc;
+    }
+    if (!depthStencil.StencilEnable)
+    {
+        depthStencil.StencilReadMask = defaultDepthStencil.StencilReadMask;
+        depthStencil.StencilWriteMask = defaultDepthStencil.StencilWriteMask;
+        depthStencil.FrontFace = defaultDepthStencil.FrontFace;
+        depthStencil.BackFace = defaultDepthStencil.BackFace;
+    }
+}
+
+UINT64 PipelineStateCache::HashDesc(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& source)
+{
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = source;
+    Normalize(desc);
+
+    UINT64 hash = ShaderCache::HashBasis;
+    hash = HashValue(HashVersion, hash);
+
+    // Shaders by content, so recompiling one to the same bytecode keeps
+    // the hash.
+    for (const D3D12_SHADER_BYTECODE* shader : { &desc.VS, &desc.PS, &desc.DS, &desc.HS, &desc.GS })
+        hash = HashShader(*shader, hash);
+
+    const D3D12_STREAM_OUTPUT_DESC& streamOut = desc.StreamOutput;
+    hash = HashValue(streamOut.NumEntries, hash);
+    for (UINT i = 0; i < streamOut.NumEntries; ++i)
+    {
+        const D3D12_SO_DECLARATION_ENTRY& entry = streamOut.pSODeclaration[i];
+        hash = HashValue(entry.Stream, hash);
+        hash = HashString(entry.SemanticName, hash);
+        hash = HashValue(entry.SemanticIndex, hash);
+        hash = HashValue(entry.StartComponent, hash);
+        hash = HashValue(entry.ComponentCount, hash);
+        hash = HashValue(entry.OutputSlot, hash);
+    }
+    hash = HashValue(streamOut.NumStrides, hash);
+    for (UINT i = 0; i < streamOut.NumStrides; ++i)
+        hash = HashValue(streamOut.pBufferStrides[i], hash);
+    hash = HashValue(streamOut.RasterizedStream, hash);
+
+    const D3D12_BLEND_DESC& blend = desc.BlendState;
+    hash = HashValue(blend.AlphaToCoverageEnable, hash);
+    hash = HashValue(blend.IndependentBlendEnable, hash);
+    for (const D3D12_RENDER_TARGET_BLEND_DESC& target : blend.RenderTarget)
+    {
+        hash = HashValue(target.BlendEnable, hash);
+        hash = HashValue(target.LogicOpEnable, hash);
+        hash = HashValue(target.SrcBlend, hash);
+        hash = HashValue(target.DestBlend, hash);
+        hash = HashValue(target.BlendOp, hash);
+        hash = HashValue(target.SrcBlendAlpha, hash);
+        hash = HashValue(target.DestBlendAlpha, hash);
+        hash = HashValue(target.BlendOpAlpha, hash);
+        hash = HashValue(target.LogicOp, hash);
+        hash = HashValue(target.RenderTargetWriteMask, hash);
+    }
+    hash = HashValue(desc.SampleMask, hash);
+
+    const D3D12_RASTERIZER_DESC& rasterizer = desc.RasterizerState;
+    hash = HashValue(rasterizer.FillMode, hash);
+    hash = HashValue(rasterizer.CullMode, hash);
+    hash = HashValue(rasterizer.FrontCounterClockwise, hash);
+    hash = HashValue(rasterizer.DepthBias, hash);
+    hash = HashValue(rasterizer.DepthBiasClamp, hash);
+    hash = HashValue(rasterizer.SlopeScaledDepthBias, hash);
+    hash = HashValue(rasterizer.DepthClipEnable, hash);
+    hash = HashValue(rasterizer.MultisampleEnable, hash);
+    hash = HashValue(rasterizer.AntialiasedLineEnable, hash);
+    hash = HashValue(rasterizer.ForcedSampleCount, hash);
+    hash = HashValue(rasterizer.ConservativeRaster, hash);
+
+    const D3D12_DEPTH_STENCIL_DESC& depthStencil = desc.DepthStencilState;
+    hash = HashValue(depthStencil.DepthEnable, hash);
+    hash = HashValue(depthStencil.DepthWriteMask, hash);
+    hash = HashValue(depthStencil.DepthFunc, hash);
+    hash = HashValue(depthStencil.StencilEnable, hash);
+    hash = HashValue(depthStencil.StencilReadMask, hash);
+    hash = HashValue(depthStencil.StencilWriteMask, hash);
+    hash = HashStencilOp(depthStencil.FrontFace, hash);
+    hash = HashStencilOp(depthStencil.BackFace, hash);
+
+    const D3D12_INPUT_LAYOUT_DESC& inputLayout = desc.InputLayout;
+    hash = HashValue(inputLayout.NumElements, hash);
+    for (UINT i = 0; i < inputLayout.NumElements; ++i)
+    {
+        const D3D12_INPUT_ELEMENT_DESC& element = inputLayout.pInputElementDescs[i];
+        hash = HashString(element.SemanticName, hash);
+        hash = HashValue(element.SemanticIndex, hash);
+        hash = HashValue(element.Format, hash);
+        hash = HashValue(element.InputSlot, hash);
+        hash = HashValue(element.AlignedByteOffset, hash);
+        hash = HashValue(element.InputSlotClass, hash);
+        hash = HashValue(element.InstanceDataStepRate, hash);
+    }
+
+    hash = HashValue(desc.IBStripCutValue, hash);
+    hash = HashValue(desc.PrimitiveTopologyType, hash);
+    hash = HashValue(desc.NumRenderTargets, hash);
+    for (DXGI_FORMAT format : desc.RTVFormats)
+        hash = HashValue(format, hash);
+    hash = HashValue(desc.DSVFormat, hash);
+    hash = HashValue(desc.SampleDesc.Count, hash);
+    hash = HashValue(desc.SampleDesc.Quality, hash);
+    hash = HashValue(desc.NodeMask, hash);
+    hash = HashValue(desc.Flags, hash);
+
+    return hash;
+}
+
+UINT64 PipelineStateCache::HashRootSignature(const void* serializedData, SIZE_T size)
+{
+    UINT64 hash = HashValue((UINT64)size, ShaderCache::HashBasis);
+    return ShaderCache::Hash(serializedData, size, hash);
+}
+
+std::wstring PipelineStateCache::MakeName(UINT64 descHash, UINT64 rootSignatureHash)
+{
+    wchar_t name[40];
+    swprintf_s(name, L"%016llx-%016llx", (unsigned long long)descHash, (unsigned long long)rootSignatureHash);
+    return name;
+}
+
+UINT64 PipelineStateCache::MakeKey(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, UINT64 hash)
+{
+    return HashValue((UINT64)(uintptr_t)desc.pRootSignature, hash);
+}
+
+std::wstring PipelineStateCache::LibraryName(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, UINT64 hash) const
+{
+    auto found = mRootSignatureHashes.find(desc.pRootSignature);
+    if (found == mRootSignatureHashes.end())
+        return std::wstring();
+
+    return MakeName(hash, found->second);
+}
+
+void PipelineStateCache::RegisterRootSignature(ID3D12RootSignature* rootSignature, const void* serializedData, SIZE_T size)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mRootSignatureHashes[rootSignature] = HashRootSignature(serializedData, size);
+}
+
+std::unique_ptr<PipelineStateCache::Entry> PipelineStateCache::MakeEntry(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, const std::wstring& name)
+{
+    auto entry = std::make_unique<Entry>();
+    entry->Desc = desc;
+    Normalize(entry->Desc);
+
+    D3D12_SHADER_BYTECODE* shaders[] = { &entry->Desc.VS, &entry->Desc.PS, &entry->Desc.DS, &entry->Desc.HS, &entry->Desc.GS };
+    for (UINT i = 0; i < _countof(shaders); ++i)
+    {
+        const BYTE* byteCode = static_cast<const BYTE*>(shaders[i]->pShaderBytecode);
+        entry->ByteCode[i].assign(byteCode, byteCode + shaders[i]->BytecodeLength);
+        if (!entry->ByteCode[i].empty())
+            shaders[i]->pShaderBytecode = entry->ByteCode[i].data();
+    }
+
+    // The names are pointed to by the copies, so they must not move.
+    D3D12_INPUT_LAYOUT_DESC& inputLayout = entry->Desc.InputLayout;
+    D3D12_STREAM_OUTPUT_DESC& streamOut = entry->Desc.StreamOutput;
+    entry->SemanticNames.reserve(inputLayout.NumElements + streamOut.NumEntries);
+
+    entry->InputElements.assign(inputLayout.pInputElementDescs, inputLayout.pInputElementDescs + inputLayout.NumElements);
+    for (D3D12_INPUT_ELEMENT_DESC& element : entry->InputElements)
+    {
+        entry->SemanticNames.push_back(element.SemanticName);
+        element.SemanticName = entry->SemanticNames.back().c_str();
+    }
+    inputLayout.pInputElementDescs = entry->InputElements.data();
+
+    entry->StreamOutEntries.assign(streamOut.pSODeclaration, streamOut.pSODeclaration + streamOut.NumEntries);
+    for (D3D12_SO_DECLARATION_ENTRY& soEntry : entry->StreamOutEntries)
+    {
+        // Gaps in the output have no name.
+        if (soEntry.SemanticName == nullptr)
+            continue;
+
+        entry->SemanticNames.push_back(soEntry.SemanticName);
+        soEntry.SemanticName = entry->SemanticNames.back().c_str();
+    }
+    entry->StreamOutStrides.assign(streamOut.pBufferStrides, streamOut.pBufferStrides + streamOut.NumStrides);
+    streamOut.pSODeclaration = entry->StreamOutEntries.data();
+    streamOut.pBufferStrides = entry->StreamOutStrides.data();
+
+    entry->Name = name;
+
+    return entry;
+}
+
+// ------------------------------------------------------------------
+// Pipelines
+// ------------------------------------------------------------------
+ID3D12PipelineState* PipelineStateCache::GetOrCreate(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+{
+    UINT64 hash = HashDesc(desc);
+    UINT64 key = MakeKey(desc, hash);
+
+    Entry* entry = nullptr;
+    bool pending = false;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        auto found = mEntries.find(key);
+        if (found == mEntries.end())
+            found = mEntries.emplace(key, MakeEntry(desc, LibraryName(desc, hash))).first;
+
+        entry = found->second.get();
+        if (entry->State != nullptr && !entry->Pending)
+        {
+            ++mDeduplicatedCount;
+            return entry->State.Get();
+        }
+
+        // Keep background requests from creating it a second time.
+        pending = entry->Pending;
+        entry->Pending = true;
+    }
+
+    // Being created in the background already; wait for it rather than
+    // create it twice.
+    if (pending)
+    {
+        mBackgroundCreates.wait();
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (entry->State != nullptr)
+        {
+            ++mDeduplicatedCount;
+            return entry->State.Get();
+        }
+        entry->Pending = true;
+    }
+
+    // New, or failed in the background, in which case creating it again
+    // reports the error.
+    ComPtr<ID3D12PipelineState> state;
+    bool loaded = false;
+    HRESULT hr = Create(*entry, state, loaded);
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        entry->State = state;
+        entry->Pending = false;
+        entry->Failed = FAILED(hr);
+        if (SUCCEEDED(hr))
+            ++(loaded ? mLoadedCount : mCreatedCount);
+    }
+    ThrowIfFailed(hr);
+
+    return entry->State.Get();
+}
+
+ID3D12PipelineState* PipelineStateCache::GetOrCreateAsync(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, ID3D12PipelineState* fallback)
+{
+    UINT64 hash = HashDesc(desc);
+    UINT64 key = MakeKey(desc, hash);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto found = mEntries.find(key);
+    if (found != mEntries.end())
+    {
+        const Entry& entry = *found->second;
+        if (entry.State == nullptr || entry.Pending)
+            return fallback;
+
+        ++mDeduplicatedCount;
+        return entry.State.Get();
+    }
+
+    Entry* entry = mEntries.emplace(key, MakeEntry(desc, LibraryName(desc, hash))).first->second.get();
+    entry->Pending = true;
+
+    mBackgroundCreates.run([this, entry]()
+    {
+        ComPtr<ID3D12PipelineState> state;
+        bool loaded = false;
+        HRESULT hr = Create(*entry, state, loaded);
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        entry->State = state;
+        entry->Pending = false;
+        entry->Failed = FAILED(hr);
+        if (SUCCEEDED(hr))
+            ++(loaded ? mLoadedCount : mCreatedCount);
+    });
+
+    return fallback;
+}
+
+HRESULT PipelineStateCache::Create(const Entry& entry, ComPtr<ID3D12PipelineState>& state, bool& loaded)
+{
+    loaded = false;
+
+    // Pipelines of root signatures the cache does not know have no name.
+    bool useLibrary = mLibrary != nullptr && !entry.Name.empty();
+    if (useLibrary)
+    {
+        // Fails for names the library does not have, and for ones stored
+        // with a description that no longer matches, e.g. by a driver
+        // that compiles it differently.
+        std::lock_guard<std::mutex> lock(mLibraryMutex);
+        if (SUCCEEDED(mLibrary->LoadGraphicsPipeline(entry.Name.c_str(), &entry.Desc, IID_PPV_ARGS(&state))))
+        {
+            loaded = true;
+            return S_OK;
+        }
+    }
+
+    HRESULT hr = mDevice->CreateGraphicsPipelineState(&entry.Desc, IID_PPV_ARGS(&state));
+    if (FAILED(hr))
+        return hr;
+
+    if (useLibrary)
+    {
+        std::lock_guard<std::mutex> lock(mLibraryMutex);
+        if (SUCCEEDED(mLibrary->StorePipeline(entry.Name.c_str(), state.Get())))
+        {
+            mLibraryDirty = true;
+        }
+        else if (!mLibraryData.empty())
+        {
+            // The name is taken by a pipeline of the file that failed to
+            // load. Kept, it would fail on every start and never be
+            // replaced, so the file is started over.
+            RebuildLibrary();
+            if (mLibrary != nullptr && SUCCEEDED(mLibrary->StorePipeline(entry.Name.c_str(), state.Get())))
+                mLibraryDirty = true;
+        }
+    }
+
+    return S_OK;
+}
+
+// ------------------------------------------------------------------
+// Pipelines loaded from the old library are stored again, so the file
+// written back keeps them. The library has to go before its data.
+// ------------------------------------------------------------------
+void PipelineStateCache::RebuildLibrary()
+{
+    mLibrary = nullptr;
+    mLibraryData.clear();
+
+    ComPtr<ID3D12Device1> device1;
+    if (FAILED(mDevice.As(&device1)) || FAILED(device1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&mLibrary))))
+    {
+        mLibrary = nullptr;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (const auto& found : mEntries)
+    {
+        const Entry& entry = *found.second;
+        if (entry.State != nullptr && !entry.Pending && !entry.Name.empty())
+            mLibrary->StorePipeline(entry.Name.c_str(), entry.State.Get());
+    }
+    mLibraryDirty = true;
+}
+
+bool PipelineStateCache::Save()
+{
+    // Background creations may still store pipelines.
+    mBackgroundCreates.wait();
+
+    std::lock_guard<std::mutex> lock(mLibraryMutex);
+    if (mLibrary == nullptr || !mLibraryDirty)
+        return true;
+
+    std::vector<BYTE> data(mLibrary->GetSerializedSize());
+    if (FAILED(mLibrary->Serialize(data.data(), data.size())))
+        return false;
+
+    // Write to a temporary file first, so the library is either complete
+    // or the previous one.
+    fs::path tempPath = mLibraryFile;
+    tempPath += ".tmp";
+    bool written;
+    {
+        std::ofstream fout(tempPath, std::ios::binary | std::ios::trunc);
+        fout.write((const char*)data.data(), (std::streamsize)data.size());
+        written = (bool)fout;
+    }
+
+    std::error_code error;
+    if (written)
+        fs::rename(tempPath, mLibraryFile, error);
+    if (!written || error)
+    {
+        fs::remove(tempPath, error);
+        return false;
+    }
+
+    mLibraryDirty = false;
+    return true;
+}
+
+// ------------------------------------------------------------------
+// Statistics
+// ------------------------------------------------------------------
+UINT PipelineStateCache::PipelineCount() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    UINT count = 0;
+    for (const auto& entry : mEntries)
+        count += entry.second->State != nullptr ? 1 : 0;
+    return count;
+}
+
+UINT PipelineStateCache::CreatedCount() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mCreatedCount;
+}
+
+UINT PipelineStateCache::LoadedCount() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mLoadedCount;
+}
+
+UINT PipelineStateCache::DeduplicatedCount() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mDeduplicatedCount;
+}
+
+UINT PipelineStateCache::PendingCount() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    UINT count = 0;
+    for (const auto& entry : mEntries)
+        count += entry.second->Pending ? 1 : 0;
+    return count;
+}
@@ -0,0 +1,129 @@
+//*******************************************************************
+// PipelineStateCache.h:
+//
+// Graphics pipeline states keyed by a hash of their description. The
+// description is normalized first, so fields the pipeline ignores
+// (blend factors of disabled blending, formats past the render target
+// count, ...) do not tell otherwise identical states apart, and every
+// distinct state is created once however often it is asked for.
+//
+// Pipelines are created when first asked for, either right away or in
+// the background while the caller keeps drawing with a fallback. The
+// ones the driver had to compile are stored in a pipeline library that
+// is written back to disk, so the next start loads them instead.
+//*******************************************************************
+
+#pragma once
+
+#include "Utils/DXUtil.h"
+
+class PipelineStateCache
+{
+public:
+	// The library file may be missing, or written by another driver, in
+	// which case it is started over.
+	PipelineStateCache(ID3D12Device* device, const std::wstring& libraryFile);
+	~PipelineStateCache();
+
+	PipelineStateCache(const PipelineStateCache& rhs) = delete;
+	PipelineStateCache& operator=(const PipelineStateCache& rhs) = delete;
+
+	// Reset the fields the pipeline ignores to fixed values. Neither of
+	// these needs a device.
+	static void Normalize(D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc);
+
+	// Hash of the normalized description, shader bytecode and input layout
+	// included. The root signature is left out, since only its address is
+	// known here, which changes from run to run; the name of the pipeline
+	// in the library adds the hash of its serialized form.
+	static UINT64 HashDesc(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc);
+
+	// Hash of a serialized root signature, the same from run to run.
+	static UINT64 HashRootSignature(const void* serializedData, SIZE_T size);
+
+	// Name in the library of the pipeline with these hashes.
+	static std::wstring MakeName(UINT64 descHash, UINT64 rootSignatureHash);
+
+	// Tell the cache what a root signature was serialized to, before asking
+	// for pipelines using it. Pipelines of root signatures it does not know
+	// are compiled every time rather than stored in the library.
+	void RegisterRootSignature(ID3D12RootSignature* rootSignature, const void* serializedData, SIZE_T size);
+
+	// The pipeline of desc, created now if there is none yet. What desc
+	// points to is only read during the call.
+	ID3D12PipelineState* GetOrCreate(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc);
+
+	// The pipeline of desc if it has been created. Otherwise returns the
+	// fallback and creates it in the background, so a later call finds it.
+	// Pipelines that fail to create keep returning the fallback.
+	ID3D12PipelineState* GetOrCreateAsync(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, ID3D12PipelineState* fallback);
+
+	// Write the library back if pipelines were added to it. Called by the
+	// destructor; failing only costs the next start the compile time.
+	bool Save();
+
+	UINT PipelineCount() const;
+	UINT CreatedCount() const;		// Compiled by the driver
+	UINT LoadedCount() const;		// Found in the library
+	UINT DeduplicatedCount() const;	// Requests served by an existing pipeline
+	UINT PendingCount() const;
+
+private:
+	// A description together with copies of everything it points to, so
+	// it can outlive the caller's for a background creation.
+	struct Entry
+	{
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC Desc;
+		std::vector<BYTE> ByteCode[5];
+		std::vector<D3D12_INPUT_ELEMENT_DESC> InputElements;
+		std::vector<D3D12_SO_DECLARATION_ENTRY> StreamOutEntries;
+		std::vector<UINT> StreamOutStrides;
+		std::vector<std::string> SemanticNames;
+
+		// Name in the library.
+		std::wstring Name;
+
+		Microsoft::WRL::ComPtr<ID3D12PipelineState> State;
+		bool Pending = false;
+		bool Failed = false;
+	};
+
+	static std::unique_ptr<Entry> MakeEntry(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, const std::wstring& name);
+
+	// Key of the entry in this run, which tells root signatures apart.
+	static UINT64 MakeKey(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, UINT64 hash);
+
+	// Name in the library of the pipeline of desc, or empty if its root
+	// signature is not registered. Called with mMutex held.
+	std::wstring LibraryName(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, UINT64 hash) const;
+
+	// Load the pipeline from the library or create and store it. Safe to
+	// call from any thread.
+	HRESULT Create(const Entry& entry, Microsoft::WRL::ComPtr<ID3D12PipelineState>& state, bool& loaded);
+
+	// Replace the library read from disk with an empty one holding the
+	// pipelines created so far. Called with mLibraryMutex held.
+	void RebuildLibrary();
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12Device> mDevice;
+	std::filesystem::path mLibraryFile;
+
+	// The library reads its pipelines from the file contents, which have
+	// to stay alive as long as it does.
+	std::vector<BYTE> mLibraryData;
+	Microsoft::WRL::ComPtr<ID3D12PipelineLibrary> mLibrary;
+	std::mutex mLibraryMutex;
+	bool mLibraryDirty = false;
+
+	// Entries stay put, so background creations can hold on to them.
+	mutable std::mutex mMutex;
+	std::unordered_map<UINT64, std::unique_ptr<Entry>> mEntries;
+	std::unordered_map<ID3D12RootSignature*, UINT64> mRootSignatureHashes;
+
+	UINT mCreatedCount = 0;
+	UINT mLoadedCount = 0;
+	UINT mDeduplicatedCount = 0;
+
+	concurrency::task_group mBackgroundCreates;
+};
@@ -51,6 +51,9 @@ struct RenderItem
 
 	DirectX::BoundingBox Bounds;
 
+	// World space bounds of all the instances, used to order the draws.
+	DirectX::BoundingSphere WorldBounds;
+
 	// The per-instance data in system memory is stored as part of the render-
 	// item structure, as the render-item maintains how many times it should
 	// be instanced.
@@ -62,6 +65,37 @@ struct RenderItem
 	UINT StartIndexLocation = 0;
 	int BaseVertexLocation = 0;
 
+	// Level of detail chain of the submesh, if it has one. The visible
+	// instances are grouped by level in the instance buffer, finest first,
+	// and LODInstanceCounts[i] of them are drawn with LODs[i].
+	std::vector<SubmeshLOD> LODs;
+	std::vector<UINT> LODInstanceCounts;
+
+	// The same counts for the shadow view, which draws shadow casters from
+	// a list of its own, written to the upload ring every frame.
+	UINT ShadowInstanceCount = 0;
+	std::vector<UINT> ShadowLODInstanceCounts;
+	D3D12_GPU_VIRTUAL_ADDRESS ShadowInstanceAddress = 0;
+
+	// System memory copies of the visible lists of both views, as last
+	// written to the current frame resource. Render items merged into one
+	// draw have their lists gathered from here.
+	std::vector<UINT> VisibleInstanceSlots;
+	std::vector<UINT> ShadowVisibleInstanceSlots;
+
 	int layerID = 0;
 	UINT instanceBufferID = 0;
+
+	// Render items drawing the same submesh share an ID, so the sort keys
+	// keep them next to each other and they can be drawn together.
+	UINT geometryID = 0;
+
+	// Index of the first instance of this render-item in the scene-wide
+	// InstanceBounds. Its instances occupy a contiguous range from there.
+	UINT firstInstanceID = 0;
+
+	// Occluders are drawn into the software occlusion buffer every frame,
+	// and the other instances are tested against it before they are drawn.
+	// Keep this to a few large, low-poly meshes.
+	bool isOccluder = false;
 };
@@ -0,0 +1,418 @@
+//*******************************************************************
+// RenderGraph.cpp
+//*******************************************************************
+
+#include "lmpch.h"
+#include "RenderGraph.h"
+#include "Memory/FrameArena.h"
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+    UINT64 AlignUp(UINT64 value, UINT64 alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    bool IsWriteState(D3D12_RESOURCE_STATES state)
+    {
+        return (state & (D3D12_RESOURCE_STATE_RENDER_TARGET |
+                         D3D12_RESOURCE_STATE_UNORDERED_ACCESS |
+                         D3D12_RESOURCE_STATE_DEPTH_WRITE |
+                         D3D12_RESOURCE_STATE_COPY_DEST |
+                         D3D12_RESOURCE_STATE_RESOLVE_DEST |
+                         D3D12_RESOURCE_STATE_STREAM_OUT)) != 0;
+    }
+}
+
+// ------------------------------------------------------------------
+// Declaration
+// ------------------------------------------------------------------
+RenderGraph::TextureDesc RenderGraph::DescribeTexture(ID3D12Device* device, const D3D12_RESOURCE_DESC& desc, const D3D12_CLEAR_VALUE* clearValue)
+{
+    TextureDesc texture;
+    texture.Desc = desc;
+    if (clearValue != nullptr)
+    {
+        texture.ClearValue = *clearValue;
+        texture.HasClearValue = true;
+    }
+
+    D3D12_RESOURCE_ALLOCATION_INFO info = device->GetResourceAllocationInfo(0, 1, &desc);
+    texture.Size = info.SizeInBytes;
+    texture.Alignment = info.Alignment;
+
+    return texture;
+}
+
+RenderGraph::ResourceHandle RenderGraph::ImportResource(const std::string& name, D3D12_RESOURCE_STATES initialState, D3D12_RESOURCE_STATES finalState)
+{
+    Resource resource;
+    resource.Name = name;
+    resource.IsImported = true;
+    resource.InitialState = initialState;
+    resource.FinalState = finalState;
+
+    mResources.push_back(std::move(resource));
+    return (ResourceHandle)mResources.size() - 1;
+}
+
+RenderGraph::ResourceHandle RenderGraph::CreateTexture(const std::string& name, const TextureDesc& desc)
+{
+    // Placed resources need their size and alignment up front.
+    assert(desc.Size != 0);
+    assert(desc.Alignment != 0 && (desc.Alignment & (desc.Alignment - 1)) == 0);
+
+    Resource resource;
+    resource.Name = name;
+    resource.Texture = desc;
+
+    mResources.push_back(std::move(resource));
+    return (ResourceHandle)mResources.size() - 1;
+}
+
+RenderGraph::PassHandle RenderGraph::AddPass(const std::string& name, bool hasSideEffects)
+{
+    Pass pass;
+    pass.Name = name;
+    pass.HasSideEffects = hasSideEffects;
+
+    mPasses.push_back(std::move(pass));
+    return (PassHandle)mPasses.size() - 1;
+}
+
+void RenderGraph::Read(PassHandle pass, ResourceHandle resource, D3D12_RESOURCE_STATES state)
+{
+    AddAccess(pass, resource, state, false);
+}
+
+void RenderGraph::Write(PassHandle pass, ResourceHandle resource, D3D12_RESOURCE_STATES state)
+{
+    assert(IsWriteState(state));
+    AddAccess(pass, resource, state, true);
+}
+
+void RenderGraph::AddAccess(PassHandle pass, ResourceHandle resource, D3D12_RESOURCE_STATES state, bool isWrite)
+{
+    assert(pass < mPasses.size());
+    assert(resource < mResources.size());
+
+    // A resource is in one state for the whole pass, so declaring it twice
+    // only makes sense if the states can be combined, i.e. both are reads.
+    for (Access& access : mPasses[pass].Accesses)
+    {
+        if (access.Resource == resource)
+        {
+            assert(!isWrite && !access.IsWrite);
+            access.State |= state;
+            return;
+        }
+    }
+
+    mPasses[pass].Accesses.push_back({ resource, state, isWrite });
+}
+
+// ------------------------------------------------------------------
+// Compilation
+// ------------------------------------------------------------------
+void RenderGraph::Compile()
+{
+    CullPasses();
+    ComputeLifetimes();
+    PlaceTransients();
+    BuildBarriers();
+}
+
+// ------------------------------------------------------------------
+// Walk the passes backwards from the ones whose results leave the
+// frame, i.e. those with side effects or writing to an imported
+// resource. A pass is live if a live pass after it reads something it
+// writes.
+// ------------------------------------------------------------------
+void RenderGraph::CullPasses()
+{
+    std::vector<bool> isNeeded(mResources.size(), false);
+    for (size_t i = 0; i < mResources.size(); ++i)
+        isNeeded[i] = mResources[i].IsImported;
+
+    mLivePassCount = 0;
+    for (size_t i = mPasses.size(); i-- > 0;)
+    {
+        Pass& pass = mPasses[i];
+
+        bool isLive = pass.HasSideEffects;
+        for (const Access& access : pass.Accesses)
+        {
+            if (access.IsWrite && isNeeded[access.Resource])
+                isLive = true;
+        }
+
+        pass.Culled = !isLive;
+        if (pass.Culled)
+            continue;
+
+        // Everything a live pass reads has to be produced by the passes
+        // before it. Writes are not marked as consumed, since the passes
+        // before may still add to the resource rather than replace it.
+        for (const Access& access : pass.Accesses)
+        {
+            if (!access.IsWrite)
+                isNeeded[access.Resource] = true;
+        }
+        ++mLivePassCount;
+    }
+}
+
+void RenderGraph::ComputeLifetimes()
+{
+    for (Resource& resource : mResources)
+    {
+        resource.FirstPass = InvalidIndex;
+        resource.LastPass = InvalidIndex;
+        resource.LastState = resource.InitialState;
+    }
+
+    for (UINT i = 0; i < (UINT)mPasses.size(); ++i)
+    {
+        if (mPasses[i].Culled)
+            continue;
+
+        for (const Access& access : mPasses[i].Accesses)
+        {
+            Resource& resource = mResources[access.Resource];
+            if (resource.FirstPass == InvalidIndex)
+                resource.FirstPass = i;
+            resource.LastPass = i;
+            resource.LastState = access.State;
+        }
+    }
+}
+
+// ------------------------------------------------------------------
+// Place the live transients largest first, each at the lowest offset
+// that does not overlap a placed transient alive at the same time.
+// ------------------------------------------------------------------
+void RenderGraph::PlaceTransients()
+{
+    std::vector<ResourceHandle> transients;
+    mTransientSize = 0;
+    mHeapAlignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+
+    for (ResourceHandle i = 0; i < (ResourceHandle)mResources.size(); ++i)
+    {
+        Resource& resource = mResources[i];
+        resource.HeapOffset = 0;
+        resource.IsAliased = false;
+
+        if (resource.IsImported || resource.FirstPass == InvalidIndex)
+            continue;
+
+        transients.push_back(i);
+        mTransientSize += resource.Texture.Size;
+        mHeapAlignment = std::max(mHeapAlignment, resource.Texture.Alignment);
+    }
+
+    std::stable_sort(transients.begin(), transients.end(), [this](ResourceHandle a, ResourceHandle b)
+    {
+        return mResources[a].Texture.Size > mResources[b].Texture.Size;
+    });
+
+    mHeapSize = 0;
+    std::vector<ResourceHandle> placed;
+    for (ResourceHandle handle : transients)
+    {
+        Resource& resource = mResources[handle];
+
+        // Ranges taken by the placed transients whose lifetimes overlap.
+        std::vector<std::pair<UINT64, UINT64>> taken;
+        for (ResourceHandle other : placed)
+        {
+            const Resource& o = mResources[other];
+            if (o.FirstPass <= resource.LastPass && resource.FirstPass <= o.LastPass)
+                taken.push_back({ o.HeapOffset, o.HeapOffset + o.Texture.Size });
+        }
+        std::sort(taken.begin(), taken.end());
+
+        UINT64 offset = 0;
+        for (const auto& range : taken)
+        {
+            if (offset + resource.Texture.Size <= range.first)
+                break;
+            offset = std::max(offset, AlignUp(range.second, resource.Texture.Alignment));
+        }
+
+        resource.HeapOffset = offset;
+        mHeapSize = std::max(mHeapSize, offset + resource.Texture.Size);
+        placed.push_back(handle);
+    }
+    mHeapSize = AlignUp(mHeapSize, mHeapAlignment);
+
+    // Any transient sharing memory with another one must be made the active
+    // resource there before its first use.
+    for (ResourceHandle a : placed)
+    {
+        for (ResourceHandle b : placed)
+        {
+            const Resource& ra = mResources[a];
+            const Resource& rb = mResources[b];
+            if (a != b && ra.HeapOffset < rb.HeapOffset + rb.Texture.Size && rb.HeapOffset < ra.HeapOffset + ra.Texture.Size)
+                mResources[a].IsAliased = true;
+        }
+    }
+}
+
+// ------------------------------------------------------------------
+// Track the state of every resource through the live passes. A
+// transient starts the frame in the state the frame leaves it in, which
+// is also the state it is created in, so the same barriers work every
+// frame.
+// ------------------------------------------------------------------
+void RenderGraph::BuildBarriers()
+{
+    std::vector<D3D12_RESOURCE_STATES> states(mResources.size());
+    for (size_t i = 0; i < mResources.size(); ++i)
+    {
+        const Resource& resource = mResources[i];
+        states[i] = resource.IsImported ? resource.InitialState : resource.LastState;
+    }
+
+    mBarrierCount = 0;
+    for (UINT i = 0; i < (UINT)mPasses.size(); ++i)
+    {
+        Pass& pass = mPasses[i];
+        pass.Barriers.clear();
+
+        if (pass.Culled)
+            continue;
+
+        for (const Access& access : pass.Accesses)
+        {
+            const Resource& resource = mResources[access.Resource];
+
+            if (resource.IsAliased && resource.FirstPass == i)
+            {
+                Barrier barrier;
+                barrier.Resource = access.Resource;
+                barrier.Aliasing = true;
+                pass.Barriers.push_back(barrier);
+            }
+
+            if (states[access.Resource] != access.State)
+            {
+                Barrier barrier;
+                barrier.Resource = access.Resource;
+                barrier.Before = states[access.Resource];
+                barrier.After = access.State;
+                pass.Barriers.push_back(barrier);
+
+                states[access.Resource] = access.State;
+            }
+        }
+        mBarrierCount += (UINT)pass.Barriers.size();
+    }
+
+    mFinalBarriers.clear();
+    for (ResourceHandle i = 0; i < (ResourceHandle)mResources.size(); ++i)
+    {
+        const Resource& resource = mResources[i];
+        if (resource.IsImported && states[i] != resource.FinalState)
+        {
+            Barrier barrier;
+            barrier.Resource = i;
+            barrier.Before = states[i];
+            barrier.After = resource.FinalState;
+            mFinalBarriers.push_back(barrier);
+        }
+    }
+    mBarrierCount += (UINT)mFinalBarriers.size();
+}
+
+// ------------------------------------------------------------------
+// Resources
+// ------------------------------------------------------------------
+void RenderGraph::Realize(ID3D12Device* device)
+{
+    for (Resource& resource : mResources)
+        resource.Transient.Reset();
+    mHeap.Reset();
+
+    if (mHeapSize == 0)
+        return;
+
+    D3D12_HEAP_DESC heapDesc = {};
+    heapDesc.SizeInBytes = mHeapSize;
+    heapDesc.Properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+    heapDesc.Alignment = mHeapAlignment;
+    heapDesc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES;
+    ThrowIfFailed(device->CreateHeap(&heapDesc, IID_PPV_ARGS(&mHeap)));
+
+    for (Resource& resource : mResources)
+    {
+        if (resource.IsImported || resource.FirstPass == InvalidIndex)
+            continue;
+
+        ThrowIfFailed(device->CreatePlacedResource(
+            mHeap.Get(),
+            resource.HeapOffset,
+            &resource.Texture.Desc,
+            resource.LastState,
+            resource.Texture.HasClearValue ? &resource.Texture.ClearValue : nullptr,
+            IID_PPV_ARGS(&resource.Transient)));
+
+#if defined(DEBUG) || defined(_DEBUG)
+        resource.Transient->SetName(AnsiToWString(resource.Name).c_str());
+#endif
+    }
+}
+
+void RenderGraph::SetImportedResource(ResourceHandle resource, ID3D12Resource* pointer)
+{
+    assert(mResources[resource].IsImported);
+    mResources[resource].Imported = pointer;
+}
+
+ID3D12Resource* RenderGraph::GetResource(ResourceHandle resource) const
+{
+    const Resource& r = mResources[resource];
+    return r.IsImported ? r.Imported : r.Transient.Get();
+}
+
+// ------------------------------------------------------------------
+// Recording
+// ------------------------------------------------------------------
+void RenderGraph::RecordPassBarriers(PassHandle pass, ID3D12GraphicsCommandList* cmdList) const
+{
+    assert(!mPasses[pass].Culled);
+    RecordBarriers(mPasses[pass].Barriers, cmdList);
+}
+
+void RenderGraph::RecordFinalBarriers(ID3D12GraphicsCommandList* cmdList) const
+{
+    RecordBarriers(mFinalBarriers, cmdList);
+}
+
+void RenderGraph::RecordBarriers(const std::vector<Barrier>& barriers, ID3D12GraphicsCommandList* cmdList) const
+{
+    if (barriers.empty())
+        return;
+
+    // Recorded on the worker threads every frame, so the list comes from
+    // their arenas.
+    FrameArena::Scope scope;
+    std::pmr::vector<D3D12_RESOURCE_BARRIER> d3dBarriers(&scope.Arena());
+    d3dBarriers.reserve(barriers.size());
+
+    for (const Barrier& barrier : barriers)
+    {
+        ID3D12Resource* resource = GetResource(barrier.Resource);
+        assert(resource != nullptr);
+
+        if (barrier.Aliasing)
+            d3dBarriers.push_back(CD3DX12_RESOURCE_BARRIER::Aliasing(nullptr, resource));
+        else
+            d3dBarriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(resource, barrier.Before, barrier.After));
+    }
+
+    cmdList->ResourceBarrier((UINT)d3dBarriers.size(), d3dBarriers.data());
+}
@@ -0,0 +1,170 @@
+//*******************************************************************
+// RenderGraph.h:
+//
+// Frame graph over the passes of a frame. Passes are declared in
+// submission order together with the resources they read and write
+// and the state they need them in. Compiling the graph culls passes
+// whose output nothing uses, works out every state transition, and
+// places the transient textures in one heap so that textures whose
+// lifetimes do not overlap share memory.
+//
+// Compile only looks at the declarations, so the barriers and the heap
+// layout can be inspected without a device. Realize then creates the
+// heap and the transient textures once; the compiled barriers are
+// replayed every frame.
+//*******************************************************************
+
+#pragma once
+
+#include "Utils/DXUtil.h"
+
+class RenderGraph
+{
+public:
+	using ResourceHandle = UINT;
+	using PassHandle = UINT;
+
+	static constexpr UINT InvalidIndex = 0xFFFFFFFF;
+
+	struct TextureDesc
+	{
+		D3D12_RESOURCE_DESC Desc = {};
+		D3D12_CLEAR_VALUE ClearValue = {};
+		bool HasClearValue = false;
+
+		// Placement requirements, as reported by the device.
+		UINT64 Size = 0;
+		UINT64 Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+	};
+
+	struct Barrier
+	{
+		ResourceHandle Resource = InvalidIndex;
+		D3D12_RESOURCE_STATES Before = D3D12_RESOURCE_STATE_COMMON;
+		D3D12_RESOURCE_STATES After = D3D12_RESOURCE_STATE_COMMON;
+
+		// Makes the resource the active one in memory it shares with other
+		// transients. Its contents are undefined afterwards, so the pass
+		// must clear or fully overwrite it.
+		bool Aliasing = false;
+	};
+
+	RenderGraph() = default;
+
+	RenderGraph(const RenderGraph& rhs) = delete;
+	RenderGraph& operator=(const RenderGraph& rhs) = delete;
+
+	// Fill in the placement requirements of a texture description.
+	static TextureDesc DescribeTexture(ID3D12Device* device, const D3D12_RESOURCE_DESC& desc, const D3D12_CLEAR_VALUE* clearValue);
+
+	// A resource owned outside the graph. It is in initialState when the
+	// frame starts and is left in finalState. Writing to it keeps a pass
+	// from being culled.
+	ResourceHandle ImportResource(const std::string& name, D3D12_RESOURCE_STATES initialState, D3D12_RESOURCE_STATES finalState);
+
+	// A texture that only lives within the frame, created by Realize.
+	ResourceHandle CreateTexture(const std::string& name, const TextureDesc& desc);
+
+	// Passes are executed in the order they are added. Passes with side
+	// effects are never culled.
+	PassHandle AddPass(const std::string& name, bool hasSideEffects = false);
+
+	void Read(PassHandle pass, ResourceHandle resource, D3D12_RESOURCE_STATES state);
+	void Write(PassHandle pass, ResourceHandle resource, D3D12_RESOURCE_STATES state);
+
+	void Compile();
+
+	// Create the heap and the transient textures. The GPU must not be using
+	// the textures of an earlier Realize.
+	void Realize(ID3D12Device* device);
+
+	// Imported resources can change from frame to frame, e.g. the back buffer.
+	void SetImportedResource(ResourceHandle resource, ID3D12Resource* pointer);
+	ID3D12Resource* GetResource(ResourceHandle resource) const;
+
+	bool IsPassCulled(PassHandle pass) const { return mPasses[pass].Culled; }
+
+	// Record the barriers needed before a pass, and the ones returning the
+	// imported resources to their final states after the last pass.
+	void RecordPassBarriers(PassHandle pass, ID3D12GraphicsCommandList* cmdList) const;
+	void RecordFinalBarriers(ID3D12GraphicsCommandList* cmdList) const;
+
+	const std::vector<Barrier>& GetPassBarriers(PassHandle pass) const { return mPasses[pass].Barriers; }
+	const std::vector<Barrier>& GetFinalBarriers() const { return mFinalBarriers; }
+
+	UINT PassCount() const { return (UINT)mPasses.size(); }
+	UINT LivePassCount() const { return mLivePassCount; }
+	UINT BarrierCount() const { return mBarrierCount; }
+
+	// Offset of a transient texture in the heap.
+	UINT64 GetHeapOffset(ResourceHandle resource) const { return mResources[resource].HeapOffset; }
+
+	// Memory of the transient heap, and what the live transients would
+	// need without aliasing.
+	UINT64 HeapSize() const { return mHeapSize; }
+	UINT64 TransientSize() const { return mTransientSize; }
+
+private:
+	struct Access
+	{
+		ResourceHandle Resource;
+		D3D12_RESOURCE_STATES State;
+		bool IsWrite;
+	};
+
+	struct Pass
+	{
+		std::string Name;
+		bool HasSideEffects = false;
+		std::vector<Access> Accesses;
+
+		bool Culled = false;
+		std::vector<Barrier> Barriers;
+	};
+
+	struct Resource
+	{
+		std::string Name;
+		bool IsImported = false;
+
+		// Imported resources only.
+		D3D12_RESOURCE_STATES InitialState = D3D12_RESOURCE_STATE_COMMON;
+		D3D12_RESOURCE_STATES FinalState = D3D12_RESOURCE_STATE_COMMON;
+		ID3D12Resource* Imported = nullptr;
+
+		// Transient textures only.
+		TextureDesc Texture;
+		Microsoft::WRL::ComPtr<ID3D12Resource> Transient;
+
+		// Live passes that first and last access the resource, and the state
+		// the last one leaves it in.
+		UINT FirstPass = InvalidIndex;
+		UINT LastPass = InvalidIndex;
+		D3D12_RESOURCE_STATES LastState = D3D12_RESOURCE_STATE_COMMON;
+
+		UINT64 HeapOffset = 0;
+		bool IsAliased = false;
+	};
+
+	void AddAccess(PassHandle pass, ResourceHandle resource, D3D12_RESOURCE_STATES state, bool isWrite);
+
+	void CullPasses();
+	void ComputeLifetimes();
+	void PlaceTransients();
+	void BuildBarriers();
+
+	void RecordBarriers(const std::vector<Barrier>& barriers, ID3D12GraphicsCommandList* cmdList) const;
+
+private:
+	std::vector<Pass> mPasses;
+	std::vector<Resource> mResources;
+	std::vector<Barrier> mFinalBarriers;
+
+	UINT mLivePassCount = 0;
+	UINT mBarrierCount = 0;
+
+	UINT64 mHeapSize = 0;
+	UINT64 mHeapAlignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+	UINT64 mTransientSize = 0;
+	Microsoft::WRL::ComPtr<ID3D12Heap> mHeap;
+};
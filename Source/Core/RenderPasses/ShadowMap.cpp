@@ -14,8 +14,6 @@ ShadowMap::ShadowMap(ID3D12Device* device, DescriptorHeapWrapper* pDescHeap, UIN
 
 	mViewport = { 0.0f, 0.0f, (float)width, (float)height, 0.0f, 1.0f };
 	mScissorRect = { 0, 0, (int)width, (int)height };
-
-	BuildResource();
 }
 
 UINT ShadowMap::Width()const
@@ -30,7 +28,7 @@ UINT ShadowMap::Height()const
 
 ID3D12Resource* ShadowMap::Resource()
 {
-	return mShadowMap.Get();
+	return mShadowMap;
 }
 
 CD3DX12_CPU_DESCRIPTOR_HANDLE ShadowMap::Dsv()const
@@ -57,6 +55,11 @@ void ShadowMap::BuildDescriptors(CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDsv)
 	BuildDescriptors();
 }
 
+void ShadowMap::SetResource(ID3D12Resource* resource)
+{
+	mShadowMap = resource;
+}
+
 void ShadowMap::OnResize(UINT newWidth, UINT newHeight)
 {
 	if ((mWidth != newWidth) || (mHeight != newHeight))
@@ -64,13 +67,20 @@ void ShadowMap::OnResize(UINT newWidth, UINT newHeight)
 		mWidth = newWidth;
 		mHeight = newHeight;
 
-		BuildResource();
+		mViewport = { 0.0f, 0.0f, (float)newWidth, (float)newHeight, 0.0f, 1.0f };
+		mScissorRect = { 0, 0, (int)newWidth, (int)newHeight };
 
-		// New resource, so we need new descriptors to that resource.
-		BuildDescriptors();
+		// The old texture no longer matches; the owner creates one from
+		// ResourceDesc() and hands it over with SetResource().
+		mShadowMap = nullptr;
 	}
 }
 
+void ShadowMap::CreateSrv(UINT heapIndex)
+{
+	mCbvSrvUavDescriptorHeap->CreateSrvDescriptor(md3dDevice, mShadowMap, D3D12_SRV_DIMENSION_TEXTURE2D, SHADOW_MAP, heapIndex);
+}
+
 void ShadowMap::BuildDescriptors()
 {
 	// Create SRV to resource so we can sample the shadow map in a shader program.
@@ -83,7 +93,7 @@ void ShadowMap::BuildDescriptors()
 	//srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
 	//srvDesc.Texture2D.PlaneSlice = 0;8\
 	//md3dDevice->CreateShaderResourceView(mShadowMap.Get(), &srvDesc, mhCpuSrv);
-	mCbvSrvUavDescriptorHeap->CreateSrvDescriptor(md3dDevice, mShadowMap.Get(), D3D12_SRV_DIMENSION_TEXTURE2D, SHADOW_MAP);
+	// The SRV is written with CreateSrv, into the table it is sampled from.
 
 	// Create DSV to resource so we can render to the shadow map.
 	D3D12_DEPTH_STENCIL_VIEW_DESC dsvDesc;
@@ -91,10 +101,10 @@ void ShadowMap::BuildDescriptors()
 	dsvDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
 	dsvDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
 	dsvDesc.Texture2D.MipSlice = 0;
-	md3dDevice->CreateDepthStencilView(mShadowMap.Get(), &dsvDesc, mhCpuDsv);
+	md3dDevice->CreateDepthStencilView(mShadowMap, &dsvDesc, mhCpuDsv);
 }
 
-void ShadowMap::BuildResource()
+D3D12_RESOURCE_DESC ShadowMap::ResourceDesc()const
 {
 	D3D12_RESOURCE_DESC texDesc;
 	ZeroMemory(&texDesc, sizeof(D3D12_RESOURCE_DESC));
@@ -110,16 +120,15 @@ void ShadowMap::BuildResource()
 	texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
 	texDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
 
+	return texDesc;
+}
+
+D3D12_CLEAR_VALUE ShadowMap::ClearValue()const
+{
 	D3D12_CLEAR_VALUE optClear;
 	optClear.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
 	optClear.DepthStencil.Depth = 1.0f;
 	optClear.DepthStencil.Stencil = 0;
 
-	ThrowIfFailed(md3dDevice->CreateCommittedResource(
-		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-		D3D12_HEAP_FLAG_NONE,
-		&texDesc,
-		D3D12_RESOURCE_STATE_GENERIC_READ,
-		&optClear,
-		IID_PPV_ARGS(&mShadowMap)));
-}
\ No newline at end of file
+	return optClear;
+}
@@ -2,7 +2,8 @@
 // ShadowMap.h:
 //
 // Utility class that stores the scene depth from perspective of the 
-// light source.
+// light source. The texture itself is a transient of the render graph;
+// the shadow map describes it and creates the views once it exists.
 //*******************************************************************
 
 #pragma once
@@ -26,16 +27,25 @@ public:
 	ID3D12Resource* Resource();
 	CD3DX12_CPU_DESCRIPTOR_HANDLE Dsv()const;
 
+	// Description and optimized clear value of the depth texture.
+	D3D12_RESOURCE_DESC ResourceDesc()const;
+	D3D12_CLEAR_VALUE ClearValue()const;
+
+	// Hand over the depth texture, before the descriptors are built.
+	void SetResource(ID3D12Resource* resource);
+
 	D3D12_VIEWPORT Viewport()const;
 	D3D12_RECT ScissorRect()const;
 
 	void BuildDescriptors(CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDsv);
 
+	// Write the SRV of the current texture at heapIndex of the heap.
+	void CreateSrv(UINT heapIndex);
+
 	void OnResize(UINT newWidth, UINT newHeight);
 
 private:
 	void BuildDescriptors();
-	void BuildResource();
 
 private:
 
@@ -51,5 +61,5 @@ private:
 
 	CD3DX12_CPU_DESCRIPTOR_HANDLE mhCpuDsv;
 
-	Microsoft::WRL::ComPtr<ID3D12Resource> mShadowMap = nullptr;
+	ID3D12Resource* mShadowMap = nullptr;
 };
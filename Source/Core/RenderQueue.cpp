@@ -0,0 +1,205 @@
+//*******************************************************************
+// RenderQueue.cpp
+//*******************************************************************
+#include "lmpch.h"
+#include "RenderQueue.h"
+
+namespace
+{
+    inline UINT64 Field(UINT value, UINT bits)
+    {
+        return (UINT64)(value & ((1u << bits) - 1));
+    }
+}
+
+RenderQueue::RenderQueue()
+{
+    std::fill(std::begin(mLayerBegin), std::end(mLayerBegin), 0);
+    std::fill(std::begin(mLayerBatchBegin), std::end(mLayerBatchBegin), 0);
+}
+
+UINT64 RenderQueue::MakeKey(UINT layer, UINT pso, UINT geometry, UINT material, float viewDepth, DepthOrder order)
+{
+    static_assert(LayerBits + PSOBits + GeometryBits + MaterialBits + DepthBits < 64, "Sort key fields leave no bit for the layout");
+
+    UINT depth = QuantizeDepth(viewDepth);
+
+    UINT64 key = Field(layer, LayerBits);
+    if (order == DepthOrder::BackToFront)
+    {
+        // Farthest first, state only breaks ties.
+        key = (key << DepthBits) | Field(~depth, DepthBits);
+        key = (key << PSOBits) | Field(pso, PSOBits);
+        key = (key << GeometryBits) | Field(geometry, GeometryBits);
+        key = (key << MaterialBits) | Field(material, MaterialBits);
+    }
+    else
+    {
+        key = (key << PSOBits) | Field(pso, PSOBits);
+        key = (key << GeometryBits) | Field(geometry, GeometryBits);
+        key = (key << MaterialBits) | Field(material, MaterialBits);
+        key = (key << DepthBits) | Field(depth, DepthBits);
+    }
+
+    // Left-align, so the layer always sits in the top bits. One of the
+    // unused bits below records the layout.
+    key <<= 64 - LayerBits - PSOBits - GeometryBits - MaterialBits - DepthBits;
+    if (order == DepthOrder::BackToFront)
+        key |= BackToFrontBit;
+
+    return key;
+}
+
+UINT RenderQueue::PSOOf(UINT64 key)
+{
+    const UINT shift = (key & BackToFrontBit) ?
+        64 - LayerBits - DepthBits - PSOBits : 64 - LayerBits - PSOBits;
+
+    return (UINT)Field((UINT)(key >> shift), PSOBits);
+}
+
+UINT RenderQueue::QuantizeDepth(float viewDepth)
+{
+    // Also catches NaN.
+    if (!(viewDepth > 0.0f))
+        return 0;
+
+    UINT bits;
+    memcpy(&bits, &viewDepth, sizeof(bits));
+
+    // The sign bit is clear, so the top 24 of the remaining 31 bits: the
+    // exponent and 16 of the 23 mantissa bits.
+    return bits >> (31 - DepthBits);
+}
+
+void RenderQueue::Clear()
+{
+    mEntries.clear();
+    mItems.clear();
+    mBatches.clear();
+    std::fill(std::begin(mLayerBegin), std::end(mLayerBegin), 0);
+    std::fill(std::begin(mLayerBatchBegin), std::end(mLayerBatchBegin), 0);
+}
+
+void RenderQueue::Push(UINT64 key, RenderItem* item)
+{
+    mEntries.push_back({ key, item });
+}
+
+void RenderQueue::Sort(bool mergeBatches)
+{
+    RadixSort(mEntries, mScratch);
+
+    mItems.resize(mEntries.size());
+    for (size_t i = 0; i < mEntries.size(); ++i)
+        mItems[i] = mEntries[i].Item;
+
+    // Layers are the top bits of the key, so each occupies one run.
+    UINT e = 0;
+    for (UINT layer = 0; layer < MaxLayers; ++layer)
+    {
+        mLayerBegin[layer] = e;
+        while (e < (UINT)mEntries.size() && LayerOf(mEntries[e].Key) == layer)
+            ++e;
+    }
+    mLayerBegin[MaxLayers] = e;
+
+    // Batches never cross layers, so they split at the layer boundaries.
+    mBatches.clear();
+    for (UINT layer = 0; layer < MaxLayers; ++layer)
+    {
+        mLayerBatchBegin[layer] = (UINT)mBatches.size();
+
+        for (UINT i = mLayerBegin[layer]; i < mLayerBegin[layer + 1]; ++i)
+        {
+            if (mergeBatches && i > mLayerBegin[layer] && PSOOf(mEntries[i - 1].Key) == PSOOf(mEntries[i].Key) &&
+                CanBatch(*mItems[i - 1], *mItems[i]))
+            {
+                ++mBatches.back().ItemCount;
+                continue;
+            }
+
+            Batch batch;
+            batch.FirstItem = i;
+            batch.ItemCount = 1;
+            mBatches.push_back(batch);
+        }
+    }
+    mLayerBatchBegin[MaxLayers] = (UINT)mBatches.size();
+}
+
+bool RenderQueue::CanBatch(const RenderItem& a, const RenderItem& b)
+{
+    return a.Geo == b.Geo &&
+        a.IndexCount == b.IndexCount &&
+        a.StartIndexLocation == b.StartIndexLocation &&
+        a.BaseVertexLocation == b.BaseVertexLocation &&
+        a.PrimitiveType == b.PrimitiveType &&
+        a.layerID == b.layerID &&
+        a.LODs.empty() && b.LODs.empty();
+}
+
+RenderQueue::DrawList RenderQueue::GetLayer(UINT layer) const
+{
+    assert(layer < MaxLayers);
+
+    const UINT begin = mLayerBegin[layer];
+    return DrawList(mItems.data() + begin, mLayerBegin[layer + 1] - begin);
+}
+
+RenderQueue::ConstBatchList RenderQueue::GetBatches(UINT layer) const
+{
+    assert(layer < MaxLayers);
+
+    const UINT begin = mLayerBatchBegin[layer];
+    return ConstBatchList(mBatches.data() + begin, mLayerBatchBegin[layer + 1] - begin);
+}
+
+void RenderQueue::RadixSort(std::vector<Entry>& entries, std::vector<Entry>& scratch)
+{
+    const size_t count = entries.size();
+    if (count < 2)
+        return;
+
+    // All eight histograms in one read over the keys.
+    UINT histograms[8][256] = {};
+    for (const Entry& entry : entries)
+    {
+        UINT64 key = entry.Key;
+        for (int b = 0; b < 8; ++b)
+            ++histograms[b][(key >> (8 * b)) & 0xFF];
+    }
+
+    scratch.resize(count);
+    Entry* src = entries.data();
+    Entry* dst = scratch.data();
+
+    for (int b = 0; b < 8; ++b)
+    {
+        UINT* histogram = histograms[b];
+
+        // Every key has the same byte here; the pass would not move anything.
+        if (histogram[(src[0].Key >> (8 * b)) & 0xFF] == count)
+            continue;
+
+        UINT offset = 0;
+        for (int i = 0; i < 256; ++i)
+        {
+            UINT n = histogram[i];
+            histogram[i] = offset;
+            offset += n;
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const Entry& entry = src[i];
+            dst[histogram[(entry.Key >> (8 * b)) & 0xFF]++] = entry;
+        }
+
+        std::swap(src, dst);
+    }
+
+    // An odd number of passes leaves the result in the scratch buffer.
+    if (src != entries.data())
+        entries.swap(scratch);
+}
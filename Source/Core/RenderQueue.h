@@ -0,0 +1,157 @@
+//*******************************************************************
+// RenderQueue.h:
+//
+// Draws of a frame ordered by a 64-bit sort key. The key packs the
+// layer, pipeline state, geometry, material and a quantized view depth
+// so that sorting the keys both groups draws sharing state and orders
+// them by distance. Opaque layers are drawn front to back within each
+// state bucket; blended layers are ordered back to front first.
+//
+// After sorting, neighbouring render items that draw the same submesh
+// with the same pipeline state are merged into batches, which the
+// caller draws with one instanced draw over their combined instances.
+//*******************************************************************
+
+#pragma once
+
+#include "RenderItem.h"
+
+class RenderQueue
+{
+public:
+	// Key layout, most significant field first. Opaque keys store
+	// layer | pso | geometry | material | depth; back-to-front keys move the
+	// inverted depth up behind the layer. The lowest bit tells the two apart.
+	static const UINT LayerBits = 4;
+	static const UINT PSOBits = 8;
+	static const UINT GeometryBits = 12;
+	static const UINT MaterialBits = 12;
+	static const UINT DepthBits = 24;
+	static const UINT MaxLayers = 1u << LayerBits;
+
+	enum class DepthOrder
+	{
+		FrontToBack,
+		BackToFront
+	};
+
+	struct Entry
+	{
+		UINT64 Key;
+		RenderItem* Item;
+	};
+
+	// Run of sorted render items that are drawn together. The caller fills
+	// in where their instances are and how many there are.
+	struct Batch
+	{
+		UINT FirstItem = 0;     // Index into GetItems()
+		UINT ItemCount = 0;
+		UINT InstanceOffset = 0;
+		UINT InstanceCount = 0;
+	};
+
+	// Contiguous run of sorted elements.
+	template<typename T>
+	class Range
+	{
+	public:
+		Range(T* elements, UINT count) : mElements(elements), mCount(count) {}
+
+		T* begin() const { return mElements; }
+		T* end() const { return mElements + mCount; }
+		T& operator[](UINT i) const { return mElements[i]; }
+		UINT size() const { return mCount; }
+		bool empty() const { return mCount == 0; }
+
+	private:
+		T* mElements;
+		UINT mCount;
+	};
+
+	using DrawList = Range<RenderItem* const>;
+	using BatchList = Range<Batch>;
+	using ConstBatchList = Range<const Batch>;
+
+	RenderQueue();
+
+	RenderQueue(const RenderQueue& rhs) = delete;
+	RenderQueue& operator=(const RenderQueue& rhs) = delete;
+
+	// Fields wider than their bits are truncated. Depth is the distance
+	// along the view direction; negative values count as 0.
+	static UINT64 MakeKey(UINT layer, UINT pso, UINT geometry, UINT material, float viewDepth, DepthOrder order);
+
+	// Monotonic 24-bit code of a non-negative depth: the top bits of its
+	// float representation, which keep the 8 exponent bits and the top 16
+	// mantissa bits.
+	static UINT QuantizeDepth(float viewDepth);
+
+	static UINT LayerOf(UINT64 key) { return (UINT)(key >> (64 - LayerBits)); }
+	static UINT PSOOf(UINT64 key);
+
+	void Clear();
+	void Push(UINT64 key, RenderItem* item);
+
+	// Sort the pushed draws by key and group them into batches. Without
+	// merging every render item is a batch of its own.
+	void Sort(bool mergeBatches = true);
+
+	UINT Size() const { return (UINT)mEntries.size(); }
+
+	// Sorted draws, of all layers or of one. Only valid after Sort.
+	DrawList GetItems() const { return DrawList(mItems.data(), (UINT)mItems.size()); }
+	DrawList GetLayer(UINT layer) const;
+
+	BatchList GetBatches() { return BatchList(mBatches.data(), (UINT)mBatches.size()); }
+	ConstBatchList GetBatches(UINT layer) const;
+
+	// Fill in the instance counts of the batches, with instanceCountOf(item)
+	// the number of instances a render item draws, and place the instances
+	// of the batches merging several items back to back from 0. Returns how
+	// many instances those batches hold. Only valid after Sort.
+	template<typename TInstanceCount>
+	UINT AssignInstances(const TInstanceCount& instanceCountOf)
+	{
+		UINT offset = 0;
+		for (Batch& batch : mBatches)
+		{
+			batch.InstanceCount = 0;
+			for (UINT i = 0; i < batch.ItemCount; ++i)
+				batch.InstanceCount += instanceCountOf(*mItems[batch.FirstItem + i]);
+
+			// A render item on its own draws from its own list.
+			if (batch.ItemCount == 1)
+				continue;
+
+			batch.InstanceOffset = offset;
+			offset += batch.InstanceCount;
+		}
+		return offset;
+	}
+
+	// Whether two render items can share one instanced draw: the same
+	// submesh, topology and layer, and no level of detail chain. Sort also
+	// requires the same pipeline state in their keys.
+	static bool CanBatch(const RenderItem& a, const RenderItem& b);
+
+	// LSD radix sort of the entries by key, one byte per pass. Passes over
+	// bytes that every key shares are skipped, so the unused top bits of
+	// the key cost nothing. scratch is resized as needed.
+	static void RadixSort(std::vector<Entry>& entries, std::vector<Entry>& scratch);
+
+private:
+	static const UINT64 BackToFrontBit = 1;
+
+private:
+	std::vector<Entry> mEntries;
+	std::vector<Entry> mScratch;
+
+	// Items in key order, and where each layer starts among them.
+	std::vector<RenderItem*> mItems;
+	UINT mLayerBegin[MaxLayers + 1];
+
+	// Batches in item order, and where each layer starts among them.
+	std::vector<Batch> mBatches;
+	UINT mLayerBatchBegin[MaxLayers + 1];
+};
@@ -0,0 +1,282 @@
+//*******************************************************************
+// ShaderCache.cpp
+//*******************************************************************
+#include "lmpch.h"
+#include "ShaderCache.h"
+
+using Microsoft::WRL::ComPtr;
+namespace fs = std::filesystem;
+
+namespace
+{
+    const UINT64 FnvPrime = 0x100000001B3ull;
+
+    // Bump when the key or the file layout changes.
+    const UINT CacheVersion = 1;
+    const UINT CacheMagic = 0x43534D4C;    // "LMSC"
+
+    struct CacheFileHeader
+    {
+        UINT Magic;
+        UINT Version;
+        UINT64 Key;
+        UINT64 ByteCodeSize;
+    };
+
+    UINT64 HashString(const std::string& str, UINT64 hash)
+    {
+        // Include the terminator, so "ab" + "c" and "a" + "bc" differ.
+        return ShaderCache::Hash(str.c_str(), str.size() + 1, hash);
+    }
+
+    bool ReadFile(const fs::path& path, std::string& contents)
+    {
+        std::ifstream fin(path, std::ios::binary);
+        if (!fin)
+            return false;
+
+        std::ostringstream stream;
+        stream << fin.rdbuf();
+        contents = stream.str();
+        return true;
+    }
+
+    // Names in the #include directives of an HLSL source, in order. Line
+    // comments are skipped; includes inside block comments or disabled
+    // #if branches are still reported, which at worst adds a file to the
+    // key that does not need to be there.
+    std::vector<std::string> FindIncludes(const std::string& source)
+    {
+        std::vector<std::string> includes;
+
+        std::istringstream lines(source);
+        std::string line;
+        while (std::getline(lines, line))
+        {
+            size_t pos = line.find_first_not_of(" \t");
+            if (pos == std::string::npos || line[pos] != '#')
+                continue;
+
+            pos = line.find_first_not_of(" \t", pos + 1);
+            if (pos == std::string::npos || line.compare(pos, 7, "include") != 0)
+                continue;
+
+            size_t open = line.find_first_of("\"<", pos + 7);
+            if (open == std::string::npos)
+                continue;
+
+            size_t close = line.find(line[open] == '"' ? '"' : '>', open + 1);
+            if (close != std::string::npos)
+                includes.push_back(line.substr(open + 1, close - open - 1));
+        }
+
+        return includes;
+    }
+}
+
+ShaderCache::ShaderCache(const std::wstring& cacheFolder) :
+    mCacheFolder(cacheFolder)
+{
+    // A cache that cannot be created only costs the compile time.
+    std::error_code error;
+    fs::create_directories(mCacheFolder, error);
+}
+
+UINT64 ShaderCache::Hash(const void* data, std::size_t size, UINT64 hash)
+{
+    const BYTE* bytes = static_cast<const BYTE*>(data);
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= FnvPrime;
+    }
+    return hash;
+}
+
+void ShaderCache::Add(const std::string& name, const std::wstring& filename, const D3D_SHADER_MACRO* defines,
+    const std::string& entrypoint, const std::string& target)
+{
+    Entry entry;
+    entry.Name = name;
+    entry.Filename = filename;
+    entry.EntryPoint = entrypoint;
+    entry.Target = target;
+
+    for (const D3D_SHADER_MACRO* define = defines; define != nullptr && define->Name != nullptr; ++define)
+        entry.Defines.emplace_back(define->Name, define->Definition != nullptr ? define->Definition : "");
+
+    mEntries.push_back(std::move(entry));
+}
+
+// ------------------------------------------------------------------
+// Look every queued shader up by key, then compile the misses on
+// worker threads. D3DCompile does not share state between calls, so
+// the misses need no locking.
+// ------------------------------------------------------------------
+void ShaderCache::Build(std::unordered_map<std::string, ComPtr<ID3DBlob>>& shaders)
+{
+    auto buildStart = std::chrono::steady_clock::now();
+
+    mClosureHashes.clear();
+    mHitCount = 0;
+    mMissCount = 0;
+
+    std::vector<Entry*> misses;
+    for (Entry& entry : mEntries)
+    {
+        entry.Key = ComputeKey(entry);
+        entry.ByteCode = Load(entry.Key);
+
+        if (entry.ByteCode != nullptr)
+            ++mHitCount;
+        else
+            misses.push_back(&entry);
+    }
+    mMissCount = (UINT)misses.size();
+
+    concurrency::parallel_for(size_t(0), misses.size(), [&](size_t i)
+    {
+        Entry* entry = misses[i];
+
+        // Build the define array back from the copies.
+        std::vector<D3D_SHADER_MACRO> defines;
+        for (const auto& define : entry->Defines)
+            defines.push_back({ define.first.c_str(), define.second.c_str() });
+        defines.push_back({ nullptr, nullptr });
+
+        entry->ByteCode = DXUtil::CompileShader(entry->Filename, defines.data(), entry->EntryPoint, entry->Target);
+        Store(entry->Key, entry->ByteCode.Get());
+    });
+
+    for (Entry& entry : mEntries)
+        shaders[entry.Name] = entry.ByteCode;
+    mEntries.clear();
+
+    mBuildTimeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+}
+
+// ------------------------------------------------------------------
+// Keys
+// ------------------------------------------------------------------
+UINT64 ShaderCache::ComputeKey(const Entry& entry)
+{
+    UINT64 hash = HashBasis;
+    hash = Hash(&CacheVersion, sizeof(CacheVersion), hash);
+
+    // Shaders of the same file share the hash of its include closure.
+    auto closure = mClosureHashes.find(entry.Filename);
+    if (closure == mClosureHashes.end())
+    {
+        std::set<fs::path> visited;
+        closure = mClosureHashes.emplace(entry.Filename, HashIncludeClosure(entry.Filename, HashBasis, visited)).first;
+    }
+    hash = Hash(&closure->second, sizeof(closure->second), hash);
+
+    for (const auto& define : entry.Defines)
+    {
+        hash = HashString(define.first, hash);
+        hash = HashString(define.second, hash);
+    }
+    hash = HashString(entry.EntryPoint, hash);
+    hash = HashString(entry.Target, hash);
+
+    UINT compileFlags = DXUtil::GetShaderCompileFlags();
+    hash = Hash(&compileFlags, sizeof(compileFlags), hash);
+
+    return hash;
+}
+
+UINT64 ShaderCache::HashIncludeClosure(const fs::path& file, UINT64 hash, std::set<fs::path>& visited)
+{
+    std::error_code error;
+    fs::path canonical = fs::weakly_canonical(file, error);
+    if (error)
+        canonical = file;
+
+    if (!visited.insert(canonical).second)
+        return hash;
+
+    // The name ends up in the debug information of the bytecode.
+    std::string name = canonical.filename().string();
+    hash = HashString(name, hash);
+
+    std::string source;
+    if (!ReadFile(canonical, source))
+    {
+        // Missing files are left to the compiler to report; a key that
+        // changes every run keeps the result from being cached.
+        UINT64 now = (UINT64)std::chrono::steady_clock::now().time_since_epoch().count();
+        return Hash(&now, sizeof(now), hash);
+    }
+    hash = Hash(source.data(), source.size(), hash);
+
+    // The standard include handler resolves names relative to the
+    // including file.
+    for (const std::string& include : FindIncludes(source))
+        hash = HashIncludeClosure(canonical.parent_path() / include, hash, visited);
+
+    return hash;
+}
+
+// ------------------------------------------------------------------
+// Cache files
+// ------------------------------------------------------------------
+fs::path ShaderCache::EntryPath(UINT64 key) const
+{
+    char name[32];
+    sprintf_s(name, "%016llx.cso", (unsigned long long)key);
+    return mCacheFolder / name;
+}
+
+ComPtr<ID3DBlob> ShaderCache::Load(UINT64 key) const
+{
+    std::ifstream fin(EntryPath(key), std::ios::binary);
+    if (!fin)
+        return nullptr;
+
+    CacheFileHeader header;
+    if (!fin.read((char*)&header, sizeof(header)))
+        return nullptr;
+
+    // A file of another version or cut short by a crash is a miss.
+    if (header.Magic != CacheMagic || header.Version != CacheVersion || header.Key != key || header.ByteCodeSize == 0)
+        return nullptr;
+
+    ComPtr<ID3DBlob> byteCode;
+    if (FAILED(D3DCreateBlob((SIZE_T)header.ByteCodeSize, byteCode.GetAddressOf())))
+        return nullptr;
+
+    if (!fin.read((char*)byteCode->GetBufferPointer(), (std::streamsize)header.ByteCodeSize))
+        return nullptr;
+
+    return byteCode;
+}
+
+void ShaderCache::Store(UINT64 key, ID3DBlob* byteCode) const
+{
+    CacheFileHeader header;
+    header.Magic = CacheMagic;
+    header.Version = CacheVersion;
+    header.Key = key;
+    header.ByteCodeSize = byteCode->GetBufferSize();
+
+    // Write to a temporary file first, so an entry is either complete or
+    // absent even if two instances of the app build at the same time.
+    fs::path path = EntryPath(key);
+    fs::path tempPath = path;
+    tempPath += ".tmp" + std::to_string(GetCurrentThreadId());
+    bool written;
+    {
+        std::ofstream fout(tempPath, std::ios::binary | std::ios::trunc);
+        fout.write((const char*)&header, sizeof(header));
+        fout.write((const char*)byteCode->GetBufferPointer(), (std::streamsize)header.ByteCodeSize);
+        written = (bool)fout;
+    }
+
+    // Failing to cache a shader is not an error; it is compiled next time.
+    std::error_code error;
+    if (written)
+        fs::rename(tempPath, path, error);
+    if (!written || error)
+        fs::remove(tempPath, error);
+}
@@ -0,0 +1,75 @@
+//*******************************************************************
+// ShaderCache.h:
+//
+// Persistent cache of compiled shader bytecode. Every shader is keyed
+// by a hash of its source file and everything the file includes,
+// together with its defines, entry point, target and compile flags,
+// so editing any file a shader depends on gives it a new key and the
+// stale entry is simply never looked up again.
+//
+// Shaders are queued with Add and resolved together by Build: hits are
+// read from disk, misses are compiled in parallel and written back.
+//*******************************************************************
+
+#pragma once
+
+#include "Utils/DXUtil.h"
+
+class ShaderCache
+{
+public:
+	explicit ShaderCache(const std::wstring& cacheFolder);
+
+	ShaderCache(const ShaderCache& rhs) = delete;
+	ShaderCache& operator=(const ShaderCache& rhs) = delete;
+
+	// Queue a shader to be built under name. defines may be null.
+	void Add(const std::string& name, const std::wstring& filename, const D3D_SHADER_MACRO* defines,
+		const std::string& entrypoint, const std::string& target);
+
+	// Resolve every queued shader into shaders and clear the queue.
+	void Build(std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3DBlob>>& shaders);
+
+	// Shaders of the last Build found in the cache and compiled.
+	UINT HitCount() const { return mHitCount; }
+	UINT MissCount() const { return mMissCount; }
+	float BuildTimeMs() const { return mBuildTimeMs; }
+
+	// 64-bit FNV-1a, continuing from hash. Hashes start from HashBasis.
+	static const UINT64 HashBasis = 0xCBF29CE484222325ull;
+	static UINT64 Hash(const void* data, std::size_t size, UINT64 hash);
+
+private:
+	struct Entry
+	{
+		std::string Name;
+		std::wstring Filename;
+		std::vector<std::pair<std::string, std::string>> Defines;
+		std::string EntryPoint;
+		std::string Target;
+
+		UINT64 Key = 0;
+		Microsoft::WRL::ComPtr<ID3DBlob> ByteCode;
+	};
+
+	UINT64 ComputeKey(const Entry& entry);
+
+	// Hash of a file followed by the files it includes, depth first.
+	// Files already visited are skipped, like include guards would.
+	UINT64 HashIncludeClosure(const std::filesystem::path& file, UINT64 hash, std::set<std::filesystem::path>& visited);
+
+	std::filesystem::path EntryPath(UINT64 key) const;
+	Microsoft::WRL::ComPtr<ID3DBlob> Load(UINT64 key) const;
+	void Store(UINT64 key, ID3DBlob* byteCode) const;
+
+private:
+	std::filesystem::path mCacheFolder;
+	std::vector<Entry> mEntries;
+
+	// Closure hashes of the source files of the current Build.
+	std::unordered_map<std::wstring, UINT64> mClosureHashes;
+
+	UINT mHitCount = 0;
+	UINT mMissCount = 0;
+	float mBuildTimeMs = 0.0f;
+};
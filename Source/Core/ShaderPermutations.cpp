@@ -0,0 +1,183 @@
+//*******************************************************************
+// ShaderPermutations.cpp
+//*******************************************************************
+#include "lmpch.h"
+#include "ShaderPermutations.h"
+#include "ShaderCache.h"
+
+using Microsoft::WRL::ComPtr;
+
+std::vector<std::pair<std::string, std::string>> ShaderPermutations::GetDefines(Key key, Key featureMask)
+{
+    std::vector<std::pair<std::string, std::string>> defines;
+
+    if ((featureMask & AlphaTest) && (key & AlphaTest))
+        defines.emplace_back("ALPHA_TEST", "1");
+    if ((featureMask & Fog) && (key & Fog))
+        defines.emplace_back("FOG", "1");
+    if (featureMask & ShadowFilterMask)
+        defines.emplace_back("SHADOW_FILTER", std::to_string((UINT)GetShadowFilter(key)));
+    if (featureMask & DirLightMask)
+        defines.emplace_back("NUM_DIR_LIGHTS", std::to_string(GetDirLightCount(key)));
+
+    return defines;
+}
+
+ShaderPermutations::ShaderPermutations(const std::wstring& cacheFolder) :
+    mCacheFolder(cacheFolder)
+{
+}
+
+ShaderPermutations::~ShaderPermutations()
+{
+    // The background compiles write into the programs.
+    mBackgroundCompiles.wait();
+}
+
+void ShaderPermutations::Declare(const std::string& program, const std::wstring& filename,
+    const std::string& vsEntry, const std::string& vsTarget,
+    const std::string& psEntry, const std::string& psTarget, Key featureMask)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    assert(mPrograms.find(program) == mPrograms.end());
+
+    Program& p = mPrograms[program];
+    p.Filename = filename;
+    p.VSEntry = vsEntry;
+    p.VSTarget = vsTarget;
+    p.PSEntry = psEntry;
+    p.PSTarget = psTarget;
+    p.FeatureMask = featureMask & AllFeatures;
+}
+
+ShaderPermutations::Key ShaderPermutations::Reduce(const std::string& program, Key key) const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return key & mPrograms.at(program).FeatureMask;
+}
+
+void ShaderPermutations::Compile(const std::vector<std::pair<std::string, Key>>& permutations)
+{
+    std::vector<std::pair<std::string, Key>> missing;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (const auto& permutation : permutations)
+        {
+            Program& p = mPrograms.at(permutation.first);
+            Key key = permutation.second & p.FeatureMask;
+
+            if (p.Variants.count(key) == 0 && p.Pending.insert(key).second)
+                missing.emplace_back(permutation.first, key);
+        }
+    }
+
+    if (!missing.empty())
+        CompileVariants(missing);
+}
+
+const ShaderPermutations::Variant* ShaderPermutations::Request(const std::string& program, Key key)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    Program& p = mPrograms.at(program);
+    key &= p.FeatureMask;
+
+    auto variant = p.Variants.find(key);
+    if (variant != p.Variants.end())
+        return &variant->second;
+
+    if (p.Failed.count(key) != 0 || !p.Pending.insert(key).second)
+        return nullptr;
+
+    mBackgroundCompiles.run([this, program, key]()
+    {
+        try
+        {
+            CompileVariants({ { program, key } });
+        }
+        catch (...)
+        {
+            // The compiler output has been written to the debug output.
+            std::lock_guard<std::mutex> lock(mMutex);
+            Program& p = mPrograms.at(program);
+            p.Pending.erase(key);
+            p.Failed.insert(key);
+        }
+    });
+
+    return nullptr;
+}
+
+// ------------------------------------------------------------------
+// Both stages of every permutation go through one cache build, so
+// the misses among them compile in parallel.
+// ------------------------------------------------------------------
+void ShaderPermutations::CompileVariants(const std::vector<std::pair<std::string, Key>>& permutations)
+{
+    ShaderCache cache(mCacheFolder);
+
+    std::vector<std::string> names;
+    for (const auto& permutation : permutations)
+    {
+        // Declarations do not change, only the variants, so a copy of the
+        // sources is all that has to be taken under the lock.
+        Program p;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            const Program& declared = mPrograms.at(permutation.first);
+            p.Filename = declared.Filename;
+            p.VSEntry = declared.VSEntry;
+            p.VSTarget = declared.VSTarget;
+            p.PSEntry = declared.PSEntry;
+            p.PSTarget = declared.PSTarget;
+            p.FeatureMask = declared.FeatureMask;
+        }
+
+        std::vector<D3D_SHADER_MACRO> macros;
+        auto defines = GetDefines(permutation.second, p.FeatureMask);
+        for (const auto& define : defines)
+            macros.push_back({ define.first.c_str(), define.second.c_str() });
+        macros.push_back({ nullptr, nullptr });
+
+        std::string name = permutation.first + "#" + std::to_string(permutation.second);
+        cache.Add(name + "VS", p.Filename, macros.data(), p.VSEntry, p.VSTarget);
+        cache.Add(name + "PS", p.Filename, macros.data(), p.PSEntry, p.PSTarget);
+        names.push_back(name);
+    }
+
+    std::unordered_map<std::string, ComPtr<ID3DBlob>> shaders;
+    cache.Build(shaders);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (size_t i = 0; i < permutations.size(); ++i)
+    {
+        Program& p = mPrograms.at(permutations[i].first);
+
+        Variant variant;
+        variant.VS = shaders[names[i] + "VS"];
+        variant.PS = shaders[names[i] + "PS"];
+
+        p.Variants[permutations[i].second] = variant;
+        p.Pending.erase(permutations[i].second);
+    }
+}
+
+UINT ShaderPermutations::VariantCount() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    UINT count = 0;
+    for (const auto& program : mPrograms)
+        count += (UINT)program.second.Variants.size();
+    return count;
+}
+
+UINT ShaderPermutations::PendingCount() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    UINT count = 0;
+    for (const auto& program : mPrograms)
+        count += (UINT)program.second.Pending.size();
+    return count;
+}
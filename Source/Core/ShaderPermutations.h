@@ -0,0 +1,111 @@
+//*******************************************************************
+// ShaderPermutations.h:
+//
+// Compile-time feature variants of shader programs. A permutation is
+// identified by a compact key of feature bits, which maps to the
+// macros the HLSL sources test: ALPHA_TEST, FOG, SHADOW_FILTER and
+// NUM_DIR_LIGHTS. Each program declares the features its source reacts
+// to, and keys are reduced to those, so features a program ignores
+// never produce duplicate variants.
+//
+// Only requested variants are compiled: a set known up front in one
+// parallel batch, anything else in the background on first request.
+// Compiled bytecode goes through the ShaderCache.
+//*******************************************************************
+
+#pragma once
+
+#include "Utils/DXUtil.h"
+
+enum class ShadowFilter : UINT
+{
+	Off = 0,	// Fully lit
+	Hard,		// One comparison
+	PCF,		// Fixed-size Poisson disk
+	PCSS,		// Blocker search, then PCF sized by the penumbra
+	Count
+};
+
+class ShaderPermutations
+{
+public:
+	using Key = UINT;
+
+	// Feature bits.
+	static const Key AlphaTest = 1u << 0;
+	static const Key Fog = 1u << 1;
+	static const UINT ShadowFilterShift = 2;
+	static const Key ShadowFilterMask = 3u << ShadowFilterShift;
+	static const UINT DirLightShift = 4;
+	static const Key DirLightMask = 3u << DirLightShift;
+	static const Key AllFeatures = AlphaTest | Fog | ShadowFilterMask | DirLightMask;
+
+	static const UINT MaxDirLights = 3;
+
+	static Key MakeShadowFilter(ShadowFilter filter) { return (Key)filter << ShadowFilterShift; }
+	static Key MakeDirLightCount(UINT count) { return std::min(count, MaxDirLights) << DirLightShift; }
+
+	static ShadowFilter GetShadowFilter(Key key) { return (ShadowFilter)((key & ShadowFilterMask) >> ShadowFilterShift); }
+	static UINT GetDirLightCount(Key key) { return (key & DirLightMask) >> DirLightShift; }
+
+	// Macros of the features in the key. Features outside the program's
+	// mask are left to the defaults of the source.
+	static std::vector<std::pair<std::string, std::string>> GetDefines(Key key, Key featureMask);
+
+	struct Variant
+	{
+		Microsoft::WRL::ComPtr<ID3DBlob> VS;
+		Microsoft::WRL::ComPtr<ID3DBlob> PS;
+	};
+
+	explicit ShaderPermutations(const std::wstring& cacheFolder);
+	~ShaderPermutations();
+
+	ShaderPermutations(const ShaderPermutations& rhs) = delete;
+	ShaderPermutations& operator=(const ShaderPermutations& rhs) = delete;
+
+	// A program is a vertex and a pixel shader from one source file.
+	void Declare(const std::string& program, const std::wstring& filename,
+		const std::string& vsEntry, const std::string& vsTarget,
+		const std::string& psEntry, const std::string& psTarget, Key featureMask);
+
+	// Drop the features the program does not react to.
+	Key Reduce(const std::string& program, Key key) const;
+
+	// Compile the permutations now, in parallel, e.g. the ones the scene
+	// starts with. Keys are reduced first.
+	void Compile(const std::vector<std::pair<std::string, Key>>& permutations);
+
+	// The variant if it has been compiled. Otherwise returns null and
+	// compiles it in the background, so a later call finds it. Variants
+	// that fail to compile are not retried.
+	const Variant* Request(const std::string& program, Key key);
+
+	UINT VariantCount() const;
+	UINT PendingCount() const;
+
+private:
+	struct Program
+	{
+		std::wstring Filename;
+		std::string VSEntry, VSTarget;
+		std::string PSEntry, PSTarget;
+		Key FeatureMask = 0;
+
+		// Nodes of a map stay put, so Request can hand out pointers.
+		std::map<Key, Variant> Variants;
+		std::set<Key> Pending;
+		std::set<Key> Failed;
+	};
+
+	// Compile reduced keys of programs and publish the results.
+	void CompileVariants(const std::vector<std::pair<std::string, Key>>& permutations);
+
+private:
+	std::wstring mCacheFolder;
+
+	mutable std::mutex mMutex;
+	std::unordered_map<std::string, Program> mPrograms;
+
+	concurrency::task_group mBackgroundCompiles;
+};
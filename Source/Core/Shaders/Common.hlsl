@@ -23,9 +23,11 @@
 #include "LightingUtil.hlsl"
 #include "MathUtil.hlsl"
 
-// Shadow map related variables
-//#define USE_PCF
-#define USE_PCSS
+// Shadow filtering, chosen per permutation by ShaderPermutations:
+// 0 off, 1 a single comparison, 2 PCF, 3 PCSS.
+#ifndef SHADOW_FILTER
+    #define SHADOW_FILTER 3
+#endif
 
 #define SHADOW_DEPTH_BIAS 0.004
 #define PCF_NUM_SAMPLES NUM_SAMPLES
@@ -40,14 +42,16 @@
 #define LIGHT_SIZE_UV (LIGHT_WORLD_SIZE / LIGHT_FRUSTUM_WIDTH)
 
 
+// Matches PackedInstanceData on the CPU side. World holds the rows of the
+// transposed affine world matrix; the texture transform is looked up in
+// gTexTransforms.
 struct InstanceData
 {
-    float4x4 World;
-    float4x4 TexTransform;
-    uint MaterialIndex;
+    float4 World[3];
+    uint TexTransformIndex;
+    uint MaterialAndFlags;
     uint InstPad0;
     uint InstPad1;
-    uint InstPad2;
 };
 
 struct MaterialData
@@ -67,13 +71,40 @@ Texture2D gShadowMap : register(t1);
 
 // An array of textures, which is only supported in shader model 5.1+. Unlike
 // Texture2DArray, the textures in this array can be different sizes and
-// formats, making it more flexible than texture arrays.
-Texture2D gTextureMaps[99] : register(t2);
+// formats, making it more flexible than texture arrays. It is the bindless
+// table of TextureRegistry, sized by the root signature range, indexed by
+// the handles materials hold. Instances of one draw can use different
+// materials, so the index has to be marked NonUniformResourceIndex.
+Texture2D gTextureMaps[] : register(t2);
 
 // Put in space1, so the texture array does not overlap with these resources.
 // The texture array will occupy registers t0, t1, ..., t6 in space0.
-StructuredBuffer<InstanceData> gInstanceData : register(t0, space1);
+// gVisibleInstances lists the slots in gInstanceData drawn by the current
+// draw call, indexed by SV_InstanceID.
+StructuredBuffer<uint> gVisibleInstances : register(t0, space1);
 StructuredBuffer<MaterialData> gMaterialData : register(t1, space1);
+StructuredBuffer<float4x4> gTexTransforms : register(t2, space1);
+StructuredBuffer<InstanceData> gInstanceData : register(t3, space1);
+
+InstanceData FetchInstance(uint instanceID)
+{
+    return gInstanceData[gVisibleInstances[instanceID]];
+}
+
+float3x4 InstanceWorld(InstanceData instData)
+{
+    return float3x4(instData.World[0], instData.World[1], instData.World[2]);
+}
+
+uint InstanceMaterialIndex(InstanceData instData)
+{
+    return instData.MaterialAndFlags & 0xFFFF;
+}
+
+uint InstanceFlags(InstanceData instData)
+{
+    return instData.MaterialAndFlags >> 16;
+}
 
 
 // Sampler objects definition     
@@ -204,6 +235,9 @@ float PCSS(float4 coords)
 
 float CalcShadowFactor(float4 shadowPosH)
 {
+#if SHADOW_FILTER == 0
+    return 1.0f;
+#else
     // Complete projection by doing division by w.
     shadowPosH.xyz /= shadowPosH.w;
     
@@ -214,10 +248,12 @@ float CalcShadowFactor(float4 shadowPosH)
     //    float2(-dx, +dx), float2(0.0f, +dx), float2(dx, +dx)
     //};
     
-    #ifdef USE_PCF
+    #if SHADOW_FILTER == 1
+        return gShadowMap.SampleCmpLevelZero(gsamShadow, shadowPosH.xy, shadowPosH.z - SHADOW_DEPTH_BIAS).r;
+    #elif SHADOW_FILTER == 2
         return PCF(shadowPosH, 5.0);
-    #endif
-    #ifdef USE_PCSS
+    #else
         return PCSS(shadowPosH);
     #endif
+#endif
 }
\ No newline at end of file
@@ -75,10 +75,10 @@ VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
     // Fetch the instance data.
     // Direct3D provides the system value identifier SV_InstanceID to tell
     // which instance is being drawn in the vS.
-    InstanceData instData = gInstanceData[instanceID];
-    float4x4 world = instData.World;
-    float4x4 texTransform = instData.TexTransform;
-    uint matIndex = instData.MaterialIndex;
+    InstanceData instData = FetchInstance(instanceID);
+    float3x4 world = InstanceWorld(instData);
+    float4x4 texTransform = gTexTransforms[instData.TexTransformIndex];
+    uint matIndex = InstanceMaterialIndex(instData);
     
     vout.MatIndex = matIndex;
     
@@ -86,12 +86,12 @@ VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
     MaterialData matData = gMaterialData[matIndex];
 	
     // Transform to world space.
-    float4 posW = mul(float4(vin.PosL, 1.0f), world);
+    float4 posW = float4(mul(world, float4(vin.PosL, 1.0f)), 1.0f);
     vout.PosW = posW.xyz;
 
     // Assumes nonuniform scaling; otherwise, need to use inverse-transpose of 
     // world matrix.
-    vout.NormalW = mul(vin.NormalL, (float3x3)world);
+    vout.NormalW = mul((float3x3)world, vin.NormalL);
     
     // Transform to homogeneous clip space.
     vout.PosH = mul(posW, gViewProj);
@@ -128,7 +128,7 @@ float4 PS(VertexOut pin) : SV_Target
     uint diffuseTexIndex = matData.DiffuseMapIndex;
     
     // Dynamically look up the texture in the array.
-    diffuseAlbedo *= gTextureMaps[diffuseTexIndex].Sample(gsamAnisotropicWrap, pin.TexC);
+    diffuseAlbedo *= gTextureMaps[NonUniformResourceIndex(diffuseTexIndex)].Sample(gsamAnisotropicWrap, pin.TexC);
 	
 #ifdef ALPHA_TEST
 	// Discard pixel if texture alpha < 0.1.  We do this test as soon 
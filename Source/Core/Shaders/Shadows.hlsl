@@ -33,10 +33,10 @@ VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
     // Fetch the instance data.
     // Direct3D provides the system value identifier SV_InstanceID to tell
     // which instance is being drawn in the vS.
-    InstanceData instData = gInstanceData[instanceID];
-    float4x4 world = instData.World;
-    float4x4 texTransform = instData.TexTransform;
-    uint matIndex = instData.MaterialIndex;
+    InstanceData instData = FetchInstance(instanceID);
+    float3x4 world = InstanceWorld(instData);
+    float4x4 texTransform = gTexTransforms[instData.TexTransformIndex];
+    uint matIndex = InstanceMaterialIndex(instData);
     
     vout.MatIndex = matIndex;
     
@@ -44,7 +44,7 @@ VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
     MaterialData matData = gMaterialData[matIndex];
 	
     // Transform to world space.
-    float4 posW = mul(float4(vin.PosL, 1.0f), world);
+    float4 posW = float4(mul(world, float4(vin.PosL, 1.0f)), 1.0f);
 
     // Transform to homogeneous clip space.
     vout.PosH = mul(posW, gViewProj);
@@ -67,7 +67,7 @@ void PS(VertexOut pin)
     uint diffuseTexIndex = matData.DiffuseMapIndex;
 	
 	// Dynamically look up the texture in the array.
-    diffuseAlbedo *= gTextureMaps[diffuseTexIndex].Sample(gsamAnisotropicWrap, pin.TexC);
+    diffuseAlbedo *= gTextureMaps[NonUniformResourceIndex(diffuseTexIndex)].Sample(gsamAnisotropicWrap, pin.TexC);
 
 #ifdef ALPHA_TEST
     // Discard pixel if texture alpha < 0.1.  We do this test as soon 
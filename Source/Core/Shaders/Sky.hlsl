@@ -29,14 +29,14 @@ VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
     // Fetch the instance data.
     // Direct3D provides the system value identifier SV_InstanceID to tell
     // which instance is being drawn in the vS.
-    InstanceData instData = gInstanceData[instanceID];
-    float4x4 world = instData.World;
+    InstanceData instData = FetchInstance(instanceID);
+    float3x4 world = InstanceWorld(instData);
   
 	// Use local vertex position as cubemap lookup vector.
     vout.PosL = vin.PosL;
 	
 	// Transform to world space.
-    float4 posW = mul(float4(vin.PosL, 1.0f), world);
+    float4 posW = float4(mul(world, float4(vin.PosL, 1.0f)), 1.0f);
 
 	// Always center sky about camera.
     posW.xyz += gEyePosW;
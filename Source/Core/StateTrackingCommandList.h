@@ -0,0 +1,333 @@
+//*******************************************************************
+// StateTrackingCommandList.h:
+//
+// Front end for a graphics command list that shadows the state bound
+// through it and drops calls that would bind what is already bound:
+// pipeline state, root signature, descriptor heaps, input assembler
+// buffers and topology, root arguments, viewport and scissor rect.
+// Draws, clears and render targets are passed straight through.
+// ExecuteIndirect is passed through as well, and forgets the bindings
+// a command signature may change.
+//
+// A fresh command list has no state, so a tracker lives as long as one
+// recording. Anything recorded on Get() directly is not seen; call
+// Invalidate afterwards if it may have changed tracked state.
+//
+// The command list type is a template parameter so the filter can
+// drive any type with the same methods, e.g. one that records calls.
+//*******************************************************************
+
+#pragma once
+
+#include "Utils/DXUtil.h"
+
+template<typename TCommandList>
+class StateTrackingCommandList
+{
+public:
+    struct Stats
+    {
+        UINT Issued = 0;
+        UINT Dropped = 0;
+    };
+
+    static const UINT MaxRootParameters = 16;
+    static const UINT MaxVertexBuffers = 4;
+    static const UINT MaxDescriptorHeaps = 2;
+
+    explicit StateTrackingCommandList(TCommandList* cmdList) :
+        mCmdList(cmdList)
+    {
+        Invalidate();
+    }
+
+    StateTrackingCommandList(const StateTrackingCommandList& rhs) = delete;
+    StateTrackingCommandList& operator=(const StateTrackingCommandList& rhs) = delete;
+
+    TCommandList* Get() const { return mCmdList; }
+    const Stats& GetStats() const { return mStats; }
+
+    // Forget all tracked state, so the next call of every kind is issued.
+    void Invalidate()
+    {
+        mHasPipelineState = false;
+        mHasRootSignature = false;
+        mDescriptorHeapCount = UINT_MAX;
+        mVertexBufferMask = 0;
+        mHasIndexBuffer = false;
+        mTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+        mHasViewport = false;
+        mHasScissorRect = false;
+        InvalidateRootArguments();
+    }
+
+    void SetPipelineState(ID3D12PipelineState* pipelineState)
+    {
+        if (Filter(mHasPipelineState && pipelineState == mPipelineState))
+            return;
+
+        mPipelineState = pipelineState;
+        mHasPipelineState = true;
+        mCmdList->SetPipelineState(pipelineState);
+    }
+
+    void SetGraphicsRootSignature(ID3D12RootSignature* rootSignature)
+    {
+        if (Filter(mHasRootSignature && rootSignature == mRootSignature))
+            return;
+
+        // Root arguments do not survive a root signature change.
+        mRootSignature = rootSignature;
+        mHasRootSignature = true;
+        InvalidateRootArguments();
+        mCmdList->SetGraphicsRootSignature(rootSignature);
+    }
+
+    void SetDescriptorHeaps(UINT numHeaps, ID3D12DescriptorHeap* const* heaps)
+    {
+        bool isBound = numHeaps == mDescriptorHeapCount;
+        for (UINT i = 0; isBound && i < numHeaps; ++i)
+            isBound = heaps[i] == mDescriptorHeaps[i];
+
+        if (Filter(isBound))
+            return;
+
+        if (numHeaps <= MaxDescriptorHeaps)
+        {
+            mDescriptorHeapCount = numHeaps;
+            for (UINT i = 0; i < numHeaps; ++i)
+                mDescriptorHeaps[i] = heaps[i];
+        }
+        else
+            mDescriptorHeapCount = UINT_MAX;
+
+        // Tables point into the heaps, so they have to be set again.
+        for (RootArgument& argument : mRootArguments)
+        {
+            if (argument.Kind == RootArgumentKind::DescriptorTable)
+                argument.Kind = RootArgumentKind::None;
+        }
+        mCmdList->SetDescriptorHeaps(numHeaps, heaps);
+    }
+
+    void IASetVertexBuffers(UINT startSlot, UINT numViews, const D3D12_VERTEX_BUFFER_VIEW* views)
+    {
+        bool isTracked = startSlot + numViews <= MaxVertexBuffers;
+
+        bool isBound = isTracked && views != nullptr;
+        for (UINT i = 0; isBound && i < numViews; ++i)
+        {
+            UINT slot = startSlot + i;
+            isBound = (mVertexBufferMask & (1u << slot)) != 0 && SameView(mVertexBuffers[slot], views[i]);
+        }
+
+        if (Filter(isBound))
+            return;
+
+        for (UINT i = 0; i < numViews; ++i)
+        {
+            UINT slot = startSlot + i;
+            if (slot >= MaxVertexBuffers)
+                break;
+
+            if (views != nullptr)
+            {
+                mVertexBuffers[slot] = views[i];
+                mVertexBufferMask |= 1u << slot;
+            }
+            else
+                mVertexBufferMask &= ~(1u << slot);
+        }
+        mCmdList->IASetVertexBuffers(startSlot, numViews, views);
+    }
+
+    void IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* view)
+    {
+        bool isBound = view != nullptr && mHasIndexBuffer &&
+            view->BufferLocation == mIndexBuffer.BufferLocation &&
+            view->SizeInBytes == mIndexBuffer.SizeInBytes &&
+            view->Format == mIndexBuffer.Format;
+
+        if (Filter(isBound))
+            return;
+
+        mHasIndexBuffer = view != nullptr;
+        if (view != nullptr)
+            mIndexBuffer = *view;
+        mCmdList->IASetIndexBuffer(view);
+    }
+
+    void IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology)
+    {
+        if (Filter(topology == mTopology))
+            return;
+
+        mTopology = topology;
+        mCmdList->IASetPrimitiveTopology(topology);
+    }
+
+    void SetGraphicsRootConstantBufferView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS address)
+    {
+        if (Filter(SetRootArgument(rootParameterIndex, RootArgumentKind::ConstantBufferView, address)))
+            return;
+
+        mCmdList->SetGraphicsRootConstantBufferView(rootParameterIndex, address);
+    }
+
+    void SetGraphicsRootShaderResourceView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS address)
+    {
+        if (Filter(SetRootArgument(rootParameterIndex, RootArgumentKind::ShaderResourceView, address)))
+            return;
+
+        mCmdList->SetGraphicsRootShaderResourceView(rootParameterIndex, address);
+    }
+
+    void SetGraphicsRootDescriptorTable(UINT rootParameterIndex, D3D12_GPU_DESCRIPTOR_HANDLE baseDescriptor)
+    {
+        if (Filter(SetRootArgument(rootParameterIndex, RootArgumentKind::DescriptorTable, baseDescriptor.ptr)))
+            return;
+
+        mCmdList->SetGraphicsRootDescriptorTable(rootParameterIndex, baseDescriptor);
+    }
+
+    void RSSetViewports(UINT numViewports, const D3D12_VIEWPORT* viewports)
+    {
+        // Only a single viewport is tracked.
+        bool isBound = numViewports == 1 && mHasViewport && memcmp(&mViewport, viewports, sizeof(D3D12_VIEWPORT)) == 0;
+        if (Filter(isBound))
+            return;
+
+        mHasViewport = numViewports == 1;
+        if (mHasViewport)
+            mViewport = viewports[0];
+        mCmdList->RSSetViewports(numViewports, viewports);
+    }
+
+    void RSSetScissorRects(UINT numRects, const D3D12_RECT* rects)
+    {
+        bool isBound = numRects == 1 && mHasScissorRect && memcmp(&mScissorRect, rects, sizeof(D3D12_RECT)) == 0;
+        if (Filter(isBound))
+            return;
+
+        mHasScissorRect = numRects == 1;
+        if (mHasScissorRect)
+            mScissorRect = rects[0];
+        mCmdList->RSSetScissorRects(numRects, rects);
+    }
+
+    void OMSetRenderTargets(UINT numRenderTargetDescriptors, const D3D12_CPU_DESCRIPTOR_HANDLE* renderTargetDescriptors,
+        BOOL rtsSingleHandleToDescriptorRange, const D3D12_CPU_DESCRIPTOR_HANDLE* depthStencilDescriptor)
+    {
+        mCmdList->OMSetRenderTargets(numRenderTargetDescriptors, renderTargetDescriptors, rtsSingleHandleToDescriptorRange, depthStencilDescriptor);
+    }
+
+    void ClearRenderTargetView(D3D12_CPU_DESCRIPTOR_HANDLE renderTargetView, const FLOAT colorRGBA[4], UINT numRects, const D3D12_RECT* rects)
+    {
+        mCmdList->ClearRenderTargetView(renderTargetView, colorRGBA, numRects, rects);
+    }
+
+    void ClearDepthStencilView(D3D12_CPU_DESCRIPTOR_HANDLE depthStencilView, D3D12_CLEAR_FLAGS clearFlags,
+        FLOAT depth, UINT8 stencil, UINT numRects, const D3D12_RECT* rects)
+    {
+        mCmdList->ClearDepthStencilView(depthStencilView, clearFlags, depth, stencil, numRects, rects);
+    }
+
+    void DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndexLocation,
+        INT baseVertexLocation, UINT startInstanceLocation)
+    {
+        mCmdList->DrawIndexedInstanced(indexCountPerInstance, instanceCount, startIndexLocation, baseVertexLocation, startInstanceLocation);
+    }
+
+    void ExecuteIndirect(ID3D12CommandSignature* commandSignature, UINT maxCommandCount, ID3D12Resource* argumentBuffer,
+        UINT64 argumentBufferOffset, ID3D12Resource* countBuffer, UINT64 countBufferOffset)
+    {
+        mCmdList->ExecuteIndirect(commandSignature, maxCommandCount, argumentBuffer, argumentBufferOffset, countBuffer, countBufferOffset);
+
+        // Buffers and root arguments set by the command signature are
+        // undefined afterwards.
+        mVertexBufferMask = 0;
+        mHasIndexBuffer = false;
+        InvalidateRootArguments();
+    }
+
+private:
+    enum class RootArgumentKind : UINT8
+    {
+        None = 0,
+        ConstantBufferView,
+        ShaderResourceView,
+        DescriptorTable
+    };
+
+    struct RootArgument
+    {
+        RootArgumentKind Kind;
+        UINT64 Value;
+    };
+
+    // Count the call, and whether it is dropped.
+    bool Filter(bool isRedundant)
+    {
+        if (isRedundant)
+            ++mStats.Dropped;
+        else
+            ++mStats.Issued;
+        return isRedundant;
+    }
+
+    // Record a root argument. Returns true if it was bound already.
+    bool SetRootArgument(UINT index, RootArgumentKind kind, UINT64 value)
+    {
+        if (index >= MaxRootParameters)
+            return false;
+
+        RootArgument& argument = mRootArguments[index];
+        if (argument.Kind == kind && argument.Value == value)
+            return true;
+
+        argument.Kind = kind;
+        argument.Value = value;
+        return false;
+    }
+
+    void InvalidateRootArguments()
+    {
+        for (RootArgument& argument : mRootArguments)
+            argument.Kind = RootArgumentKind::None;
+    }
+
+    static bool SameView(const D3D12_VERTEX_BUFFER_VIEW& a, const D3D12_VERTEX_BUFFER_VIEW& b)
+    {
+        return a.BufferLocation == b.BufferLocation && a.SizeInBytes == b.SizeInBytes && a.StrideInBytes == b.StrideInBytes;
+    }
+
+private:
+    TCommandList* mCmdList;
+    Stats mStats;
+
+    ID3D12PipelineState* mPipelineState = nullptr;
+    ID3D12RootSignature* mRootSignature = nullptr;
+    bool mHasPipelineState;
+    bool mHasRootSignature;
+
+    ID3D12DescriptorHeap* mDescriptorHeaps[MaxDescriptorHeaps];
+    UINT mDescriptorHeapCount;
+
+    D3D12_VERTEX_BUFFER_VIEW mVertexBuffers[MaxVertexBuffers];
+    UINT mVertexBufferMask;
+
+    D3D12_INDEX_BUFFER_VIEW mIndexBuffer;
+    bool mHasIndexBuffer;
+
+    D3D12_PRIMITIVE_TOPOLOGY mTopology;
+
+    D3D12_VIEWPORT mViewport;
+    D3D12_RECT mScissorRect;
+    bool mHasViewport;
+    bool mHasScissorRect;
+
+    RootArgument mRootArguments[MaxRootParameters];
+};
+
+// The tracker used for the D3D12 command lists of the frame.
+using TrackedCommandList = StateTrackingCommandList<ID3D12GraphicsCommandList>;
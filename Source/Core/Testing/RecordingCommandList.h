@@ -0,0 +1,147 @@
+//*******************************************************************
+// RecordingCommandList.h:
+//
+// Stand-in for ID3D12GraphicsCommandList that records the calls made
+// on it instead of executing them. It has the methods
+// StateTrackingCommandList forwards to, so the tracker, and code
+// recording through it, can run without a device: the tests check what
+// reaches the command list, and the benchmarks time the recording
+// without the driver.
+//
+// Each call is kept as its kind and the argument that tells calls of
+// that kind apart, if any.
+//*******************************************************************
+
+#pragma once
+
+#include "lmpch.h"
+
+class RecordingCommandList
+{
+public:
+	enum class Call : UINT8
+	{
+		SetPipelineState,
+		SetGraphicsRootSignature,
+		SetDescriptorHeaps,
+		IASetVertexBuffers,
+		IASetIndexBuffer,
+		IASetPrimitiveTopology,
+		SetGraphicsRootConstantBufferView,
+		SetGraphicsRootShaderResourceView,
+		SetGraphicsRootDescriptorTable,
+		RSSetViewports,
+		RSSetScissorRects,
+		OMSetRenderTargets,
+		ClearRenderTargetView,
+		ClearDepthStencilView,
+		DrawIndexedInstanced,
+		ExecuteIndirect,
+		Count
+	};
+
+	struct Record
+	{
+		Call Kind;
+		UINT Index;		// Root parameter or first slot
+		UINT64 Value;	// Address, pointer or count
+	};
+
+	const std::vector<Record>& Calls() const { return mCalls; }
+
+	UINT Count(Call kind) const
+	{
+		return (UINT)std::count_if(mCalls.begin(), mCalls.end(), [kind](const Record& record) { return record.Kind == kind; });
+	}
+
+	void Clear() { mCalls.clear(); }
+
+	void SetPipelineState(ID3D12PipelineState* pipelineState)
+	{
+		Add(Call::SetPipelineState, 0, reinterpret_cast<UINT64>(pipelineState));
+	}
+
+	void SetGraphicsRootSignature(ID3D12RootSignature* rootSignature)
+	{
+		Add(Call::SetGraphicsRootSignature, 0, reinterpret_cast<UINT64>(rootSignature));
+	}
+
+	void SetDescriptorHeaps(UINT numHeaps, ID3D12DescriptorHeap* const* heaps)
+	{
+		Add(Call::SetDescriptorHeaps, numHeaps, numHeaps > 0 ? reinterpret_cast<UINT64>(heaps[0]) : 0);
+	}
+
+	void IASetVertexBuffers(UINT startSlot, UINT numViews, const D3D12_VERTEX_BUFFER_VIEW* views)
+	{
+		Add(Call::IASetVertexBuffers, startSlot, views != nullptr && numViews > 0 ? views[0].BufferLocation : 0);
+	}
+
+	void IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* view)
+	{
+		Add(Call::IASetIndexBuffer, 0, view != nullptr ? view->BufferLocation : 0);
+	}
+
+	void IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology)
+	{
+		Add(Call::IASetPrimitiveTopology, 0, (UINT64)topology);
+	}
+
+	void SetGraphicsRootConstantBufferView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS address)
+	{
+		Add(Call::SetGraphicsRootConstantBufferView, rootParameterIndex, address);
+	}
+
+	void SetGraphicsRootShaderResourceView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS address)
+	{
+		Add(Call::SetGraphicsRootShaderResourceView, rootParameterIndex, address);
+	}
+
+	void SetGraphicsRootDescriptorTable(UINT rootParameterIndex, D3D12_GPU_DESCRIPTOR_HANDLE baseDescriptor)
+	{
+		Add(Call::SetGraphicsRootDescriptorTable, rootParameterIndex, baseDescriptor.ptr);
+	}
+
+	void RSSetViewports(UINT numViewports, const D3D12_VIEWPORT*)
+	{
+		Add(Call::RSSetViewports, 0, numViewports);
+	}
+
+	void RSSetScissorRects(UINT numRects, const D3D12_RECT*)
+	{
+		Add(Call::RSSetScissorRects, 0, numRects);
+	}
+
+	void OMSetRenderTargets(UINT numRenderTargetDescriptors, const D3D12_CPU_DESCRIPTOR_HANDLE*, BOOL, const D3D12_CPU_DESCRIPTOR_HANDLE*)
+	{
+		Add(Call::OMSetRenderTargets, 0, numRenderTargetDescriptors);
+	}
+
+	void ClearRenderTargetView(D3D12_CPU_DESCRIPTOR_HANDLE renderTargetView, const FLOAT[4], UINT, const D3D12_RECT*)
+	{
+		Add(Call::ClearRenderTargetView, 0, renderTargetView.ptr);
+	}
+
+	void ClearDepthStencilView(D3D12_CPU_DESCRIPTOR_HANDLE depthStencilView, D3D12_CLEAR_FLAGS, FLOAT, UINT8, UINT, const D3D12_RECT*)
+	{
+		Add(Call::ClearDepthStencilView, 0, depthStencilView.ptr);
+	}
+
+	void DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT, INT, UINT)
+	{
+		Add(Call::DrawIndexedInstanced, instanceCount, indexCountPerInstance);
+	}
+
+	void ExecuteIndirect(ID3D12CommandSignature*, UINT maxCommandCount, ID3D12Resource*, UINT64 argumentBufferOffset, ID3D12Resource*, UINT64)
+	{
+		Add(Call::ExecuteIndirect, maxCommandCount, argumentBufferOffset);
+	}
+
+private:
+	void Add(Call kind, UINT index, UINT64 value)
+	{
+		mCalls.push_back({ kind, index, value });
+	}
+
+private:
+	std::vector<Record> mCalls;
+};
@@ -3,6 +3,7 @@
 //*******************************************************************
 #include "lmpch.h"
 #include "Texture.h"
+#include "Memory/GpuMemoryAllocator.h"
 
 using Microsoft::WRL::ComPtr;
 
@@ -14,15 +15,64 @@ ComPtr<ID3D12Resource> TextureWrapper::GetTextureResource(std::string name)
     return mTextures[name]->Resource;
 }
 
-void TextureWrapper::CreateDDSTextureFromFile(ComPtr<ID3D12Device> pDevice, ComPtr<ID3D12GraphicsCommandList> pCommandList, std::string name, std::wstring fileName)
+UINT TextureWrapper::GetTextureHandle(std::string name)
+{
+    auto it = mTextures.find(name);
+    assert(it != mTextures.end());
+
+    return it->second->Handle;
+}
+
+UINT TextureWrapper::CreateDDSTextureFromFile(ComPtr<ID3D12Device> pDevice, ComPtr<ID3D12GraphicsCommandList> pCommandList, std::string name, std::wstring fileName, SRV_TYPE type)
 {
     auto newTex = std::make_unique<Texture>();
     newTex->Name = name;
     newTex->Filename = pathPrefix + fileName;
     ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(pDevice.Get(),
         pCommandList.Get(), newTex->Filename.c_str(),
-        newTex->Resource, newTex->UploadHeap));
+        newTex->Resource, newTex->UploadHeap, 0, nullptr, mAllocator, mUploads));
+
+    // Cube maps stay out of the bindless table; they are bound through
+    // their own descriptors.
+    if (mRegistry != nullptr && type != CUBE_MAP)
+        newTex->Handle = mRegistry->Register(newTex->Resource.Get());
 
     // Add new texture to texture map
+    UINT handle = newTex->Handle;
     mTextures[newTex->Name] = std::move(newTex);
+    return handle;
+}
+
+void TextureWrapper::Unload(std::string name)
+{
+    auto it = mTextures.find(name);
+    assert(it != mTextures.end());
+
+    Texture& tex = *it->second;
+    if (mRegistry != nullptr && tex.Handle != TextureRegistry::NullHandle)
+        mRegistry->Unregister(tex.Handle);
+
+    // The registry holds the resource until the view is nulled; placed
+    // memory waits for the frame the same way.
+    if (mAllocator != nullptr)
+    {
+        mAllocator->Release(tex.Resource.Get());
+        if (tex.UploadHeap != nullptr)
+            mAllocator->Release(tex.UploadHeap.Get());
+    }
+
+    mTextures.erase(it);
 }
+
+void TextureWrapper::DisposeUploaders()
+{
+    for (auto& tex : mTextures)
+    {
+        if (tex.second->UploadHeap == nullptr)
+            continue;
+
+        if (mAllocator != nullptr)
+            mAllocator->Release(tex.second->UploadHeap.Get());
+        tex.second->UploadHeap = nullptr;
+    }
+}
\ No newline at end of file
@@ -8,20 +8,41 @@
 #pragma once
 
 #include "Utils/DXUtil.h"
+#include "TextureRegistry.h"
 
 class TextureWrapper
 {
 public:
-	TextureWrapper() = default;
+	// Textures are placed by allocator, get a handle in registry and are
+	// staged through uploads, for each one that is given.
+	explicit TextureWrapper(GpuMemoryAllocator* allocator = nullptr, TextureRegistry* registry = nullptr,
+		UploadBatch* uploads = nullptr) :
+		mAllocator(allocator), mRegistry(registry), mUploads(uploads) {}
 
 	Microsoft::WRL::ComPtr<ID3D12Resource> GetTextureResource(std::string name);
 
-	void CreateDDSTextureFromFile(Microsoft::WRL::ComPtr<ID3D12Device> pDevice, 
+	// Handle of the texture in the bindless table, for MaterialData.
+	UINT GetTextureHandle(std::string name);
+
+	// Returns the handle of the new texture in the bindless table, or the
+	// null handle for a cube map, which is never put there.
+	UINT CreateDDSTextureFromFile(Microsoft::WRL::ComPtr<ID3D12Device> pDevice, 
 		Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> pCommandList,
-		std::string name, std::wstring fileName);
+		std::string name, std::wstring fileName, SRV_TYPE type = DIFFUSE_MAP);
+
+	// Drop the texture and give back its handle and memory once the frames
+	// in flight are done with them.
+	void Unload(std::string name);
+
+	// Drop the upload heaps of textures loaded without an upload batch, once
+	// the copies have executed.
+	void DisposeUploaders();
 
 private:
 	std::unordered_map<std::string, std::unique_ptr<Texture>> mTextures;
+	GpuMemoryAllocator* mAllocator;
+	TextureRegistry* mRegistry;
+	UploadBatch* mUploads;
 
     std::wstring pathPrefix = L"../../Assets/Textures/";
 };
\ No newline at end of file
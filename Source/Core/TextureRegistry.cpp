@@ -0,0 +1,90 @@
+//*******************************************************************
+// TextureRegistry.cpp
+//*******************************************************************
+#include "lmpch.h"
+#include "TextureRegistry.h"
+
+using Microsoft::WRL::ComPtr;
+
+UINT TextureRegistry::GetCapacity(ID3D12Device* device, UINT reservedSrvCount, UINT maxTextures)
+{
+    D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
+    ThrowIfFailed(device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options)));
+
+    if (options.ResourceBindingTier == D3D12_RESOURCE_BINDING_TIER_1)
+    {
+        assert(reservedSrvCount < D3D12_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT);
+        return std::min(maxTextures, D3D12_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT - reservedSrvCount);
+    }
+
+    // Tier 2 heaps hold a million descriptors, shared with everything else.
+    return std::min(maxTextures, D3D12_MAX_SHADER_VISIBLE_DESCRIPTOR_HEAP_SIZE_TIER_1 / 2);
+}
+
+TextureRegistry::TextureRegistry(ComPtr<ID3D12Device> device, DescriptorHeapWrapper* heap, UINT capacity) :
+    mDevice(device),
+    mHeap(heap),
+    mResources(capacity)
+{
+    assert(capacity > NullHandle);
+
+    mTableStart = mHeap->Allocate(capacity);
+
+    // Out of range indices are undefined even for slots nothing samples,
+    // so every slot holds a valid null view until it is registered.
+    for (UINT handle = 0; handle < capacity; ++handle)
+        WriteNullView(handle);
+
+    mFreeSlots.reserve(capacity - 1);
+    for (UINT handle = capacity - 1; handle > NullHandle; --handle)
+        mFreeSlots.push_back(handle);
+}
+
+void TextureRegistry::WriteNullView(UINT handle)
+{
+    mHeap->CreateSrvDescriptor(mDevice, nullptr, D3D12_SRV_DIMENSION_TEXTURE2D, DIFFUSE_MAP, mTableStart + handle);
+}
+
+UINT TextureRegistry::Register(ID3D12Resource* resource)
+{
+    assert(resource != nullptr);
+
+    if (mFreeSlots.empty())
+        ThrowIfFailed(E_OUTOFMEMORY);
+
+    UINT handle = mFreeSlots.back();
+    mFreeSlots.pop_back();
+
+    mHeap->CreateSrvDescriptor(mDevice, resource, D3D12_SRV_DIMENSION_TEXTURE2D, DIFFUSE_MAP, mTableStart + handle);
+    mResources[handle] = resource;
+    ++mCount;
+
+    return handle;
+}
+
+void TextureRegistry::Unregister(UINT handle)
+{
+    assert(handle != NullHandle && handle < mResources.size());
+    assert(mResources[handle] != nullptr);
+
+    // The view and resource stay until the frames using them are done.
+    mPendingFrees.emplace_back(mFrameFence, handle);
+    --mCount;
+}
+
+void TextureRegistry::BeginFrame(UINT64 completedFence, UINT64 nextFrameFence)
+{
+    while (!mPendingFrees.empty() && mPendingFrees.front().first <= completedFence)
+    {
+        UINT handle = mPendingFrees.front().second;
+        mPendingFrees.pop_front();
+
+        WriteNullView(handle);
+        mResources[handle] = nullptr;
+
+        // Keep the lowest slots in use, so the table stays dense.
+        mFreeSlots.insert(std::upper_bound(mFreeSlots.begin(), mFreeSlots.end(), handle, std::greater<UINT>()), handle);
+    }
+
+    mFrameFence = nextFrameFence;
+}
@@ -0,0 +1,79 @@
+//*******************************************************************
+// TextureRegistry.h:
+//
+// Bindless texture table. One range of the shader visible heap holds a
+// view of every loaded texture, bound once per pass as an array of
+// Capacity() views; materials pick their textures by handle, the slot
+// of the view in that range. Handles stay the same for as long as the texture is
+// registered, so changing textures never changes a descriptor table.
+//
+// Slot 0 always holds a null view and is the handle of "no texture".
+// Unregistered slots may still be sampled by frames in flight, so they
+// are nulled and handed out again only once the fence of the frame
+// they were unregistered in has completed.
+//*******************************************************************
+
+#pragma once
+
+#include "Utils/DXUtil.h"
+#include "DescriptorHeap.h"
+
+class TextureRegistry
+{
+public:
+	static const UINT NullHandle = 0;
+
+	// Slots wanted where the device does not limit the table.
+	static const UINT DefaultMaxTextures = 4096;
+
+	// Number of slots the table can have on device. Resource binding tier 1
+	// allows 128 SRVs per stage, shared with the reservedSrvCount views
+	// bound in other tables; higher tiers only limit the heap.
+	static UINT GetCapacity(ID3D12Device* device, UINT reservedSrvCount, UINT maxTextures = DefaultMaxTextures);
+
+	// Takes capacity contiguous descriptors of heap for the table.
+	TextureRegistry(Microsoft::WRL::ComPtr<ID3D12Device> device, DescriptorHeapWrapper* heap, UINT capacity);
+
+	TextureRegistry(const TextureRegistry& rhs) = delete;
+	TextureRegistry& operator=(const TextureRegistry& rhs) = delete;
+
+	// Write a 2D view of resource into a free slot and return its handle,
+	// the only kind of view the Texture2D array of the shaders can read.
+	// The resource is kept alive until it is unregistered. Throws when
+	// every slot is taken.
+	UINT Register(ID3D12Resource* resource);
+
+	// Give the slot back once the GPU is done with the current frame.
+	void Unregister(UINT handle);
+
+	// Called at the start of every frame, like DescriptorHeapWrapper::BeginFrame.
+	void BeginFrame(UINT64 completedFence, UINT64 nextFrameFence);
+
+	// Bind this as the texture table; the root signature range holds
+	// Capacity() views.
+	CD3DX12_GPU_DESCRIPTOR_HANDLE GetTableStart() const { return mHeap->GetGPUHandle(mTableStart); }
+
+	UINT Capacity() const { return (UINT)mResources.size(); }
+	UINT Count() const { return mCount; }
+	UINT PendingFreeCount() const { return (UINT)mPendingFrees.size(); }
+
+private:
+	void WriteNullView(UINT handle);
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12Device> mDevice;
+	DescriptorHeapWrapper* mHeap;
+	UINT mTableStart;
+
+	// Registered resource of every slot, null for free ones.
+	std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> mResources;
+
+	// Free slots, the lowest on top.
+	std::vector<UINT> mFreeSlots;
+
+	// Unregistered slots in order, with the fence they wait for.
+	std::deque<std::pair<UINT64, UINT>> mPendingFrees;
+
+	UINT mCount = 0;
+	UINT64 mFrameFence = 0;
+};
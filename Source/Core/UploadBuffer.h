@@ -5,20 +5,30 @@
 // and destruction of an upload buffer resource, handles mapping and
 // unmapping the resource, and provides the CopyData method to update
 // a particular element in the buffer.
+//
+// Upload heaps are write-combined: the CPU should only write them, in
+// large sequential runs, and never read them back. Use CopyRange for
+// data that already exists in system memory and WriteSpan for data
+// generated element by element.
 //*******************************************************************
 
 #pragma once
 
 #include "Utils/DXUtil.h"
+#include "Utils/StreamingCopy.h"
+#include "Memory/GpuMemoryAllocator.h"
 
 template<typename T>
 class UploadBuffer
 {
 public:
-    UploadBuffer(ID3D12Device* device, UINT elementCount, bool isConstantBuffer) : 
-        mIsConstantBuffer(isConstantBuffer)
+    // The buffer is placed in a heap of allocator, if one is given.
+    UploadBuffer(ID3D12Device* device, UINT elementCount, bool isConstantBuffer, GpuMemoryAllocator* allocator = nullptr) : 
+        mIsConstantBuffer(isConstantBuffer),
+        mAllocator(allocator)
     {
         mElementByteSize = sizeof(T);
+        mElementCount = elementCount;
 
         // Constant buffer elements need to be multiples of 256 bytes.
         // This is because the hardware can only view constant data 
@@ -30,15 +40,25 @@ public:
         if(isConstantBuffer)
             mElementByteSize = DXUtil::CalcConstantBufferByteSize(sizeof(T));
 
-        ThrowIfFailed(device->CreateCommittedResource(
-            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-            D3D12_HEAP_FLAG_NONE,
-            &CD3DX12_RESOURCE_DESC::Buffer(mElementByteSize*elementCount),
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-            nullptr,
-            IID_PPV_ARGS(&mUploadBuffer)));
+        if (mAllocator != nullptr)
+        {
+            mUploadBuffer = mAllocator->CreateResource(D3D12_HEAP_TYPE_UPLOAD,
+                CD3DX12_RESOURCE_DESC::Buffer(mElementByteSize*elementCount), D3D12_RESOURCE_STATE_GENERIC_READ);
+        }
+        else
+        {
+            ThrowIfFailed(device->CreateCommittedResource(
+                &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+                D3D12_HEAP_FLAG_NONE,
+                &CD3DX12_RESOURCE_DESC::Buffer(mElementByteSize*elementCount),
+                D3D12_RESOURCE_STATE_GENERIC_READ,
+                nullptr,
+                IID_PPV_ARGS(&mUploadBuffer)));
+        }
 
-        ThrowIfFailed(mUploadBuffer->Map(0, nullptr, reinterpret_cast<void**>(&mMappedData)));
+        // An empty read range tells the driver the CPU never reads the data.
+        CD3DX12_RANGE readRange(0, 0);
+        ThrowIfFailed(mUploadBuffer->Map(0, &readRange, reinterpret_cast<void**>(&mMappedData)));
 
         // We do not need to unmap until we are done with the resource.  However, we must not write to
         // the resource while it is in use by the GPU (so we must use synchronization techniques).
@@ -51,6 +71,9 @@ public:
         if(mUploadBuffer != nullptr)
             mUploadBuffer->Unmap(0, nullptr);
 
+        if (mAllocator != nullptr)
+            mAllocator->Release(mUploadBuffer.Get());
+
         mMappedData = nullptr;
     }
 
@@ -61,13 +84,81 @@ public:
 
     void CopyData(int elementIndex, const T& data)
     {
+        assert(elementIndex >= 0 && (UINT)elementIndex < mElementCount);
+        AssertNotMapped(&data, sizeof(T));
+
         memcpy(&mMappedData[elementIndex*mElementByteSize], &data, sizeof(T));
     }
 
+    // Copy count consecutive elements. Tightly packed elements are copied
+    // in one streaming pass; constant buffer elements are padded, so they
+    // are copied one at a time.
+    void CopyRange(int firstElement, const T* data, UINT count)
+    {
+        assert(firstElement >= 0 && (UINT)firstElement + count <= mElementCount);
+        AssertNotMapped(data, count * sizeof(T));
+
+        BYTE* dst = &mMappedData[firstElement*mElementByteSize];
+        if (mElementByteSize == sizeof(T))
+        {
+            StreamingCopy(dst, data, (std::size_t)count * sizeof(T));
+            return;
+        }
+
+        for (UINT i = 0; i < count; ++i)
+            memcpy(dst + i * mElementByteSize, &data[i], sizeof(T));
+    }
+
+    // Write-only view of a range of elements. There is deliberately no way
+    // to read through it. Write the elements in increasing order.
+    class Span
+    {
+    public:
+        Span(BYTE* data, UINT stride, UINT count) :
+            mData(data), mStride(stride), mCount(count) {}
+
+        void Write(UINT index, const T& value)
+        {
+            assert(index < mCount);
+            memcpy(mData + (std::size_t)index * mStride, &value, sizeof(T));
+        }
+
+        UINT Size() const { return mCount; }
+
+    private:
+        BYTE* mData;
+        UINT mStride;
+        UINT mCount;
+    };
+
+    Span WriteSpan(int firstElement, UINT count)
+    {
+        assert(firstElement >= 0 && (UINT)firstElement + count <= mElementCount);
+
+        return Span(&mMappedData[firstElement*mElementByteSize], mElementByteSize, count);
+    }
+
+private:
+    // Copying out of the mapped memory is a read from uncached memory, which
+    // is slow enough to be a bug. Only the mapping of this buffer is checked:
+    // a source in another upload buffer, or any other write-combined memory,
+    // goes through unnoticed.
+    void AssertNotMapped(const void* data, std::size_t byteSize) const
+    {
+#if defined(DEBUG) || defined(_DEBUG)
+        const BYTE* begin = static_cast<const BYTE*>(data);
+        const BYTE* mappedEnd = mMappedData + (std::size_t)mElementByteSize * mElementCount;
+        assert(begin + byteSize <= mMappedData || begin >= mappedEnd);
+#endif
+    }
+
 private:
     Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
     BYTE* mMappedData = nullptr;
 
     UINT mElementByteSize = 0;
+    UINT mElementCount = 0;
     bool mIsConstantBuffer = false;
+
+    GpuMemoryAllocator* mAllocator = nullptr;
 };
\ No newline at end of file
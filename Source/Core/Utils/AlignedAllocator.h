@@ -0,0 +1,47 @@
+//*******************************************************************
+// AlignedAllocator.h:
+//
+// STL compatible allocator that returns memory aligned to a given
+// boundary, so SIMD kernels can use aligned loads on std::vector data.
+//*******************************************************************
+
+#pragma once
+
+template<typename T, std::size_t Alignment>
+class AlignedAllocator
+{
+public:
+	using value_type = T;
+
+	static_assert(Alignment >= alignof(T), "Alignment must be at least the natural alignment of T.");
+	static_assert((Alignment & (Alignment - 1)) == 0, "Alignment must be a power of two.");
+
+	template<typename U>
+	struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+	AlignedAllocator() noexcept = default;
+
+	template<typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {}
+
+	T* allocate(std::size_t n)
+	{
+		void* p = ::operator new(n * sizeof(T), std::align_val_t(Alignment));
+		return static_cast<T*>(p);
+	}
+
+	void deallocate(T* p, std::size_t) noexcept
+	{
+		::operator delete(p, std::align_val_t(Alignment));
+	}
+
+	template<typename U>
+	bool operator==(const AlignedAllocator<U, Alignment>&) const noexcept { return true; }
+
+	template<typename U>
+	bool operator!=(const AlignedAllocator<U, Alignment>&) const noexcept { return false; }
+};
+
+// Vector whose storage can be read with aligned 128/256-bit loads.
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T, 32>>;
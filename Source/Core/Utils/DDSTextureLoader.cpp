@@ -8,6 +8,8 @@
 #include <wrl.h>
 
 #include "DDSTextureLoader.h" 
+#include "Memory/GpuMemoryAllocator.h"
+#include "Memory/UploadBatch.h"
 
 using namespace Microsoft::WRL;
 
@@ -1225,7 +1227,9 @@ static HRESULT CreateD3DResources12(
 	_In_ bool isCubeMap,
 	_In_reads_opt_(mipCount*arraySize) D3D12_SUBRESOURCE_DATA* initData,
 	ComPtr<ID3D12Resource>& texture,
-	ComPtr<ID3D12Resource>& textureUploadHeap
+	ComPtr<ID3D12Resource>& textureUploadHeap,
+	GpuMemoryAllocator* allocator,
+	UploadBatch* uploads
 	)
 {
 	if (device == nullptr)
@@ -1253,32 +1257,55 @@ static HRESULT CreateD3DResources12(
 		texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
 		texDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
 
-		hr = device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-			D3D12_HEAP_FLAG_NONE,
-			&texDesc,
-			D3D12_RESOURCE_STATE_COMMON,
-			nullptr,
-			IID_PPV_ARGS(&texture)
-			);
+		if (allocator != nullptr)
+		{
+			// The allocator throws on failure like the rest of the engine.
+			texture = allocator->CreateResource(D3D12_HEAP_TYPE_DEFAULT, texDesc, D3D12_RESOURCE_STATE_COMMON);
+			hr = S_OK;
+		}
+		else
+		{
+			hr = device->CreateCommittedResource(
+				&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+				D3D12_HEAP_FLAG_NONE,
+				&texDesc,
+				D3D12_RESOURCE_STATE_COMMON,
+				nullptr,
+				IID_PPV_ARGS(&texture)
+				);
+		}
 
 		if (FAILED(hr))
 		{
 			texture = nullptr;
 			return hr;
 		}
+		else if (uploads != nullptr)
+		{
+			// Copied when the batch is flushed; textureUploadHeap stays empty.
+			uploads->UploadTexture(texture.Get(), 0, texDesc.DepthOrArraySize * texDesc.MipLevels,
+				initData, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+		}
 		else
 		{
 			const UINT num2DSubresources = texDesc.DepthOrArraySize * texDesc.MipLevels;
 			const UINT64 uploadBufferSize = GetRequiredIntermediateSize(texture.Get(), 0, num2DSubresources);
 
-			hr = device->CreateCommittedResource(
-				&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-				D3D12_HEAP_FLAG_NONE,
-				&CD3DX12_RESOURCE_DESC::Buffer(uploadBufferSize),
-				D3D12_RESOURCE_STATE_GENERIC_READ,
-				nullptr,
-				IID_PPV_ARGS(&textureUploadHeap));
+			if (allocator != nullptr)
+			{
+				textureUploadHeap = allocator->CreateResource(D3D12_HEAP_TYPE_UPLOAD,
+					CD3DX12_RESOURCE_DESC::Buffer(uploadBufferSize), D3D12_RESOURCE_STATE_GENERIC_READ);
+			}
+			else
+			{
+				hr = device->CreateCommittedResource(
+					&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+					D3D12_HEAP_FLAG_NONE,
+					&CD3DX12_RESOURCE_DESC::Buffer(uploadBufferSize),
+					D3D12_RESOURCE_STATE_GENERIC_READ,
+					nullptr,
+					IID_PPV_ARGS(&textureUploadHeap));
+			}
 			if (FAILED(hr))
 			{
 				texture = nullptr;
@@ -1662,7 +1689,9 @@ static HRESULT CreateTextureFromDDS12(
 	_In_ size_t maxsize,
 	_In_ bool forceSRGB,
 	ComPtr<ID3D12Resource>& texture,
-	ComPtr<ID3D12Resource>& textureUploadHeap)
+	ComPtr<ID3D12Resource>& textureUploadHeap,
+	_In_opt_ GpuMemoryAllocator* allocator,
+	_In_opt_ UploadBatch* uploads)
 {
 	HRESULT hr = S_OK;
 
@@ -1851,7 +1880,9 @@ static HRESULT CreateTextureFromDDS12(
 			isCubeMap,
 			initData.get(),
 			texture, 
-			textureUploadHeap);
+			textureUploadHeap,
+			allocator,
+			uploads);
 	}
 
 	return hr;
@@ -1963,7 +1994,9 @@ HRESULT DirectX::CreateDDSTextureFromMemory12(
 		maxsize,
 		false,
 		texture,
-		textureUploadHeap
+		textureUploadHeap,
+		nullptr,
+		nullptr
 		);
 
 	if (SUCCEEDED(hr))
@@ -2124,7 +2157,9 @@ HRESULT DirectX::CreateDDSTextureFromFile12(_In_ ID3D12Device* device,
 	_Out_ ComPtr<ID3D12Resource>& texture,
 	_Out_ ComPtr<ID3D12Resource>& textureUploadHeap,
 	_In_ size_t maxsize,
-	_Out_opt_ DDS_ALPHA_MODE* alphaMode)
+	_Out_opt_ DDS_ALPHA_MODE* alphaMode,
+	_In_opt_ GpuMemoryAllocator* allocator,
+	_In_opt_ UploadBatch* uploads)
 {
 	if (texture)
 	{
@@ -2156,7 +2191,7 @@ HRESULT DirectX::CreateDDSTextureFromFile12(_In_ ID3D12Device* device,
 	}
 
 	hr = CreateTextureFromDDS12(device, cmdList, header,
-		bitData, bitSize, maxsize, false, texture, textureUploadHeap);
+		bitData, bitSize, maxsize, false, texture, textureUploadHeap, allocator, uploads);
 
 	if (SUCCEEDED(hr))
 	{
@@ -33,6 +33,13 @@
 #define _Use_decl_annotations_
 #endif
 
+// Places the textures in shared heaps when given to the 12 loaders.
+class GpuMemoryAllocator;
+
+// Stages the texture data with the other uploads of the batch instead of
+// in an upload heap of its own, when given to the 12 loaders.
+class UploadBatch;
+
 namespace DirectX
 {
     enum DDS_ALPHA_MODE
@@ -78,7 +85,9 @@ namespace DirectX
 		                               _Out_ Microsoft::WRL::ComPtr<ID3D12Resource>& texture,
 		                               _Out_ Microsoft::WRL::ComPtr<ID3D12Resource>& textureUploadHeap,
 		                               _In_ size_t maxsize = 0,
-		                               _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr
+		                               _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr,
+		                               _In_opt_ GpuMemoryAllocator* allocator = nullptr,
+		                               _In_opt_ UploadBatch* uploads = nullptr
 		                               );
 
     // Standard version with optional auto-gen mipmap support
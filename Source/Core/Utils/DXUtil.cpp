@@ -3,6 +3,8 @@
 //*******************************************************************
 #include "lmpch.h"
 #include "DXUtil.h"
+#include "Memory/GpuMemoryAllocator.h"
+#include "Memory/GeometryPool.h"
 
 using Microsoft::WRL::ComPtr;
 
@@ -14,6 +16,48 @@ DxException::DxException(HRESULT hr, const std::wstring& functionName, const std
 {
 }
 
+D3D12_VERTEX_BUFFER_VIEW MeshGeometry::VertexBufferView()const
+{
+    if (Pool != nullptr)
+        return Pool->VertexBufferView();
+
+    D3D12_VERTEX_BUFFER_VIEW vbv;
+    vbv.BufferLocation = VertexBufferGPU->GetGPUVirtualAddress() + VertexBufferOffset;
+    vbv.StrideInBytes = VertexByteStride;
+    vbv.SizeInBytes = VertexBufferByteSize;
+
+    return vbv;
+}
+
+D3D12_INDEX_BUFFER_VIEW MeshGeometry::IndexBufferView()const
+{
+    if (Pool != nullptr)
+        return Pool->IndexBufferView();
+
+    D3D12_INDEX_BUFFER_VIEW ibv;
+    ibv.BufferLocation = IndexBufferGPU->GetGPUVirtualAddress();
+    ibv.Format = IndexFormat;
+    ibv.SizeInBytes = IndexBufferByteSize;
+
+    return ibv;
+}
+
+const void* MeshGeometry::VertexData()const
+{
+    if (Pool != nullptr)
+        return Pool->VertexData();
+
+    return VertexBufferCPU != nullptr ? VertexBufferCPU->GetBufferPointer() : nullptr;
+}
+
+const void* MeshGeometry::IndexData()const
+{
+    if (Pool != nullptr)
+        return Pool->IndexData();
+
+    return IndexBufferCPU != nullptr ? IndexBufferCPU->GetBufferPointer() : nullptr;
+}
+
 bool DXUtil::IsKeyDown(int vkeyCode)
 {
     return (GetAsyncKeyState(vkeyCode) & 0x8000) != 0;
@@ -41,28 +85,40 @@ Microsoft::WRL::ComPtr<ID3D12Resource> DXUtil::CreateDefaultBuffer(
     ID3D12GraphicsCommandList* cmdList,
     const void* initData,
     UINT64 byteSize,
-    Microsoft::WRL::ComPtr<ID3D12Resource>& uploadBuffer)
+    Microsoft::WRL::ComPtr<ID3D12Resource>& uploadBuffer,
+    GpuMemoryAllocator* allocator)
 {
     ComPtr<ID3D12Resource> defaultBuffer;
 
-    // Create the actual default buffer resource.
-    ThrowIfFailed(device->CreateCommittedResource(
-        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-        D3D12_HEAP_FLAG_NONE,
-        &CD3DX12_RESOURCE_DESC::Buffer(byteSize),
-        D3D12_RESOURCE_STATE_COMMON,
-        nullptr,
-        IID_PPV_ARGS(defaultBuffer.GetAddressOf())));
-
-    // In order to copy CPU memory data into our default buffer, we need to create
-    // an intermediate upload heap. 
-    ThrowIfFailed(device->CreateCommittedResource(
-        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-        D3D12_HEAP_FLAG_NONE,
-        &CD3DX12_RESOURCE_DESC::Buffer(byteSize),
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        nullptr,
-        IID_PPV_ARGS(uploadBuffer.GetAddressOf())));
+    if (allocator != nullptr)
+    {
+        // Placed in the heaps of the allocator instead of heaps of their own.
+        defaultBuffer = allocator->CreateResource(D3D12_HEAP_TYPE_DEFAULT,
+            CD3DX12_RESOURCE_DESC::Buffer(byteSize), D3D12_RESOURCE_STATE_COMMON);
+        uploadBuffer = allocator->CreateResource(D3D12_HEAP_TYPE_UPLOAD,
+            CD3DX12_RESOURCE_DESC::Buffer(byteSize), D3D12_RESOURCE_STATE_GENERIC_READ);
+    }
+    else
+    {
+        // Create the actual default buffer resource.
+        ThrowIfFailed(device->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+            D3D12_HEAP_FLAG_NONE,
+            &CD3DX12_RESOURCE_DESC::Buffer(byteSize),
+            D3D12_RESOURCE_STATE_COMMON,
+            nullptr,
+            IID_PPV_ARGS(defaultBuffer.GetAddressOf())));
+
+        // In order to copy CPU memory data into our default buffer, we need to create
+        // an intermediate upload heap. 
+        ThrowIfFailed(device->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+            D3D12_HEAP_FLAG_NONE,
+            &CD3DX12_RESOURCE_DESC::Buffer(byteSize),
+            D3D12_RESOURCE_STATE_GENERIC_READ,
+            nullptr,
+            IID_PPV_ARGS(uploadBuffer.GetAddressOf())));
+    }
 
 
     // Describe the data we want to copy into the default buffer.
@@ -94,10 +150,7 @@ ComPtr<ID3DBlob> DXUtil::CompileShader(
     const std::string& entrypoint,
     const std::string& target)
 {
-    UINT compileFlags = 0;
-#if defined(DEBUG) || defined(_DEBUG)  
-    compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
-#endif
+    UINT compileFlags = GetShaderCompileFlags();
 
     HRESULT hr = S_OK;
 
@@ -114,6 +167,15 @@ ComPtr<ID3DBlob> DXUtil::CompileShader(
     return byteCode;
 }
 
+UINT DXUtil::GetShaderCompileFlags()
+{
+    UINT compileFlags = 0;
+#if defined(DEBUG) || defined(_DEBUG)  
+    compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#endif
+    return compileFlags;
+}
+
 std::wstring DxException::ToString()const
 {
     // Get the string description of the error code.
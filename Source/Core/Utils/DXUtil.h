@@ -8,6 +8,10 @@
 
 extern const int gNumFrameResources;
 
+class GpuMemoryAllocator;
+class UploadBatch;
+class GeometryPool;
+
 inline void d3dSetDebugName(IDXGIObject* obj, const char* name)
 {
 	if (obj)
@@ -96,7 +100,8 @@ public:
 		ID3D12GraphicsCommandList* cmdList,
 		const void* initData,
 		UINT64 byteSize,
-		Microsoft::WRL::ComPtr<ID3D12Resource>& uploadBuffer);
+		Microsoft::WRL::ComPtr<ID3D12Resource>& uploadBuffer,
+		GpuMemoryAllocator* allocator = nullptr);
 
 	/// <summary>
 	/// Helper function to compile shaders at runtime.
@@ -107,6 +112,9 @@ public:
 		const D3D_SHADER_MACRO* defines,
 		const std::string& entrypoint,
 		const std::string& target);
+
+	// Flags CompileShader compiles with in this build configuration.
+	static UINT GetShaderCompileFlags();
 };
 
 class DxException
@@ -123,6 +131,18 @@ public:
 	int LineNumber = -1;
 };
 
+// One level of detail of a submesh. All levels of a submesh share its
+// vertices and differ only in their index range.
+struct SubmeshLOD
+{
+	UINT IndexCount = 0;
+	UINT StartIndexLocation = 0;
+
+	// Largest distance between this level and the full resolution surface,
+	// relative to the radius of the submesh bounding sphere.
+	float RelativeError = 0.0f;
+};
+
 // Defines a subrange of geometry in a MeshGeometry. This is for when multiple
 // geometries are stored in one vertex and index buffer. It provides the 
 // offsets and data needed to draw a subset of geometry stores in the vertex 
@@ -137,6 +157,10 @@ struct SubmeshGeometry
 	// Bounding box of the geometry defined by this submesh. 
 	// This is used in later chapters of the book.
 	DirectX::BoundingBox Bounds;
+
+	// Level of detail chain, finest first; LODs[0] is the submesh itself.
+	// Empty if the submesh only has a single resolution.
+	std::vector<SubmeshLOD> LODs;
 };
 
 struct MeshGeometry
@@ -156,7 +180,15 @@ struct MeshGeometry
 	Microsoft::WRL::ComPtr<ID3D12Resource> VertexBufferUploader = nullptr;
 	Microsoft::WRL::ComPtr<ID3D12Resource> IndexBufferUploader = nullptr;
 
-	// Data about the buffers.
+	// Set when the geometry lives in a GeometryPool instead of buffers of its
+	// own. The offsets in DrawArgs are then absolute within the pool, which
+	// the views and data below refer to.
+	GeometryPool* Pool = nullptr;
+	UINT PoolMesh = 0;
+
+	// Data about the buffers. Dynamic vertices may start part way into
+	// their buffer.
+	UINT64 VertexBufferOffset = 0;
 	UINT VertexByteStride = 0;
 	UINT VertexBufferByteSize = 0;
 	DXGI_FORMAT IndexFormat = DXGI_FORMAT_R16_UINT;
@@ -167,25 +199,13 @@ struct MeshGeometry
 	// the Submeshes individually.
 	std::unordered_map<std::string, SubmeshGeometry> DrawArgs;
 
-	D3D12_VERTEX_BUFFER_VIEW VertexBufferView()const
-	{
-		D3D12_VERTEX_BUFFER_VIEW vbv;
-		vbv.BufferLocation = VertexBufferGPU->GetGPUVirtualAddress();
-		vbv.StrideInBytes = VertexByteStride;
-		vbv.SizeInBytes = VertexBufferByteSize;
-
-		return vbv;
-	}
-
-	D3D12_INDEX_BUFFER_VIEW IndexBufferView()const
-	{
-		D3D12_INDEX_BUFFER_VIEW ibv;
-		ibv.BufferLocation = IndexBufferGPU->GetGPUVirtualAddress();
-		ibv.Format = IndexFormat;
-		ibv.SizeInBytes = IndexBufferByteSize;
+	D3D12_VERTEX_BUFFER_VIEW VertexBufferView()const;
+	D3D12_INDEX_BUFFER_VIEW IndexBufferView()const;
 
-		return ibv;
-	}
+	// System memory copies of the vertices and indices the offsets in
+	// DrawArgs refer to, or null if none were kept.
+	const void* VertexData()const;
+	const void* IndexData()const;
 
 	// We can free this memory after we finish upload to the GPU.
 	void DisposeUploaders()
@@ -216,6 +236,9 @@ struct Texture
 
 	Microsoft::WRL::ComPtr<ID3D12Resource> Resource = nullptr;
 	Microsoft::WRL::ComPtr<ID3D12Resource> UploadHeap = nullptr;
+
+	// Slot in the bindless texture table, 0 (a null view) if not registered.
+	UINT Handle = 0;
 };
 
 #ifndef ThrowIfFailed
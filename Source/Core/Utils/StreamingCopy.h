@@ -0,0 +1,52 @@
+//*******************************************************************
+// StreamingCopy.h:
+//
+// Memory copy for destinations the CPU only ever writes, such as
+// mapped upload heaps. The bulk of the copy uses non-temporal stores
+// in full 64 byte lines: on write-combined memory this fills whole
+// combining buffers, and on cache-coherent upload heaps it keeps data
+// the CPU will never read back out of the caches.
+//*******************************************************************
+
+#pragma once
+
+#include <emmintrin.h>
+
+inline void StreamingCopy(void* dst, const void* src, std::size_t byteSize)
+{
+	BYTE* d = static_cast<BYTE*>(dst);
+	const BYTE* s = static_cast<const BYTE*>(src);
+
+	// Plain stores up to the first 64 byte boundary of the destination, so
+	// every line the loop below streams is a whole cache line.
+	std::size_t head = (64 - (reinterpret_cast<std::uintptr_t>(d) & 63)) & 63;
+	if (head > byteSize)
+		head = byteSize;
+	memcpy(d, s, head);
+	d += head;
+	s += head;
+	byteSize -= head;
+
+	// The source may have any alignment.
+	for (; byteSize >= 64; byteSize -= 64, d += 64, s += 64)
+	{
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 16));
+		__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 32));
+		__m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 48));
+		_mm_stream_si128(reinterpret_cast<__m128i*>(d), a);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(d + 16), b);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(d + 32), c);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(d + 48), e);
+	}
+
+	// The last partial line.
+	for (; byteSize >= 16; byteSize -= 16, d += 16, s += 16)
+		_mm_stream_si128(reinterpret_cast<__m128i*>(d), _mm_loadu_si128(reinterpret_cast<const __m128i*>(s)));
+
+	memcpy(d, s, byteSize);
+
+	// Non-temporal stores are weakly ordered; make them visible before
+	// anything that follows, e.g. the submission that reads the data.
+	_mm_sfence();
+}
@@ -39,8 +39,11 @@ using namespace Microsoft::WRL;
 #include <functional>
 #include <map>
 #include <memory>
+#include <memory_resource>
 #include <mutex>
 #include <new>
+#include <queue>
+#include <set>
 #include <sstream>
 #include <string>
 #include <thread>
@@ -48,42 +48,67 @@ bool Game::Initialize()
     if (!DXCore::Initialize())
         return false;
 
+    mGpuAllocator = make_unique<GpuMemoryAllocator>(md3dDevice.Get());
+    mUploadRing = make_unique<UploadRing>(md3dDevice.Get(), UploadRing::DefaultSize, mGpuAllocator.get());
+    mUploadBatch = make_unique<UploadBatch>(md3dDevice.Get(), mGpuAllocator.get());
+
     // Reset the command list to prep for initialization commands.
     ThrowIfFailed(mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr));
 
     mCamera.SetPosition(mDefaultCamPos);
 
-    // Create the SRV heap.
+    // Create the SRV heap. The bindless texture table is as large as the
+    // device allows for the pixel shader next to the 2 views of the main
+    // pass table and the 4 root SRVs. A few more descriptors hold the null
+    // views and the GUI font, and the rest of the heap holds the transient
+    // tables of the frames in flight.
+    UINT textureCapacity = TextureRegistry::GetCapacity(md3dDevice.Get(), 6);
     mCbvSrvUavDescriptorHeap = make_unique<DescriptorHeapWrapper>();
-    mCbvSrvUavDescriptorHeap->Create(md3dDevice, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 99, true);
+    mCbvSrvUavDescriptorHeap->Create(md3dDevice, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, textureCapacity + 16, true, 32);
+    mTextureRegistry = make_unique<TextureRegistry>(md3dDevice, mCbvSrvUavDescriptorHeap.get(), textureCapacity);
 
     // Create the shadow map.
     mShadowMap = std::make_unique<ShadowMap>(
         md3dDevice.Get(), mCbvSrvUavDescriptorHeap.get(), 2048, 2048);
+    BuildRenderGraph();
 
     LoadTextures();
+
+    // Pipelines the driver compiled on an earlier start are loaded from
+    // the library instead. Root signatures are registered with it as they
+    // are built.
+    mPipelineCache = std::make_unique<PipelineStateCache>(md3dDevice.Get(), L"..\\..\\Build\\ShaderCache\\Pipelines.bin");
     BuildRootSignature();
+    BuildCommandSignature();
     BuildDescriptorHeaps();
     BuildShadersAndInputLayout();
 
     // Build scene implicit geometries
-    mGeoBuilder = make_unique<GeoBuilder>();
+    mGeoBuilder = make_unique<GeoBuilder>(mGpuAllocator.get(), mUploadBatch.get());
     mGeoBuilder->CreateWaves(128, 128, 1.0f, 0.03f, 4.0f, 0.2f);
     mGeoBuilder->BuildShapeGeometry(md3dDevice, mCommandList, "shapeGeo");
-    mGeoBuilder->BuildGeometryFromText("car.txt", md3dDevice, mCommandList, "carModel");
+    mGeoBuilder->BuildGeometryFromText("car.txt", md3dDevice, mCommandList, "carModel", 4);
+    mGeoBuilder->BuildGeometryFromText("skull.txt", md3dDevice, mCommandList, "skullModel", 5);
 
     BuildMaterials();
     BuildRenderItems();
+    BuildTexTransforms();
+    BuildInstanceBounds();
     BuildFrameResources();
     BuildPSOs();
 
-    // Execute the initialization commands.
+    // Record the copies of every mesh and texture at once, then execute the
+    // initialization commands.
+    mUploadBatch->Flush(mCommandList.Get());
     ThrowIfFailed(mCommandList->Close());
     ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
     mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
 
-    // Wait until initialization is complete.
+    // Wait until initialization is complete. Staging pages go at the first
+    // frame; anything loaded without the batch can let go of its uploaders.
     FlushCommandQueue();
+    mGeoBuilder->DisposeUploaders();
+    mTextures->DisposeUploaders();
 
     return true;
 }
@@ -124,6 +149,9 @@ void Game::OnResize()
     mCamera.SetLens(0.25f * MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
 
     BoundingFrustum::CreateFromMatrix(mCamFrustum, mCamera.GetProj());
+
+    // Cached results were computed against the old projection.
+    mVisibilityCache.Invalidate();
 }
 
 // ------------------------------------------------------------------
@@ -134,6 +162,11 @@ void Game::OnResize()
 // ------------------------------------------------------------------
 void Game::Update(const GameTimer& gt)
 {
+    // Temporaries of the last frame are dropped, and what the frame takes
+    // from the heap is counted from here to the end of Draw.
+    FrameArena::BeginFrame();
+    mFrameHeapAllocationStart = HeapAllocationCounter::Count();
+
     OnKeyboardInput(gt);
 
     // Cycle through the circular frame resource array.
@@ -151,6 +184,24 @@ void Game::Update(const GameTimer& gt)
         CloseHandle(eventHandle);
     }
 
+    // Placed memory released and upload space used in finished frames can
+    // be reused, and what is released or used from now on waits for the
+    // fence this frame will signal.
+    UINT64 completedFence = mFence->GetCompletedValue();
+    mGpuAllocator->BeginFrame(completedFence, mCurrentFence + 1);
+    mUploadRing->BeginFrame(completedFence, mCurrentFence + 1);
+    mUploadBatch->BeginFrame(completedFence, mCurrentFence + 1);
+    mGeoBuilder->BeginFrame(completedFence, mCurrentFence + 1);
+    mCbvSrvUavDescriptorHeap->BeginFrame(completedFence, mCurrentFence + 1);
+    mTextureRegistry->BeginFrame(completedFence, mCurrentFence + 1);
+
+    // The sky and the shadow map are bound as one table. It is written for
+    // every frame, so it follows the shadow map texture of the graph.
+    mMainPassSrvTable = mCbvSrvUavDescriptorHeap->AllocateTransient(2);
+    mCbvSrvUavDescriptorHeap->CreateSrvDescriptor(md3dDevice, mTextures->GetTextureResource("skyCubeMap").Get(),
+        D3D12_SRV_DIMENSION_TEXTURECUBE, CUBE_MAP, mMainPassSrvTable);
+    mShadowMap->CreateSrv(mMainPassSrvTable + 1);
+
     //
     // Animate the lights (and hence shadows).
     //
@@ -166,11 +217,23 @@ void Game::Update(const GameTimer& gt)
     }
 
     AnimateMaterials(gt);
+
+    // Packing moves the ranges of the meshes, so it happens before anything
+    // of this frame reads them.
+    if (mCompactGeometryRequested)
+    {
+        CompactGeometry();
+        mCompactGeometryRequested = false;
+    }
+
+    // The light volume decides which shadow casters are kept.
+    UpdateShadowTransform(gt);
     UpdateInstanceData(gt);
+    UpdateRenderQueues(gt);
     UpdateMaterialBuffer(gt);
-    UpdateShadowTransform(gt);
     UpdateMainPassCB(gt);
     UpdateShadowPassCB(gt);
+    UpdateShaderPermutations();
 
     //UpdateWaves(gt);
 }
@@ -183,115 +246,232 @@ void Game::Draw(const GameTimer& gt)
 {
     auto cmdListAlloc = mCurrFrameResource->CmdListAlloc;
 
-    // Reuse the memory associated with command recording. We can only reset 
+    // Reuse the memory associated with command recording. We can only reset
     // when the associated command lists have finished execution on the GPU.
     ThrowIfFailed(cmdListAlloc->Reset());
 
     // A command list can be reset after it has been added to the command queue
     // via ExecuteCommandList. Reusing the command list reuses memory.
-    ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
+    ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), nullptr));
 
-    // ========================== 1st: Shadow Pass ============================
-    // Set the descriptor heaps to the command list.
-    ID3D12DescriptorHeap* descriptorHeaps[] = { mCbvSrvUavDescriptorHeap->GetHeapPtr() };
-    mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+    // Lay out the GUI before any recording starts, so whatever it changes
+    // is settled by the time the passes read it.
+    GUI::StartFrame();
+    DrawGUI();
 
-    // Set the root signature to the command list.
-    mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
+    // Copies staged since the last frame, the GUI's included, are recorded
+    // into a list of their own that is submitted before any pass.
+    bool hasUploads = mUploadBatch->PendingCopyCount() > 0;
+    if (hasUploads)
+    {
+        auto uploadCmdListAlloc = mCurrFrameResource->UploadCmdListAlloc;
+        ThrowIfFailed(uploadCmdListAlloc->Reset());
+        ThrowIfFailed(mUploadCommandList->Reset(uploadCmdListAlloc.Get(), nullptr));
 
-    // Bind all the materials used in this scene. For structured buffers, we
-    // can bypass the heap and set as a root descriptor.
-    auto matBuffer = mCurrFrameResource->MaterialBuffer->Resource();
-    mCommandList->SetGraphicsRootShaderResourceView(2, matBuffer->GetGPUVirtualAddress());
+        mUploadBatch->Flush(mUploadCommandList.Get());
+        ThrowIfFailed(mUploadCommandList->Close());
+    }
 
-    // Bind null SRV for shadow map pass.
-    mCommandList->SetGraphicsRootDescriptorTable(3, mCbvSrvUavDescriptorHeap->GetGPUHandle(mNullCubeSrvIndex));
+    // The back buffer changes every frame, the depth buffer on resize.
+    mRenderGraph.SetImportedResource(mBackBufferResource, CurrentBackBuffer());
+    mRenderGraph.SetImportedResource(mDepthBufferResource, mDepthStencilBuffer.Get());
 
-    // Bind all the textures used in this scene. Observe that we only have to
-    // specify the first descriptor in the table. The root signature knows how
-    // many descriptors are expected in the table.
-    mCommandList->SetGraphicsRootDescriptorTable(4, mCbvSrvUavDescriptorHeap->GetGPUHandle(0));
+    auto recordStart = std::chrono::steady_clock::now();
 
-    DrawSceneToShadowMap();
+    // Every pass records into its own command list and allocator, while
+    // this thread records the GUI into mCommandList.
+    ParallelRecorder::Record((UINT)RecordingPass::Count, mParallelRecording,
+        [this](UINT i) { RecordPass((RecordingPass)i); },
+        [this]() { RecordGUIPass(); });
 
-    // ========================== 2nd: Main Pass ============================
-    // Set the viewport and scissor rect.  This needs to be reset whenever the 
-    // command list is reset.
-    mCommandList->RSSetViewports(1, &mScreenViewport);
-    mCommandList->RSSetScissorRects(1, &mScissorRect);
+    mRecordingTimeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - recordStart).count();
 
-    // Indicate a state transition on the resource usage.
-    mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
-        D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
+    // Submit the uploads, then the live passes in order, the GUI last.
+    ID3D12CommandList* cmdsLists[(int)RecordingPass::Count + 2];
+    UINT cmdsListCount = 0;
+    if (hasUploads)
+        cmdsLists[cmdsListCount++] = mUploadCommandList.Get();
+    for (int i = 0; i < (int)RecordingPass::Count; ++i)
+    {
+        if (!mRenderGraph.IsPassCulled(mGraphPasses[i]))
+            cmdsLists[cmdsListCount++] = mPassCommandLists[i].Get();
+    }
+    cmdsLists[cmdsListCount++] = mCommandList.Get();
+    mCommandQueue->ExecuteCommandLists(cmdsListCount, cmdsLists);
 
-    // Clear the back buffer and depth buffer.
-    mCommandList->ClearRenderTargetView(CurrentBackBufferView(), (float*)&mMainPassCB.FogColor, 0, nullptr);
-    mCommandList->ClearDepthStencilView(DepthStencilView(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
+    // Swap the back and front buffers
+    ThrowIfFailed(mSwapChain->Present(0, 0));
+    mCurrBackBuffer = (mCurrBackBuffer + 1) % SwapChainBufferCount;
 
-    // Specify the buffers we are going to render to.
-    mCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
+    // Advance the fence value to mark commands up to this fence point.
+    mCurrFrameResource->Fence = ++mCurrentFence;
 
-    // Bind per-pass constant buffer. We only need to do this once per-pass.
-    auto passCB = mCurrFrameResource->PassCB->Resource();
-    mCommandList->SetGraphicsRootConstantBufferView(0, passCB->GetGPUVirtualAddress());
 
-    // Bind the sky cube map.  For our demos, we just use one "world" cube map 
-    // representing the environment from far away, so all objects will use the 
-    // same cube map and we only need to set it once per-frame.  
-    // If we wanted to use "local" cube maps, we would have to change them 
-    // per-object, or dynamically index into an array of cube maps.
-    mCommandList->SetGraphicsRootDescriptorTable(3, mCbvSrvUavDescriptorHeap->GetGPUHandle(mSkyTexHeapIndex));
+    // Add an instruction to the command queue to set a new fence point.
+    // Because we are on the GPU timeline, the new fence point won't be set
+    // until the GPU finishes processing all the commands prior to this
+    // Signal().
+    mCommandQueue->Signal(mFence.Get(), mCurrentFence);
 
-    // Draw render items and set pipeline states
-    if (mIsWireframe)
-        mCommandList->SetPipelineState(mPSOs["opaque_wireframe"].Get());
-    else
-        mCommandList->SetPipelineState(mPSOs["opaque"].Get());
-    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+    // Note that GPU could still be working on commands from previous frames,
+    // but that is okay, because we are not touching any frame resources
+    // associated with those frames.
+
+    mFrameHeapAllocations = (UINT)(HeapAllocationCounter::Count() - mFrameHeapAllocationStart);
+}
+
+// ------------------------------------------------------------------
+// Record one pass into its own command list. Called from worker
+// threads, so it may only read the scene and the frame resource.
+// ------------------------------------------------------------------
+void Game::RecordPass(RecordingPass pass)
+{
+    // Nothing reads what a culled pass would produce.
+    if (mRenderGraph.IsPassCulled(mGraphPasses[(int)pass]))
+    {
+        mPassStateStats[(int)pass] = TrackedCommandList::Stats();
+        return;
+    }
 
-    //mCommandList->SetPipelineState(mPSOs["alphaTested"].Get());
-    //DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::AlphaTested]);
+    auto cmdListAlloc = mCurrFrameResource->PassCmdListAllocs[(int)pass];
+    auto d3dCmdList = mPassCommandLists[(int)pass].Get();
 
-    mCommandList->SetPipelineState(mPSOs["sky"].Get());
-    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Sky]);
+    ThrowIfFailed(cmdListAlloc->Reset());
+    ThrowIfFailed(d3dCmdList->Reset(cmdListAlloc.Get(), nullptr));
 
-    mCommandList->SetPipelineState(mPSOs["transparent"].Get());
-    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Transparent]);
+    // Everything bound for the pass goes through the tracker, which drops
+    // the calls binding what is bound already.
+    TrackedCommandList cmdList(d3dCmdList);
 
-    // Indicate a state transition on the resource usage.
-    mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
-        D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
+    // Command lists do not inherit any state from the ones submitted before
+    // them, so each pass binds everything it uses.
+    SetCommonRootBindings(cmdList);
 
+    mRenderGraph.RecordPassBarriers(mGraphPasses[(int)pass], d3dCmdList);
+
+    switch (pass)
+    {
+    case RecordingPass::Shadow:
+        DrawSceneToShadowMap(cmdList);
+        break;
+
+    case RecordingPass::Opaque:
+        // Clear the back buffer and depth buffer.
+        cmdList.ClearRenderTargetView(CurrentBackBufferView(), (float*)&mMainPassCB.FogColor, 0, nullptr);
+        cmdList.ClearDepthStencilView(DepthStencilView(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
+
+        SetMainPassState(cmdList);
+
+        // Draw render items and set pipeline states
+        if (mIsWireframe)
+            cmdList.SetPipelineState(mPSOs[(int)PipelineKind::OpaqueWireframe]);
+        else
+            cmdList.SetPipelineState(mPSOs[(int)PipelineKind::Opaque]);
+        DrawRenderItems(cmdList, RenderLayer::Opaque);
+
+        //cmdList.SetPipelineState(mPSOs.at("alphaTested").Get());
+        //DrawRenderItems(cmdList, RenderLayer::AlphaTested);
+        break;
+
+    case RecordingPass::Sky:
+        SetMainPassState(cmdList);
+        cmdList.SetPipelineState(mPSOs[(int)PipelineKind::Sky]);
+        DrawRenderItems(cmdList, RenderLayer::Sky);
+        break;
+
+    case RecordingPass::Transparent:
+        SetMainPassState(cmdList);
+        cmdList.SetPipelineState(mPSOs[(int)PipelineKind::Transparent]);
+        DrawRenderItems(cmdList, RenderLayer::Transparent);
+        break;
+
+    default:
+        assert(false);
+        break;
+    }
+
+    mPassStateStats[(int)pass] = cmdList.GetStats();
+
+    // Done recording commands.
+    ThrowIfFailed(d3dCmdList->Close());
+}
+
+// ------------------------------------------------------------------
+// Record the GUI over the finished frame into mCommandList and hand
+// the back buffer over to presentation.
+// ------------------------------------------------------------------
+void Game::RecordGUIPass()
+{
+    mRenderGraph.RecordPassBarriers(mGUIGraphPass, mCommandList.Get());
+
+    D3D12_CPU_DESCRIPTOR_HANDLE backBufferView = CurrentBackBufferView();
+    mCommandList->OMSetRenderTargets(1, &backBufferView, true, nullptr);
 
-    // GUI rendering
-    GUI::StartFrame();
-    DrawGUI();
     GUI::RenderFrame(mCommandList.Get(), mCbvSrvUavDescriptorHeap.get());
 
+    // Hand the back buffer over to presentation.
+    mRenderGraph.RecordFinalBarriers(mCommandList.Get());
+
     // Done recording commands.
     ThrowIfFailed(mCommandList->Close());
+}
 
-    // Add the command list to the queue for execution.
-    ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
-    mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+// ------------------------------------------------------------------
+// Bind the root signature and the resources shared by every pass.
+// ------------------------------------------------------------------
+void Game::SetCommonRootBindings(TrackedCommandList& cmdList)
+{
+    // Set the descriptor heaps to the command list.
+    ID3D12DescriptorHeap* descriptorHeaps[] = { mCbvSrvUavDescriptorHeap->GetHeapPtr() };
+    cmdList.SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
 
-    // Swap the back and front buffers
-    ThrowIfFailed(mSwapChain->Present(0, 0));
-    mCurrBackBuffer = (mCurrBackBuffer + 1) % SwapChainBufferCount;
+    // Set the root signature to the command list.
+    cmdList.SetGraphicsRootSignature(mRootSignature.Get());
 
-    // Advance the fence value to mark commands up to this fence point.
-    mCurrFrameResource->Fence = ++mCurrentFence;
+    // Bind all the materials used in this scene. For structured buffers, we
+    // can bypass the heap and set as a root descriptor.
+    auto matBuffer = mCurrFrameResource->MaterialBuffer->Resource();
+    cmdList.SetGraphicsRootShaderResourceView(2, matBuffer->GetGPUVirtualAddress());
 
+    // The texture transforms never change, so every frame shares one buffer.
+    cmdList.SetGraphicsRootShaderResourceView(5, mTexTransformBuffer->Resource()->GetGPUVirtualAddress());
 
-    // Add an instruction to the command queue to set a new fence point. 
-    // Because we are on the GPU timeline, the new fence point won't be set 
-    // until the GPU finishes processing all the commands prior to this
-    // Signal().
-    mCommandQueue->Signal(mFence.Get(), mCurrentFence);
+    // Every draw indexes into the same persistent instance data.
+    auto instanceBuffer = mCurrFrameResource->InstanceBuffer->Resource();
+    cmdList.SetGraphicsRootShaderResourceView(6, instanceBuffer->GetGPUVirtualAddress());
 
-    // Note that GPU could still be working on commands from previous frames, 
-    // but that is okay, because we are not touching any frame resources 
-    // associated with those frames.
+    // Bind null SRV for shadow map pass.
+    cmdList.SetGraphicsRootDescriptorTable(3, mCbvSrvUavDescriptorHeap->GetGPUHandle(mNullCubeSrvIndex));
+
+    // Bind all the textures of the scene at once. Materials index the table
+    // by handle, so it never changes between draws.
+    cmdList.SetGraphicsRootDescriptorTable(4, mTextureRegistry->GetTableStart());
+}
+
+// ------------------------------------------------------------------
+// Set the render targets and per-pass bindings of the main pass.
+// ------------------------------------------------------------------
+void Game::SetMainPassState(TrackedCommandList& cmdList)
+{
+    // Set the viewport and scissor rect.  This needs to be reset whenever the
+    // command list is reset.
+    cmdList.RSSetViewports(1, &mScreenViewport);
+    cmdList.RSSetScissorRects(1, &mScissorRect);
+
+    // Specify the buffers we are going to render to.
+    D3D12_CPU_DESCRIPTOR_HANDLE backBufferView = CurrentBackBufferView();
+    D3D12_CPU_DESCRIPTOR_HANDLE depthStencilView = DepthStencilView();
+    cmdList.OMSetRenderTargets(1, &backBufferView, true, &depthStencilView);
+
+    // Bind per-pass constant buffer. We only need to do this once per-pass.
+    cmdList.SetGraphicsRootConstantBufferView(0, mMainPassCBAddress);
+
+    // Bind the sky cube map.  For our demos, we just use one "world" cube map
+    // representing the environment from far away, so all objects will use the
+    // same cube map and we only need to set it once per-frame.
+    // If we wanted to use "local" cube maps, we would have to change them
+    // per-object, or dynamically index into an array of cube maps.
+    cmdList.SetGraphicsRootDescriptorTable(3, mCbvSrvUavDescriptorHeap->GetGPUHandle(mMainPassSrvTable));
 }
 
 #pragma region Update Methods
@@ -328,93 +508,697 @@ void Game::OnKeyboardInput(const GameTimer& gt)
 }
 
 // ------------------------------------------------------------------
-// Translate the texture coordinates in the texture plane as a function
-// of time.
+// Translate the texture coordinates in the texture plane as a function
+// of time.
+// ------------------------------------------------------------------
+void Game::AnimateMaterials(const GameTimer& gt)
+{
+    // Scroll the water material texture coordinates.
+    auto waterMat = mMaterials->GetMaterial("water");
+
+    float& tu = waterMat->GetTransform()(3, 0);
+    float& tv = waterMat->GetTransform()(3, 1);
+
+    tu += 0.1f * gt.DeltaTime();
+    tv += 0.02f * gt.DeltaTime();
+
+    if (tu >= 1.0f)
+        tu -= 1.0f;
+
+    if (tv >= 1.0f)
+        tv -= 1.0f;
+
+    waterMat->SetTransformRowCol(3, 0, tu);
+    waterMat->SetTransformRowCol(3, 1, tv);
+
+    // Material has changed, so need to update cbuffer.
+    waterMat->SetNumFramesDirty(gNumFrameResources);
+}
+
+// ------------------------------------------------------------------
+// Update the per instance data.
+// ------------------------------------------------------------------
+void Game::UpdateInstanceData(const GameTimer& gt)
+{
+    totalVisibleInstanceCount = 0;
+    mInstanceBytesWritten = 0;
+
+    XMMATRIX view = mCamera.GetView();
+    XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+
+    if (mAllRitems.empty())
+        return;
+
+    // Only the slots that changed since this frame resource was last used
+    // are copied; the rest of the buffer is still current.
+    mInstanceStore.Upload(*mCurrFrameResource->InstanceBuffer);
+    mInstanceBytesWritten = mInstanceStore.GetStats().BytesWritten;
+
+    // The world space frustum planes are extracted once per frame and shared
+    // by every render item.
+    XMMATRIX viewProj = XMMatrixMultiply(view, mCamera.GetProj());
+    mFrustumCuller.SetViewProj(viewProj);
+
+    XMMATRIX lightViewProj = XMMatrixMultiply(XMLoadFloat4x4(&mLightView), XMLoadFloat4x4(&mLightProj));
+    mShadowCasterCuller.SetShadowCasterVolume(lightViewProj);
+    mShadowCasterCount = 0;
+    mShadowVisibleCount = 0;
+
+    mOccludedInstanceCount = 0;
+    if (mOcclusionCullingEnabled)
+    {
+        auto occlusionStart = std::chrono::steady_clock::now();
+        DrawOccluders(viewProj);
+        mOcclusionTimeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - occlusionStart).count();
+    }
+
+    XMMATRIX proj = mCamera.GetProj();
+    mLODPixelScale = 0.5f * mClientHeight * XMVectorGetY(proj.r[1]);
+    mLODEyePosW = mCamera.GetPosition3f();
+    std::fill(mLODInstanceTotals.begin(), mLODInstanceTotals.end(), 0);
+
+    std::chrono::steady_clock::duration cullingTime(0);
+
+    for (auto& e : mAllRitems)
+    {
+        e->InstanceCount = 0;
+        e->ShadowInstanceCount = 0;
+    }
+
+    if (mFrustumCullingEnabled && mCullingMode == CullingMode::Hierarchy)
+    {
+        auto cullStart = std::chrono::steady_clock::now();
+
+        // Pick up the bounds of any instance that moved since the last frame,
+        // then traverse the whole scene at once.
+        mInstanceBVH.Refit(mInstanceBounds);
+        UINT visibleCount = mInstanceBVH.Cull(mFrustumCuller, mInstanceBounds, mVisibleInstances.data(), &mBVHStats);
+
+        cullingTime = std::chrono::steady_clock::now() - cullStart;
+
+        // Render items left out of the hierarchy are always visible. Sorting
+        // then groups the list by render item, in the order of mAllRitems.
+        for (auto& e : mAllRitems)
+        {
+            if (!IsFrustumCullable(*e))
+            {
+                for (UINT i = 0; i < (UINT)e->Instances.size(); ++i)
+                    mVisibleInstances[visibleCount++] = e->firstInstanceID + i;
+            }
+        }
+
+        std::sort(mVisibleInstances.begin(), mVisibleInstances.begin() + visibleCount);
+
+        UINT v = 0;
+        for (auto& e : mAllRitems)
+        {
+            const UINT first = v;
+            const UINT end = e->firstInstanceID + (UINT)e->Instances.size();
+            for (; v < visibleCount && mVisibleInstances[v] < end; ++v)
+                mVisibleInstances[v] -= e->firstInstanceID;
+
+            // The temporal mode can only reuse buffers it wrote itself.
+            WriteVisibleInstances(e.get(), mVisibleInstances.data() + first, v - first, true, false);
+        }
+
+        // The hierarchy is built for the camera view; the shadow casters are
+        // tested separately.
+        for (auto& e : mAllRitems)
+        {
+            if (!IsShadowCaster(*e))
+                continue;
+
+            auto cullStart = std::chrono::steady_clock::now();
+            UINT shadowVisibleCount = CullShadowCasters(e.get(), mShadowVisibleInstances.data());
+            cullingTime += std::chrono::steady_clock::now() - cullStart;
+
+            WriteShadowInstances(e.get(), mShadowVisibleInstances.data(), shadowVisibleCount);
+        }
+    }
+    else
+    {
+        // Reusing last frame's instance buffers is only safe when nothing but
+        // the frustum test decides what is drawn.
+        bool useTemporalCache = mFrustumCullingEnabled && mCullingMode == CullingMode::Temporal;
+        bool canReuseBuffers = useTemporalCache && !mOcclusionCullingEnabled;
+
+        if (useTemporalCache)
+        {
+            VisibilityCache::CameraPose pose = {
+                mCamera.GetPosition3f(), mCamera.GetRight3f(), mCamera.GetUp3f(), mCamera.GetLook3f() };
+            mVisibilityCache.BeginFrame(mFrustumCuller, pose);
+        }
+
+        for (auto& e : mAllRitems)
+        {
+            const UINT instanceCount = (UINT)e->Instances.size();
+
+            bool isCullingEnabled = mFrustumCullingEnabled && IsFrustumCullable(*e);
+            bool isShadowCaster = IsShadowCaster(*e);
+            bool visibleSetChanged = !canReuseBuffers;
+
+            UINT visibleInstanceCount = 0;
+            UINT shadowVisibleCount = 0;
+            bool isShadowCulled = false;
+            if (isCullingEnabled)
+            {
+                auto cullStart = std::chrono::steady_clock::now();
+
+                if (mCullingMode == CullingMode::Reference)
+                    visibleInstanceCount = CullInstancesReference(e.get(), invView, mVisibleInstances.data());
+                else if (mCullingMode == CullingMode::Temporal)
+                    visibleInstanceCount = mVisibilityCache.Cull(mInstanceBounds, e->firstInstanceID, instanceCount, mVisibleInstances.data(), visibleSetChanged);
+                else if (isShadowCaster && mShadowCullingEnabled)
+                {
+                    // Both views in a single pass over the bounds.
+                    const FrustumCuller* views[] = { &mFrustumCuller, &mShadowCasterCuller };
+                    UINT* outVisible[] = { mVisibleInstances.data(), mShadowVisibleInstances.data() };
+                    UINT outCounts[_countof(views)];
+                    FrustumCuller::CullViews(views, _countof(views), mInstanceBounds, e->firstInstanceID, instanceCount, outVisible, outCounts);
+
+                    visibleInstanceCount = outCounts[0];
+                    shadowVisibleCount = outCounts[1];
+                    isShadowCulled = true;
+                }
+                else
+                    visibleInstanceCount = mFrustumCuller.Cull(mInstanceBounds, e->firstInstanceID, instanceCount, mVisibleInstances.data());
+
+                cullingTime += std::chrono::steady_clock::now() - cullStart;
+            }
+            else
+            {
+                for (UINT i = 0; i < instanceCount; ++i)
+                    mVisibleInstances[visibleInstanceCount++] = i;
+            }
+
+            if (isShadowCaster && !isShadowCulled)
+            {
+                auto cullStart = std::chrono::steady_clock::now();
+                shadowVisibleCount = CullShadowCasters(e.get(), mShadowVisibleInstances.data());
+                cullingTime += std::chrono::steady_clock::now() - cullStart;
+            }
+
+            WriteVisibleInstances(e.get(), mVisibleInstances.data(), visibleInstanceCount, visibleSetChanged, canReuseBuffers);
+            if (isShadowCaster)
+                WriteShadowInstances(e.get(), mShadowVisibleInstances.data(), shadowVisibleCount);
+        }
+    }
+
+    for (auto& e : mAllRitems)
+        totalVisibleInstanceCount += e->InstanceCount;
+
+    mCullingTimeMs = std::chrono::duration<float, std::milli>(cullingTime).count();
+}
+
+// ------------------------------------------------------------------
+// Write the slots of the instances of a render item that passed
+// frustum culling to its visible instance list in the current frame
+// resource. Occluded ones are dropped and the rest are grouped by
+// level of detail, so every level is drawn from one contiguous range
+// of the list.
+// ------------------------------------------------------------------
+void Game::WriteVisibleInstances(RenderItem* ri, UINT* visible, UINT count, bool visibleSetChanged, bool canReuseBuffers)
+{
+    UINT visibleCount = 0;
+    for (UINT v = 0; v < count; ++v)
+    {
+        if (!IsOccluded(*ri, visible[v]))
+            visible[visibleCount++] = visible[v];
+    }
+
+    const UINT lodCount = (UINT)ri->LODs.size();
+    if (lodCount > 0)
+    {
+        std::fill(ri->LODInstanceCounts.begin(), ri->LODInstanceCounts.end(), 0);
+
+        for (UINT v = 0; v < visibleCount; ++v)
+        {
+            UINT level = SelectLOD(*ri, visible[v]);
+            ++ri->LODInstanceCounts[level];
+
+            // A level switch changes the buffer contents as much as a
+            // visibility change does.
+            UINT8& lastLevel = mInstanceLODs[ri->firstInstanceID + visible[v]];
+            if (lastLevel != level)
+            {
+                lastLevel = (UINT8)level;
+                visibleSetChanged = true;
+            }
+        }
+
+        if (mLODInstanceTotals.size() < lodCount)
+            mLODInstanceTotals.resize(lodCount, 0);
+        for (UINT level = 0; level < lodCount; ++level)
+            mLODInstanceTotals[level] += ri->LODInstanceCounts[level];
+    }
+
+    // Each frame resource has its own visible list, so a changed visible
+    // set has to be written to all of them in turn. Outside the temporal mode
+    // the count never runs down, so switching to it starts with every buffer
+    // being rewritten.
+    if (visibleSetChanged)
+        ri->NumFramesDirty = gNumFrameResources;
+
+    if (ri->NumFramesDirty == 0)
+    {
+        // The buffer of this frame resource already holds exactly these
+        // instances.
+        ri->InstanceCount = visibleCount;
+        return;
+    }
+
+    if (lodCount > 0)
+    {
+        // Counting sort by level; the scratch list ends up in draw order.
+        UINT offsets[16];
+        assert(lodCount <= _countof(offsets));
+
+        UINT offset = 0;
+        for (UINT level = 0; level < lodCount; ++level)
+        {
+            offsets[level] = offset;
+            offset += ri->LODInstanceCounts[level];
+        }
+
+        for (UINT v = 0; v < visibleCount; ++v)
+            mLODSortedInstances[offsets[mInstanceLODs[ri->firstInstanceID + visible[v]]]++] = visible[v];
+
+        visible = mLODSortedInstances.data();
+    }
+
+    auto visibleSpan = mCurrFrameResource->VisibleInstanceBuffer[ri->instanceBufferID]->WriteSpan(0, visibleCount);
+    ri->VisibleInstanceSlots.resize(visibleCount);
+    for (UINT v = 0; v < visibleCount; ++v)
+    {
+        ri->VisibleInstanceSlots[v] = ri->firstInstanceID + visible[v];
+        visibleSpan.Write(v, ri->VisibleInstanceSlots[v]);
+    }
+    ri->InstanceCount = visibleCount;
+    mInstanceBytesWritten += visibleCount * sizeof(UINT);
+
+    if (canReuseBuffers)
+        ri->NumFramesDirty--;
+}
+
+// ------------------------------------------------------------------
+// Write the shadow casters of a render item that are inside the light
+// volume to its shadow view list, grouped by level of detail like the
+// camera list. Levels are picked from the camera's point of view, so
+// the casters match the geometry seen on screen. The list is rewritten
+// every frame, so it comes from the upload ring.
+// ------------------------------------------------------------------
+void Game::WriteShadowInstances(RenderItem* ri, const UINT* visible, UINT count)
+{
+    const UINT lodCount = (UINT)ri->LODs.size();
+    if (lodCount > 0)
+    {
+        ri->ShadowLODInstanceCounts.assign(lodCount, 0);
+
+        for (UINT v = 0; v < count; ++v)
+        {
+            UINT level = SelectLOD(*ri, visible[v]);
+            mShadowInstanceLODs[v] = (UINT8)level;
+            ++ri->ShadowLODInstanceCounts[level];
+        }
+
+        // Counting sort by level; the scratch list ends up in draw order.
+        UINT offsets[16];
+        assert(lodCount <= _countof(offsets));
+
+        UINT offset = 0;
+        for (UINT level = 0; level < lodCount; ++level)
+        {
+            offsets[level] = offset;
+            offset += ri->ShadowLODInstanceCounts[level];
+        }
+
+        for (UINT v = 0; v < count; ++v)
+            mLODSortedInstances[offsets[mShadowInstanceLODs[v]]++] = visible[v];
+
+        visible = mLODSortedInstances.data();
+    }
+
+    UploadRing::Allocation shadowList;
+    auto visibleSpan = mUploadRing->WriteSpan<UINT>(count, shadowList);
+    ri->ShadowInstanceAddress = shadowList.GpuAddress;
+    ri->ShadowVisibleInstanceSlots.resize(count);
+    for (UINT v = 0; v < count; ++v)
+    {
+        ri->ShadowVisibleInstanceSlots[v] = ri->firstInstanceID + visible[v];
+        visibleSpan.Write(v, ri->ShadowVisibleInstanceSlots[v]);
+    }
+    ri->ShadowInstanceCount = count;
+    mInstanceBytesWritten += count * sizeof(UINT);
+
+    mShadowCasterCount += (UINT)ri->Instances.size();
+    mShadowVisibleCount += count;
+}
+
+// ------------------------------------------------------------------
+// Key every render item with visible instances into the queue of each
+// view it is drawn in, and sort the queues. Blended layers are drawn
+// back to front, everything else front to back.
+// ------------------------------------------------------------------
+void Game::UpdateRenderQueues(const GameTimer& gt)
+{
+    RenderQueue& cameraQueue = mRenderQueues[(int)InstanceView::Camera];
+    RenderQueue& shadowQueue = mRenderQueues[(int)InstanceView::Shadow];
+    cameraQueue.Clear();
+    shadowQueue.Clear();
+
+    XMVECTOR eyePos = mCamera.GetPosition();
+    XMVECTOR look = mCamera.GetLook();
+    XMMATRIX lightView = XMLoadFloat4x4(&mLightView);
+
+    for (auto& e : mAllRitems)
+    {
+        // Each layer is drawn with a single PSO, so the layer stands in for it.
+        const UINT pso = (UINT)e->layerID;
+        const UINT material = e->Instances.empty() ? 0 : e->Instances[0].MaterialIndex;
+        XMVECTOR center = XMLoadFloat3(&e->WorldBounds.Center);
+
+        if (e->InstanceCount > 0)
+        {
+            float depth = XMVectorGetX(XMVector3Dot(center - eyePos, look));
+            auto order = e->layerID == (int)RenderLayer::Transparent ?
+                RenderQueue::DepthOrder::BackToFront : RenderQueue::DepthOrder::FrontToBack;
+
+            cameraQueue.Push(RenderQueue::MakeKey(e->layerID, pso, e->geometryID, material, depth, order), e.get());
+        }
+
+        if (IsShadowCaster(*e) && e->ShadowInstanceCount > 0)
+        {
+            float depth = XMVectorGetZ(XMVector3TransformCoord(center, lightView));
+            shadowQueue.Push(RenderQueue::MakeKey(e->layerID, pso, e->geometryID, material, depth, RenderQueue::DepthOrder::FrontToBack), e.get());
+        }
+    }
+
+    cameraQueue.Sort(mAutoInstancingEnabled);
+    shadowQueue.Sort(mAutoInstancingEnabled);
+
+    WriteBatchInstances(InstanceView::Camera);
+    WriteBatchInstances(InstanceView::Shadow);
+
+    // The flag is read by the recording threads, so they only go by what
+    // was built here.
+    mIndirectDrawsBuilt = mIndirectDrawEnabled;
+    if (mIndirectDrawsBuilt)
+    {
+        mIndirectDrawBuilder.Clear();
+        BuildIndirectDraws(InstanceView::Camera);
+        BuildIndirectDraws(InstanceView::Shadow);
+
+        mIndirectDrawArgs = mUploadRing->CopyRange(mIndirectDrawBuilder.Data(), mIndirectDrawBuilder.Size());
+        mInstanceBytesWritten += mIndirectDrawBuilder.Size() * sizeof(IndirectDrawCommand);
+    }
+}
+
+// ------------------------------------------------------------------
+// Emit the argument records of every layer of a view's queue, the same
+// draws DrawRenderItems records directly, one group of ranges per layer.
+// ------------------------------------------------------------------
+void Game::BuildIndirectDraws(InstanceView view)
+{
+    const bool isShadowView = view == InstanceView::Shadow;
+    const RenderQueue& queue = mRenderQueues[(int)view];
+    auto items = queue.GetItems();
+
+    for (int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+    {
+        mIndirectDrawBuilder.BeginGroup();
+
+        for (const RenderQueue::Batch& batch : queue.GetBatches(layer))
+        {
+            auto ri = items[batch.FirstItem];
+            D3D12_VERTEX_BUFFER_VIEW vertexBuffer = ri->Geo->VertexBufferView();
+            D3D12_INDEX_BUFFER_VIEW indexBuffer = ri->Geo->IndexBufferView();
+
+            if (batch.ItemCount > 1)
+            {
+                mIndirectDrawBuilder.AddDraw(vertexBuffer, indexBuffer, ri->PrimitiveType,
+                    mBatchInstanceAddresses[(int)view] + batch.InstanceOffset * sizeof(UINT),
+                    ri->IndexCount, batch.InstanceCount, ri->StartIndexLocation, ri->BaseVertexLocation);
+                continue;
+            }
+
+            D3D12_GPU_VIRTUAL_ADDRESS instanceAddress = GetVisibleInstanceAddress(*ri, view);
+
+            if (ri->LODs.empty())
+            {
+                UINT instanceCount = isShadowView ? ri->ShadowInstanceCount : ri->InstanceCount;
+                mIndirectDrawBuilder.AddDraw(vertexBuffer, indexBuffer, ri->PrimitiveType, instanceAddress,
+                    ri->IndexCount, instanceCount, ri->StartIndexLocation, ri->BaseVertexLocation);
+                continue;
+            }
+
+            const auto& lodInstanceCounts = isShadowView ? ri->ShadowLODInstanceCounts : ri->LODInstanceCounts;
+            for (size_t level = 0; level < ri->LODs.size(); ++level)
+            {
+                const SubmeshLOD& lod = ri->LODs[level];
+                mIndirectDrawBuilder.AddDraw(vertexBuffer, indexBuffer, ri->PrimitiveType, instanceAddress,
+                    lod.IndexCount, lodInstanceCounts[level], lod.StartIndexLocation, ri->BaseVertexLocation);
+
+                instanceAddress += lodInstanceCounts[level] * sizeof(UINT);
+            }
+        }
+
+        mIndirectRanges[(int)view][layer] = mIndirectDrawBuilder.EndGroup();
+    }
+}
+
+// ------------------------------------------------------------------
+// Count the instances of every batch of a view's queue, and gather the
+// visible lists of batches merging several render items back to back
+// into the batch list of the view, so each of them is one instanced
+// draw. The batch list is sized to this frame's batches in the upload
+// ring.
+// ------------------------------------------------------------------
+void Game::WriteBatchInstances(InstanceView view)
+{
+    RenderQueue& queue = mRenderQueues[(int)view];
+    const bool isShadowView = view == InstanceView::Shadow;
+
+    auto items = queue.GetItems();
+
+    const UINT offset = queue.AssignInstances([isShadowView](const RenderItem& ri)
+    {
+        return isShadowView ? ri.ShadowInstanceCount : ri.InstanceCount;
+    });
+
+    UINT drawCount = 0;
+    for (const RenderQueue::Batch& batch : queue.GetBatches())
+    {
+        const RenderItem* first = items[batch.FirstItem];
+        drawCount += first->LODs.empty() ? 1 : (UINT)first->LODs.size();
+    }
+
+    mDrawCounts[(int)view] = drawCount;
+
+    UploadRing::Allocation batchList;
+    auto batchSpan = mUploadRing->WriteSpan<UINT>(offset, batchList);
+    mBatchInstanceAddresses[(int)view] = batchList.GpuAddress;
+    mInstanceBytesWritten += offset * sizeof(UINT);
+
+    UINT v = 0;
+    for (const RenderQueue::Batch& batch : queue.GetBatches())
+    {
+        if (batch.ItemCount == 1)
+            continue;
+
+        for (UINT i = 0; i < batch.ItemCount; ++i)
+        {
+            const RenderItem* ri = items[batch.FirstItem + i];
+            const UINT count = isShadowView ? ri->ShadowInstanceCount : ri->InstanceCount;
+            const UINT* slots = isShadowView ? ri->ShadowVisibleInstanceSlots.data() : ri->VisibleInstanceSlots.data();
+            for (UINT s = 0; s < count; ++s)
+                batchSpan.Write(v++, slots[s]);
+        }
+    }
+}
+
+// ------------------------------------------------------------------
+// Address of the visible instance list a render item draws from when
+// it is not merged with others.
+// ------------------------------------------------------------------
+D3D12_GPU_VIRTUAL_ADDRESS Game::GetVisibleInstanceAddress(const RenderItem& ri, InstanceView view) const
+{
+    if (view == InstanceView::Shadow)
+        return ri.ShadowInstanceAddress;
+
+    return mCurrFrameResource->VisibleInstanceBuffer[ri.instanceBufferID]->Resource()->GetGPUVirtualAddress();
+}
+
+// ------------------------------------------------------------------
+// Pick the coarsest level of detail whose error stays below the pixel
+// threshold, given the projected size of the instance bounding sphere.
+// ------------------------------------------------------------------
+UINT Game::SelectLOD(const RenderItem& ri, UINT instanceIndex) const
+{
+    if (!mLODEnabled || ri.LODs.empty())
+        return 0;
+
+    const UINT index = ri.firstInstanceID + instanceIndex;
+
+    float dx = mInstanceBounds.CenterX()[index] - mLODEyePosW.x;
+    float dy = mInstanceBounds.CenterY()[index] - mLODEyePosW.y;
+    float dz = mInstanceBounds.CenterZ()[index] - mLODEyePosW.z;
+    float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+
+    // Inside the bounding sphere the projected size is unbounded.
+    float radius = mInstanceBounds.Radius()[index];
+    if (distance <= radius)
+        return 0;
+
+    float projectedRadius = radius * mLODPixelScale / distance;
+
+    UINT level = 0;
+    while (level + 1 < (UINT)ri.LODs.size() && ri.LODs[level + 1].RelativeError * projectedRadius <= mLODMaxErrorPixels)
+        ++level;
+
+    return level;
+}
+
+// ------------------------------------------------------------------
+// Pack the geometry pools. The render items copied their ranges from
+// the DrawArgs of their geometry, so they move by as much as it did.
+// Frames in flight keep drawing from the old buffers; the copies filling
+// the new ones are submitted ahead of this frame's passes.
+// ------------------------------------------------------------------
+void Game::CompactGeometry()
+{
+    std::unordered_map<const MeshGeometry*, GeometryPool::Mesh> before;
+    for (auto& ri : mAllRitems)
+    {
+        if (ri->Geo->Pool != nullptr)
+            before[ri->Geo] = ri->Geo->Pool->GetMesh(ri->Geo->PoolMesh);
+    }
+
+    mGeoBuilder->Compact();
+
+    for (auto& ri : mAllRitems)
+    {
+        auto it = before.find(ri->Geo);
+        if (it == before.end())
+            continue;
+
+        const GeometryPool::Mesh& after = ri->Geo->Pool->GetMesh(ri->Geo->PoolMesh);
+        INT vertexDelta = (INT)after.BaseVertex - (INT)it->second.BaseVertex;
+        INT indexDelta = (INT)after.StartIndex - (INT)it->second.StartIndex;
+
+        ri->BaseVertexLocation += vertexDelta;
+        ri->StartIndexLocation += indexDelta;
+        for (SubmeshLOD& lod : ri->LODs)
+            lod.StartIndexLocation += indexDelta;
+    }
+}
+
+// ------------------------------------------------------------------
+// Everything but the skybox can be frustum culled.
+// ------------------------------------------------------------------
+bool Game::IsFrustumCullable(const RenderItem& ri) const
+{
+    return ri.layerID != (int)RenderLayer::Sky;
+}
+
+// ------------------------------------------------------------------
+// Only the opaque layer is drawn into the shadow map.
 // ------------------------------------------------------------------
-void Game::AnimateMaterials(const GameTimer& gt)
+bool Game::IsShadowCaster(const RenderItem& ri) const
 {
-    // Scroll the water material texture coordinates.
-    auto waterMat = mMaterials->GetMaterial("water");
-
-    float& tu = waterMat->GetTransform()(3, 0);
-    float& tv = waterMat->GetTransform()(3, 1);
-
-    tu += 0.1f * gt.DeltaTime();
-    tv += 0.02f * gt.DeltaTime();
-
-    if (tu >= 1.0f)
-        tu -= 1.0f;
+    return ri.layerID == (int)RenderLayer::Opaque;
+}
 
-    if (tv >= 1.0f)
-        tv -= 1.0f;
+// ------------------------------------------------------------------
+// Test the instances of a render item against the shadow caster
+// volume. Writes the offsets of the ones that can cast into the shadow
+// map, or of all of them when shadow culling is off.
+// ------------------------------------------------------------------
+UINT Game::CullShadowCasters(const RenderItem* ri, UINT* outVisible) const
+{
+    const UINT instanceCount = (UINT)ri->Instances.size();
 
-    waterMat->SetTransformRowCol(3, 0, tu);
-    waterMat->SetTransformRowCol(3, 1, tv);
+    if (mShadowCullingEnabled && IsFrustumCullable(*ri))
+        return mShadowCasterCuller.Cull(mInstanceBounds, ri->firstInstanceID, instanceCount, outVisible);
 
-    // Material has changed, so need to update cbuffer.
-    waterMat->SetNumFramesDirty(gNumFrameResources);
+    for (UINT i = 0; i < instanceCount; ++i)
+        outVisible[i] = i;
+    return instanceCount;
 }
 
 // ------------------------------------------------------------------
-// Update the per instance data.
+// Rasterize every instance of the occluder render items into the
+// software depth buffer, from the CPU copies of their geometry.
 // ------------------------------------------------------------------
-void Game::UpdateInstanceData(const GameTimer& gt)
+void Game::DrawOccluders(FXMMATRIX viewProj)
 {
-    totalVisibleInstanceCount = 0;
-
-    XMMATRIX view = mCamera.GetView();
-    XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+    mOcclusionBuffer.Begin(viewProj);
 
-    if (mAllRitems.empty())
-        return;
-
-    //int rItemIndex = 0;
     for (auto& e : mAllRitems)
     {
-        auto currInstanceBuffer = mCurrFrameResource->InstanceBuffer[e->instanceBufferID].get();
-
-        const auto& instanceData = e->Instances;
+        if (!e->isOccluder || e->Geo->VertexData() == nullptr || e->Geo->IndexData() == nullptr)
+            continue;
 
-        int visibleInstanceCount = 0;
+        const void* vertices = e->Geo->VertexData();
+        const BYTE* indices = static_cast<const BYTE*>(e->Geo->IndexData());
+        bool indices32 = e->Geo->IndexFormat == DXGI_FORMAT_R32_UINT;
+        indices += e->StartIndexLocation * (indices32 ? sizeof(UINT32) : sizeof(UINT16));
 
-        bool isFCEnabled = mFrustumCullingEnabled;
+        for (const auto& instance : e->Instances)
+        {
+            mOcclusionBuffer.DrawIndexed(
+                vertices, e->Geo->VertexByteStride,
+                indices, indices32, e->IndexCount,
+                e->BaseVertexLocation, XMLoadFloat4x4(&instance.World));
+        }
+    }
 
-        // Disable frustum culling for skybox
-        if (e->layerID == (int)RenderLayer::Sky)
-            mFrustumCullingEnabled = false;
+    mOcclusionBuffer.End();
+}
 
-        for (UINT i = 0; i < (UINT)instanceData.size(); ++i)
-        {
-            XMMATRIX world = XMLoadFloat4x4(&instanceData[i].World);
-            XMMATRIX texTransform = XMLoadFloat4x4(&instanceData[i].TexTransform);
+// ------------------------------------------------------------------
+// Test the world space bounds of an instance against the occlusion
+// buffer. Occluders are never tested against themselves.
+// ------------------------------------------------------------------
+bool Game::IsOccluded(const RenderItem& ri, UINT instanceIndex)
+{
+    if (!mOcclusionCullingEnabled || ri.isOccluder || !IsFrustumCullable(ri))
+        return false;
 
-            XMMATRIX invWorld = XMMatrixInverse(&XMMatrixDeterminant(world), world);
+    BoundingBox box = mInstanceBounds.GetBox(ri.firstInstanceID + instanceIndex);
+    if (mOcclusionBuffer.IsVisible(box.Center, box.Extents))
+        return false;
 
-            // View space to the object's local space.
-            XMMATRIX viewToLocal = XMMatrixMultiply(invView, invWorld);
+    ++mOccludedInstanceCount;
+    return true;
+}
 
-            // Transform the camera frustum from view space to the object's local space.
-            BoundingFrustum localSpaceFrustum;
-            mCamFrustum.Transform(localSpaceFrustum, viewToLocal);
+// ------------------------------------------------------------------
+// Original per-instance culling path: transforms the camera frustum
+// into the local space of every instance. Kept as the baseline the
+// batch culler is measured against.
+// ------------------------------------------------------------------
+UINT Game::CullInstancesReference(const RenderItem* ri, FXMMATRIX invView, UINT* outVisible)
+{
+    UINT visibleInstanceCount = 0;
 
-            // Perform the box/frustum intersection test in local space.
-            if ((localSpaceFrustum.Contains(e->Bounds) != DirectX::DISJOINT) || !mFrustumCullingEnabled)
-            {
-                InstanceData data;
-                XMStoreFloat4x4(&data.World, XMMatrixTranspose(world));
-                XMStoreFloat4x4(&data.TexTransform, XMMatrixTranspose(texTransform));
-                data.MaterialIndex = instanceData[i].MaterialIndex;
+    for (UINT i = 0; i < (UINT)ri->Instances.size(); ++i)
+    {
+        XMMATRIX world = XMLoadFloat4x4(&ri->Instances[i].World);
+        XMMATRIX invWorld = XMMatrixInverse(&XMMatrixDeterminant(world), world);
 
-                // Write the instance data to structured buffer for the visible objects.
-                currInstanceBuffer->CopyData(visibleInstanceCount++, data);
-            }
-        }
+        // View space to the object's local space.
+        XMMATRIX viewToLocal = XMMatrixMultiply(invView, invWorld);
 
-        e->InstanceCount = visibleInstanceCount;
-        mFrustumCullingEnabled = isFCEnabled;
+        // Transform the camera frustum from view space to the object's local space.
+        BoundingFrustum localSpaceFrustum;
+        mCamFrustum.Transform(localSpaceFrustum, viewToLocal);
 
-        totalVisibleInstanceCount += visibleInstanceCount;
+        // Perform the box/frustum intersection test in local space.
+        if (localSpaceFrustum.Contains(ri->Bounds) != DirectX::DISJOINT)
+            outVisible[visibleInstanceCount++] = i;
     }
+
+    return visibleInstanceCount;
 }
 
 // ------------------------------------------------------------------
@@ -425,19 +1209,34 @@ void Game::UpdateInstanceData(const GameTimer& gt)
 void Game::UpdateMaterialBuffer(const GameTimer& gt)
 {
     auto currMaterialBuffer = mCurrFrameResource->MaterialBuffer.get();
-    for (auto& e : mMaterials->GetTable())
+    mMaterialData.resize(mMaterials->GetSize());
+
+    UINT firstDirty = UINT_MAX;
+    UINT lastDirty = 0;
+    for (const auto& e : mMaterials->GetTable())
     {
+        const auto& mat = e.second;
+        UINT index = mat->GetMatCBIndex();
+        assert(index < mMaterialData.size());
+
+        mMaterialData[index] = mat->GetMaterialData();
+
         // Only update the cbuffer data if the constants have changed. If the 
         // cbuffer data changes, it needs to be updated for each FrameResource.
-        auto mat = e.second;
         if (mat->GetNumFramesDirty() > 0)
         {
-            currMaterialBuffer->CopyData(mat->GetMatCBIndex(), mat->GetMaterialData());
+            firstDirty = MathHelper::Min(firstDirty, index);
+            lastDirty = MathHelper::Max(lastDirty, index);
 
             // Next FrameResource need to be updated too.
             mat->DecrementNumFramesDirty();
         }
     }
+
+    // One copy spanning every dirty material. The clean ones in between are
+    // rewritten with the data they already hold.
+    if (firstDirty <= lastDirty)
+        currMaterialBuffer->CopyRange(firstDirty, &mMaterialData[firstDirty], lastDirty - firstDirty + 1);
 }
 
 // ------------------------------------------------------------------
@@ -526,8 +1325,36 @@ void Game::UpdateMainPassCB(const GameTimer& gt)
     //mMainPassCB.Lights[2].Direction = mRotatedLightDirections[2];
     //mMainPassCB.Lights[2].Strength = { 0.2f, 0.2f, 0.2f };
 
-    auto currPassCB = mCurrFrameResource->PassCB.get();
-    currPassCB->CopyData(0, mMainPassCB);
+    mMainPassCBAddress = mUploadRing->CopyConstants(mMainPassCB);
+}
+
+// ------------------------------------------------------------------
+// Switch the lit passes to the leanest variant for the current pass
+// settings. A variant whose shaders or pipelines do not exist yet is
+// built in the background, and the passes keep the current one until
+// then.
+// ------------------------------------------------------------------
+void Game::UpdateShaderPermutations()
+{
+    ShaderPermutations::Key key = mShaderPermutations->Reduce("default", GetPassShaderKey());
+    if (key == mPassShaderKey)
+        return;
+
+    auto variant = mShaderPermutations->Request("default", key);
+    if (variant != nullptr && BuildDefaultPSOs(*variant, true))
+        mPassShaderKey = key;
+}
+
+// ------------------------------------------------------------------
+// Features of the lit shaders that follow from the pass settings.
+// ------------------------------------------------------------------
+ShaderPermutations::Key Game::GetPassShaderKey() const
+{
+    ShaderPermutations::Key key = ShaderPermutations::MakeShadowFilter(mShadowFilter) |
+        ShaderPermutations::MakeDirLightCount(mDirLightCount);
+    if (mFogEnabled)
+        key |= ShaderPermutations::Fog;
+    return key;
 }
 
 void Game::UpdateShadowPassCB(const GameTimer& gt)
@@ -555,8 +1382,7 @@ void Game::UpdateShadowPassCB(const GameTimer& gt)
     mShadowPassCB.NearZ = mLightNearZ;
     mShadowPassCB.FarZ = mLightFarZ;
 
-    auto currPassCB = mCurrFrameResource->PassCB.get();
-    currPassCB->CopyData(1, mShadowPassCB);
+    mShadowPassCBAddress = mUploadRing->CopyConstants(mShadowPassCB);
 }
 
 // ------------------------------------------------------------------
@@ -582,7 +1408,8 @@ void Game::UpdateWaves(const GameTimer& gt)
     mGeoBuilder->GetWaves()->Update(gt.DeltaTime());
 
     // Update the wave vertex buffer with the new solution.
-    auto currWavesVB = mCurrFrameResource->WavesVB.get();
+    UploadRing::Allocation wavesVB;
+    auto wavesSpan = mUploadRing->WriteSpan<Vertex>(mGeoBuilder->GetWaves()->VertexCount(), wavesVB);
     for (int i = 0; i < mGeoBuilder->GetWaves()->VertexCount(); ++i)
     {
         Vertex v;
@@ -595,11 +1422,12 @@ void Game::UpdateWaves(const GameTimer& gt)
         v.TexC.x = 0.5f + v.Pos.x / mGeoBuilder->GetWaves()->Width();
         v.TexC.y = 0.5f - v.Pos.z / mGeoBuilder->GetWaves()->Depth();
 
-        currWavesVB->CopyData(i, v);
+        wavesSpan.Write(i, v);
     }
 
-    // Set the dynamic VB of the wave renderitem to the current frame VB.
-    mWavesRitem->Geo->VertexBufferGPU = currWavesVB->Resource();
+    // Set the dynamic VB of the wave renderitem to this frame's vertices.
+    mWavesRitem->Geo->VertexBufferGPU = wavesVB.Resource;
+    mWavesRitem->Geo->VertexBufferOffset = wavesVB.Offset;
 }
 
 #pragma endregion
@@ -641,10 +1469,13 @@ void Game::LoadTextures()
         L"Skyboxes/sunsetcube1024.dds",
     };
 
-    mTextures = make_unique<TextureWrapper>();
+    // Every 2D texture gets its handle in the bindless table as it loads.
+    // The sky cube map keeps its own view in the main pass table.
+    mTextures = make_unique<TextureWrapper>(mGpuAllocator.get(), mTextureRegistry.get(), mUploadBatch.get());
     for (int i = 0; i < (int)texNames.size(); i++)
     {
-        mTextures->CreateDDSTextureFromFile(md3dDevice, mCommandList, texNames[i], texFilenames[i]);
+        SRV_TYPE type = texNames[i] == "skyCubeMap" ? CUBE_MAP : DIFFUSE_MAP;
+        mTextures->CreateDDSTextureFromFile(md3dDevice, mCommandList, texNames[i], texFilenames[i], type);
     }
 }
 
@@ -672,11 +1503,14 @@ void Game::BuildRootSignature()
     CD3DX12_DESCRIPTOR_RANGE texTable0;
     texTable0.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 2, 0, 0);
 
+    // The bindless texture table, as large as the registry made it for this
+    // device. The array in the shaders is unbounded and takes its size from
+    // this range, which stays within the binding tier's per-stage limit.
     CD3DX12_DESCRIPTOR_RANGE texTable1;
-    texTable1.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 99, 2, 0);
+    texTable1.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, mTextureRegistry->Capacity(), 2, 0);
 
     // Root parameter can be a table, root descriptor or root constants.
-    CD3DX12_ROOT_PARAMETER slotRootParameter[5];
+    CD3DX12_ROOT_PARAMETER slotRootParameter[7];
 
     // Create root CBVs.
     // Performance TIP: Order from most frequent to least frequent.
@@ -685,12 +1519,14 @@ void Game::BuildRootSignature()
     slotRootParameter[2].InitAsShaderResourceView(1, 1);
     slotRootParameter[3].InitAsDescriptorTable(1, &texTable0, D3D12_SHADER_VISIBILITY_PIXEL);
     slotRootParameter[4].InitAsDescriptorTable(1, &texTable1, D3D12_SHADER_VISIBILITY_PIXEL);
+    slotRootParameter[5].InitAsShaderResourceView(2, 1);
+    slotRootParameter[6].InitAsShaderResourceView(3, 1);
 
 
     auto staticSamplers = GetStaticSamplers();
 
     // A root signature is an array of root parameters.
-    CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(5, slotRootParameter,
+    CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(7, slotRootParameter,
         (UINT)staticSamplers.size(), staticSamplers.data(),
         D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
@@ -713,6 +1549,27 @@ void Game::BuildRootSignature()
         serializedRootSig->GetBufferPointer(),
         serializedRootSig->GetBufferSize(),
         IID_PPV_ARGS(mRootSignature.GetAddressOf())));
+
+    // The pipelines are named in the library after what it was built from.
+    mPipelineCache->RegisterRootSignature(mRootSignature.Get(),
+        serializedRootSig->GetBufferPointer(), serializedRootSig->GetBufferSize());
+}
+
+// ------------------------------------------------------------------
+// Create the command signature of the indirect draws. It changes the
+// visible instance list, a root argument, so it needs the root
+// signature.
+// ------------------------------------------------------------------
+void Game::BuildCommandSignature()
+{
+    D3D12_INDIRECT_ARGUMENT_DESC arguments[IndirectDrawBuilder::ArgumentCount];
+    D3D12_COMMAND_SIGNATURE_DESC signatureDesc;
+    IndirectDrawBuilder::DescribeCommandSignature(1, arguments, signatureDesc);
+
+    ThrowIfFailed(md3dDevice->CreateCommandSignature(
+        &signatureDesc,
+        mRootSignature.Get(),
+        IID_PPV_ARGS(mDrawCommandSignature.GetAddressOf())));
 }
 
 // ------------------------------------------------------------------
@@ -720,35 +1577,17 @@ void Game::BuildRootSignature()
 // ------------------------------------------------------------------
 void Game::BuildDescriptorHeaps()
 {
-    //
-    // Fill out the heap with actual descriptors.
-    //
-    mCbvSrvUavDescriptorHeap->CreateSrvDescriptor(md3dDevice, mTextures->GetTextureResource("bricksTex").Get(),     D3D12_SRV_DIMENSION_TEXTURE2D, DIFFUSE_MAP);
-    mCbvSrvUavDescriptorHeap->CreateSrvDescriptor(md3dDevice, mTextures->GetTextureResource("waterTex").Get(),      D3D12_SRV_DIMENSION_TEXTURE2D, DIFFUSE_MAP);
-    mCbvSrvUavDescriptorHeap->CreateSrvDescriptor(md3dDevice, mTextures->GetTextureResource("crate01Tex").Get(),    D3D12_SRV_DIMENSION_TEXTURE2D, DIFFUSE_MAP);
-    mCbvSrvUavDescriptorHeap->CreateSrvDescriptor(md3dDevice, mTextures->GetTextureResource("crate02Tex").Get(),    D3D12_SRV_DIMENSION_TEXTURE2D, DIFFUSE_MAP);
-    mCbvSrvUavDescriptorHeap->CreateSrvDescriptor(md3dDevice, mTextures->GetTextureResource("iceTex").Get(),        D3D12_SRV_DIMENSION_TEXTURE2D, DIFFUSE_MAP);
-    mCbvSrvUavDescriptorHeap->CreateSrvDescriptor(md3dDevice, mTextures->GetTextureResource("grassTex").Get(),      D3D12_SRV_DIMENSION_TEXTURE2D, DIFFUSE_MAP);
-    mCbvSrvUavDescriptorHeap->CreateSrvDescriptor(md3dDevice, mTextures->GetTextureResource("whiteTex").Get(),      D3D12_SRV_DIMENSION_TEXTURE2D, DIFFUSE_MAP);
-    mCbvSrvUavDescriptorHeap->CreateSrvDescriptor(md3dDevice, mTextures->GetTextureResource("checkboardTex").Get(), D3D12_SRV_DIMENSION_TEXTURE2D, DIFFUSE_MAP);
-    mCbvSrvUavDescriptorHeap->CreateSrvDescriptor(md3dDevice, mTextures->GetTextureResource("tileTex").Get(),       D3D12_SRV_DIMENSION_TEXTURE2D, DIFFUSE_MAP);
-
-    // Sky cube map
-    mSkyTexHeapIndex = mCbvSrvUavDescriptorHeap->GetLastDescIndex();
-    mCbvSrvUavDescriptorHeap->CreateSrvDescriptor(md3dDevice, mTextures->GetTextureResource("skyCubeMap").Get(), D3D12_SRV_DIMENSION_TEXTURECUBE, CUBE_MAP);
-
-    // Shadow map
+    // Texture views are written by the registry as the textures load.
+
+    // Shadow map. Its SRV goes into the main pass table every frame.
     auto dsvCpuStart = mDsvHeap->GetCPUDescriptorHandleForHeapStart();
-    mShadowMapHeapIndex = mCbvSrvUavDescriptorHeap->GetLastDescIndex();
     mShadowMap->BuildDescriptors(CD3DX12_CPU_DESCRIPTOR_HANDLE(dsvCpuStart, 1, mDsvDescriptorSize));
 
-    // Null cube
-    mNullCubeSrvIndex = mCbvSrvUavDescriptorHeap->GetLastDescIndex();
-    mCbvSrvUavDescriptorHeap->CreateSrvDescriptor(md3dDevice, nullptr, D3D12_SRV_DIMENSION_TEXTURECUBE, CUBE_MAP);
-
-    // Null texture
-    mNullTexSrvIndex = mCbvSrvUavDescriptorHeap->GetLastDescIndex();
-    mCbvSrvUavDescriptorHeap->CreateSrvDescriptor(md3dDevice, nullptr, D3D12_SRV_DIMENSION_TEXTURE2D, DIFFUSE_MAP);
+    // Null cube and texture, bound together as the table of the shadow pass.
+    mNullCubeSrvIndex = mCbvSrvUavDescriptorHeap->Allocate(2);
+    mNullTexSrvIndex = mNullCubeSrvIndex + 1;
+    mCbvSrvUavDescriptorHeap->CreateSrvDescriptor(md3dDevice, nullptr, D3D12_SRV_DIMENSION_TEXTURECUBE, CUBE_MAP, mNullCubeSrvIndex);
+    mCbvSrvUavDescriptorHeap->CreateSrvDescriptor(md3dDevice, nullptr, D3D12_SRV_DIMENSION_TEXTURE2D, DIFFUSE_MAP, mNullTexSrvIndex);
 
     GUI::SetupRenderer(md3dDevice.Get(), mCbvSrvUavDescriptorHeap.get());
 }
@@ -776,15 +1615,31 @@ void Game::BuildShadersAndInputLayout()
     //const std::wstring shaderFolderPath = L"..\\..\\Engine\\Engine\\Shaders\\";
     const std::wstring shaderFolderPath = L"..\\..\\Source\\Core\\Shaders\\";
 
-    mShaders["standardVS"] = DXUtil::CompileShader(shaderFolderPath + L"Default.hlsl", nullptr, "VS", "vs_5_1");
-    mShaders["opaquePS"] = DXUtil::CompileShader(shaderFolderPath + L"Default.hlsl", nullptr, "PS", "ps_5_1");
-    
-    mShaders["shadowVS"] = DXUtil::CompileShader(shaderFolderPath + L"Shadows.hlsl", nullptr, "VS", "vs_5_1");
-    mShaders["shadowOpaquePS"] = DXUtil::CompileShader(shaderFolderPath + L"Shadows.hlsl", nullptr, "PS", "ps_5_1");
-    mShaders["shadowAlphaTestedPS"] = DXUtil::CompileShader(shaderFolderPath + L"Shadows.hlsl", alphaTestDefines, "PS", "ps_5_1");
+    // Compiled shaders are kept next to the build output, and only the
+    // ones whose sources changed are compiled again.
+    const std::wstring shaderCacheFolderPath = L"..\\..\\Build\\ShaderCache\\";
+    ShaderCache shaderCache(shaderCacheFolderPath);
+
+    shaderCache.Add("shadowVS", shaderFolderPath + L"Shadows.hlsl", nullptr, "VS", "vs_5_1");
+    shaderCache.Add("shadowOpaquePS", shaderFolderPath + L"Shadows.hlsl", nullptr, "PS", "ps_5_1");
+    shaderCache.Add("shadowAlphaTestedPS", shaderFolderPath + L"Shadows.hlsl", alphaTestDefines, "PS", "ps_5_1");
+
+    shaderCache.Add("skyVS", shaderFolderPath + L"Sky.hlsl", nullptr, "VS", "vs_5_1");
+    shaderCache.Add("skyPS", shaderFolderPath + L"Sky.hlsl", nullptr, "PS", "ps_5_1");
 
-    mShaders["skyVS"] = DXUtil::CompileShader(shaderFolderPath + L"Sky.hlsl", nullptr, "VS", "vs_5_1");
-    mShaders["skyPS"] = DXUtil::CompileShader(shaderFolderPath + L"Sky.hlsl", nullptr, "PS", "ps_5_1");
+    shaderCache.Build(mShaders);
+    mShaderCacheHits = shaderCache.HitCount();
+    mShaderCacheMisses = shaderCache.MissCount();
+    mShaderBuildTimeMs = shaderCache.BuildTimeMs();
+
+    // The lit shaders come in variants, of which only the one the starting
+    // pass settings select is compiled up front.
+    mShaderPermutations = std::make_unique<ShaderPermutations>(shaderCacheFolderPath);
+    mShaderPermutations->Declare("default", shaderFolderPath + L"Default.hlsl", "VS", "vs_5_1", "PS", "ps_5_1",
+        ShaderPermutations::AllFeatures);
+
+    mPassShaderKey = mShaderPermutations->Reduce("default", GetPassShaderKey());
+    mShaderPermutations->Compile({ { "default", mPassShaderKey } });
 
     mInputLayout =
     {
@@ -808,21 +1663,11 @@ void Game::BuildPSOs()
     D3D12_GRAPHICS_PIPELINE_STATE_DESC opaquePsoDesc;
 
     //
-    // PSO for opaque objects.
+    // PSO for opaque objects. Its shaders are set per permutation.
     //
     ZeroMemory(&opaquePsoDesc, sizeof(D3D12_GRAPHICS_PIPELINE_STATE_DESC));
     opaquePsoDesc.InputLayout = { mInputLayout.data(), (UINT)mInputLayout.size() };
     opaquePsoDesc.pRootSignature = mRootSignature.Get();
-    opaquePsoDesc.VS =
-    {
-        reinterpret_cast<BYTE*>(mShaders["standardVS"]->GetBufferPointer()),
-        mShaders["standardVS"]->GetBufferSize()
-    };
-    opaquePsoDesc.PS =
-    {
-        reinterpret_cast<BYTE*>(mShaders["opaquePS"]->GetBufferPointer()),
-        mShaders["opaquePS"]->GetBufferSize()
-    };
     opaquePsoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
     opaquePsoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
     opaquePsoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
@@ -833,17 +1678,10 @@ void Game::BuildPSOs()
     opaquePsoDesc.SampleDesc.Count = m4xMsaaState ? 4 : 1;
     opaquePsoDesc.SampleDesc.Quality = m4xMsaaState ? (m4xMsaaQuality - 1) : 0;
     opaquePsoDesc.DSVFormat = mDepthStencilFormat;
+    mDefaultPsoDesc = opaquePsoDesc;
 
-    // Create an ID3D12PipelineState object using the descriptor we filled out
-    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaquePsoDesc, IID_PPV_ARGS(&mPSOs["opaque"])));
-
-
-    //
-    // PSO for opaque wireframe objects.
-    //
-    D3D12_GRAPHICS_PIPELINE_STATE_DESC opaqueWireframePsoDesc = opaquePsoDesc;
-    opaqueWireframePsoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME;
-    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaqueWireframePsoDesc, IID_PPV_ARGS(&mPSOs["opaque_wireframe"])));
+    // The opaque, wireframe and transparent PSOs of the starting variant.
+    BuildDefaultPSOs(*mShaderPermutations->Request("default", mPassShaderKey), false);
 
 
     //
@@ -868,7 +1706,7 @@ void Game::BuildPSOs()
     // Shadow map pass does not have a render target.
     smapPsoDesc.RTVFormats[0] = DXGI_FORMAT_UNKNOWN;
     smapPsoDesc.NumRenderTargets = 0;
-    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&smapPsoDesc, IID_PPV_ARGS(&mPSOs["shadow_opaque"])));
+    mPSOs[(int)PipelineKind::ShadowOpaque] = mPipelineCache->GetOrCreate(smapPsoDesc);
 
 
     //
@@ -894,8 +1732,48 @@ void Game::BuildPSOs()
         reinterpret_cast<BYTE*>(mShaders["skyPS"]->GetBufferPointer()),
         mShaders["skyPS"]->GetBufferSize()
     };
-    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&skyPsoDesc, IID_PPV_ARGS(&mPSOs["sky"])));
+    mPSOs[(int)PipelineKind::Sky] = mPipelineCache->GetOrCreate(skyPsoDesc);
+
+    ////
+    //// PSO for alpha tested objects
+    ////
+    //D3D12_GRAPHICS_PIPELINE_STATE_DESC alphaTestedPsoDesc = opaquePsoDesc;
+    //alphaTestedPsoDesc.PS =
+    //{
+    //    reinterpret_cast<BYTE*>(mShaders["shadowAlphaTestedPS"]->GetBufferPointer()),
+    //    mShaders["shadowAlphaTestedPS"]->GetBufferSize()
+    //};
+    //alphaTestedPsoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
+    //ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&alphaTestedPsoDesc, IID_PPV_ARGS(&mPSOs["shadowAlphaTestedPS"])));
+}
+
+// ------------------------------------------------------------------
+// Make the PSOs drawing with the default program for one of its
+// permutations the ones the passes use. The cache creates each state
+// once; PSOs of earlier permutations stay in it, since the GPU may
+// still be using them and switching back costs nothing. Created in
+// the background when async is set, in which case nothing changes
+// and false is returned until all of them are ready.
+// ------------------------------------------------------------------
+bool Game::BuildDefaultPSOs(const ShaderPermutations::Variant& variant, bool async)
+{
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC opaquePsoDesc = mDefaultPsoDesc;
+    opaquePsoDesc.VS =
+    {
+        reinterpret_cast<BYTE*>(variant.VS->GetBufferPointer()),
+        variant.VS->GetBufferSize()
+    };
+    opaquePsoDesc.PS =
+    {
+        reinterpret_cast<BYTE*>(variant.PS->GetBufferPointer()),
+        variant.PS->GetBufferSize()
+    };
 
+    //
+    // PSO for opaque wireframe objects.
+    //
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC opaqueWireframePsoDesc = opaquePsoDesc;
+    opaqueWireframePsoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME;
 
     //
     // PSO for transparent objects
@@ -916,19 +1794,24 @@ void Game::BuildPSOs()
     transparencyBlendDesc.RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
 
     transparentPsoDesc.BlendState.RenderTarget[0] = transparencyBlendDesc;
-    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&transparentPsoDesc, IID_PPV_ARGS(&mPSOs["transparent"])));
 
-    ////
-    //// PSO for alpha tested objects
-    ////
-    //D3D12_GRAPHICS_PIPELINE_STATE_DESC alphaTestedPsoDesc = opaquePsoDesc;
-    //alphaTestedPsoDesc.PS =
-    //{
-    //    reinterpret_cast<BYTE*>(mShaders["shadowAlphaTestedPS"]->GetBufferPointer()),
-    //    mShaders["shadowAlphaTestedPS"]->GetBufferSize()
-    //};
-    //alphaTestedPsoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
-    //ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&alphaTestedPsoDesc, IID_PPV_ARGS(&mPSOs["shadowAlphaTestedPS"])));
+    const D3D12_GRAPHICS_PIPELINE_STATE_DESC* descs[] = { &opaquePsoDesc, &opaqueWireframePsoDesc, &transparentPsoDesc };
+    const PipelineKind kinds[] = { PipelineKind::Opaque, PipelineKind::OpaqueWireframe, PipelineKind::Transparent };
+
+    // Ask for all of them before checking, so they are created together.
+    ID3D12PipelineState* psos[_countof(descs)];
+    bool ready = true;
+    for (UINT i = 0; i < _countof(descs); ++i)
+    {
+        psos[i] = async ? mPipelineCache->GetOrCreateAsync(*descs[i], nullptr) : mPipelineCache->GetOrCreate(*descs[i]);
+        ready &= psos[i] != nullptr;
+    }
+    if (!ready)
+        return false;
+
+    for (UINT i = 0; i < _countof(descs); ++i)
+        mPSOs[(int)kinds[i]] = psos[i];
+    return true;
 }
 
 // ------------------------------------------------------------------
@@ -937,16 +1820,47 @@ void Game::BuildPSOs()
 // ------------------------------------------------------------------
 void Game::BuildFrameResources()
 {
+    // Every view draws each render item at most once per level of detail.
+    UINT maxIndirectDraws = 0;
+    for (auto& e : mAllRitems)
+        maxIndirectDraws += std::max<UINT>(1, (UINT)e->LODs.size());
+    maxIndirectDraws *= (UINT)InstanceView::Count;
+    mIndirectDrawBuilder.Reserve(maxIndirectDraws);
+
     // Having multiple frame resources do not prevent any waiting, but it helps
     // us keep the GPU fed. While the GPU is processing commands from frame n, 
     // it allows the CPU to continue on to build and submit commands for frames
     // n+1 and n+2. This helps keep the command queue nonempty so that the GPU
     // always has work to do.
+
     for (int i = 0; i < gNumFrameResources; ++i)
     {
         mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-            2, mInstanceCounts, mMaterials->GetSize(), mGeoBuilder->GetWaves()->VertexCount()));
+            mInstanceCounts, mMaterials->GetSize(), (UINT)RecordingPass::Count, mGpuAllocator.get()));
+    }
+
+    // The command lists of the passes are reset with the allocators of the
+    // current frame resource every frame, so one set is enough.
+    for (int i = 0; i < (int)RecordingPass::Count; ++i)
+    {
+        ThrowIfFailed(md3dDevice->CreateCommandList(
+            0,
+            D3D12_COMMAND_LIST_TYPE_DIRECT,
+            mFrameResources[0]->PassCmdListAllocs[i].Get(),
+            nullptr,
+            IID_PPV_ARGS(mPassCommandLists[i].GetAddressOf())));
+
+        // Start off in a closed state, like mCommandList.
+        mPassCommandLists[i]->Close();
     }
+
+    ThrowIfFailed(md3dDevice->CreateCommandList(
+        0,
+        D3D12_COMMAND_LIST_TYPE_DIRECT,
+        mFrameResources[0]->UploadCmdListAlloc.Get(),
+        nullptr,
+        IID_PPV_ARGS(mUploadCommandList.GetAddressOf())));
+    mUploadCommandList->Close();
 }
 
 // ------------------------------------------------------------------
@@ -959,7 +1873,7 @@ void Game::BuildMaterials()
 
     auto bricks = Material::Create("bricks");
     bricks->SetMatCBIndex(0);
-    bricks->SetDiffuseSrvHeapIndex(0);
+    bricks->SetDiffuseTexture(mTextures->GetTextureHandle("bricksTex"));
     bricks->SetDiffuseAlbedo(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f));
     bricks->SetFresnel(XMFLOAT3(0.02f, 0.02f, 0.02f));
     bricks->SetRoughness(0.1f);
@@ -967,7 +1881,7 @@ void Game::BuildMaterials()
 
     auto water = Material::Create("water");
     water->SetMatCBIndex(1);
-    water->SetDiffuseSrvHeapIndex(1);
+    water->SetDiffuseTexture(mTextures->GetTextureHandle("waterTex"));
     water->SetDiffuseAlbedo(XMFLOAT4(1.0f, 1.0f, 1.0f, 0.5f));
     water->SetFresnel(XMFLOAT3(0.2f, 0.2f, 0.2f));
     water->SetRoughness(0.2f);
@@ -975,7 +1889,7 @@ void Game::BuildMaterials()
 
     auto crate01 = Material::Create("crate01");
     crate01->SetMatCBIndex(2);
-    crate01->SetDiffuseSrvHeapIndex(2);
+    crate01->SetDiffuseTexture(mTextures->GetTextureHandle("crate01Tex"));
     crate01->SetDiffuseAlbedo(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f));
     crate01->SetFresnel(XMFLOAT3(0.1f, 0.1f, 0.1f));
     crate01->SetRoughness(0.5f);
@@ -983,7 +1897,7 @@ void Game::BuildMaterials()
 
     auto crate02 = Material::Create("crate02");
     crate02->SetMatCBIndex(3);
-    crate02->SetDiffuseSrvHeapIndex(3);
+    crate02->SetDiffuseTexture(mTextures->GetTextureHandle("crate02Tex"));
     crate02->SetDiffuseAlbedo(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f));
     crate02->SetFresnel(XMFLOAT3(0.1f, 0.1f, 0.1f));
     crate02->SetRoughness(0.5f);
@@ -991,7 +1905,7 @@ void Game::BuildMaterials()
 
     auto ice = Material::Create("ice");
     ice->SetMatCBIndex(4);
-    ice->SetDiffuseSrvHeapIndex(4);
+    ice->SetDiffuseTexture(mTextures->GetTextureHandle("iceTex"));
     ice->SetDiffuseAlbedo(XMFLOAT4(0.0f, 0.0f, 0.1f, 1.0f));
     ice->SetFresnel(XMFLOAT3(0.98f, 0.97f, 0.95f));
     ice->SetRoughness(0.1f);
@@ -999,7 +1913,7 @@ void Game::BuildMaterials()
 
     auto grass = Material::Create("grass");
     grass->SetMatCBIndex(5);
-    grass->SetDiffuseSrvHeapIndex(5);
+    grass->SetDiffuseTexture(mTextures->GetTextureHandle("grassTex"));
     grass->SetDiffuseAlbedo(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f));
     grass->SetFresnel(XMFLOAT3(0.05f, 0.05f, 0.05f));
     grass->SetRoughness(0.2f);
@@ -1007,7 +1921,7 @@ void Game::BuildMaterials()
 
     auto mirror = Material::Create("mirror");
     mirror->SetMatCBIndex(6);
-    mirror->SetDiffuseSrvHeapIndex(6);
+    mirror->SetDiffuseTexture(mTextures->GetTextureHandle("whiteTex"));
     mirror->SetDiffuseAlbedo(XMFLOAT4(0.0f, 0.0f, 0.1f, 1.0f));
     mirror->SetFresnel(XMFLOAT3(0.98f, 0.97f, 0.95f));
     mirror->SetRoughness(0.1f);
@@ -1015,7 +1929,7 @@ void Game::BuildMaterials()
 
     auto checkboard = Material::Create("checkboard");
     checkboard->SetMatCBIndex(7);
-    checkboard->SetDiffuseSrvHeapIndex(7);
+    checkboard->SetDiffuseTexture(mTextures->GetTextureHandle("checkboardTex"));
     checkboard->SetDiffuseAlbedo(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f));
     checkboard->SetFresnel(XMFLOAT3(0.1f, 0.1f, 0.1f));
     checkboard->SetRoughness(1.0f);
@@ -1023,7 +1937,7 @@ void Game::BuildMaterials()
 
     auto tile = Material::Create("tile");
     tile->SetMatCBIndex(8);
-    tile->SetDiffuseSrvHeapIndex(8);
+    tile->SetDiffuseTexture(mTextures->GetTextureHandle("tileTex"));
     tile->SetDiffuseAlbedo(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f));
     tile->SetFresnel(XMFLOAT3(0.05f, 0.05f, 0.05f));
     tile->SetRoughness(1.0f);
@@ -1031,13 +1945,48 @@ void Game::BuildMaterials()
 
     auto sky = Material::Create("sky");
     sky->SetMatCBIndex(9);
-    sky->SetDiffuseSrvHeapIndex(9);
     sky->SetDiffuseAlbedo(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f));
     sky->SetFresnel(XMFLOAT3(0.1f, 0.1f, 0.1f));
     sky->SetRoughness(1.0f);
     mMaterials->AddMaterial(sky);
 }
 
+// ------------------------------------------------------------------
+// Collect the distinct texture transforms of all instances into one
+// table and point every instance at its entry.
+// ------------------------------------------------------------------
+void Game::BuildTexTransforms()
+{
+    std::vector<XMFLOAT4X4> texTransforms;
+
+    for (auto& e : mAllRitems)
+    {
+        for (auto& instance : e->Instances)
+        {
+            assert(instance.MaterialIndex <= PackedInstanceData::MaterialIndexMask);
+
+            UINT index = 0;
+            while (index < (UINT)texTransforms.size() &&
+                memcmp(&texTransforms[index], &instance.TexTransform, sizeof(XMFLOAT4X4)) != 0)
+                ++index;
+
+            if (index == (UINT)texTransforms.size())
+                texTransforms.push_back(instance.TexTransform);
+
+            instance.TexTransformIndex = index;
+        }
+    }
+
+    mTexTransformBuffer = std::make_unique<UploadBuffer<XMFLOAT4X4>>(md3dDevice.Get(), (UINT)texTransforms.size(), false, mGpuAllocator.get());
+
+    for (UINT i = 0; i < (UINT)texTransforms.size(); ++i)
+    {
+        XMFLOAT4X4 texTransform;
+        XMStoreFloat4x4(&texTransform, XMMatrixTranspose(XMLoadFloat4x4(&texTransforms[i])));
+        mTexTransformBuffer->CopyData(i, texTransform);
+    }
+}
+
 // ------------------------------------------------------------------
 // Define and build scene render items. All the render items share the 
 // same MeshGeometry, we use the DrawArgs to get the DrawIndexedInstanced 
@@ -1067,9 +2016,9 @@ void Game::BuildRenderItems()
     skyRitem->Instances[0].MaterialIndex = mMaterials->GetMaterial("sky")->GetMatCBIndex();
 
     skyRitem->instanceBufferID = instanceBufferID++;
+    skyRitem->layerID = (int)RenderLayer::Sky;
     mInstanceCounts.push_back(instanceCount);
     totalInstanceCount += instanceCount;
-    mRitemLayer[(int)RenderLayer::Sky].push_back(skyRitem.get());
 
 
     // 2 - Cylinder render item
@@ -1120,9 +2069,9 @@ void Game::BuildRenderItems()
     }
 
     cylinderRitem->instanceBufferID = instanceBufferID++;
+    cylinderRitem->layerID = (int)RenderLayer::Opaque;
     mInstanceCounts.push_back(instanceCount);
     totalInstanceCount += instanceCount;
-    mRitemLayer[(int)RenderLayer::Opaque].push_back(cylinderRitem.get());
 
 
     // 3 - Floor (grid)
@@ -1144,9 +2093,10 @@ void Game::BuildRenderItems()
     floorRitem->Instances[0].MaterialIndex = mMaterials->GetMaterial("tile")->GetMatCBIndex();
 
     floorRitem->instanceBufferID = instanceBufferID++;
+    floorRitem->layerID = (int)RenderLayer::Opaque;
+    floorRitem->isOccluder = true;
     mInstanceCounts.push_back(instanceCount);
     totalInstanceCount += instanceCount;
-    mRitemLayer[(int)RenderLayer::Opaque].push_back(floorRitem.get());
 
 
     // 4 - Car Model
@@ -1159,6 +2109,8 @@ void Game::BuildRenderItems()
     carRitem->StartIndexLocation = carRitem->Geo->DrawArgs["carModel"].StartIndexLocation;
     carRitem->BaseVertexLocation = carRitem->Geo->DrawArgs["carModel"].BaseVertexLocation;
     carRitem->Bounds = carRitem->Geo->DrawArgs["carModel"].Bounds;
+    carRitem->LODs = carRitem->Geo->DrawArgs["carModel"].LODs;
+    carRitem->LODInstanceCounts.resize(carRitem->LODs.size());
 
     // Only one car model needed
     instanceCount = 1;
@@ -1167,15 +2119,147 @@ void Game::BuildRenderItems()
     carRitem->Instances[0].MaterialIndex = mMaterials->GetMaterial("mirror")->GetMatCBIndex();
 
     carRitem->instanceBufferID = instanceBufferID++;
+    carRitem->layerID = (int)RenderLayer::Opaque;
+    carRitem->isOccluder = true;
+    mInstanceCounts.push_back(instanceCount);
+    totalInstanceCount += instanceCount;
+
+    // 5 - Skull models, a row of them running off into the distance so
+    // the far ones draw their coarse levels.
+    auto skullRitem = std::make_unique<RenderItem>();
+    skullRitem->World = MathHelper::Identity4x4();
+    skullRitem->ObjCBIndex = 5;
+    skullRitem->Geo = mGeoBuilder->GetMeshGeo("skullModel");
+    skullRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+    skullRitem->IndexCount = skullRitem->Geo->DrawArgs["skullModel"].IndexCount;
+    skullRitem->StartIndexLocation = skullRitem->Geo->DrawArgs["skullModel"].StartIndexLocation;
+    skullRitem->BaseVertexLocation = skullRitem->Geo->DrawArgs["skullModel"].BaseVertexLocation;
+    skullRitem->Bounds = skullRitem->Geo->DrawArgs["skullModel"].Bounds;
+    skullRitem->LODs = skullRitem->Geo->DrawArgs["skullModel"].LODs;
+    skullRitem->LODInstanceCounts.resize(skullRitem->LODs.size());
+
+    instanceCount = 10;
+    skullRitem->Instances.resize(instanceCount);
+    for (UINT i = 0; i < instanceCount; ++i)
+    {
+        XMStoreFloat4x4(&skullRitem->Instances[i].World, XMMatrixScaling(0.5f, 0.5f, 0.5f) * XMMatrixTranslation(-20.0f, 2.0f, 20.0f + i * 50.0f));
+        skullRitem->Instances[i].MaterialIndex = mMaterials->GetMaterial("ice")->GetMatCBIndex();
+    }
+
+    skullRitem->instanceBufferID = instanceBufferID++;
+    skullRitem->layerID = (int)RenderLayer::Opaque;
     mInstanceCounts.push_back(instanceCount);
     totalInstanceCount += instanceCount;
-    mRitemLayer[(int)RenderLayer::Opaque].push_back(carRitem.get());
 
     // Push all render items to list
     mAllRitems.push_back(std::move(cylinderRitem));
     mAllRitems.push_back(std::move(skyRitem));
     mAllRitems.push_back(std::move(floorRitem));
     mAllRitems.push_back(std::move(carRitem));
+    mAllRitems.push_back(std::move(skullRitem));
+
+    // Number the submeshes for the draw sort keys.
+    std::map<std::pair<const MeshGeometry*, UINT>, UINT> geometryIDs;
+    for (auto& e : mAllRitems)
+    {
+        auto submesh = std::make_pair((const MeshGeometry*)e->Geo, e->StartIndexLocation);
+        e->geometryID = geometryIDs.emplace(submesh, (UINT)geometryIDs.size()).first->second;
+    }
+}
+
+// ------------------------------------------------------------------
+// Declare the passes of the frame and what they read and write. The
+// shadow map is a transient of the graph; the back buffer and the
+// depth buffer belong to DXCore and are imported.
+// ------------------------------------------------------------------
+void Game::BuildRenderGraph()
+{
+    mBackBufferResource = mRenderGraph.ImportResource("BackBuffer",
+        D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_PRESENT);
+    mDepthBufferResource = mRenderGraph.ImportResource("DepthBuffer",
+        D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+
+    D3D12_RESOURCE_DESC shadowMapDesc = mShadowMap->ResourceDesc();
+    D3D12_CLEAR_VALUE shadowMapClear = mShadowMap->ClearValue();
+    mShadowMapResource = mRenderGraph.CreateTexture("ShadowMap",
+        RenderGraph::DescribeTexture(md3dDevice.Get(), shadowMapDesc, &shadowMapClear));
+
+    auto& shadow = mGraphPasses[(int)RecordingPass::Shadow];
+    shadow = mRenderGraph.AddPass("Shadow");
+    mRenderGraph.Write(shadow, mShadowMapResource, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+
+    auto& opaque = mGraphPasses[(int)RecordingPass::Opaque];
+    opaque = mRenderGraph.AddPass("Opaque");
+    mRenderGraph.Read(opaque, mShadowMapResource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    mRenderGraph.Write(opaque, mBackBufferResource, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    mRenderGraph.Write(opaque, mDepthBufferResource, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+
+    auto& sky = mGraphPasses[(int)RecordingPass::Sky];
+    sky = mRenderGraph.AddPass("Sky");
+    mRenderGraph.Write(sky, mBackBufferResource, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    mRenderGraph.Write(sky, mDepthBufferResource, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+
+    auto& transparent = mGraphPasses[(int)RecordingPass::Transparent];
+    transparent = mRenderGraph.AddPass("Transparent");
+    mRenderGraph.Read(transparent, mShadowMapResource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    mRenderGraph.Write(transparent, mBackBufferResource, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    mRenderGraph.Write(transparent, mDepthBufferResource, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+
+    mGUIGraphPass = mRenderGraph.AddPass("GUI");
+    mRenderGraph.Write(mGUIGraphPass, mBackBufferResource, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+    mRenderGraph.Compile();
+    mRenderGraph.Realize(md3dDevice.Get());
+
+    // The views are created with the other descriptors in BuildDescriptorHeaps.
+    mShadowMap->SetResource(mRenderGraph.GetResource(mShadowMapResource));
+}
+
+// ------------------------------------------------------------------
+// Compute the world space bounds of every render item instance and
+// store them in the scene-wide structure-of-arrays used for culling,
+// then build the hierarchy over the ones that can be culled.
+// ------------------------------------------------------------------
+void Game::BuildInstanceBounds()
+{
+    mInstanceBounds.Clear();
+    mInstanceStore.Resize(totalInstanceCount);
+
+    std::vector<UINT> cullableInstances;
+
+    for (auto& e : mAllRitems)
+    {
+        e->firstInstanceID = mInstanceBounds.Size();
+
+        BoundingBox worldBox;
+        for (const auto& instance : e->Instances)
+        {
+            UINT index = mInstanceBounds.Add(e->Bounds, XMLoadFloat4x4(&instance.World));
+            mInstanceStore.Set(index, instance);
+
+            if (IsFrustumCullable(*e))
+                cullableInstances.push_back(index);
+
+            BoundingBox instanceBox = mInstanceBounds.GetBox(index);
+            if (index == e->firstInstanceID)
+                worldBox = instanceBox;
+            else
+                BoundingBox::CreateMerged(worldBox, worldBox, instanceBox);
+        }
+        BoundingSphere::CreateFromBoundingBox(e->WorldBounds, worldBox);
+    }
+
+    // Instances that move later only need mInstanceStore.Set and
+    // mInstanceBounds.Update followed by mInstanceBVH.MarkDirty and
+    // mVisibilityCache.MarkMoved; the tree is refit before the next traversal.
+    mInstanceBVH.Build(mInstanceBounds, cullableInstances.data(), (UINT)cullableInstances.size());
+    mVisibilityCache.Resize(mInstanceBounds.Size());
+
+    mVisibleInstances.resize(mInstanceBounds.Size());
+    mShadowVisibleInstances.resize(mInstanceBounds.Size());
+    mShadowInstanceLODs.resize(mInstanceBounds.Size());
+    mLODSortedInstances.resize(mInstanceBounds.Size());
+    mInstanceLODs.assign(mInstanceBounds.Size(), 0);
 }
 
 #pragma endregion
@@ -1184,61 +2268,107 @@ void Game::BuildRenderItems()
 // ------------------------------------------------------------------
 // Draw call for the shadow map pass.
 // ------------------------------------------------------------------
-void Game::DrawSceneToShadowMap()
+void Game::DrawSceneToShadowMap(TrackedCommandList& cmdList)
 {
-    mCommandList->RSSetViewports(1, &mShadowMap->Viewport());
-    mCommandList->RSSetScissorRects(1, &mShadowMap->ScissorRect());
-
-    // Change to DEPTH_WRITE.
-    mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mShadowMap->Resource(),
-        D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_DEPTH_WRITE));
-
-    UINT passCBByteSize = DXUtil::CalcConstantBufferByteSize(sizeof(PassConstants));
+    cmdList.RSSetViewports(1, &mShadowMap->Viewport());
+    cmdList.RSSetScissorRects(1, &mShadowMap->ScissorRect());
 
     // Clear the back buffer and depth buffer.
-    mCommandList->ClearDepthStencilView(mShadowMap->Dsv(),
+    cmdList.ClearDepthStencilView(mShadowMap->Dsv(),
         D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
 
     // Set null render target because we are only going to draw to
     // depth buffer.  Setting a null render target will disable color writes.
     // Note the active PSO also must specify a render target count of 0.
-    mCommandList->OMSetRenderTargets(0, nullptr, false, &mShadowMap->Dsv());
+    cmdList.OMSetRenderTargets(0, nullptr, false, &mShadowMap->Dsv());
 
     // Bind the pass constant buffer for the shadow map pass.
-    auto passCB = mCurrFrameResource->PassCB->Resource();
-    D3D12_GPU_VIRTUAL_ADDRESS passCBAddress = passCB->GetGPUVirtualAddress() + 1 * passCBByteSize;
-    mCommandList->SetGraphicsRootConstantBufferView(0, passCBAddress);
-
-    mCommandList->SetPipelineState(mPSOs["shadow_opaque"].Get());
+    cmdList.SetGraphicsRootConstantBufferView(0, mShadowPassCBAddress);
 
-    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+    cmdList.SetPipelineState(mPSOs[(int)PipelineKind::ShadowOpaque]);
 
-    // Change back to GENERIC_READ so we can read the texture in a shader.
-    mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mShadowMap->Resource(),
-        D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_GENERIC_READ));
+    DrawRenderItems(cmdList, RenderLayer::Opaque, InstanceView::Shadow);
 }
 
 // ------------------------------------------------------------------
 // Draw stored render items. Invoked in the main Draw call.
 // ------------------------------------------------------------------
-void Game::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
+void Game::DrawRenderItems(TrackedCommandList& cmdList, RenderLayer layer, InstanceView view)
 {
-    // For each render item...
-    for (size_t i = 0; i < ritems.size(); ++i)
+    const bool isShadowView = view == InstanceView::Shadow;
+    const RenderQueue& queue = mRenderQueues[(int)view];
+    auto items = queue.GetItems();
+
+    // The whole layer in one call per topology, from the records built
+    // with the queue. The records cannot set the topology, and a fresh
+    // command list has none.
+    if (mIndirectDrawsBuilt)
+    {
+        const IndirectDrawBuilder::Group& group = mIndirectRanges[(int)view][(int)layer];
+        for (UINT i = 0; i < group.RangeCount; ++i)
+        {
+            const IndirectDrawBuilder::Range& range = mIndirectDrawBuilder.GetRange(group.FirstRange + i);
+            cmdList.IASetPrimitiveTopology(range.Topology);
+            cmdList.ExecuteIndirect(mDrawCommandSignature.Get(), range.Count,
+                mIndirectDrawArgs.Resource, mIndirectDrawArgs.Offset + range.First * sizeof(IndirectDrawCommand), nullptr, 0);
+        }
+        return;
+    }
+
+    // For each batch of render items...
+    for (const RenderQueue::Batch& batch : queue.GetBatches((UINT)layer))
     {
-        auto ri = ritems[i];
-        
-        cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-        cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
-        cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+        auto ri = items[batch.FirstItem];
+
+        // Pooled geometries all share the buffers of their vertex format,
+        // so the tracker drops these after the first draw of the pass.
+        cmdList.IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
+        cmdList.IASetIndexBuffer(&ri->Geo->IndexBufferView());
+        cmdList.IASetPrimitiveTopology(ri->PrimitiveType);
+
+        // Merged render items share the submesh, so one draw covers the
+        // instances of all of them, gathered into the batch buffer.
+        // SV_InstanceID does not include a StartInstanceLocation, so the
+        // base instance is applied by binding the list at the batch offset.
+        if (batch.ItemCount > 1)
+        {
+            cmdList.SetGraphicsRootShaderResourceView(1, mBatchInstanceAddresses[(int)view] + batch.InstanceOffset * sizeof(UINT));
+
+            cmdList.DrawIndexedInstanced(ri->IndexCount, batch.InstanceCount, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+            continue;
+        }
 
-        // Set the instance buffer to use for this render-item.
+        // Set the visible instance list to use for this render-item.
         // For structured buffers, we can bypass the heap and set as a root 
         // descriptor.
-        auto instanceBuffer = mCurrFrameResource->InstanceBuffer[ri->instanceBufferID]->Resource();
-        mCommandList->SetGraphicsRootShaderResourceView(1, instanceBuffer->GetGPUVirtualAddress());
+        D3D12_GPU_VIRTUAL_ADDRESS instanceAddress = GetVisibleInstanceAddress(*ri, view);
+        const auto& lodInstanceCounts = isShadowView ? ri->ShadowLODInstanceCounts : ri->LODInstanceCounts;
+
+        if (ri->LODs.empty())
+        {
+            cmdList.SetGraphicsRootShaderResourceView(1, instanceAddress);
+
+            UINT instanceCount = isShadowView ? ri->ShadowInstanceCount : ri->InstanceCount;
+            cmdList.DrawIndexedInstanced(ri->IndexCount, instanceCount, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+            continue;
+        }
+
+        // One instanced draw per level of detail. SV_InstanceID restarts at 0
+        // for every draw, so each level gets the visible list bound at the
+        // start of its own range instead of a StartInstanceLocation.
+        for (size_t level = 0; level < ri->LODs.size(); ++level)
+        {
+            UINT instanceCount = lodInstanceCounts[level];
+            if (instanceCount == 0)
+                continue;
+
+            cmdList.SetGraphicsRootShaderResourceView(1, instanceAddress);
 
-        cmdList->DrawIndexedInstanced(ri->IndexCount, ri->InstanceCount, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+            const SubmeshLOD& lod = ri->LODs[level];
+            cmdList.DrawIndexedInstanced(lod.IndexCount, instanceCount, lod.StartIndexLocation, ri->BaseVertexLocation, 0);
+
+            instanceAddress += instanceCount * sizeof(UINT);
+        }
     }
 }
 
@@ -1270,13 +2400,128 @@ void Game::DrawGUI()
     if (ImGui::Begin("DEBUG", 0, window_flags))
     {
         ImGui::Text("Resolution: %i x %i", mClientWidth, mClientHeight);
+        ImGui::Checkbox("Parallel recording", &mParallelRecording);
+        ImGui::Text("Command recording: %.3f ms", mRecordingTimeMs);
+        {
+            TrackedCommandList::Stats stateStats;
+            for (const auto& passStats : mPassStateStats)
+            {
+                stateStats.Issued += passStats.Issued;
+                stateStats.Dropped += passStats.Dropped;
+            }
+            ImGui::Text("State changes: %u issued, %u redundant dropped", stateStats.Issued, stateStats.Dropped);
+        }
+        ImGui::Text("Render graph: %u / %u passes, %u barriers", mRenderGraph.LivePassCount(), mRenderGraph.PassCount(), mRenderGraph.BarrierCount());
+        ImGui::Text("Transient heap: %.1f MB (%.1f MB unaliased)",
+            mRenderGraph.HeapSize() / (1024.0f * 1024.0f), mRenderGraph.TransientSize() / (1024.0f * 1024.0f));
         ImGui::Separator();
 
-        ImGui::Text("Frustum Culling: \n");
+        ImGui::Checkbox("Frustum Culling", &mFrustumCullingEnabled);
         if (mFrustumCullingEnabled)
+        {
+            const char* cullingModes[] = { "Reference (per-instance)", "SIMD batch", "Hierarchy (BVH)", "Temporal cache" };
+            if (ImGui::Combo("Method", (int*)&mCullingMode, cullingModes, (int)CullingMode::Count))
+                mVisibilityCache.Invalidate();
             ImGui::Text("%i objects visible out of %i", totalVisibleInstanceCount, totalInstanceCount);
+            ImGui::Text("Culling time: %.3f ms", mCullingTimeMs);
+            if (mCullingMode == CullingMode::Hierarchy)
+            {
+                ImGui::Text("BVH nodes visited: %u / %u", mBVHStats.NodesVisited, mInstanceBVH.NodeCount());
+                ImGui::Text("Leaves tested: %u, subtrees accepted: %u", mBVHStats.LeavesTested, mBVHStats.SubtreesAccepted);
+            }
+            else if (mCullingMode == CullingMode::Temporal)
+            {
+                const auto& cacheStats = mVisibilityCache.GetStats();
+                ImGui::Text("Cache hits: %u, misses: %u", cacheStats.Hits, cacheStats.Misses);
+                ImGui::Text("Render items skipped: %u", cacheStats.RangesSkipped);
+                ImGui::Text("Visibility changes: %u", cacheStats.Changes);
+            }
+        }
         else
             ImGui::Text("Disabled");
+        ImGui::Text("Instance data written: %.1f KB (%u dirty ranges)", mInstanceBytesWritten / 1024.0f, mInstanceStore.GetStats().RangesWritten);
+
+        ImGui::Checkbox("Mesh LOD", &mLODEnabled);
+        if (mLODEnabled)
+        {
+            ImGui::SliderFloat("Max error (px)", &mLODMaxErrorPixels, 0.25f, 16.0f);
+            for (size_t level = 0; level < mLODInstanceTotals.size(); ++level)
+                ImGui::Text("LOD %zu: %u instances", level, mLODInstanceTotals[level]);
+        }
+
+        ImGui::Checkbox("Occlusion Culling", &mOcclusionCullingEnabled);
+        if (mOcclusionCullingEnabled)
+        {
+            ImGui::Text("%u objects occluded", mOccludedInstanceCount);
+            ImGui::Text("Occluder triangles: %u (%.3f ms)", mOcclusionBuffer.TrianglesDrawn(), mOcclusionTimeMs);
+        }
+
+        ImGui::Text("Shaders: %u cached, %u compiled (%.1f ms)", mShaderCacheHits, mShaderCacheMisses, mShaderBuildTimeMs);
+
+        const char* shadowFilters[] = { "Off", "Hard", "PCF", "PCSS" };
+        int shadowFilter = (int)mShadowFilter;
+        if (ImGui::Combo("Shadow Filter", &shadowFilter, shadowFilters, (int)ShadowFilter::Count))
+            mShadowFilter = (ShadowFilter)shadowFilter;
+
+        int dirLightCount = (int)mDirLightCount;
+        if (ImGui::SliderInt("Directional Lights", &dirLightCount, 0, (int)ShaderPermutations::MaxDirLights))
+            mDirLightCount = (UINT)dirLightCount;
+
+        ImGui::Checkbox("Fog", &mFogEnabled);
+        ImGui::Text("Shader variants: %u (%u compiling)", mShaderPermutations->VariantCount(), mShaderPermutations->PendingCount());
+        ImGui::Text("Pipelines: %u (%u compiled, %u from library, %u shared, %u pending)", mPipelineCache->PipelineCount(),
+            mPipelineCache->CreatedCount(), mPipelineCache->LoadedCount(), mPipelineCache->DeduplicatedCount(), mPipelineCache->PendingCount());
+
+        ImGui::Checkbox("Indirect Draws", &mIndirectDrawEnabled);
+        if (mIndirectDrawsBuilt)
+            ImGui::Text("%u argument records", mIndirectDrawBuilder.Size());
+
+        FrameArena::Scope scope;
+        for (const auto& heap : mGpuAllocator->GetHeapStats(&scope.Arena()))
+        {
+            ImGui::Text("%s heap: %.1f / %.1f MB, %u resources, %.0f%% fragmented",
+                heap.Type == D3D12_HEAP_TYPE_UPLOAD ? "Upload" : "Default", heap.UsedSize / 1048576.0f, heap.Size / 1048576.0f,
+                heap.AllocationCount, heap.Fragmentation * 100.0f);
+        }
+        ImGui::Text("%u placed, %u committed, %.1f KB pending release", mGpuAllocator->PlacedCount(),
+            mGpuAllocator->CommittedCount(), mGpuAllocator->PendingReleaseSize() / 1024.0f);
+
+        ImGui::Text("Upload ring: %.1f / %.1f MB, %.1f KB per frame, grown %u times", mUploadRing->UsedSize() / 1048576.0f,
+            mUploadRing->Size() / 1048576.0f, mUploadRing->FrameSize() / 1024.0f, mUploadRing->GrowCount());
+
+        ImGui::Text("Staging: %.1f MB in flight (%u pages), %.1f MB uploaded", mUploadBatch->StagingSize() / 1048576.0f,
+            mUploadBatch->PageCount(), mUploadBatch->UploadedSize() / 1048576.0f);
+
+        const FrameArena& arena = FrameArena::Get();
+        ImGui::Text("Frame arena: %.1f / %.1f KB last frame (%u blocks)", arena.LastFrameSize() / 1024.0f,
+            arena.Capacity() / 1024.0f, arena.BlockCount());
+        if (HeapAllocationCounter::Enabled)
+            ImGui::Text("Heap allocations last frame: %u", mFrameHeapAllocations);
+        else
+            ImGui::Text("Heap allocations: counted in debug builds");
+
+        for (const auto& pool : mGeoBuilder->GetPools())
+        {
+            const GeometryPool& p = *pool.second;
+            ImGui::Text("Geometry pool (%u B vertices): %u meshes, %u / %u vertices, %u / %u indices, %.0f%% fragmented, grown %u times",
+                p.VertexStride(), p.MeshCount(), p.UsedVertexCount(), p.VertexCapacity(), p.UsedIndexCount(), p.IndexCapacity(),
+                p.Fragmentation() * 100.0f, p.GrowCount());
+        }
+        if (ImGui::Button("Compact Geometry"))
+            mCompactGeometryRequested = true;
+
+        ImGui::Text("Descriptors: %u / %u (%u pending free), transient %u / %u", mCbvSrvUavDescriptorHeap->GetUsedCount(),
+            mCbvSrvUavDescriptorHeap->GetPersistentCount(), mCbvSrvUavDescriptorHeap->GetPendingFreeCount(),
+            mCbvSrvUavDescriptorHeap->GetTransientUsedCount(), mCbvSrvUavDescriptorHeap->GetTransientCount());
+        ImGui::Text("Bindless textures: %u / %u (%u pending free)", mTextureRegistry->Count(),
+            mTextureRegistry->Capacity() - 1, mTextureRegistry->PendingFreeCount());
+
+        ImGui::Checkbox("Auto Instancing", &mAutoInstancingEnabled);
+        ImGui::Text("Draws: %u camera (%u render items), %u shadow",
+            mDrawCounts[(int)InstanceView::Camera], mRenderQueues[(int)InstanceView::Camera].Size(), mDrawCounts[(int)InstanceView::Shadow]);
+
+        ImGui::Checkbox("Shadow Caster Culling", &mShadowCullingEnabled);
+        ImGui::Text("%u shadow casters drawn out of %u", mShadowVisibleCount, mShadowCasterCount);
         ImGui::Separator();
 
         if (ImGui::IsMousePosValid())
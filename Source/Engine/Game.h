@@ -24,6 +24,37 @@ enum class RenderLayer : int
 	Count
 };
 
+// Parts of the frame recorded into separate command lists, in
+// submission order. The GUI is recorded last, on the main thread.
+enum class RecordingPass : int
+{
+	Shadow = 0,
+	Opaque,
+	Sky,
+	Transparent,
+	Count
+};
+
+// Pipelines the passes bind.
+enum class PipelineKind : int
+{
+	Opaque = 0,
+	OpaqueWireframe,
+	Transparent,
+	Sky,
+	ShadowOpaque,
+	Count
+};
+
+enum class CullingMode : int
+{
+	Reference = 0,	// Frustum transformed into each instance's local space
+	SimdBatch,		// World space planes against SoA bounds
+	Hierarchy,		// BVH traversal over all instance bounds
+	Temporal,		// Cached per-instance results, re-tested on change
+	Count
+};
+
 class Game : public DXCore
 {
 public:
@@ -50,44 +81,129 @@ private:
 	void OnKeyboardInput(const GameTimer& gt);
 	void AnimateMaterials(const GameTimer& gt);
 	void UpdateInstanceData(const GameTimer& gt);
+	void UpdateRenderQueues(const GameTimer& gt);
+	void WriteBatchInstances(InstanceView view);
+	void BuildIndirectDraws(InstanceView view);
 	void UpdateMaterialBuffer(const GameTimer& gt);
 	void UpdateShadowTransform(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
 	void UpdateShadowPassCB(const GameTimer& gt);
+	void UpdateShaderPermutations();
+	ShaderPermutations::Key GetPassShaderKey() const;
 	void UpdateWaves(const GameTimer& gt);
 
 	void LoadTextures();
 	void BuildRootSignature();
+	void BuildCommandSignature();
 	void BuildDescriptorHeaps();
 	void BuildShadersAndInputLayout();
 	void BuildPSOs();
+	bool BuildDefaultPSOs(const ShaderPermutations::Variant& variant, bool async);
 	void BuildFrameResources();
 	void BuildMaterials();
 	void BuildRenderItems();
+	void BuildTexTransforms();
+	void BuildInstanceBounds();
+	void BuildRenderGraph();
 
-	void DrawSceneToShadowMap();
-	void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
+	void RecordPass(RecordingPass pass);
+	void RecordGUIPass();
+	void SetCommonRootBindings(TrackedCommandList& cmdList);
+	void SetMainPassState(TrackedCommandList& cmdList);
+
+	void DrawSceneToShadowMap(TrackedCommandList& cmdList);
+	void DrawRenderItems(TrackedCommandList& cmdList, RenderLayer layer, InstanceView view = InstanceView::Camera);
 	void DrawGUI();
 
+	UINT CullInstancesReference(const RenderItem* ri, DirectX::FXMMATRIX invView, UINT* outVisible);
+	bool IsFrustumCullable(const RenderItem& ri) const;
+	bool IsShadowCaster(const RenderItem& ri) const;
+	UINT CullShadowCasters(const RenderItem* ri, UINT* outVisible) const;
+	void DrawOccluders(DirectX::FXMMATRIX viewProj);
+	bool IsOccluded(const RenderItem& ri, UINT instanceIndex);
+	void WriteVisibleInstances(RenderItem* ri, UINT* visible, UINT count, bool visibleSetChanged, bool canReuseBuffers);
+	void WriteShadowInstances(RenderItem* ri, const UINT* visible, UINT count);
+	UINT SelectLOD(const RenderItem& ri, UINT instanceIndex) const;
+	D3D12_GPU_VIRTUAL_ADDRESS GetVisibleInstanceAddress(const RenderItem& ri, InstanceView view) const;
+	void CompactGeometry();
+
 	std::array<const CD3DX12_STATIC_SAMPLER_DESC, 7> GetStaticSamplers();
 
 private:
 
+	// Heaps the buffers and textures are placed in. Declared first so it
+	// outlives everything placed in it.
+	std::unique_ptr<GpuMemoryAllocator> mGpuAllocator = nullptr;
+
+	// Space for everything written once per frame, shared by the frames in
+	// flight.
+	std::unique_ptr<UploadRing> mUploadRing = nullptr;
+
+	// Staging for the initial data of meshes and textures, freed as the
+	// copies complete.
+	std::unique_ptr<UploadBatch> mUploadBatch = nullptr;
+
 	std::vector<std::unique_ptr<FrameResource>> mFrameResources;
 	FrameResource* mCurrFrameResource = nullptr;
 	int mCurrFrameResourceIndex = 0;
 
 	Microsoft::WRL::ComPtr<ID3D12RootSignature> mRootSignature = nullptr;
 
+	// One command list per RecordingPass, so the passes can be recorded on
+	// worker threads at the same time.
+	std::array<Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>, (int)RecordingPass::Count> mPassCommandLists;
+
+	// The copies of the upload batch, submitted before the passes so they
+	// are done by the time anything draws from their destinations.
+	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> mUploadCommandList;
+	bool mParallelRecording = true;
+	float mRecordingTimeMs = 0.0f;
+
+	// State changes issued and dropped as redundant by each pass in the
+	// last frame. Each worker only writes the entry of its own pass.
+	std::array<TrackedCommandList::Stats, (int)RecordingPass::Count> mPassStateStats;
+
+	// Resources and passes of the frame. The graph owns the shadow map and
+	// records every barrier between the passes.
+	RenderGraph mRenderGraph;
+	RenderGraph::ResourceHandle mBackBufferResource = RenderGraph::InvalidIndex;
+	RenderGraph::ResourceHandle mDepthBufferResource = RenderGraph::InvalidIndex;
+	RenderGraph::ResourceHandle mShadowMapResource = RenderGraph::InvalidIndex;
+	std::array<RenderGraph::PassHandle, (int)RecordingPass::Count> mGraphPasses;
+	RenderGraph::PassHandle mGUIGraphPass = RenderGraph::InvalidIndex;
+
 	std::unique_ptr<DescriptorHeapWrapper> mCbvSrvUavDescriptorHeap = nullptr;
+	std::unique_ptr<TextureRegistry> mTextureRegistry = nullptr;
 	std::unique_ptr<TextureWrapper> mTextures = nullptr;
 	std::unique_ptr<GeoBuilder> mGeoBuilder = nullptr;
 	std::unique_ptr<MaterialWrapper> mMaterials = nullptr;
 
+	// Material data in buffer order, gathered for the bulk upload.
+	std::vector<MaterialData> mMaterialData;
+
 	// Use unordered maps for constant time lookup and reference our objects by 
 	// name.
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3DBlob>> mShaders;
-	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D12PipelineState>> mPSOs;
+
+	// Variants of the lit shaders. The pass settings below select the one
+	// the opaque, wireframe and transparent PSOs currently use.
+	std::unique_ptr<ShaderPermutations> mShaderPermutations = nullptr;
+	ShaderPermutations::Key mPassShaderKey = 0;
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC mDefaultPsoDesc;
+
+	ShadowFilter mShadowFilter = ShadowFilter::PCSS;
+	UINT mDirLightCount = ShaderPermutations::MaxDirLights;
+	bool mFogEnabled = false;
+
+	// How the shaders were built at startup.
+	UINT mShaderCacheHits = 0;
+	UINT mShaderCacheMisses = 0;
+	float mShaderBuildTimeMs = 0.0f;
+
+	// Pipelines are owned by the cache, which keeps the ones it created in
+	// a library on disk for the next start.
+	std::unique_ptr<PipelineStateCache> mPipelineCache = nullptr;
+	ID3D12PipelineState* mPSOs[(int)PipelineKind::Count] = {};
 
 	std::vector<D3D12_INPUT_ELEMENT_DESC> mInputLayout;
 
@@ -95,26 +211,119 @@ private:
 	RenderItem* mWavesRitem = nullptr;
 	std::vector<std::unique_ptr<RenderItem>> mAllRitems;
 
-	// Render items divided by PSO.
-	std::vector<RenderItem*> mRitemLayer[(int)RenderLayer::Count];
+	// Draws of each view sorted by key, rebuilt every frame from the render
+	// items with visible instances.
+	RenderQueue mRenderQueues[(int)InstanceView::Count];
+
+	// Merge render items drawing the same submesh into one instanced draw.
+	bool mAutoInstancingEnabled = true;
+	UINT mDrawCounts[(int)InstanceView::Count] = {};
+
+	// Per view, the visible lists of the merged render items of this frame,
+	// gathered back to back.
+	D3D12_GPU_VIRTUAL_ADDRESS mBatchInstanceAddresses[(int)InstanceView::Count] = {};
+
+	// Draw the layers with one ExecuteIndirect per topology. The argument
+	// records are built with the queues; mIndirectRanges holds the ranges
+	// of every layer of every view when mIndirectDrawsBuilt is set.
+	bool mIndirectDrawEnabled = false;
+	bool mIndirectDrawsBuilt = false;
+	IndirectDrawBuilder mIndirectDrawBuilder;
+	UploadRing::Allocation mIndirectDrawArgs;
+	IndirectDrawBuilder::Group mIndirectRanges[(int)InstanceView::Count][(int)RenderLayer::Count];
+	Microsoft::WRL::ComPtr<ID3D12CommandSignature> mDrawCommandSignature = nullptr;
+
+	// Set by the GUI; the pools are packed at the start of the next Update.
+	bool mCompactGeometryRequested = false;
+
+	// Calls to operator new between the start of Update and the end of Draw
+	// in the last frame. Only counted in debug builds.
+	UINT64 mFrameHeapAllocationStart = 0;
+	UINT mFrameHeapAllocations = 0;
 
 	// Instancing variables
 	std::vector<UINT> mInstanceCounts;  // Max instance counts of all render items
 	int totalVisibleInstanceCount = 0;
 	int totalInstanceCount = 0;
 
+	// Texture transforms shared by the instances, which refer to them by
+	// index. Written once after the render items are built.
+	std::unique_ptr<UploadBuffer<DirectX::XMFLOAT4X4>> mTexTransformBuffer = nullptr;
+
+	// Per-instance data of every render item, in slots indexed like
+	// mInstanceBounds.
+	InstanceStore mInstanceStore;
+
+	// Bytes written to the instance data and visible lists in the last frame.
+	UINT mInstanceBytesWritten = 0;
+
 	// Application-level frustum culling
 	bool mFrustumCullingEnabled = false;
+	CullingMode mCullingMode = CullingMode::SimdBatch;
 	DirectX::BoundingFrustum mCamFrustum;
-
-	UINT mSkyTexHeapIndex = 0;
-	UINT mShadowMapHeapIndex = 0;
+	FrustumCuller mFrustumCuller;
+
+	// World space bounds of every instance, indexed by firstInstanceID + i.
+	InstanceBounds mInstanceBounds;
+
+	// Hierarchy over the bounds of every cullable instance.
+	InstanceBVH mInstanceBVH;
+	InstanceBVH::CullStats mBVHStats;
+
+	// Visibility carried over from earlier frames for the temporal mode.
+	VisibilityCache mVisibilityCache;
+
+	// Scratch list of visible instances: offsets within the render item being
+	// updated, or indices into mInstanceBounds for the hierarchy.
+	std::vector<UINT> mVisibleInstances;
+
+	// CPU time spent on visibility tests in the last frame.
+	float mCullingTimeMs = 0.0f;
+
+	// Shadow casters are culled against the light volume extruded towards
+	// the light, independently of the camera, into lists of their own.
+	bool mShadowCullingEnabled = true;
+	FrustumCuller mShadowCasterCuller;
+	std::vector<UINT> mShadowVisibleInstances;
+	std::vector<UINT8> mShadowInstanceLODs;
+	UINT mShadowCasterCount = 0;
+	UINT mShadowVisibleCount = 0;
+
+	// Software occlusion culling against the occluder render items.
+	bool mOcclusionCullingEnabled = false;
+	OcclusionBuffer mOcclusionBuffer;
+	UINT mOccludedInstanceCount = 0;
+	float mOcclusionTimeMs = 0.0f;
+
+	// Level of detail selection. An instance uses the coarsest level whose
+	// error, projected to the screen, stays below mLODMaxErrorPixels.
+	bool mLODEnabled = true;
+	float mLODMaxErrorPixels = 1.0f;
+	float mLODPixelScale = 0.0f;        // Projected radius in pixels of a unit sphere at unit distance.
+	DirectX::XMFLOAT3 mLODEyePosW;
+
+	// Level used by every entry of mInstanceBounds in the last frame it was
+	// written, and the scratch list used to group instances by level.
+	std::vector<UINT8> mInstanceLODs;
+	std::vector<UINT> mLODSortedInstances;
+
+	// Visible instances drawn with each level this frame, over all items.
+	std::vector<UINT> mLODInstanceTotals;
+
+	// Descriptor indices of the null views.
 	UINT mNullCubeSrvIndex = 0;
 	UINT mNullTexSrvIndex = 0;
 
-	// Constant buffer for different rendering passes
-	PassConstants mMainPassCB;  // index 0 of pass cbuffer.
-	PassConstants mShadowPassCB;// index 1 of pass cbuffer.
+	// The sky and shadow map table of this frame, in the transient part of
+	// the heap.
+	UINT mMainPassSrvTable = 0;
+
+	// Constant buffer for different rendering passes, and where this
+	// frame's copies are in the upload ring.
+	PassConstants mMainPassCB;
+	PassConstants mShadowPassCB;
+	D3D12_GPU_VIRTUAL_ADDRESS mMainPassCBAddress = 0;
+	D3D12_GPU_VIRTUAL_ADDRESS mShadowPassCBAddress = 0;
 
 	bool mIsWireframe = false;
 
@@ -0,0 +1,167 @@
+//*******************************************************************
+// IndirectDrawBuilderTests.cpp:
+//
+// Records and ranges of the indirect draw builder: every range holds
+// draws of one topology, groups never share a range, and the records
+// carry the draws as ExecuteIndirect will read them.
+//*******************************************************************
+#include "TestFramework.h"
+#include "IndirectDrawBuilder.h"
+
+namespace
+{
+    const D3D12_PRIMITIVE_TOPOLOGY Triangles = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+    const D3D12_PRIMITIVE_TOPOLOGY Lines = D3D_PRIMITIVE_TOPOLOGY_LINELIST;
+
+    // A draw of the given topology whose instance list address tells it
+    // apart from the others.
+    void AddDraw(IndirectDrawBuilder& builder, D3D12_PRIMITIVE_TOPOLOGY topology, UINT id, UINT instanceCount = 1)
+    {
+        D3D12_VERTEX_BUFFER_VIEW vertexBuffer = { 0x10000, 4096, 32 };
+        D3D12_INDEX_BUFFER_VIEW indexBuffer = { 0x20000, 1024, DXGI_FORMAT_R16_UINT };
+        builder.AddDraw(vertexBuffer, indexBuffer, topology, 0x30000 + id * 256ull, 36, instanceCount, 0, 0);
+    }
+
+    bool SameRange(const IndirectDrawBuilder::Range& range, UINT first, UINT count, D3D12_PRIMITIVE_TOPOLOGY topology)
+    {
+        return range.First == first && range.Count == count && range.Topology == topology;
+    }
+}
+
+TEST_CASE(IndirectDraw_CommandLayout)
+{
+    // One record per 64 byte line, with the addresses 8 byte aligned.
+    CHECK_EQUAL((size_t)64, sizeof(IndirectDrawCommand));
+    CHECK_EQUAL((size_t)0, offsetof(IndirectDrawCommand, VisibleInstances) % 8);
+
+    D3D12_INDIRECT_ARGUMENT_DESC arguments[IndirectDrawBuilder::ArgumentCount];
+    D3D12_COMMAND_SIGNATURE_DESC desc;
+    IndirectDrawBuilder::DescribeCommandSignature(3, arguments, desc);
+    CHECK_EQUAL((UINT)sizeof(IndirectDrawCommand), desc.ByteStride);
+    CHECK_EQUAL((UINT)IndirectDrawBuilder::ArgumentCount, desc.NumArgumentDescs);
+    CHECK(arguments[0].Type == D3D12_INDIRECT_ARGUMENT_TYPE_VERTEX_BUFFER_VIEW);
+    CHECK(arguments[1].Type == D3D12_INDIRECT_ARGUMENT_TYPE_INDEX_BUFFER_VIEW);
+    CHECK(arguments[2].Type == D3D12_INDIRECT_ARGUMENT_TYPE_SHADER_RESOURCE_VIEW);
+    CHECK_EQUAL(3u, arguments[2].ShaderResourceView.RootParameterIndex);
+    CHECK(arguments[3].Type == D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED);
+}
+
+TEST_CASE(IndirectDraw_Records)
+{
+    IndirectDrawBuilder builder;
+    D3D12_VERTEX_BUFFER_VIEW vertexBuffer = { 0x10000, 4096, 32 };
+    D3D12_INDEX_BUFFER_VIEW indexBuffer = { 0x20000, 1024, DXGI_FORMAT_R32_UINT };
+
+    builder.BeginGroup();
+    builder.AddDraw(vertexBuffer, indexBuffer, Triangles, 0x30100, 36, 5, 12, -4);
+    builder.EndGroup();
+
+    CHECK_EQUAL(1u, builder.Size());
+    const IndirectDrawCommand& command = builder.Data()[0];
+    CHECK_EQUAL(vertexBuffer.BufferLocation, command.VertexBuffer.BufferLocation);
+    CHECK_EQUAL(vertexBuffer.StrideInBytes, command.VertexBuffer.StrideInBytes);
+    CHECK_EQUAL(indexBuffer.BufferLocation, command.IndexBuffer.BufferLocation);
+    CHECK(command.IndexBuffer.Format == DXGI_FORMAT_R32_UINT);
+    CHECK_EQUAL(0x30100ull, command.VisibleInstances);
+    CHECK_EQUAL(36u, command.Draw.IndexCountPerInstance);
+    CHECK_EQUAL(5u, command.Draw.InstanceCount);
+    CHECK_EQUAL(12u, command.Draw.StartIndexLocation);
+    CHECK_EQUAL(-4, command.Draw.BaseVertexLocation);
+
+    // The instance list address carries the offset instead.
+    CHECK_EQUAL(0u, command.Draw.StartInstanceLocation);
+}
+
+// ------------------------------------------------------------------
+// Every change of topology within a group starts a new range.
+// ------------------------------------------------------------------
+TEST_CASE(IndirectDraw_RangesSplitByTopology)
+{
+    IndirectDrawBuilder builder;
+
+    builder.BeginGroup();
+    AddDraw(builder, Triangles, 0);
+    AddDraw(builder, Triangles, 1);
+    AddDraw(builder, Lines, 2);
+    AddDraw(builder, Triangles, 3);
+    AddDraw(builder, Triangles, 4);
+    IndirectDrawBuilder::Group group = builder.EndGroup();
+
+    CHECK_EQUAL(0u, group.FirstRange);
+    CHECK_EQUAL(3u, group.RangeCount);
+    CHECK(SameRange(builder.GetRange(0), 0, 2, Triangles));
+    CHECK(SameRange(builder.GetRange(1), 2, 1, Lines));
+    CHECK(SameRange(builder.GetRange(2), 3, 2, Triangles));
+    CHECK_EQUAL(5u, builder.Size());
+}
+
+// ------------------------------------------------------------------
+// A group starts its own range even when it continues the topology of
+// the last one, and empty groups have none.
+// ------------------------------------------------------------------
+TEST_CASE(IndirectDraw_Groups)
+{
+    IndirectDrawBuilder builder;
+
+    builder.BeginGroup();
+    AddDraw(builder, Triangles, 0);
+    IndirectDrawBuilder::Group first = builder.EndGroup();
+
+    builder.BeginGroup();
+    IndirectDrawBuilder::Group empty = builder.EndGroup();
+
+    builder.BeginGroup();
+    AddDraw(builder, Triangles, 1);
+    AddDraw(builder, Triangles, 2);
+    IndirectDrawBuilder::Group second = builder.EndGroup();
+
+    CHECK_EQUAL(0u, first.FirstRange);
+    CHECK_EQUAL(1u, first.RangeCount);
+    CHECK_EQUAL(0u, empty.RangeCount);
+    CHECK_EQUAL(1u, second.FirstRange);
+    CHECK_EQUAL(1u, second.RangeCount);
+    CHECK(SameRange(builder.GetRange(second.FirstRange), 1, 2, Triangles));
+    CHECK_EQUAL(2u, builder.RangeCount());
+}
+
+// ------------------------------------------------------------------
+// Draws without instances leave no record, and do not split the range
+// around them.
+// ------------------------------------------------------------------
+TEST_CASE(IndirectDraw_SkipsEmptyDraws)
+{
+    IndirectDrawBuilder builder;
+
+    builder.BeginGroup();
+    AddDraw(builder, Triangles, 0);
+    AddDraw(builder, Lines, 1, 0);
+    AddDraw(builder, Triangles, 2);
+    IndirectDrawBuilder::Group group = builder.EndGroup();
+
+    CHECK_EQUAL(1u, group.RangeCount);
+    CHECK(SameRange(builder.GetRange(0), 0, 2, Triangles));
+    CHECK_EQUAL(2u, builder.Size());
+    CHECK_EQUAL(0x30000ull + 2 * 256, builder.Data()[1].VisibleInstances);
+
+    builder.BeginGroup();
+    AddDraw(builder, Lines, 3, 0);
+    CHECK_EQUAL(0u, builder.EndGroup().RangeCount);
+}
+
+TEST_CASE(IndirectDraw_Clear)
+{
+    IndirectDrawBuilder builder;
+    builder.BeginGroup();
+    AddDraw(builder, Lines, 0);
+    builder.EndGroup();
+
+    builder.Clear();
+    CHECK_EQUAL(0u, builder.Size());
+    CHECK_EQUAL(0u, builder.RangeCount());
+
+    builder.BeginGroup();
+    AddDraw(builder, Triangles, 1);
+    IndirectDrawBuilder::Group group = builder.EndGroup();
+    CHECK_EQUAL(0u, group.FirstRange);
+    CHECK(SameRange(builder.GetRange(0), 0, 1, Triangles));
+}
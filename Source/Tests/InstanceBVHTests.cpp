@@ -0,0 +1,218 @@
+//*******************************************************************
+// InstanceBVHTests.cpp:
+//
+// The bounding volume hierarchy against the frustum culler it speeds
+// up. Whatever the tree rejects or accepts as a whole subtree, it must
+// find the entries the culler finds, also after entries have moved
+// and the tree was refit instead of rebuilt.
+//*******************************************************************
+#include "TestFramework.h"
+#include "Culling/InstanceBVH.h"
+
+using namespace DirectX;
+
+namespace
+{
+    const UINT EntryCount = 2000;
+
+    // xorshift32, mapped to [0, 1). The same sequence on every run.
+    struct Random
+    {
+        UINT State = 0x2545F491u;
+
+        float Next()
+        {
+            State ^= State << 13;
+            State ^= State >> 17;
+            State ^= State << 5;
+            return (State >> 8) / (float)(1u << 24);
+        }
+
+        float Range(float lo, float hi) { return lo + (hi - lo) * Next(); }
+    };
+
+    // A box of random size and orientation somewhere in a square of side
+    // 200 around the origin.
+    XMMATRIX RandomWorld(Random& random)
+    {
+        XMMATRIX scale = XMMatrixScaling(random.Range(0.5f, 3.0f), random.Range(0.5f, 3.0f), random.Range(0.5f, 3.0f));
+        XMMATRIX rotation = XMMatrixRotationRollPitchYaw(random.Range(0.0f, XM_2PI), random.Range(0.0f, XM_2PI), 0.0f);
+        XMMATRIX translation = XMMatrixTranslation(random.Range(-100.0f, 100.0f), random.Range(0.0f, 10.0f), random.Range(-100.0f, 100.0f));
+        return scale * rotation * translation;
+    }
+
+    const BoundingBox UnitBox(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.5f, 0.5f, 0.5f));
+
+    void BuildScene(InstanceBounds& bounds, Random& random)
+    {
+        for (UINT i = 0; i < EntryCount; ++i)
+            bounds.Add(UnitBox, RandomWorld(random));
+    }
+
+    FrustumCuller MakeCuller(const XMFLOAT3& position, float yaw, float farZ)
+    {
+        XMVECTOR eye = XMLoadFloat3(&position);
+        XMVECTOR look = XMVectorSet(sinf(yaw), -0.2f, cosf(yaw), 0.0f);
+        XMMATRIX view = XMMatrixLookAtLH(eye, eye + look, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+        XMMATRIX proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 1.0f, farZ);
+
+        FrustumCuller culler;
+        culler.SetViewProj(XMMatrixMultiply(view, proj));
+        return culler;
+    }
+
+    // Check the tree finds the entries the culler finds among the ones
+    // the tree was built over. indices must be sorted.
+    bool CullMatches(const InstanceBVH& bvh, const FrustumCuller& culler, const InstanceBounds& bounds,
+        const std::vector<UINT>& indices, InstanceBVH::CullStats* stats = nullptr)
+    {
+        std::vector<UINT> found(bvh.Size());
+        found.resize(bvh.Cull(culler, bounds, found.data(), stats));
+        std::sort(found.begin(), found.end());
+
+        std::vector<UINT> expected;
+        for (UINT index : indices)
+        {
+            if (culler.IsVisible(bounds, index))
+                expected.push_back(index);
+        }
+
+        // The batch culler must agree with its scalar test, too.
+        std::vector<UINT> batch(bounds.Size());
+        batch.resize(culler.Cull(bounds, 0, bounds.Size(), batch.data()));
+        std::vector<UINT> batchExpected;
+        for (UINT index : batch)
+        {
+            if (std::binary_search(indices.begin(), indices.end(), index))
+                batchExpected.push_back(index);
+        }
+
+        return found == expected && found == batchExpected;
+    }
+
+    std::vector<UINT> AllIndices(UINT count)
+    {
+        std::vector<UINT> indices(count);
+        for (UINT i = 0; i < count; ++i)
+            indices[i] = i;
+        return indices;
+    }
+}
+
+TEST_CASE(InstanceBVH_MatchesCuller)
+{
+    Random random;
+    InstanceBounds bounds;
+    BuildScene(bounds, random);
+
+    const std::vector<UINT> indices = AllIndices(EntryCount);
+    InstanceBVH bvh;
+    bvh.Build(bounds, indices.data(), (UINT)indices.size());
+    CHECK_EQUAL(EntryCount, bvh.Size());
+
+    // Cameras inside the scene, outside it looking in, and looking away.
+    const XMFLOAT3 positions[] = { XMFLOAT3(0.0f, 5.0f, 0.0f), XMFLOAT3(-150.0f, 20.0f, -150.0f), XMFLOAT3(60.0f, 2.0f, 90.0f) };
+    const float yaws[] = { 0.0f, XM_PIDIV4, 2.5f, XM_PI };
+
+    bool allMatch = true;
+    for (const XMFLOAT3& position : positions)
+    {
+        for (float yaw : yaws)
+            allMatch = allMatch && CullMatches(bvh, MakeCuller(position, yaw, 120.0f), bounds, indices);
+    }
+    CHECK(allMatch);
+}
+
+TEST_CASE(InstanceBVH_SubsetOfBounds)
+{
+    // The tree is built over the entries of some render items only; the
+    // others are never returned.
+    Random random;
+    InstanceBounds bounds;
+    BuildScene(bounds, random);
+
+    std::vector<UINT> indices;
+    for (UINT i = 0; i < EntryCount; i += 3)
+        indices.push_back(i);
+
+    InstanceBVH bvh;
+    bvh.Build(bounds, indices.data(), (UINT)indices.size());
+    CHECK_EQUAL((UINT)indices.size(), bvh.Size());
+    CHECK(CullMatches(bvh, MakeCuller(XMFLOAT3(0.0f, 5.0f, -120.0f), 0.0f, 300.0f), bounds, indices));
+}
+
+TEST_CASE(InstanceBVH_RefitAfterMoves)
+{
+    Random random;
+    InstanceBounds bounds;
+    BuildScene(bounds, random);
+
+    const std::vector<UINT> indices = AllIndices(EntryCount);
+    InstanceBVH bvh;
+    bvh.Build(bounds, indices.data(), (UINT)indices.size());
+
+    const FrustumCuller culler = MakeCuller(XMFLOAT3(0.0f, 5.0f, -120.0f), 0.0f, 80.0f);
+
+    std::vector<UINT> visible(EntryCount);
+    UINT visibleCount = bvh.Cull(culler, bounds, visible.data());
+    CHECK(visibleCount > 0);
+
+    // Move every tenth entry to a new place, which takes some into view
+    // and some out of it, and refit.
+    bool allMatch = true;
+    for (UINT round = 0; round < 4; ++round)
+    {
+        for (UINT i = round; i < EntryCount; i += 10)
+        {
+            bounds.Update(i, UnitBox, RandomWorld(random));
+            bvh.MarkDirty(i);
+        }
+
+        // Marking the same entry again before the refit is harmless.
+        bvh.MarkDirty(round);
+        bvh.Refit(bounds);
+
+        allMatch = allMatch && CullMatches(bvh, culler, bounds, indices);
+    }
+    CHECK(allMatch);
+
+    // A moved entry the tree no longer bounds would be missed: pull one
+    // far outside the scene into the middle of the view.
+    bounds.Update(7, UnitBox, XMMatrixTranslation(0.0f, 5.0f, -100.0f));
+    bvh.MarkDirty(7);
+    bvh.Refit(bounds);
+
+    visibleCount = bvh.Cull(culler, bounds, visible.data());
+    CHECK(std::find(visible.begin(), visible.begin() + visibleCount, 7u) != visible.begin() + visibleCount);
+    CHECK(CullMatches(bvh, culler, bounds, indices));
+}
+
+TEST_CASE(InstanceBVH_AcceptsSubtreesInside)
+{
+    // A small cluster well inside a camera's frustum is accepted whole,
+    // without testing its leaves.
+    InstanceBounds bounds;
+    for (UINT i = 0; i < 256; ++i)
+        bounds.Add(UnitBox, XMMatrixTranslation((float)(i % 16) * 2.0f - 16.0f, 0.0f, (float)(i / 16) * 2.0f + 60.0f));
+
+    const std::vector<UINT> indices = AllIndices(bounds.Size());
+    InstanceBVH bvh;
+    bvh.Build(bounds, indices.data(), (UINT)indices.size());
+    CHECK(bvh.NodeCount() > 1);
+
+    const FrustumCuller culler = MakeCuller(XMFLOAT3(0.0f, 10.0f, 0.0f), 0.0f, 500.0f);
+
+    InstanceBVH::CullStats stats;
+    std::vector<UINT> visible(bvh.Size());
+    CHECK_EQUAL(bvh.Size(), bvh.Cull(culler, bounds, visible.data(), &stats));
+    CHECK_EQUAL(1u, stats.NodesVisited);
+    CHECK_EQUAL(1u, stats.SubtreesAccepted);
+    CHECK_EQUAL(0u, stats.LeavesTested);
+
+    // Looking past the cluster's edge, the subtrees fully inside are still
+    // accepted whole and the rest tested leaf by leaf.
+    const FrustumCuller edge = MakeCuller(XMFLOAT3(-20.0f, 10.0f, 40.0f), 0.35f, 500.0f);
+    CHECK(CullMatches(bvh, edge, bounds, indices, &stats));
+    CHECK(stats.SubtreesAccepted > 0);
+    CHECK(stats.LeavesTested > 0);
+}
@@ -0,0 +1,222 @@
+//*******************************************************************
+// MeshSimplifierTests.cpp:
+//
+// The level of detail chain of the mesh simplifier on a closed sphere
+// and on an open grid: every level within its index budget, no
+// triangle turned against the surface it replaces, the border of the
+// grid kept where it was, and the index ranges of the chain laid out
+// one after another in the index buffer.
+//*******************************************************************
+#include "TestFramework.h"
+#include "MeshSimplifier.h"
+
+using namespace DirectX;
+
+namespace
+{
+    const UINT LODCount = 4;
+
+    struct Mesh
+    {
+        std::vector<XMFLOAT3> Positions;
+        std::vector<std::uint32_t> Indices;
+    };
+
+    XMFLOAT3 Subtract(const XMFLOAT3& a, const XMFLOAT3& b) { return XMFLOAT3(a.x - b.x, a.y - b.y, a.z - b.z); }
+    XMFLOAT3 Add(const XMFLOAT3& a, const XMFLOAT3& b) { return XMFLOAT3(a.x + b.x, a.y + b.y, a.z + b.z); }
+    float Dot(const XMFLOAT3& a, const XMFLOAT3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+    XMFLOAT3 Cross(const XMFLOAT3& a, const XMFLOAT3& b)
+    {
+        return XMFLOAT3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+    }
+
+    // Twice the area of the triangle, along its normal.
+    XMFLOAT3 FaceNormal(const Mesh& mesh, const std::uint32_t* triangle)
+    {
+        const XMFLOAT3& a = mesh.Positions[triangle[0]];
+        return Cross(Subtract(mesh.Positions[triangle[1]], a), Subtract(mesh.Positions[triangle[2]], a));
+    }
+
+    // A unit sphere whose rings share their seam and poles, so that every
+    // edge belongs to two triangles.
+    Mesh MakeClosedSphere(UINT slices, UINT stacks)
+    {
+        Mesh mesh;
+        mesh.Positions.push_back(XMFLOAT3(0.0f, 1.0f, 0.0f));
+        for (UINT i = 1; i < stacks; ++i)
+        {
+            float phi = XM_PI * i / stacks;
+            for (UINT j = 0; j < slices; ++j)
+            {
+                float theta = XM_2PI * j / slices;
+                mesh.Positions.push_back(XMFLOAT3(sinf(phi) * cosf(theta), cosf(phi), sinf(phi) * sinf(theta)));
+            }
+        }
+        mesh.Positions.push_back(XMFLOAT3(0.0f, -1.0f, 0.0f));
+
+        const std::uint32_t south = (std::uint32_t)mesh.Positions.size() - 1;
+        auto ring = [slices](UINT stack, UINT slice) { return (std::uint32_t)(1 + (stack - 1) * slices + slice % slices); };
+
+        for (UINT j = 0; j < slices; ++j)
+            mesh.Indices.insert(mesh.Indices.end(), { 0, ring(1, j + 1), ring(1, j) });
+
+        for (UINT i = 1; i + 1 < stacks; ++i)
+        {
+            for (UINT j = 0; j < slices; ++j)
+            {
+                mesh.Indices.insert(mesh.Indices.end(), { ring(i, j), ring(i, j + 1), ring(i + 1, j) });
+                mesh.Indices.insert(mesh.Indices.end(), { ring(i + 1, j), ring(i, j + 1), ring(i + 1, j + 1) });
+            }
+        }
+
+        for (UINT j = 0; j < slices; ++j)
+            mesh.Indices.insert(mesh.Indices.end(), { south, ring(stacks - 1, j), ring(stacks - 1, j + 1) });
+
+        return mesh;
+    }
+
+    // A flat n x n quad grid of side 2 in the xz plane around the origin.
+    Mesh MakeOpenGrid(UINT n)
+    {
+        Mesh mesh;
+        for (UINT i = 0; i <= n; ++i)
+            for (UINT j = 0; j <= n; ++j)
+                mesh.Positions.push_back(XMFLOAT3(-1.0f + 2.0f * j / n, 0.0f, -1.0f + 2.0f * i / n));
+
+        for (UINT i = 0; i < n; ++i)
+        {
+            for (UINT j = 0; j < n; ++j)
+            {
+                std::uint32_t v = i * (n + 1) + j;
+                mesh.Indices.insert(mesh.Indices.end(), { v, v + n + 1, v + 1 });
+                mesh.Indices.insert(mesh.Indices.end(), { v + 1, v + n + 1, v + n + 2 });
+            }
+        }
+
+        return mesh;
+    }
+
+    // The normal of every vertex of the source mesh, summed over the
+    // triangles around it.
+    std::vector<XMFLOAT3> VertexNormals(const Mesh& mesh)
+    {
+        std::vector<XMFLOAT3> normals(mesh.Positions.size(), XMFLOAT3(0.0f, 0.0f, 0.0f));
+        for (size_t t = 0; t < mesh.Indices.size(); t += 3)
+        {
+            XMFLOAT3 normal = FaceNormal(mesh, &mesh.Indices[t]);
+            for (size_t k = 0; k < 3; ++k)
+                normals[mesh.Indices[t + k]] = Add(normals[mesh.Indices[t + k]], normal);
+        }
+        return normals;
+    }
+
+    // The chain for the source mesh, with the indices of all its levels
+    // appended to a copy of the source indices.
+    std::vector<SubmeshLOD> BuildChain(const Mesh& source, std::vector<std::uint32_t>& indices)
+    {
+        indices = source.Indices;
+        return MeshSimplifier::BuildLODChain(source.Positions, indices, LODCount, 1.0f);
+    }
+
+    // The full chain, then every level on its own: within its budget,
+    // and turned the way the source surface is around its corners.
+    void CheckChain(const Mesh& source)
+    {
+        std::vector<std::uint32_t> indices;
+        std::vector<SubmeshLOD> lods = BuildChain(source, indices);
+        std::vector<XMFLOAT3> normals = VertexNormals(source);
+
+        CHECK_EQUAL((size_t)LODCount, lods.size());
+        CHECK_EQUAL((UINT)source.Indices.size(), lods[0].IndexCount);
+        CHECK_EQUAL(0u, lods[0].StartIndexLocation);
+
+        const UINT triangleCount = (UINT)source.Indices.size() / 3;
+        UINT next = 0;
+        for (UINT level = 0; level < lods.size(); ++level)
+        {
+            const SubmeshLOD& lod = lods[level];
+
+            // Back to back in the order of the chain, so no two overlap,
+            // and the last one ends where the buffer does.
+            CHECK_EQUAL(next, lod.StartIndexLocation);
+            CHECK(lod.IndexCount > 0);
+            CHECK(lod.IndexCount % 3 == 0);
+            next = lod.StartIndexLocation + lod.IndexCount;
+            CHECK(next <= indices.size());
+
+            CHECK(lod.IndexCount <= 3 * (triangleCount >> level));
+            if (level > 0)
+                CHECK(lod.IndexCount < lods[level - 1].IndexCount);
+
+            for (UINT t = lod.StartIndexLocation; t + 2 < next; t += 3)
+            {
+                const std::uint32_t* triangle = &indices[t];
+                for (size_t k = 0; k < 3; ++k)
+                    CHECK(triangle[k] < source.Positions.size());
+
+                XMFLOAT3 around = Add(Add(normals[triangle[0]], normals[triangle[1]]), normals[triangle[2]]);
+                CHECK(Dot(FaceNormal(source, triangle), around) > 0.0f);
+            }
+        }
+        CHECK_EQUAL((UINT)indices.size(), next);
+    }
+
+    bool OnSide(float coordinate) { return fabsf(fabsf(coordinate) - 1.0f) < 1e-5f; }
+}
+
+TEST_CASE(MeshSimplifier_ClosedMeshChain)
+{
+    CheckChain(MakeClosedSphere(24, 16));
+}
+
+TEST_CASE(MeshSimplifier_OpenGridChain)
+{
+    CheckChain(MakeOpenGrid(20));
+}
+
+TEST_CASE(MeshSimplifier_KeepsOpenBoundary)
+{
+    Mesh grid = MakeOpenGrid(20);
+    std::vector<std::uint32_t> indices;
+    std::vector<SubmeshLOD> lods = BuildChain(grid, indices);
+
+    for (const SubmeshLOD& lod : lods)
+    {
+        // An edge that only one triangle uses is on the border of the
+        // level. It must run along a side of the square, and together
+        // the border edges must go all the way around.
+        std::map<std::pair<std::uint32_t, std::uint32_t>, UINT> edgeUses;
+        float area = 0.0f;
+        for (UINT t = lod.StartIndexLocation; t < lod.StartIndexLocation + lod.IndexCount; t += 3)
+        {
+            for (UINT k = 0; k < 3; ++k)
+            {
+                std::uint32_t a = indices[t + k];
+                std::uint32_t b = indices[t + (k + 1) % 3];
+                ++edgeUses[std::make_pair(std::min(a, b), std::max(a, b))];
+            }
+            area += 0.5f * fabsf(FaceNormal(grid, &indices[t]).y);
+        }
+
+        float borderLength = 0.0f;
+        for (const auto& edge : edgeUses)
+        {
+            CHECK(edge.second <= 2);
+            if (edge.second != 1)
+                continue;
+
+            const XMFLOAT3& a = grid.Positions[edge.first.first];
+            const XMFLOAT3& b = grid.Positions[edge.first.second];
+            bool alongX = OnSide(a.z) && OnSide(b.z) && a.z == b.z;
+            bool alongZ = OnSide(a.x) && OnSide(b.x) && a.x == b.x;
+            CHECK(alongX || alongZ);
+
+            XMFLOAT3 d = Subtract(b, a);
+            borderLength += sqrtf(Dot(d, d));
+        }
+
+        CHECK(fabsf(borderLength - 8.0f) < 1e-3f);
+        CHECK(fabsf(area - 4.0f) < 1e-3f);
+    }
+}
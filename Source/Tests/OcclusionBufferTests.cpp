@@ -0,0 +1,253 @@
+//*******************************************************************
+// OcclusionBufferTests.cpp:
+//
+// The software occlusion buffer against occluders whose coverage and
+// depth can be worked out by hand: which pixels a quad fills and with
+// what depth, near plane clipping, and which boxes IsVisible rejects
+// behind it.
+//*******************************************************************
+#include "TestFramework.h"
+#include "Culling/OcclusionBuffer.h"
+
+using namespace DirectX;
+
+namespace
+{
+    const UINT Width = 256;
+    const UINT Height = 128;
+
+    const float NearZ = 1.0f;
+    const float FarZ = 100.0f;
+
+    // Looking down +z from the origin with a 90 degree vertical field of
+    // view, so at distance z a point (x, y) lands on pixel
+    // (128 + 64 * x / z, 64 - 64 * y / z).
+    XMMATRIX ViewProj()
+    {
+        XMMATRIX view = XMMatrixLookAtLH(XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f), XMVectorSet(0.0f, 0.0f, 1.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+        XMMATRIX proj = XMMatrixPerspectiveFovLH(XM_PIDIV2, (float)Width / Height, NearZ, FarZ);
+        return XMMatrixMultiply(view, proj);
+    }
+
+    // Depth buffer value of a point at view distance z.
+    float DepthAt(float z)
+    {
+        return FarZ / (FarZ - NearZ) * (1.0f - NearZ / z);
+    }
+
+    float Pixel(const OcclusionBuffer& buffer, UINT x, UINT y)
+    {
+        return buffer.GetDepth()[y * buffer.Width() + x];
+    }
+
+    // Vertices carry more than a position, as they do in the meshes the
+    // buffer is fed with.
+    struct Vertex
+    {
+        XMFLOAT3 Pos;
+        XMFLOAT3 Normal;
+    };
+
+    // Quad facing the camera at distance z, spanning [x0, x1] x [y0, y1].
+    void DrawQuad(OcclusionBuffer& buffer, float x0, float x1, float y0, float y1, float z)
+    {
+        const Vertex vertices[] =
+        {
+            { XMFLOAT3(x0, y0, z), XMFLOAT3(0.0f, 0.0f, -1.0f) },
+            { XMFLOAT3(x0, y1, z), XMFLOAT3(0.0f, 0.0f, -1.0f) },
+            { XMFLOAT3(x1, y1, z), XMFLOAT3(0.0f, 0.0f, -1.0f) },
+            { XMFLOAT3(x1, y0, z), XMFLOAT3(0.0f, 0.0f, -1.0f) },
+        };
+        const UINT16 indices[] = { 0, 1, 2, 0, 2, 3 };
+        buffer.DrawIndexed(vertices, sizeof(Vertex), indices, false, 6, 0, XMMatrixIdentity());
+    }
+}
+
+TEST_CASE(OcclusionBuffer_Clear)
+{
+    OcclusionBuffer buffer(Width, Height);
+    buffer.Begin(ViewProj());
+    buffer.End();
+
+    bool allFar = true;
+    for (UINT i = 0; i < Width * Height; ++i)
+        allFar = allFar && buffer.GetDepth()[i] == 1.0f;
+    CHECK(allFar);
+
+    // Nothing occludes anything in an empty buffer.
+    CHECK(buffer.IsVisible(XMFLOAT3(0.0f, 0.0f, 90.0f), XMFLOAT3(1.0f, 1.0f, 1.0f)));
+    CHECK_EQUAL(0u, buffer.TrianglesDrawn());
+}
+
+TEST_CASE(OcclusionBuffer_Coverage)
+{
+    // A 10x10 quad at z = 10 covers the pixels [96, 160) x [32, 96).
+    OcclusionBuffer buffer(Width, Height);
+    buffer.Begin(ViewProj());
+    DrawQuad(buffer, -5.0f, 5.0f, -5.0f, 5.0f, 10.0f);
+    buffer.End();
+
+    CHECK_EQUAL(2u, buffer.TrianglesDrawn());
+
+    UINT covered = 0;
+    bool depthsMatch = true;
+    for (UINT y = 0; y < Height; ++y)
+    {
+        for (UINT x = 0; x < Width; ++x)
+        {
+            bool inside = x >= 96 && x < 160 && y >= 32 && y < 96;
+            float depth = Pixel(buffer, x, y);
+            if (inside)
+            {
+                ++covered;
+                depthsMatch = depthsMatch && fabsf(depth - DepthAt(10.0f)) < 1e-4f;
+            }
+            else
+            {
+                depthsMatch = depthsMatch && depth == 1.0f;
+            }
+        }
+    }
+    CHECK(depthsMatch);
+    CHECK_EQUAL(64u * 64u, covered);
+}
+
+TEST_CASE(OcclusionBuffer_IndexFormats)
+{
+    // The same quad from 32-bit indices, offset by a base vertex and wound
+    // the other way, fills the same pixels with the same depth.
+    OcclusionBuffer reference(Width, Height);
+    reference.Begin(ViewProj());
+    DrawQuad(reference, -5.0f, 5.0f, -5.0f, 5.0f, 10.0f);
+    reference.End();
+
+    const Vertex vertices[] =
+    {
+        { XMFLOAT3(100.0f, 100.0f, 100.0f), XMFLOAT3() },
+        { XMFLOAT3(100.0f, 100.0f, 100.0f), XMFLOAT3() },
+        { XMFLOAT3(-5.0f, -5.0f, 10.0f), XMFLOAT3() },
+        { XMFLOAT3(-5.0f, 5.0f, 10.0f), XMFLOAT3() },
+        { XMFLOAT3(5.0f, 5.0f, 10.0f), XMFLOAT3() },
+        { XMFLOAT3(5.0f, -5.0f, 10.0f), XMFLOAT3() },
+    };
+    const UINT32 indices[] = { 0, 2, 1, 0, 3, 2 };
+
+    OcclusionBuffer buffer(Width, Height);
+    buffer.Begin(ViewProj());
+    buffer.DrawIndexed(vertices, sizeof(Vertex), indices, true, 6, 2, XMMatrixIdentity());
+    buffer.End();
+
+    CHECK_EQUAL(0, memcmp(reference.GetDepth(), buffer.GetDepth(), Width * Height * sizeof(float)));
+}
+
+TEST_CASE(OcclusionBuffer_NearestWins)
+{
+    // A nearer quad over part of a farther one, drawn after it, and a
+    // farther one drawn last that must not overwrite either.
+    OcclusionBuffer buffer(Width, Height);
+    buffer.Begin(ViewProj());
+    DrawQuad(buffer, -5.0f, 5.0f, -5.0f, 5.0f, 10.0f);
+    DrawQuad(buffer, 0.0f, 2.5f, 0.0f, 2.5f, 5.0f);
+    DrawQuad(buffer, -200.0f, 200.0f, -200.0f, 200.0f, 50.0f);
+    buffer.End();
+
+    // The near quad covers [128, 160) x [32, 64).
+    CHECK(fabsf(Pixel(buffer, 140, 40) - DepthAt(5.0f)) < 1e-4f);
+    CHECK(fabsf(Pixel(buffer, 100, 80) - DepthAt(10.0f)) < 1e-4f);
+    CHECK(fabsf(Pixel(buffer, 10, 10) - DepthAt(50.0f)) < 1e-4f);
+}
+
+TEST_CASE(OcclusionBuffer_NearPlaneClipping)
+{
+    OcclusionBuffer buffer(Width, Height);
+    buffer.Begin(ViewProj());
+
+    // Entirely behind the camera: clipped away.
+    DrawQuad(buffer, -5.0f, 5.0f, -5.0f, 5.0f, -10.0f);
+    CHECK_EQUAL(0u, buffer.TrianglesDrawn());
+
+    // A floor running from behind the camera into the distance is clipped
+    // at the near plane and still fills the bottom of the screen.
+    const Vertex floor[] =
+    {
+        { XMFLOAT3(-50.0f, -1.0f, -10.0f), XMFLOAT3() },
+        { XMFLOAT3(-50.0f, -1.0f, 90.0f), XMFLOAT3() },
+        { XMFLOAT3(50.0f, -1.0f, 90.0f), XMFLOAT3() },
+        { XMFLOAT3(50.0f, -1.0f, -10.0f), XMFLOAT3() },
+    };
+    const UINT16 indices[] = { 0, 1, 2, 0, 2, 3 };
+    buffer.DrawIndexed(floor, sizeof(Vertex), indices, false, 6, 0, XMMatrixIdentity());
+    buffer.End();
+
+    CHECK_EQUAL(2u, buffer.TrianglesDrawn());
+
+    // The bottom row is the floor at the near plane, the row at the
+    // horizon is left alone, and nothing is written outside [0, 1].
+    CHECK(Pixel(buffer, 128, Height - 1) < DepthAt(2.0f));
+    CHECK_EQUAL(1.0f, Pixel(buffer, 128, Height / 2 - 1));
+
+    bool inRange = true;
+    for (UINT i = 0; i < Width * Height; ++i)
+        inRange = inRange && buffer.GetDepth()[i] >= 0.0f && buffer.GetDepth()[i] <= 1.0f;
+    CHECK(inRange);
+
+    // The world transform is applied before clipping.
+    buffer.Begin(ViewProj());
+    const UINT16 wall[] = { 0, 1, 2 };
+    const Vertex behind[] =
+    {
+        { XMFLOAT3(-5.0f, -5.0f, -10.0f), XMFLOAT3() },
+        { XMFLOAT3(-5.0f, 5.0f, -10.0f), XMFLOAT3() },
+        { XMFLOAT3(5.0f, 5.0f, -10.0f), XMFLOAT3() },
+    };
+    buffer.DrawIndexed(behind, sizeof(Vertex), wall, false, 3, 0, XMMatrixTranslation(0.0f, 0.0f, 20.0f));
+    buffer.End();
+    CHECK_EQUAL(1u, buffer.TrianglesDrawn());
+    CHECK(fabsf(Pixel(buffer, 120, 60) - DepthAt(10.0f)) < 1e-4f);
+}
+
+TEST_CASE(OcclusionBuffer_IsVisible)
+{
+    OcclusionBuffer buffer(Width, Height);
+    buffer.Begin(ViewProj());
+    DrawQuad(buffer, -5.0f, 5.0f, -5.0f, 5.0f, 10.0f);
+    buffer.End();
+
+    const XMFLOAT3 unit(1.0f, 1.0f, 1.0f);
+
+    // Behind the quad and within its outline.
+    CHECK(!buffer.IsVisible(XMFLOAT3(0.0f, 0.0f, 20.0f), unit));
+    CHECK(!buffer.IsVisible(XMFLOAT3(-6.0f, 6.0f, 30.0f), unit));
+
+    // In front of it, or through it.
+    CHECK(buffer.IsVisible(XMFLOAT3(0.0f, 0.0f, 5.0f), unit));
+    CHECK(buffer.IsVisible(XMFLOAT3(0.0f, 0.0f, 10.0f), unit));
+
+    // Behind it but reaching past its edge.
+    CHECK(buffer.IsVisible(XMFLOAT3(9.0f, 0.0f, 20.0f), unit));
+
+    // Crossing the near plane, or off screen: left to the frustum test.
+    CHECK(buffer.IsVisible(XMFLOAT3(0.0f, 0.0f, 1.0f), unit));
+    CHECK(buffer.IsVisible(XMFLOAT3(0.0f, 0.0f, -20.0f), unit));
+    CHECK(buffer.IsVisible(XMFLOAT3(500.0f, 0.0f, 20.0f), unit));
+}
+
+TEST_CASE(OcclusionBuffer_PartialTiles)
+{
+    // The quad's right edge falls inside a tile, at x = 161.6, so the
+    // tile at [160, 168) still holds the far plane. Boxes over it must be
+    // decided per pixel.
+    OcclusionBuffer buffer(Width, Height);
+    buffer.Begin(ViewProj());
+    DrawQuad(buffer, -5.0f, 5.25f, -5.0f, 5.0f, 10.0f);
+    buffer.End();
+
+    CHECK(Pixel(buffer, 161, 64) < 1.0f);
+    CHECK_EQUAL(1.0f, Pixel(buffer, 162, 64));
+
+    // Covers pixels [157, 161) at z = 20, all behind the quad.
+    CHECK(!buffer.IsVisible(XMFLOAT3(9.44f, 0.0f, 20.0f), XMFLOAT3(0.6f, 0.6f, 0.5f)));
+
+    // Covers pixels up to 164, past the quad's edge.
+    CHECK(buffer.IsVisible(XMFLOAT3(10.5f, 0.0f, 20.0f), XMFLOAT3(0.6f, 0.6f, 0.5f)));
+}
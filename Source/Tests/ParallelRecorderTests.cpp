@@ -0,0 +1,118 @@
+//*******************************************************************
+// ParallelRecorderTests.cpp:
+//
+// The fork-join recording of the frame's passes, driven with
+// recording command lists in place of D3D ones. Recording in parallel
+// must leave every pass's list with the calls recording in order
+// leaves it with, run the caller's work on the calling thread, and
+// give back the arena memory it took.
+//*******************************************************************
+#include "TestFramework.h"
+#include "ParallelRecorder.h"
+#include "StateTrackingCommandList.h"
+#include "Testing/RecordingCommandList.h"
+
+namespace
+{
+    const UINT PassCount = 8;
+    const UINT DrawsPerPass = 500;
+
+    // A pass binding a few pipelines and meshes, each for a run of draws,
+    // so the tracker drops some of the calls. Different for every pass.
+    void RecordPass(UINT pass, RecordingCommandList& list)
+    {
+        StateTrackingCommandList<RecordingCommandList> cmdList(&list);
+        cmdList.SetGraphicsRootSignature(reinterpret_cast<ID3D12RootSignature*>(0x100));
+        cmdList.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+        for (UINT i = 0; i < DrawsPerPass; ++i)
+        {
+            cmdList.SetPipelineState(reinterpret_cast<ID3D12PipelineState*>((UINT64)0x1000 + (i / 50) % 3));
+
+            D3D12_VERTEX_BUFFER_VIEW vertexBuffer = { 0x10000ull * (pass + 1) + (i / 10) * 256ull, 4096, 32 };
+            cmdList.IASetVertexBuffers(0, 1, &vertexBuffer);
+
+            cmdList.SetGraphicsRootShaderResourceView(0, 0x80000ull + i * 64ull);
+            cmdList.DrawIndexedInstanced(36 + pass, 1, 0, 0, 0);
+        }
+    }
+
+    bool SameCalls(const RecordingCommandList& a, const RecordingCommandList& b)
+    {
+        const auto& callsA = a.Calls();
+        const auto& callsB = b.Calls();
+        if (callsA.size() != callsB.size())
+            return false;
+
+        for (size_t i = 0; i < callsA.size(); ++i)
+        {
+            if (callsA[i].Kind != callsB[i].Kind || callsA[i].Index != callsB[i].Index || callsA[i].Value != callsB[i].Value)
+                return false;
+        }
+        return true;
+    }
+}
+
+TEST_CASE(ParallelRecorder_MatchesSerial)
+{
+    RecordingCommandList serial[PassCount];
+    RecordingCommandList parallel[PassCount];
+
+    ParallelRecorder::Record(PassCount, false, [&](UINT i) { RecordPass(i, serial[i]); }, []() {});
+    ParallelRecorder::Record(PassCount, true, [&](UINT i) { RecordPass(i, parallel[i]); }, []() {});
+
+    for (UINT i = 0; i < PassCount; ++i)
+    {
+        CHECK_EQUAL(DrawsPerPass, parallel[i].Count(RecordingCommandList::Call::DrawIndexedInstanced));
+        CHECK(SameCalls(serial[i], parallel[i]));
+    }
+
+    // Recording again into the same lists gives the same result.
+    for (RecordingCommandList& list : parallel)
+        list.Clear();
+    ParallelRecorder::Record(PassCount, true, [&](UINT i) { RecordPass(i, parallel[i]); }, []() {});
+    for (UINT i = 0; i < PassCount; ++i)
+        CHECK(SameCalls(serial[i], parallel[i]));
+}
+
+TEST_CASE(ParallelRecorder_RunsEveryPassOnce)
+{
+    for (bool parallel : { false, true })
+    {
+        std::atomic<UINT> runs[PassCount] = {};
+        std::atomic<UINT> callerRuns(0);
+        std::thread::id callerThread;
+
+        ParallelRecorder::Record(PassCount, parallel,
+            [&](UINT i) { runs[i].fetch_add(1); },
+            [&]() { callerRuns.fetch_add(1); callerThread = std::this_thread::get_id(); });
+
+        for (UINT i = 0; i < PassCount; ++i)
+            CHECK_EQUAL(1u, runs[i].load());
+        CHECK_EQUAL(1u, callerRuns.load());
+        CHECK(callerThread == std::this_thread::get_id());
+    }
+
+    // In order, the passes come first and in the order of their index.
+    std::vector<int> order;
+    ParallelRecorder::Record(4, false, [&](UINT i) { order.push_back((int)i); }, [&]() { order.push_back(-1); });
+    CHECK(order == std::vector<int>({ 0, 1, 2, 3, -1 }));
+
+    // No passes leaves only the caller's work.
+    UINT callerOnly = 0;
+    ParallelRecorder::Record(0, true, [](UINT) { assert(false); }, [&]() { ++callerOnly; });
+    CHECK_EQUAL(1u, callerOnly);
+}
+
+TEST_CASE(ParallelRecorder_ReturnsArenaMemory)
+{
+    FrameArena& arena = FrameArena::Get();
+    size_t usedBefore = arena.UsedSize();
+
+    size_t usedWhileRecording = 0;
+    ParallelRecorder::Record(PassCount, true, [](UINT) {}, [&]() { usedWhileRecording = arena.UsedSize(); });
+
+    // The task handles were in the caller's arena while the passes ran.
+    CHECK(usedWhileRecording > usedBefore);
+    CHECK_EQUAL(usedBefore, arena.UsedSize());
+}
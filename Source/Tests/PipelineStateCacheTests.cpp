@@ -0,0 +1,233 @@
+//*******************************************************************
+// PipelineStateCacheTests.cpp:
+//
+// Normalization and hashing of pipeline descriptions: fields the
+// pipeline ignores must not change the hash, the ones it uses must,
+// and library names must tell root signatures apart.
+//*******************************************************************
+#include "TestFramework.h"
+#include "PipelineStateCache.h"
+
+namespace
+{
+    // Stand-ins for shader bytecode; only their contents are hashed.
+    const BYTE VertexShader[] = { 'D', 'X', 'B', 'C', 0x01, 0x02, 0x03, 0x04 };
+    const BYTE PixelShader[] = { 'D', 'X', 'B', 'C', 0x05, 0x06, 0x07, 0x08 };
+
+    const D3D12_INPUT_ELEMENT_DESC InputLayout[] =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+    };
+
+    // An opaque pass into one target, as the engine builds them.
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC BaseDesc()
+    {
+        D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = {};
+        desc.VS = { VertexShader, sizeof(VertexShader) };
+        desc.PS = { PixelShader, sizeof(PixelShader) };
+        desc.InputLayout = { InputLayout, _countof(InputLayout) };
+        desc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
+        desc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+        desc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+        desc.SampleMask = UINT_MAX;
+        desc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+        desc.NumRenderTargets = 1;
+        desc.RTVFormats[0] = DXGI_FORMAT_R16G16B16A16_FLOAT;
+        desc.DSVFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
+        desc.SampleDesc = { 1, 0 };
+        return desc;
+    }
+
+    template<typename TChange>
+    bool ChangesHash(TChange change)
+    {
+        D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = BaseDesc();
+        change(desc);
+        return PipelineStateCache::HashDesc(desc) != PipelineStateCache::HashDesc(BaseDesc());
+    }
+}
+
+TEST_CASE(PipelineStateCache_HashIsStable)
+{
+    CHECK_EQUAL(PipelineStateCache::HashDesc(BaseDesc()), PipelineStateCache::HashDesc(BaseDesc()));
+
+    // Shaders and semantic names by content, not by address.
+    std::vector<BYTE> vertexShader(VertexShader, VertexShader + sizeof(VertexShader));
+    std::string position = "POSITION";
+    D3D12_INPUT_ELEMENT_DESC inputLayout[_countof(InputLayout)];
+    memcpy(inputLayout, InputLayout, sizeof(InputLayout));
+    inputLayout[0].SemanticName = position.c_str();
+
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = BaseDesc();
+    desc.VS.pShaderBytecode = vertexShader.data();
+    desc.InputLayout.pInputElementDescs = inputLayout;
+    CHECK_EQUAL(PipelineStateCache::HashDesc(BaseDesc()), PipelineStateCache::HashDesc(desc));
+}
+
+// ------------------------------------------------------------------
+// Fields the pipeline does not use leave the hash as it is.
+// ------------------------------------------------------------------
+TEST_CASE(PipelineStateCache_HashIgnoresUnusedFields)
+{
+    // Factors of disabled blending, and the logic op while it is off.
+    CHECK(!ChangesHash([](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+    {
+        desc.BlendState.RenderTarget[0].SrcBlend = D3D12_BLEND_SRC_ALPHA;
+        desc.BlendState.RenderTarget[0].DestBlend = D3D12_BLEND_INV_SRC_ALPHA;
+        desc.BlendState.RenderTarget[0].LogicOp = D3D12_LOGIC_OP_XOR;
+    }));
+
+    // Blending of other targets without independent blending, and
+    // independent blending with a single target.
+    CHECK(!ChangesHash([](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+    {
+        desc.BlendState.RenderTarget[3].BlendEnable = TRUE;
+        desc.BlendState.RenderTarget[3].RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_RED;
+    }));
+    CHECK(!ChangesHash([](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc) { desc.BlendState.IndependentBlendEnable = TRUE; }));
+
+    // Formats past the render target count.
+    CHECK(!ChangesHash([](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc) { desc.RTVFormats[2] = DXGI_FORMAT_R8G8B8A8_UNORM; }));
+
+    // Stencil state while stencil is off, and a cached blob.
+    CHECK(!ChangesHash([](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+    {
+        desc.DepthStencilState.StencilWriteMask = 0x0f;
+        desc.DepthStencilState.FrontFace.StencilPassOp = D3D12_STENCIL_OP_REPLACE;
+    }));
+    CHECK(!ChangesHash([](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc) { desc.CachedPSO = { VertexShader, sizeof(VertexShader) }; }));
+
+    // Missing shaders however they are missing.
+    CHECK(!ChangesHash([](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc) { desc.GS = { VertexShader, 0 }; }));
+
+    // The root signature only goes into the key and the library name.
+    CHECK(!ChangesHash([](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc) { desc.pRootSignature = reinterpret_cast<ID3D12RootSignature*>(16); }));
+}
+
+// ------------------------------------------------------------------
+// Depth writes and the depth function only count while depth testing is
+// on.
+// ------------------------------------------------------------------
+TEST_CASE(PipelineStateCache_HashOfDisabledDepth)
+{
+    auto disableDepth = [](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+    {
+        desc.DepthStencilState.DepthEnable = FALSE;
+        desc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ALL;
+        desc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL;
+    };
+
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC first = BaseDesc();
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC second = BaseDesc();
+    disableDepth(first);
+    disableDepth(second);
+    second.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO;
+    second.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_ALWAYS;
+    CHECK_EQUAL(PipelineStateCache::HashDesc(first), PipelineStateCache::HashDesc(second));
+
+    CHECK(ChangesHash(disableDepth));
+    CHECK(ChangesHash([](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc) { desc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL; }));
+}
+
+// ------------------------------------------------------------------
+// Every field the pipeline uses tells states apart.
+// ------------------------------------------------------------------
+TEST_CASE(PipelineStateCache_HashDistinguishesStates)
+{
+    CHECK(ChangesHash([](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc) { desc.PS = {}; }));
+    CHECK(ChangesHash([](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc) { desc.PS = { VertexShader, sizeof(VertexShader) }; }));
+    CHECK(ChangesHash([](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc) { desc.VS.BytecodeLength -= 1; }));
+    CHECK(ChangesHash([](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc) { desc.InputLayout.NumElements = 1; }));
+    CHECK(ChangesHash([](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc) { desc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE; }));
+    CHECK(ChangesHash([](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc) { desc.RasterizerState.DepthBias = 100; }));
+    CHECK(ChangesHash([](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc) { desc.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME; }));
+    CHECK(ChangesHash([](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc) { desc.BlendState.RenderTarget[0].RenderTargetWriteMask = 0; }));
+    CHECK(ChangesHash([](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc) { desc.BlendState.AlphaToCoverageEnable = TRUE; }));
+    CHECK(ChangesHash([](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc) { desc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM; }));
+    CHECK(ChangesHash([](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc) { desc.DSVFormat = DXGI_FORMAT_UNKNOWN; }));
+    CHECK(ChangesHash([](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc) { desc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_LINE; }));
+    CHECK(ChangesHash([](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc) { desc.SampleDesc.Count = 4; }));
+
+    // Blend factors once blending is on.
+    auto enableBlend = [](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+    {
+        desc.BlendState.RenderTarget[0].BlendEnable = TRUE;
+        desc.BlendState.RenderTarget[0].SrcBlend = D3D12_BLEND_SRC_ALPHA;
+    };
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC blended = BaseDesc();
+    enableBlend(blended);
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC otherFactor = blended;
+    otherFactor.BlendState.RenderTarget[0].DestBlend = D3D12_BLEND_INV_SRC_ALPHA;
+    CHECK(ChangesHash(enableBlend));
+    CHECK(PipelineStateCache::HashDesc(blended) != PipelineStateCache::HashDesc(otherFactor));
+
+    // A second target's format, and its blending with independent blending.
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC twoTargets = BaseDesc();
+    twoTargets.NumRenderTargets = 2;
+    twoTargets.RTVFormats[1] = DXGI_FORMAT_R8G8B8A8_UNORM;
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC otherFormat = twoTargets;
+    otherFormat.RTVFormats[1] = DXGI_FORMAT_R16G16B16A16_FLOAT;
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC independent = twoTargets;
+    independent.BlendState.IndependentBlendEnable = TRUE;
+    independent.BlendState.RenderTarget[1].RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_RED;
+    CHECK(PipelineStateCache::HashDesc(twoTargets) != PipelineStateCache::HashDesc(BaseDesc()));
+    CHECK(PipelineStateCache::HashDesc(twoTargets) != PipelineStateCache::HashDesc(otherFormat));
+    CHECK(PipelineStateCache::HashDesc(twoTargets) != PipelineStateCache::HashDesc(independent));
+}
+
+TEST_CASE(PipelineStateCache_Normalize)
+{
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = BaseDesc();
+    desc.GS = { VertexShader, 0 };
+    desc.CachedPSO = { VertexShader, sizeof(VertexShader) };
+    desc.RTVFormats[5] = DXGI_FORMAT_R8G8B8A8_UNORM;
+    desc.BlendState.IndependentBlendEnable = TRUE;
+    desc.BlendState.RenderTarget[0].SrcBlend = D3D12_BLEND_SRC_ALPHA;
+    desc.BlendState.RenderTarget[0].RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_RED;
+    desc.BlendState.RenderTarget[4].BlendEnable = TRUE;
+    desc.DepthStencilState.DepthEnable = FALSE;
+    desc.DepthStencilState.StencilReadMask = 0x0f;
+    PipelineStateCache::Normalize(desc);
+
+    const D3D12_RENDER_TARGET_BLEND_DESC defaultBlend = CD3DX12_BLEND_DESC(D3D12_DEFAULT).RenderTarget[0];
+    CHECK(desc.GS.pShaderBytecode == nullptr);
+    CHECK(desc.CachedPSO.pCachedBlob == nullptr && desc.CachedPSO.CachedBlobSizeInBytes == 0);
+    CHECK(desc.RTVFormats[5] == DXGI_FORMAT_UNKNOWN);
+    CHECK(desc.RTVFormats[0] == DXGI_FORMAT_R16G16B16A16_FLOAT);
+    CHECK(!desc.BlendState.IndependentBlendEnable);
+    CHECK(desc.BlendState.RenderTarget[0].SrcBlend == defaultBlend.SrcBlend);
+    CHECK_EQUAL((UINT)D3D12_COLOR_WRITE_ENABLE_RED, (UINT)desc.BlendState.RenderTarget[0].RenderTargetWriteMask);
+    CHECK(!desc.BlendState.RenderTarget[4].BlendEnable);
+    CHECK(desc.DepthStencilState.DepthWriteMask == D3D12_DEPTH_WRITE_MASK_ZERO);
+    CHECK_EQUAL((UINT)0xff, (UINT)desc.DepthStencilState.StencilReadMask);
+
+    // Normalizing twice changes nothing more.
+    UINT64 hash = PipelineStateCache::HashDesc(desc);
+    PipelineStateCache::Normalize(desc);
+    CHECK_EQUAL(hash, PipelineStateCache::HashDesc(desc));
+}
+
+// ------------------------------------------------------------------
+// Library names combine the description with the serialized root
+// signature, so pipelines of different root signatures never share one.
+// ------------------------------------------------------------------
+TEST_CASE(PipelineStateCache_LibraryNames)
+{
+    const BYTE rootSignature[] = { 0x10, 0x20, 0x30, 0x40 };
+    const BYTE otherRootSignature[] = { 0x10, 0x20, 0x30, 0x41 };
+    std::vector<BYTE> copy(rootSignature, rootSignature + sizeof(rootSignature));
+
+    UINT64 rootHash = PipelineStateCache::HashRootSignature(rootSignature, sizeof(rootSignature));
+    CHECK_EQUAL(rootHash, PipelineStateCache::HashRootSignature(copy.data(), copy.size()));
+    CHECK(rootHash != PipelineStateCache::HashRootSignature(otherRootSignature, sizeof(otherRootSignature)));
+    CHECK(rootHash != PipelineStateCache::HashRootSignature(rootSignature, sizeof(rootSignature) - 1));
+
+    UINT64 descHash = PipelineStateCache::HashDesc(BaseDesc());
+    std::wstring name = PipelineStateCache::MakeName(descHash, rootHash);
+    CHECK(name == PipelineStateCache::MakeName(descHash, PipelineStateCache::HashRootSignature(copy.data(), copy.size())));
+    CHECK(name != PipelineStateCache::MakeName(descHash, PipelineStateCache::HashRootSignature(otherRootSignature, sizeof(otherRootSignature))));
+    CHECK(name != PipelineStateCache::MakeName(descHash + 1, rootHash));
+
+    CHECK(PipelineStateCache::MakeName(0x1234, 0xabcdef) == L"0000000000001234-0000000000abcdef");
+}
@@ -0,0 +1,319 @@
+//*******************************************************************
+// RenderGraphTests.cpp:
+//
+// Compiles small hand-built graphs and checks what Compile works out
+// from the declarations alone: the barriers before every pass and at
+// the end of the frame, which passes are culled, and where the
+// transients go in the heap.
+//*******************************************************************
+#include "TestFramework.h"
+#include "RenderPasses/RenderGraph.h"
+
+namespace
+{
+    const UINT64 PageSize = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+
+    // Only the placement requirements matter to Compile.
+    RenderGraph::TextureDesc Texture(UINT64 pages, UINT64 alignment = PageSize)
+    {
+        RenderGraph::TextureDesc desc;
+        desc.Size = pages * PageSize;
+        desc.Alignment = alignment;
+        return desc;
+    }
+
+    bool IsTransition(const RenderGraph::Barrier& barrier, RenderGraph::ResourceHandle resource,
+        D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after)
+    {
+        return !barrier.Aliasing && barrier.Resource == resource && barrier.Before == before && barrier.After == after;
+    }
+
+    bool IsAliasing(const RenderGraph::Barrier& barrier, RenderGraph::ResourceHandle resource)
+    {
+        return barrier.Aliasing && barrier.Resource == resource;
+    }
+
+    bool Overlaps(const RenderGraph& graph, RenderGraph::ResourceHandle a, UINT64 sizeA, RenderGraph::ResourceHandle b, UINT64 sizeB)
+    {
+        UINT64 offsetA = graph.GetHeapOffset(a);
+        UINT64 offsetB = graph.GetHeapOffset(b);
+        return offsetA < offsetB + sizeB && offsetB < offsetA + sizeA;
+    }
+}
+
+TEST_CASE(RenderGraph_Barriers)
+{
+    // The shape of the frame Game builds: a shadow map rendered and then
+    // sampled, the back buffer presented at the end.
+    RenderGraph graph;
+    auto backBuffer = graph.ImportResource("BackBuffer", D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_PRESENT);
+    auto depthBuffer = graph.ImportResource("DepthBuffer", D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+    auto shadowMap = graph.CreateTexture("ShadowMap", Texture(4));
+
+    auto shadow = graph.AddPass("Shadow");
+    graph.Write(shadow, shadowMap, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+
+    auto opaque = graph.AddPass("Opaque");
+    graph.Read(opaque, shadowMap, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    graph.Write(opaque, backBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    graph.Write(opaque, depthBuffer, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+
+    // Two reads of one resource in a pass combine into one state.
+    auto compute = graph.AddPass("Compute");
+    graph.Read(compute, shadowMap, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    graph.Read(compute, shadowMap, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    graph.Write(compute, backBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+    auto gui = graph.AddPass("GUI");
+    graph.Write(gui, backBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+    graph.Compile();
+
+    CHECK_EQUAL(4u, graph.LivePassCount());
+
+    // A transient starts the frame in the state the frame leaves it in.
+    const D3D12_RESOURCE_STATES bothShaders = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+    const auto& shadowBarriers = graph.GetPassBarriers(shadow);
+    CHECK_EQUAL((size_t)1, shadowBarriers.size());
+    CHECK(IsTransition(shadowBarriers[0], shadowMap, bothShaders, D3D12_RESOURCE_STATE_DEPTH_WRITE));
+
+    // The depth buffer is already in the state the pass wants.
+    const auto& opaqueBarriers = graph.GetPassBarriers(opaque);
+    CHECK_EQUAL((size_t)2, opaqueBarriers.size());
+    CHECK(IsTransition(opaqueBarriers[0], shadowMap, D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+    CHECK(IsTransition(opaqueBarriers[1], backBuffer, D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
+
+    const auto& computeBarriers = graph.GetPassBarriers(compute);
+    CHECK_EQUAL((size_t)2, computeBarriers.size());
+    CHECK(IsTransition(computeBarriers[0], shadowMap, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, bothShaders));
+    CHECK(IsTransition(computeBarriers[1], backBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+
+    const auto& guiBarriers = graph.GetPassBarriers(gui);
+    CHECK_EQUAL((size_t)1, guiBarriers.size());
+    CHECK(IsTransition(guiBarriers[0], backBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_RENDER_TARGET));
+
+    // Only the imported resources are returned to a final state.
+    const auto& finalBarriers = graph.GetFinalBarriers();
+    CHECK_EQUAL((size_t)1, finalBarriers.size());
+    CHECK(IsTransition(finalBarriers[0], backBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
+
+    CHECK_EQUAL(7u, graph.BarrierCount());
+
+    // A single transient has the heap to itself.
+    CHECK_EQUAL(4 * PageSize, graph.HeapSize());
+    CHECK_EQUAL(4 * PageSize, graph.TransientSize());
+
+    // Compiling again starts over rather than adding to the last result.
+    graph.Compile();
+    CHECK_EQUAL(4u, graph.LivePassCount());
+    CHECK_EQUAL(7u, graph.BarrierCount());
+    CHECK_EQUAL((size_t)2, graph.GetPassBarriers(opaque).size());
+}
+
+TEST_CASE(RenderGraph_Culling)
+{
+    RenderGraph graph;
+    auto backBuffer = graph.ImportResource("BackBuffer", D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_PRESENT);
+    auto debugTarget = graph.CreateTexture("Debug", Texture(1));
+    auto colorTarget = graph.CreateTexture("Color", Texture(2));
+    auto deadTarget = graph.CreateTexture("Dead", Texture(8));
+    auto deadResult = graph.CreateTexture("DeadResult", Texture(8));
+
+    // Nothing reads what it writes.
+    auto unused = graph.AddPass("Unused");
+    graph.Write(unused, debugTarget, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+    // Live because the pass after it reads its output.
+    auto producer = graph.AddPass("Producer");
+    graph.Write(producer, colorTarget, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+    // Live because it writes to an imported resource.
+    auto consumer = graph.AddPass("Consumer");
+    graph.Read(consumer, colorTarget, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    graph.Write(consumer, backBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+    // Live for its side effects. It writes what Unused writes, which does
+    // not make Unused live, since only reads consume a resource.
+    auto debug = graph.AddPass("Debug", true);
+    graph.Write(debug, debugTarget, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+    // A chain whose end result nothing uses is culled as a whole.
+    auto deadFirst = graph.AddPass("DeadFirst");
+    graph.Write(deadFirst, deadTarget, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    auto deadSecond = graph.AddPass("DeadSecond");
+    graph.Read(deadSecond, deadTarget, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    graph.Write(deadSecond, deadResult, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+    graph.Compile();
+
+    CHECK(graph.IsPassCulled(unused));
+    CHECK(!graph.IsPassCulled(producer));
+    CHECK(!graph.IsPassCulled(consumer));
+    CHECK(!graph.IsPassCulled(debug));
+    CHECK(graph.IsPassCulled(deadFirst));
+    CHECK(graph.IsPassCulled(deadSecond));
+    CHECK_EQUAL(6u, graph.PassCount());
+    CHECK_EQUAL(3u, graph.LivePassCount());
+
+    // Culled passes record nothing, and their accesses do not count
+    // towards the states of the live ones.
+    CHECK(graph.GetPassBarriers(unused).empty());
+    CHECK(graph.GetPassBarriers(deadFirst).empty());
+    CHECK(graph.GetPassBarriers(deadSecond).empty());
+
+    // Debug's target was last left a render target by Debug itself, so it
+    // only has to be made the active resource in the memory it shares
+    // with the color target.
+    const auto& debugBarriers = graph.GetPassBarriers(debug);
+    CHECK_EQUAL((size_t)1, debugBarriers.size());
+    CHECK(IsAliasing(debugBarriers[0], debugTarget));
+
+    // Transients only the culled passes touch take no memory.
+    CHECK_EQUAL(3 * PageSize, graph.TransientSize());
+    CHECK_EQUAL(2 * PageSize, graph.HeapSize());
+}
+
+TEST_CASE(RenderGraph_Aliasing)
+{
+    // A chain of passes each reading the last one's output, so every
+    // transient only lives across two passes.
+    RenderGraph graph;
+    auto backBuffer = graph.ImportResource("BackBuffer", D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_PRESENT);
+    auto a = graph.CreateTexture("A", Texture(4));
+    auto b = graph.CreateTexture("B", Texture(2));
+    auto c = graph.CreateTexture("C", Texture(4));
+
+    auto first = graph.AddPass("First");
+    graph.Write(first, a, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+    auto second = graph.AddPass("Second");
+    graph.Read(second, a, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    graph.Write(second, b, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+    auto third = graph.AddPass("Third");
+    graph.Read(third, b, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    graph.Write(third, c, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+    auto fourth = graph.AddPass("Fourth");
+    graph.Read(fourth, c, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    graph.Write(fourth, backBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+    graph.Compile();
+
+    // A and C are never alive at once and share memory. B overlaps both
+    // and gets memory of its own.
+    CHECK(Overlaps(graph, a, 4 * PageSize, c, 4 * PageSize));
+    CHECK(!Overlaps(graph, a, 4 * PageSize, b, 2 * PageSize));
+    CHECK(!Overlaps(graph, b, 2 * PageSize, c, 4 * PageSize));
+
+    // The heap only needs room for the two transients alive at a time.
+    CHECK_EQUAL(10 * PageSize, graph.TransientSize());
+    CHECK_EQUAL(6 * PageSize, graph.HeapSize());
+
+    // The transients sharing memory are made active before their first
+    // use, ahead of the transition into the state the pass wants.
+    const auto& firstBarriers = graph.GetPassBarriers(first);
+    CHECK_EQUAL((size_t)2, firstBarriers.size());
+    CHECK(IsAliasing(firstBarriers[0], a));
+    CHECK(IsTransition(firstBarriers[1], a, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET));
+
+    const auto& thirdBarriers = graph.GetPassBarriers(third);
+    CHECK_EQUAL((size_t)3, thirdBarriers.size());
+    CHECK(IsTransition(thirdBarriers[0], b, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+    CHECK(IsAliasing(thirdBarriers[1], c));
+    CHECK(IsTransition(thirdBarriers[2], c, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET));
+
+    // B has its memory to itself and needs no aliasing barrier.
+    for (const RenderGraph::Barrier& barrier : graph.GetPassBarriers(second))
+        CHECK(!IsAliasing(barrier, b));
+}
+
+TEST_CASE(RenderGraph_PeakMemory)
+{
+    // Transients of mixed sizes with staggered lifetimes. Whatever the
+    // order they are placed in, no two alive at once may overlap, and the
+    // heap must not need more than the most memory alive at any pass.
+    RenderGraph graph;
+    auto backBuffer = graph.ImportResource("BackBuffer", D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_PRESENT);
+
+    const UINT count = 6;
+    const UINT64 pages[count] = { 1, 8, 3, 5, 2, 4 };
+    RenderGraph::ResourceHandle textures[count];
+    for (UINT i = 0; i < count; ++i)
+        textures[i] = graph.CreateTexture("T" + std::to_string(i), Texture(pages[i]));
+
+    // Pass i writes texture i and reads the two before it, so texture i
+    // lives through passes i to i + 2.
+    for (UINT i = 0; i < count; ++i)
+    {
+        auto pass = graph.AddPass("P" + std::to_string(i));
+        if (i >= 2)
+            graph.Read(pass, textures[i - 2], D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+        if (i >= 1)
+            graph.Read(pass, textures[i - 1], D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+        graph.Write(pass, textures[i], D3D12_RESOURCE_STATE_RENDER_TARGET);
+    }
+    auto present = graph.AddPass("Present");
+    graph.Read(present, textures[count - 2], D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    graph.Read(present, textures[count - 1], D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    graph.Write(present, backBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+    graph.Compile();
+    CHECK_EQUAL(count + 1, graph.LivePassCount());
+
+    UINT64 peak = 0;
+    UINT64 total = 0;
+    for (UINT pass = 0; pass <= count; ++pass)
+    {
+        UINT64 alive = 0;
+        for (UINT i = 0; i < count; ++i)
+        {
+            if (i <= pass && pass <= i + 2)
+                alive += pages[i] * PageSize;
+        }
+        peak = std::max(peak, alive);
+    }
+    for (UINT i = 0; i < count; ++i)
+        total += pages[i] * PageSize;
+
+    CHECK_EQUAL(total, graph.TransientSize());
+    CHECK(graph.HeapSize() >= peak);
+    CHECK(graph.HeapSize() < total);
+
+    for (UINT i = 0; i < count; ++i)
+    {
+        CHECK_EQUAL((UINT64)0, graph.GetHeapOffset(textures[i]) % PageSize);
+        CHECK(graph.GetHeapOffset(textures[i]) + pages[i] * PageSize <= graph.HeapSize());
+
+        for (UINT j = i + 1; j <= i + 2 && j < count; ++j)
+            CHECK(!Overlaps(graph, textures[i], pages[i] * PageSize, textures[j], pages[j] * PageSize));
+    }
+}
+
+TEST_CASE(RenderGraph_HeapAlignment)
+{
+    // A multisampled target needs its heap, and its place in it, aligned
+    // to 4MB, however small it is.
+    const UINT64 msaaAlignment = D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT;
+
+    RenderGraph graph;
+    auto backBuffer = graph.ImportResource("BackBuffer", D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_PRESENT);
+    auto small = graph.CreateTexture("Small", Texture(3));
+    auto msaa = graph.CreateTexture("Msaa", Texture(2, msaaAlignment));
+
+    auto pass = graph.AddPass("Resolve");
+    graph.Write(pass, small, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    graph.Write(pass, msaa, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    graph.Write(pass, backBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+    auto present = graph.AddPass("Present");
+    graph.Read(present, small, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    graph.Read(present, msaa, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    graph.Write(present, backBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+    graph.Compile();
+
+    CHECK_EQUAL((UINT64)0, graph.GetHeapOffset(msaa) % msaaAlignment);
+    CHECK_EQUAL((UINT64)0, graph.HeapSize() % msaaAlignment);
+    CHECK(!Overlaps(graph, small, 3 * PageSize, msaa, 2 * PageSize));
+}
@@ -0,0 +1,305 @@
+//*******************************************************************
+// RenderQueueTests.cpp:
+//
+// The sort keys of the render queue and their radix sort: the sort
+// against std::stable_sort, including keys that share whole bytes, the
+// order of the fields in the key, and the depth order of opaque and
+// blended layers. Then the batches merging render items that draw the
+// same submesh.
+//*******************************************************************
+#include "TestFramework.h"
+#include "RenderQueue.h"
+
+namespace
+{
+    // The layers of Game's RenderLayer the tests use.
+    const UINT OpaqueLayer = 0;
+    const UINT TransparentLayer = 2;
+
+    // xorshift64. The same sequence on every run.
+    struct Random
+    {
+        UINT64 State = 0x9E3779B97F4A7C15ull;
+
+        UINT64 Next()
+        {
+            State ^= State << 13;
+            State ^= State >> 7;
+            State ^= State << 17;
+            return State;
+        }
+    };
+
+    // Entries with the given keys, each pointing at a distinct fake item
+    // so the order of equal keys can be checked.
+    std::vector<RenderQueue::Entry> MakeEntries(const std::vector<UINT64>& keys)
+    {
+        std::vector<RenderQueue::Entry> entries(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i)
+            entries[i] = { keys[i], reinterpret_cast<RenderItem*>(i + 1) };
+        return entries;
+    }
+
+    // Whether the radix sort gives what a stable comparison sort gives.
+    bool SortsLikeStableSort(const std::vector<UINT64>& keys)
+    {
+        std::vector<RenderQueue::Entry> radix = MakeEntries(keys);
+        std::vector<RenderQueue::Entry> scratch;
+        RenderQueue::RadixSort(radix, scratch);
+
+        std::vector<RenderQueue::Entry> reference = MakeEntries(keys);
+        std::stable_sort(reference.begin(), reference.end(),
+            [](const RenderQueue::Entry& a, const RenderQueue::Entry& b) { return a.Key < b.Key; });
+
+        return std::equal(radix.begin(), radix.end(), reference.begin(),
+            [](const RenderQueue::Entry& a, const RenderQueue::Entry& b) { return a.Key == b.Key && a.Item == b.Item; });
+    }
+
+    UINT MaxField(UINT bits)
+    {
+        return (1u << bits) - 1;
+    }
+}
+
+TEST_CASE(RenderQueue_RadixSortMatchesStableSort)
+{
+    Random random;
+
+    // Keys differing in every byte.
+    std::vector<UINT64> keys(5000);
+    for (UINT64& key : keys)
+        key = random.Next();
+    CHECK(SortsLikeStableSort(keys));
+
+    // The top five bytes are shared, so their passes are skipped, and the
+    // low bytes have many duplicates.
+    for (UINT64& key : keys)
+        key = 0xA5C3F00D42000000ull | (random.Next() & 0x3F3F3F);
+    CHECK(SortsLikeStableSort(keys));
+
+    // Shared bytes between the ones that differ, which leaves an odd number
+    // of passes to run.
+    for (UINT64& key : keys)
+        key = (random.Next() & 0xFF0000FF000000FFull) | 0x0012340056789A00ull;
+    CHECK(SortsLikeStableSort(keys));
+
+    // All keys the same: every pass is skipped and nothing moves.
+    std::fill(keys.begin(), keys.end(), 0x0123456789ABCDEFull);
+    CHECK(SortsLikeStableSort(keys));
+
+    // Keys made by MakeKey, as the queue is fed.
+    for (UINT64& key : keys)
+    {
+        UINT64 r = random.Next();
+        key = RenderQueue::MakeKey((UINT)(r % 5), (UINT)(r >> 8) % 4, (UINT)(r >> 16) % 32, (UINT)(r >> 24) % 16,
+            (float)(r >> 40) * 0.001f, r & 1 ? RenderQueue::DepthOrder::BackToFront : RenderQueue::DepthOrder::FrontToBack);
+    }
+    CHECK(SortsLikeStableSort(keys));
+
+    // Too short to sort.
+    CHECK(SortsLikeStableSort({}));
+    CHECK(SortsLikeStableSort({ 42 }));
+}
+
+TEST_CASE(RenderQueue_KeyFieldOrder)
+{
+    using DepthOrder = RenderQueue::DepthOrder;
+    const float Far = 1.0e30f;
+
+    // Each field outweighs every field below it at its largest value.
+    CHECK(RenderQueue::MakeKey(1, 0, 0, 0, 0.0f, DepthOrder::FrontToBack) >
+        RenderQueue::MakeKey(0, MaxField(RenderQueue::PSOBits), MaxField(RenderQueue::GeometryBits), MaxField(RenderQueue::MaterialBits), Far, DepthOrder::FrontToBack));
+    CHECK(RenderQueue::MakeKey(0, 1, 0, 0, 0.0f, DepthOrder::FrontToBack) >
+        RenderQueue::MakeKey(0, 0, MaxField(RenderQueue::GeometryBits), MaxField(RenderQueue::MaterialBits), Far, DepthOrder::FrontToBack));
+    CHECK(RenderQueue::MakeKey(0, 0, 1, 0, 0.0f, DepthOrder::FrontToBack) >
+        RenderQueue::MakeKey(0, 0, 0, MaxField(RenderQueue::MaterialBits), Far, DepthOrder::FrontToBack));
+    CHECK(RenderQueue::MakeKey(0, 0, 0, 1, 0.0f, DepthOrder::FrontToBack) >
+        RenderQueue::MakeKey(0, 0, 0, 0, Far, DepthOrder::FrontToBack));
+    CHECK(RenderQueue::MakeKey(0, 0, 0, 0, 2.0f, DepthOrder::FrontToBack) >
+        RenderQueue::MakeKey(0, 0, 0, 0, 1.0f, DepthOrder::FrontToBack));
+
+    // Back to front, the depth comes right after the layer, inverted.
+    CHECK(RenderQueue::MakeKey(1, 0, 0, 0, Far, DepthOrder::BackToFront) >
+        RenderQueue::MakeKey(0, MaxField(RenderQueue::PSOBits), 0, 0, 0.0f, DepthOrder::BackToFront));
+    CHECK(RenderQueue::MakeKey(0, MaxField(RenderQueue::PSOBits), MaxField(RenderQueue::GeometryBits), MaxField(RenderQueue::MaterialBits), 2.0f, DepthOrder::BackToFront) <
+        RenderQueue::MakeKey(0, 0, 0, 0, 1.0f, DepthOrder::BackToFront));
+    CHECK(RenderQueue::MakeKey(0, 1, 0, 0, 1.0f, DepthOrder::BackToFront) >
+        RenderQueue::MakeKey(0, 0, MaxField(RenderQueue::GeometryBits), MaxField(RenderQueue::MaterialBits), 1.0f, DepthOrder::BackToFront));
+
+    // The layer sits in the top bits either way, and wider fields are cut.
+    CHECK_EQUAL(TransparentLayer, RenderQueue::LayerOf(RenderQueue::MakeKey(TransparentLayer, 7, 9, 3, 4.0f, DepthOrder::BackToFront)));
+    CHECK_EQUAL(OpaqueLayer, RenderQueue::LayerOf(RenderQueue::MakeKey(OpaqueLayer, 7, 9, 3, 4.0f, DepthOrder::FrontToBack)));
+    CHECK_EQUAL(RenderQueue::MakeKey(0, 1, 0, 0, 0.0f, DepthOrder::FrontToBack),
+        RenderQueue::MakeKey(0, 1 + (1u << RenderQueue::PSOBits), 0, 0, 0.0f, DepthOrder::FrontToBack));
+
+    // Depth codes keep the order of the depths, and negative depths and
+    // NaN count as 0.
+    CHECK(RenderQueue::QuantizeDepth(0.5f) < RenderQueue::QuantizeDepth(0.51f));
+    CHECK(RenderQueue::QuantizeDepth(100.0f) < RenderQueue::QuantizeDepth(1000.0f));
+    CHECK_EQUAL(0u, RenderQueue::QuantizeDepth(-3.0f));
+    CHECK_EQUAL(0u, RenderQueue::QuantizeDepth(std::numeric_limits<float>::quiet_NaN()));
+}
+
+TEST_CASE(RenderQueue_DepthOrderPerLayer)
+{
+    // Opaque items of one state at known view depths, and transparent ones
+    // of different states.
+    const float opaqueDepths[] = { 5.0f, 1.0f, 10.0f, 3.0f };
+    const float transparentDepths[] = { 2.0f, 40.0f, 7.5f, 0.25f };
+
+    RenderItem opaque[_countof(opaqueDepths)];
+    RenderItem transparent[_countof(transparentDepths)];
+
+    RenderQueue queue;
+    for (UINT i = 0; i < _countof(opaqueDepths); ++i)
+        queue.Push(RenderQueue::MakeKey(OpaqueLayer, 0, 3, 1, opaqueDepths[i], RenderQueue::DepthOrder::FrontToBack), &opaque[i]);
+    for (UINT i = 0; i < _countof(transparentDepths); ++i)
+        queue.Push(RenderQueue::MakeKey(TransparentLayer, i, 4 - i, i % 2, transparentDepths[i], RenderQueue::DepthOrder::BackToFront), &transparent[i]);
+    queue.Sort(false);
+
+    // Nearest first.
+    auto opaqueItems = queue.GetLayer(OpaqueLayer);
+    CHECK_EQUAL(4u, opaqueItems.size());
+    CHECK(opaqueItems[0] == &opaque[1]);
+    CHECK(opaqueItems[1] == &opaque[3]);
+    CHECK(opaqueItems[2] == &opaque[0]);
+    CHECK(opaqueItems[3] == &opaque[2]);
+
+    // Farthest first, whatever their state.
+    auto transparentItems = queue.GetLayer(TransparentLayer);
+    CHECK_EQUAL(4u, transparentItems.size());
+    CHECK(transparentItems[0] == &transparent[1]);
+    CHECK(transparentItems[1] == &transparent[2]);
+    CHECK(transparentItems[2] == &transparent[0]);
+    CHECK(transparentItems[3] == &transparent[3]);
+
+    // The layers follow each other in the full list, and the unused ones
+    // are empty.
+    CHECK_EQUAL(8u, queue.GetItems().size());
+    CHECK(queue.GetItems()[0] == &opaque[1]);
+    CHECK(queue.GetItems()[4] == &transparent[1]);
+    CHECK(queue.GetLayer(1).empty());
+
+    // Opaque draws group by state before depth: a far draw with a lower
+    // pipeline state still comes first.
+    RenderItem nearItem, farItem;
+    queue.Clear();
+    queue.Push(RenderQueue::MakeKey(OpaqueLayer, 1, 0, 0, 1.0f, RenderQueue::DepthOrder::FrontToBack), &nearItem);
+    queue.Push(RenderQueue::MakeKey(OpaqueLayer, 0, 0, 0, 500.0f, RenderQueue::DepthOrder::FrontToBack), &farItem);
+    queue.Sort(false);
+    CHECK(queue.GetItems()[0] == &farItem);
+    CHECK(queue.GetItems()[1] == &nearItem);
+}
+
+TEST_CASE(RenderQueue_MergesItemsDrawingTheSameSubmesh)
+{
+    const UINT AlphaTestedLayer = 3;
+
+    MeshGeometry geoA, geoB;
+    auto setup = [](RenderItem& ri, MeshGeometry* geo, UINT startIndex, D3D12_PRIMITIVE_TOPOLOGY topology, UINT layer, UINT instanceCount)
+    {
+        ri.Geo = geo;
+        ri.IndexCount = 36;
+        ri.StartIndexLocation = startIndex;
+        ri.BaseVertexLocation = 0;
+        ri.PrimitiveType = topology;
+        ri.layerID = (int)layer;
+        ri.InstanceCount = instanceCount;
+    };
+    const D3D12_PRIMITIVE_TOPOLOGY Triangles = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+
+    // Four items drawing the same submesh with the same pipeline, with
+    // different materials and depths, and items that each differ from them
+    // in one way. Geometry IDs are chosen so the differing items sort right
+    // next to the shared ones.
+    RenderItem shared[4], otherGeometry, otherSubmesh, otherTopology, otherPSO[2], otherLayer, withLODs[2];
+    const UINT sharedInstances[] = { 3, 5, 2, 4 };
+    for (UINT i = 0; i < 4; ++i)
+        setup(shared[i], &geoA, 0, Triangles, OpaqueLayer, sharedInstances[i]);
+    setup(otherGeometry, &geoB, 0, Triangles, OpaqueLayer, 1);
+    setup(otherSubmesh, &geoA, 36, Triangles, OpaqueLayer, 2);
+    setup(otherTopology, &geoA, 0, D3D_PRIMITIVE_TOPOLOGY_LINELIST, OpaqueLayer, 6);
+    setup(otherPSO[0], &geoA, 0, Triangles, OpaqueLayer, 7);
+    setup(otherPSO[1], &geoA, 0, Triangles, OpaqueLayer, 1);
+    setup(otherLayer, &geoA, 0, Triangles, AlphaTestedLayer, 9);
+    for (RenderItem& ri : withLODs)
+    {
+        setup(ri, &geoA, 0, Triangles, OpaqueLayer, 4);
+        ri.LODs.resize(2);
+    }
+
+    using DepthOrder = RenderQueue::DepthOrder;
+    RenderQueue queue;
+    for (UINT i = 0; i < 4; ++i)
+        queue.Push(RenderQueue::MakeKey(OpaqueLayer, 0, 5, i / 2, 1.0f + i, DepthOrder::FrontToBack), &shared[i]);
+    queue.Push(RenderQueue::MakeKey(OpaqueLayer, 0, 2, 0, 1.0f, DepthOrder::FrontToBack), &otherGeometry);
+    queue.Push(RenderQueue::MakeKey(OpaqueLayer, 0, 3, 0, 1.0f, DepthOrder::FrontToBack), &otherSubmesh);
+    queue.Push(RenderQueue::MakeKey(OpaqueLayer, 0, 4, 0, 1.0f, DepthOrder::FrontToBack), &otherTopology);
+    queue.Push(RenderQueue::MakeKey(OpaqueLayer, 1, 5, 0, 1.0f, DepthOrder::FrontToBack), &otherPSO[0]);
+    queue.Push(RenderQueue::MakeKey(OpaqueLayer, 1, 5, 0, 2.0f, DepthOrder::FrontToBack), &otherPSO[1]);
+    queue.Push(RenderQueue::MakeKey(AlphaTestedLayer, 0, 5, 0, 1.0f, DepthOrder::FrontToBack), &otherLayer);
+    queue.Push(RenderQueue::MakeKey(OpaqueLayer, 2, 5, 0, 1.0f, DepthOrder::FrontToBack), &withLODs[0]);
+    queue.Push(RenderQueue::MakeKey(OpaqueLayer, 2, 5, 0, 2.0f, DepthOrder::FrontToBack), &withLODs[1]);
+
+    // Merging compares the pipeline states in the keys, in either layout.
+    CHECK_EQUAL(7u, RenderQueue::PSOOf(RenderQueue::MakeKey(TransparentLayer, 7, 9, 3, 4.0f, DepthOrder::BackToFront)));
+    CHECK_EQUAL(7u, RenderQueue::PSOOf(RenderQueue::MakeKey(OpaqueLayer, 7, 9, 3, 4.0f, DepthOrder::FrontToBack)));
+
+    // Without merging every item is a draw of its own.
+    queue.Sort(false);
+    CHECK_EQUAL(queue.Size(), queue.GetBatches().size());
+
+    queue.Sort(true);
+    auto items = queue.GetItems();
+    auto batches = queue.GetBatches();
+
+    // 13 items, 8 draws: the shared ones are one, and so are the two that
+    // only share a pipeline among themselves.
+    CHECK_EQUAL(13u, items.size());
+    CHECK_EQUAL(8u, batches.size());
+    CHECK_EQUAL(7u, queue.GetBatches(OpaqueLayer).size());
+    CHECK_EQUAL(1u, queue.GetBatches(AlphaTestedLayer).size());
+
+    // The batches cover the sorted items one after the other.
+    UINT nextItem = 0;
+    for (const RenderQueue::Batch& batch : batches)
+    {
+        CHECK_EQUAL(nextItem, batch.FirstItem);
+        nextItem += batch.ItemCount;
+    }
+    CHECK_EQUAL(items.size(), nextItem);
+
+    const UINT mergedInstances = queue.AssignInstances([](const RenderItem& ri) { return ri.InstanceCount; });
+
+    // Layer 0 in key order: other geometry, other submesh, other topology,
+    // the shared items, the other pipeline, the two with LODs.
+    const RenderQueue::Batch& sharedBatch = batches[3];
+    CHECK_EQUAL(4u, sharedBatch.ItemCount);
+    CHECK_EQUAL(14u, sharedBatch.InstanceCount);
+    CHECK_EQUAL(0u, sharedBatch.InstanceOffset);
+    bool allShared = true;
+    for (UINT i = 0; i < sharedBatch.ItemCount; ++i)
+        allShared = allShared && std::find(std::begin(shared), std::end(shared), items[sharedBatch.FirstItem + i]) != std::end(shared);
+    CHECK(allShared);
+
+    const RenderQueue::Batch& psoBatch = batches[4];
+    CHECK_EQUAL(2u, psoBatch.ItemCount);
+    CHECK(items[psoBatch.FirstItem] == &otherPSO[0]);
+    CHECK_EQUAL(8u, psoBatch.InstanceCount);
+    CHECK_EQUAL(14u, psoBatch.InstanceOffset);
+
+    // Merged batches are laid out back to back; items drawn on their own
+    // keep their own lists.
+    CHECK_EQUAL(22u, mergedInstances);
+    CHECK(items[batches[0].FirstItem] == &otherGeometry);
+    CHECK(items[batches[1].FirstItem] == &otherSubmesh);
+    CHECK(items[batches[2].FirstItem] == &otherTopology);
+    CHECK(items[batches[5].FirstItem] == &withLODs[0]);
+    CHECK(items[batches[6].FirstItem] == &withLODs[1]);
+    CHECK(items[batches[7].FirstItem] == &otherLayer);
+    for (UINT b : { 0u, 1u, 2u, 5u, 6u, 7u })
+    {
+        CHECK_EQUAL(1u, batches[b].ItemCount);
+        CHECK_EQUAL(items[batches[b].FirstItem]->InstanceCount, batches[b].InstanceCount);
+    }
+}
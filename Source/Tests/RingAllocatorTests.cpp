@@ -0,0 +1,95 @@
+//*******************************************************************
+// RingAllocatorTests.cpp:
+//
+// The ring allocator at its edges: a frame filling the ring, and
+// allocations wrapping around the end or blocked by a frame still in
+// flight.
+//*******************************************************************
+#include "TestFramework.h"
+#include "Memory/RingAllocator.h"
+
+namespace
+{
+    const UINT64 RingSize = 64 * 1024;
+    const UINT64 Invalid = RingAllocator::InvalidOffset;
+}
+
+// ------------------------------------------------------------------
+// A frame can fill the ring but no more, and gets the space back only
+// once its fence completes.
+// ------------------------------------------------------------------
+TEST_CASE(RingAllocator_Overflow)
+{
+    RingAllocator ring(RingSize);
+    for (UINT64 i = 0; i < 16; ++i)
+        CHECK_EQUAL(i * (RingSize / 16), ring.Allocate(RingSize / 16, 256));
+    CHECK_EQUAL(RingSize, ring.UsedSize());
+    CHECK_EQUAL(Invalid, ring.Allocate(1, 1));
+
+    ring.EndFrame(1);
+    ring.Reclaim(0);
+    CHECK_EQUAL(Invalid, ring.Allocate(1, 1));
+
+    ring.Reclaim(1);
+    CHECK_EQUAL(0ull, ring.UsedSize());
+    CHECK_EQUAL(0u, ring.FramesInFlight());
+}
+
+// ------------------------------------------------------------------
+// What does not fit before the end goes to the front, as far as the
+// oldest frame in flight allows.
+// ------------------------------------------------------------------
+TEST_CASE(RingAllocator_WrapAround)
+{
+    RingAllocator ring(RingSize);
+    CHECK_EQUAL(0ull, ring.Allocate(40 * 1024, 256));
+    ring.EndFrame(1);
+    CHECK_EQUAL(40ull * 1024, ring.Allocate(16 * 1024, 256));
+    ring.EndFrame(2);
+    ring.Reclaim(1);
+
+    // 8 KB are left before the end, so this skips them.
+    CHECK_EQUAL(0ull, ring.Allocate(16 * 1024, 256));
+    CHECK_EQUAL(40ull * 1024, ring.UsedSize());
+
+    // Up to the start of frame 2 and no further.
+    CHECK_EQUAL(Invalid, ring.Allocate(24 * 1024 + 1, 1));
+    CHECK_EQUAL(16ull * 1024, ring.Allocate(24 * 1024, 1));
+    CHECK_EQUAL(RingSize, ring.UsedSize());
+
+    ring.EndFrame(3);
+    ring.Reclaim(3);
+    CHECK_EQUAL(0ull, ring.UsedSize());
+    CHECK_EQUAL(0u, ring.FramesInFlight());
+}
+
+TEST_CASE(RingAllocator_Alignment)
+{
+    RingAllocator ring(RingSize);
+    CHECK_EQUAL(0ull, ring.Allocate(1, 1));
+    CHECK_EQUAL(256ull, ring.Allocate(1, 256));
+    CHECK_EQUAL(512ull, ring.Allocate(0, 256));
+
+    // Empty allocations still take a byte.
+    CHECK_EQUAL(513ull, ring.Allocate(0, 1));
+}
+
+// ------------------------------------------------------------------
+// Sizes no ring state can hold are refused outright.
+// ------------------------------------------------------------------
+TEST_CASE(RingAllocator_TooLarge)
+{
+    RingAllocator ring(RingSize);
+    CHECK_EQUAL(Invalid, ring.Allocate(RingSize + 1, 1));
+
+    CHECK_EQUAL(0ull, ring.Allocate(1, 1));
+    CHECK_EQUAL(Invalid, ring.Allocate(RingSize, 1));
+    ring.EndFrame(1);
+    ring.Reclaim(1);
+
+    CHECK_EQUAL(Invalid, ring.Allocate(RingSize + 1, 1));
+
+    // Empty again, so the whole ring fits at once.
+    CHECK_EQUAL(0ull, ring.Allocate(RingSize, 1));
+    CHECK_EQUAL(Invalid, ring.Allocate(1, 1));
+}
@@ -0,0 +1,259 @@
+//*******************************************************************
+// StateTrackingCommandListTests.cpp:
+//
+// The state tracker in front of a recording command list: calls that
+// bind what is bound already must not reach the command list, and
+// everything else must, in order.
+//*******************************************************************
+#include "TestFramework.h"
+#include "StateTrackingCommandList.h"
+#include "Testing/RecordingCommandList.h"
+
+namespace
+{
+    using Call = RecordingCommandList::Call;
+    using Tracker = StateTrackingCommandList<RecordingCommandList>;
+
+    // Distinct addresses standing in for D3D objects; never dereferenced.
+    template<typename T>
+    T* Fake(UINT id)
+    {
+        return reinterpret_cast<T*>((uintptr_t)id * 256);
+    }
+
+    D3D12_VERTEX_BUFFER_VIEW VertexBuffer(D3D12_GPU_VIRTUAL_ADDRESS address, UINT stride)
+    {
+        return { address, 1024, stride };
+    }
+
+    D3D12_GPU_DESCRIPTOR_HANDLE Descriptor(UINT64 ptr)
+    {
+        D3D12_GPU_DESCRIPTOR_HANDLE handle;
+        handle.ptr = ptr;
+        return handle;
+    }
+}
+
+TEST_CASE(StateTracking_PipelineState)
+{
+    RecordingCommandList cmdList;
+    Tracker tracker(&cmdList);
+
+    tracker.SetPipelineState(Fake<ID3D12PipelineState>(1));
+    tracker.SetPipelineState(Fake<ID3D12PipelineState>(1));
+    tracker.SetPipelineState(Fake<ID3D12PipelineState>(2));
+    tracker.SetPipelineState(Fake<ID3D12PipelineState>(1));
+
+    CHECK_EQUAL(3u, cmdList.Count(Call::SetPipelineState));
+    CHECK_EQUAL(3u, tracker.GetStats().Issued);
+    CHECK_EQUAL(1u, tracker.GetStats().Dropped);
+
+    // The ones that got through are the changes, in order.
+    const auto& calls = cmdList.Calls();
+    CHECK(calls[0].Value == (UINT64)(uintptr_t)Fake<ID3D12PipelineState>(1));
+    CHECK(calls[1].Value == (UINT64)(uintptr_t)Fake<ID3D12PipelineState>(2));
+    CHECK(calls[2].Value == (UINT64)(uintptr_t)Fake<ID3D12PipelineState>(1));
+}
+
+// ------------------------------------------------------------------
+// Root arguments are tracked per parameter and kind, and forgotten when
+// the root signature changes.
+// ------------------------------------------------------------------
+TEST_CASE(StateTracking_RootArguments)
+{
+    RecordingCommandList cmdList;
+    Tracker tracker(&cmdList);
+
+    tracker.SetGraphicsRootSignature(Fake<ID3D12RootSignature>(1));
+    tracker.SetGraphicsRootConstantBufferView(0, 0x1000);
+    tracker.SetGraphicsRootConstantBufferView(0, 0x1000);
+    tracker.SetGraphicsRootConstantBufferView(1, 0x1000);
+    tracker.SetGraphicsRootShaderResourceView(0, 0x1000);
+    tracker.SetGraphicsRootShaderResourceView(0, 0x1000);
+    CHECK_EQUAL(2u, cmdList.Count(Call::SetGraphicsRootConstantBufferView));
+    CHECK_EQUAL(1u, cmdList.Count(Call::SetGraphicsRootShaderResourceView));
+
+    // The same root signature keeps them.
+    tracker.SetGraphicsRootSignature(Fake<ID3D12RootSignature>(1));
+    tracker.SetGraphicsRootConstantBufferView(1, 0x1000);
+    CHECK_EQUAL(1u, cmdList.Count(Call::SetGraphicsRootSignature));
+    CHECK_EQUAL(2u, cmdList.Count(Call::SetGraphicsRootConstantBufferView));
+
+    // Another one does not.
+    tracker.SetGraphicsRootSignature(Fake<ID3D12RootSignature>(2));
+    tracker.SetGraphicsRootConstantBufferView(1, 0x1000);
+    CHECK_EQUAL(2u, cmdList.Count(Call::SetGraphicsRootSignature));
+    CHECK_EQUAL(3u, cmdList.Count(Call::SetGraphicsRootConstantBufferView));
+
+    // Parameters past the tracked ones are always issued.
+    tracker.SetGraphicsRootConstantBufferView(Tracker::MaxRootParameters, 0x2000);
+    tracker.SetGraphicsRootConstantBufferView(Tracker::MaxRootParameters, 0x2000);
+    CHECK_EQUAL(5u, cmdList.Count(Call::SetGraphicsRootConstantBufferView));
+}
+
+// ------------------------------------------------------------------
+// Changing descriptor heaps forgets the tables pointing into them, but
+// not root descriptors.
+// ------------------------------------------------------------------
+TEST_CASE(StateTracking_DescriptorHeaps)
+{
+    RecordingCommandList cmdList;
+    Tracker tracker(&cmdList);
+
+    ID3D12DescriptorHeap* heaps[] = { Fake<ID3D12DescriptorHeap>(1), Fake<ID3D12DescriptorHeap>(2) };
+    ID3D12DescriptorHeap* otherHeaps[] = { Fake<ID3D12DescriptorHeap>(3) };
+
+    tracker.SetDescriptorHeaps(2, heaps);
+    tracker.SetDescriptorHeaps(2, heaps);
+    tracker.SetDescriptorHeaps(1, heaps);
+    CHECK_EQUAL(2u, cmdList.Count(Call::SetDescriptorHeaps));
+
+    tracker.SetGraphicsRootDescriptorTable(2, Descriptor(0x100));
+    tracker.SetGraphicsRootDescriptorTable(2, Descriptor(0x100));
+    tracker.SetGraphicsRootConstantBufferView(3, 0x1000);
+    CHECK_EQUAL(1u, cmdList.Count(Call::SetGraphicsRootDescriptorTable));
+
+    tracker.SetDescriptorHeaps(1, otherHeaps);
+    tracker.SetGraphicsRootDescriptorTable(2, Descriptor(0x100));
+    tracker.SetGraphicsRootConstantBufferView(3, 0x1000);
+    CHECK_EQUAL(3u, cmdList.Count(Call::SetDescriptorHeaps));
+    CHECK_EQUAL(2u, cmdList.Count(Call::SetGraphicsRootDescriptorTable));
+    CHECK_EQUAL(1u, cmdList.Count(Call::SetGraphicsRootConstantBufferView));
+}
+
+TEST_CASE(StateTracking_InputAssembler)
+{
+    RecordingCommandList cmdList;
+    Tracker tracker(&cmdList);
+
+    D3D12_VERTEX_BUFFER_VIEW views[] = { VertexBuffer(0x1000, 32), VertexBuffer(0x8000, 16) };
+    tracker.IASetVertexBuffers(0, 2, views);
+    tracker.IASetVertexBuffers(0, 2, views);
+    tracker.IASetVertexBuffers(1, 1, &views[1]);
+    CHECK_EQUAL(1u, cmdList.Count(Call::IASetVertexBuffers));
+
+    // A different stride is a different view.
+    D3D12_VERTEX_BUFFER_VIEW restrided = VertexBuffer(0x1000, 16);
+    tracker.IASetVertexBuffers(0, 1, &restrided);
+    CHECK_EQUAL(2u, cmdList.Count(Call::IASetVertexBuffers));
+
+    // Unbinding is issued, and leaves nothing to drop against.
+    tracker.IASetVertexBuffers(1, 1, nullptr);
+    tracker.IASetVertexBuffers(1, 1, &views[1]);
+    CHECK_EQUAL(4u, cmdList.Count(Call::IASetVertexBuffers));
+
+    D3D12_INDEX_BUFFER_VIEW indexBuffer = { 0x4000, 600, DXGI_FORMAT_R16_UINT };
+    D3D12_INDEX_BUFFER_VIEW wideIndices = { 0x4000, 600, DXGI_FORMAT_R32_UINT };
+    tracker.IASetIndexBuffer(&indexBuffer);
+    tracker.IASetIndexBuffer(&indexBuffer);
+    tracker.IASetIndexBuffer(&wideIndices);
+    CHECK_EQUAL(2u, cmdList.Count(Call::IASetIndexBuffer));
+
+    tracker.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    tracker.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    tracker.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_LINELIST);
+    CHECK_EQUAL(2u, cmdList.Count(Call::IASetPrimitiveTopology));
+}
+
+TEST_CASE(StateTracking_ViewportAndScissor)
+{
+    RecordingCommandList cmdList;
+    Tracker tracker(&cmdList);
+
+    D3D12_VIEWPORT viewport = { 0.0f, 0.0f, 1280.0f, 720.0f, 0.0f, 1.0f };
+    D3D12_VIEWPORT shadowViewport = { 0.0f, 0.0f, 2048.0f, 2048.0f, 0.0f, 1.0f };
+    D3D12_RECT scissorRect = { 0, 0, 1280, 720 };
+
+    tracker.RSSetViewports(1, &viewport);
+    tracker.RSSetViewports(1, &viewport);
+    tracker.RSSetViewports(1, &shadowViewport);
+    tracker.RSSetScissorRects(1, &scissorRect);
+    tracker.RSSetScissorRects(1, &scissorRect);
+
+    CHECK_EQUAL(2u, cmdList.Count(Call::RSSetViewports));
+    CHECK_EQUAL(1u, cmdList.Count(Call::RSSetScissorRects));
+}
+
+// ------------------------------------------------------------------
+// Work is never dropped, however often it repeats.
+// ------------------------------------------------------------------
+TEST_CASE(StateTracking_PassesWorkThrough)
+{
+    RecordingCommandList cmdList;
+    Tracker tracker(&cmdList);
+
+    D3D12_CPU_DESCRIPTOR_HANDLE rtv = { 0x10 };
+    D3D12_CPU_DESCRIPTOR_HANDLE dsv = { 0x20 };
+    const FLOAT color[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    for (UINT i = 0; i < 2; ++i)
+    {
+        tracker.OMSetRenderTargets(1, &rtv, TRUE, &dsv);
+        tracker.ClearRenderTargetView(rtv, color, 0, nullptr);
+        tracker.ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
+        tracker.DrawIndexedInstanced(36, 1, 0, 0, 0);
+    }
+
+    CHECK_EQUAL(2u, cmdList.Count(Call::OMSetRenderTargets));
+    CHECK_EQUAL(2u, cmdList.Count(Call::ClearRenderTargetView));
+    CHECK_EQUAL(2u, cmdList.Count(Call::ClearDepthStencilView));
+    CHECK_EQUAL(2u, cmdList.Count(Call::DrawIndexedInstanced));
+    CHECK_EQUAL(0u, tracker.GetStats().Dropped);
+}
+
+// ------------------------------------------------------------------
+// ExecuteIndirect may change buffers and root arguments, but not the
+// pipeline or the topology.
+// ------------------------------------------------------------------
+TEST_CASE(StateTracking_ExecuteIndirect)
+{
+    RecordingCommandList cmdList;
+    Tracker tracker(&cmdList);
+
+    D3D12_VERTEX_BUFFER_VIEW vertexBuffer = VertexBuffer(0x1000, 32);
+    D3D12_INDEX_BUFFER_VIEW indexBuffer = { 0x4000, 600, DXGI_FORMAT_R16_UINT };
+    auto bind = [&]()
+    {
+        tracker.SetPipelineState(Fake<ID3D12PipelineState>(1));
+        tracker.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+        tracker.IASetVertexBuffers(0, 1, &vertexBuffer);
+        tracker.IASetIndexBuffer(&indexBuffer);
+        tracker.SetGraphicsRootShaderResourceView(1, 0x9000);
+    };
+
+    bind();
+    tracker.ExecuteIndirect(Fake<ID3D12CommandSignature>(1), 10, nullptr, 0, nullptr, 0);
+    bind();
+
+    CHECK_EQUAL(1u, cmdList.Count(Call::SetPipelineState));
+    CHECK_EQUAL(1u, cmdList.Count(Call::IASetPrimitiveTopology));
+    CHECK_EQUAL(2u, cmdList.Count(Call::IASetVertexBuffers));
+    CHECK_EQUAL(2u, cmdList.Count(Call::IASetIndexBuffer));
+    CHECK_EQUAL(2u, cmdList.Count(Call::SetGraphicsRootShaderResourceView));
+    CHECK_EQUAL(1u, cmdList.Count(Call::ExecuteIndirect));
+}
+
+TEST_CASE(StateTracking_Invalidate)
+{
+    RecordingCommandList cmdList;
+    Tracker tracker(&cmdList);
+
+    D3D12_VIEWPORT viewport = { 0.0f, 0.0f, 1280.0f, 720.0f, 0.0f, 1.0f };
+    auto bind = [&]()
+    {
+        tracker.SetPipelineState(Fake<ID3D12PipelineState>(1));
+        tracker.SetGraphicsRootSignature(Fake<ID3D12RootSignature>(1));
+        tracker.SetGraphicsRootConstantBufferView(0, 0x1000);
+        tracker.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+        tracker.RSSetViewports(1, &viewport);
+    };
+
+    bind();
+    bind();
+    CHECK_EQUAL(5u, (UINT)cmdList.Calls().size());
+
+    tracker.Invalidate();
+    bind();
+    CHECK_EQUAL(10u, (UINT)cmdList.Calls().size());
+    CHECK_EQUAL(10u, tracker.GetStats().Issued);
+    CHECK_EQUAL(5u, tracker.GetStats().Dropped);
+}
@@ -0,0 +1,48 @@
+//*******************************************************************
+// TestFramework.h:
+//
+// Just enough of a test framework for the pure CPU parts of Core.
+// TEST_CASE defines a function and registers it with the runner; the
+// CHECK macros report a failed condition with its location and let the
+// test go on. The runner exits with an error code when a check failed
+// or a test threw, so a failing run fails whatever started it.
+//*******************************************************************
+
+#pragma once
+
+#include "lmpch.h"
+
+namespace Test
+{
+	using TestFunction = void(*)();
+
+	// Adds a test to the runner during static initialization.
+	struct Registrar
+	{
+		Registrar(const char* name, TestFunction function);
+	};
+
+	void ReportFailure(const char* file, int line, const std::string& message);
+
+	template<typename TExpected, typename TActual>
+	void CheckEqual(const TExpected& expected, const TActual& actual, const char* file, int line, const char* expression)
+	{
+		if (expected == actual)
+			return;
+
+		std::ostringstream message;
+		message << expression << ": expected " << expected << ", got " << actual;
+		ReportFailure(file, line, message.str());
+	}
+}
+
+#define TEST_CASE(name) \
+	static void name(); \
+	static Test::Registrar name##Registrar(#name, name); \
+	static void name()
+
+#define CHECK(condition) \
+	do { if (!(condition)) Test::ReportFailure(__FILE__, __LINE__, #condition); } while (false)
+
+#define CHECK_EQUAL(expected, actual) \
+	Test::CheckEqual((expected), (actual), __FILE__, __LINE__, #actual)
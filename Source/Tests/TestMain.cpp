@@ -0,0 +1,73 @@
+//*******************************************************************
+// TestMain.cpp:
+//
+// Runs every registered test and returns the number that failed.
+//*******************************************************************
+#include "TestFramework.h"
+
+namespace
+{
+    struct TestInfo
+    {
+        const char* Name;
+        Test::TestFunction Function;
+    };
+
+    // Function local, so registrars in other files find it constructed.
+    std::vector<TestInfo>& Tests()
+    {
+        static std::vector<TestInfo> tests;
+        return tests;
+    }
+
+    UINT sFailedChecks = 0;
+}
+
+Test::Registrar::Registrar(const char* name, TestFunction function)
+{
+    Tests().push_back({ name, function });
+}
+
+void Test::ReportFailure(const char* file, int line, const std::string& message)
+{
+    std::cout << "  " << file << "(" << line << "): " << message << std::endl;
+    ++sFailedChecks;
+}
+
+// ------------------------------------------------------------------
+// An optional argument runs only the tests whose name contains it.
+// ------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    const char* filter = argc > 1 ? argv[1] : nullptr;
+
+    int failedTests = 0;
+    int runTests = 0;
+    for (const TestInfo& test : Tests())
+    {
+        if (filter != nullptr && strstr(test.Name, filter) == nullptr)
+            continue;
+
+        std::cout << test.Name << std::endl;
+        UINT failedBefore = sFailedChecks;
+        try
+        {
+            test.Function();
+        }
+        catch (const std::exception& e)
+        {
+            Test::ReportFailure(__FILE__, __LINE__, std::string("threw ") + e.what());
+        }
+        catch (...)
+        {
+            Test::ReportFailure(__FILE__, __LINE__, "threw an exception");
+        }
+
+        ++runTests;
+        if (sFailedChecks != failedBefore)
+            ++failedTests;
+    }
+
+    std::cout << runTests - failedTests << " of " << runTests << " tests passed" << std::endl;
+    return failedTests;
+}
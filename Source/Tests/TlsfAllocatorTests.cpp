@@ -0,0 +1,163 @@
+//*******************************************************************
+// TlsfAllocatorTests.cpp:
+//
+// The TLSF allocator under random allocations and frees the size of
+// GPU resources, with its blocks and free lists checked after every
+// operation.
+//*******************************************************************
+#include "TestFramework.h"
+#include "Memory/TlsfAllocator.h"
+
+namespace
+{
+    // The heap and placement alignments of GpuMemoryAllocator.
+    const UINT64 HeapSize = 64ull << 20;
+    const UINT64 Granularity = D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT;
+
+    // Same sequence on every run, so a failure can be reproduced.
+    class XorShift
+    {
+    public:
+        UINT64 Next()
+        {
+            mState ^= mState << 13;
+            mState ^= mState >> 7;
+            mState ^= mState << 17;
+            return mState;
+        }
+
+    private:
+        UINT64 mState = 0x9E3779B97F4A7C15ull;
+    };
+}
+
+// ------------------------------------------------------------------
+// Allocate and free random sizes and alignments. Every allocation must
+// be aligned, inside the heap and clear of the live ones, and the
+// allocator must pass Validate after every operation.
+// ------------------------------------------------------------------
+TEST_CASE(TlsfAllocator_Stress)
+{
+    const UINT64 alignments[] = { Granularity, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT, D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT };
+    const int operations = 20000;
+    const size_t maxLive = 1024;
+
+    TlsfAllocator allocator(HeapSize, Granularity);
+    std::vector<TlsfAllocator::Allocation> live;
+
+    // Offset to end of the live allocations, to find overlaps.
+    std::map<UINT64, UINT64> ranges;
+
+    XorShift random;
+    UINT failedAllocations = 0;
+    for (int op = 0; op < operations; ++op)
+    {
+        UINT64 r = random.Next();
+        if (live.empty() || ((r & 3) != 0 && live.size() < maxLive))
+        {
+            // Mostly small sizes with the odd large one, like real resources.
+            UINT64 size = (r >> 8) % ((r & 0x30) == 0 ? 8ull << 20 : 256ull << 10) + 1;
+            UINT64 alignment = alignments[(r >> 40) % _countof(alignments)];
+            TlsfAllocator::Allocation allocation = allocator.Allocate(size, alignment);
+            if (!allocation.IsValid())
+            {
+                // Only for lack of room. Searching by size class may pass
+                // over a block that would just fit, but none twice as large.
+                CHECK(allocator.LargestFreeBlock() < 2 * (size + alignment));
+                ++failedAllocations;
+            }
+            else
+            {
+                CHECK_EQUAL(0ull, allocation.Offset % alignment);
+                CHECK(allocation.Size >= size);
+                CHECK(allocation.Offset + allocation.Size <= HeapSize);
+
+                auto next = ranges.lower_bound(allocation.Offset);
+                CHECK(next == ranges.end() || allocation.Offset + allocation.Size <= next->first);
+                CHECK(next == ranges.begin() || std::prev(next)->second <= allocation.Offset);
+                ranges.emplace(allocation.Offset, allocation.Offset + allocation.Size);
+                live.push_back(allocation);
+            }
+        }
+        else
+        {
+            size_t i = (size_t)((r >> 8) % live.size());
+            allocator.Free(live[i]);
+            ranges.erase(live[i].Offset);
+            live[i] = live.back();
+            live.pop_back();
+        }
+
+        if (!allocator.Validate())
+        {
+            Test::ReportFailure(__FILE__, __LINE__, "Validate failed after operation " + std::to_string(op));
+            return;
+        }
+        CHECK_EQUAL((UINT)live.size(), allocator.AllocationCount());
+    }
+
+    // Large requests run out of room now and then, but most must fit.
+    // The heap has to have filled up for the test to cover that.
+    CHECK(failedAllocations > 0);
+
+    for (const TlsfAllocator::Allocation& allocation : live)
+        allocator.Free(allocation);
+    CHECK(allocator.Validate());
+    CHECK_EQUAL(0ull, allocator.UsedSize());
+    CHECK_EQUAL(HeapSize, allocator.LargestFreeBlock());
+}
+
+// ------------------------------------------------------------------
+// Freed blocks merge with free neighbours on either side.
+// ------------------------------------------------------------------
+TEST_CASE(TlsfAllocator_MergesNeighbours)
+{
+    TlsfAllocator allocator(HeapSize, Granularity);
+    TlsfAllocator::Allocation blocks[4];
+    for (TlsfAllocator::Allocation& block : blocks)
+        block = allocator.Allocate(1ull << 20, Granularity);
+
+    allocator.Free(blocks[1]);
+    allocator.Free(blocks[3]);
+    CHECK(allocator.Validate());
+    CHECK(allocator.Fragmentation() > 0.0f);
+    CHECK_EQUAL(HeapSize - (3ull << 20), allocator.LargestFreeBlock());
+
+    allocator.Free(blocks[2]);
+    CHECK(allocator.Validate());
+    CHECK_EQUAL(HeapSize - (1ull << 20), allocator.LargestFreeBlock());
+    CHECK_EQUAL(0.0f, allocator.Fragmentation());
+
+    allocator.Free(blocks[0]);
+    CHECK(allocator.Validate());
+    CHECK_EQUAL(HeapSize, allocator.LargestFreeBlock());
+    CHECK_EQUAL(0u, allocator.AllocationCount());
+}
+
+// ------------------------------------------------------------------
+// A full heap refuses more and takes the space back when freed. Sizes
+// are rounded up to the granularity.
+// ------------------------------------------------------------------
+TEST_CASE(TlsfAllocator_Exhaustion)
+{
+    TlsfAllocator allocator(HeapSize, Granularity);
+
+    TlsfAllocator::Allocation small = allocator.Allocate(1, Granularity);
+    CHECK(small.IsValid());
+    CHECK_EQUAL(Granularity, small.Size);
+
+    TlsfAllocator::Allocation rest = allocator.Allocate(HeapSize - Granularity, Granularity);
+    CHECK(rest.IsValid());
+    CHECK(!allocator.Allocate(1, Granularity).IsValid());
+    CHECK(!allocator.Allocate(HeapSize + 1, Granularity).IsValid());
+    CHECK_EQUAL(0ull, allocator.FreeSize());
+
+    allocator.Free(small);
+    TlsfAllocator::Allocation again = allocator.Allocate(Granularity, Granularity);
+    CHECK_EQUAL(small.Offset, again.Offset);
+
+    allocator.Free(again);
+    allocator.Free(rest);
+    CHECK(allocator.Validate());
+    CHECK(allocator.Allocate(HeapSize, Granularity).IsValid());
+}
@@ -0,0 +1,119 @@
+//*******************************************************************
+// UploadRingTests.cpp:
+//
+// The upload ring growing out of a full buffer, with buffers in plain
+// memory so no device is needed.
+//*******************************************************************
+#include "TestFramework.h"
+#include "Memory/UploadRing.h"
+
+namespace
+{
+    const UINT64 RingSize = 64 * 1024;
+
+    // Buffers in system memory at made up GPU addresses, far enough
+    // apart that an address tells which buffer it is in.
+    class FakeBufferFactory : public UploadRing::BufferFactory
+    {
+    public:
+        static const UINT64 AddressSpacing = 1ull << 32;
+
+        UploadRing::Buffer CreateBuffer(UINT64 size) override
+        {
+            auto memory = std::make_unique<BYTE[]>((size_t)size);
+
+            UploadRing::Buffer buffer;
+            buffer.MappedData = memory.get();
+            buffer.GpuAddress = ++mCreatedCount * AddressSpacing;
+            mBuffers.emplace(buffer.MappedData, std::move(memory));
+            return buffer;
+        }
+
+        void ReleaseBuffer(UploadRing::Buffer& buffer) override
+        {
+            size_t erased = mBuffers.erase(buffer.MappedData);
+            CHECK_EQUAL((size_t)1, erased);
+        }
+
+        UINT LiveCount() const { return (UINT)mBuffers.size(); }
+        UINT CreatedCount() const { return (UINT)mCreatedCount; }
+
+    private:
+        std::unordered_map<BYTE*, std::unique_ptr<BYTE[]>> mBuffers;
+        UINT64 mCreatedCount = 0;
+    };
+
+    UINT64 BufferOf(const UploadRing::Allocation& allocation)
+    {
+        return allocation.GpuAddress / FakeBufferFactory::AddressSpacing;
+    }
+}
+
+// ------------------------------------------------------------------
+// Space comes back once the frame that used it completes, without the
+// ring growing.
+// ------------------------------------------------------------------
+TEST_CASE(UploadRing_ReuseAfterFence)
+{
+    auto factory = std::make_unique<FakeBufferFactory>();
+    FakeBufferFactory& buffers = *factory;
+    UploadRing ring(std::move(factory), RingSize);
+
+    ring.BeginFrame(0, 1);
+    UploadRing::Allocation first = ring.Allocate(RingSize / 2, 256);
+    ring.BeginFrame(0, 2);
+    UploadRing::Allocation second = ring.Allocate(RingSize / 2, 256);
+    CHECK_EQUAL(RingSize / 2, second.Offset);
+    CHECK_EQUAL(RingSize / 2, ring.FrameSize());
+
+    ring.BeginFrame(1, 3);
+    UploadRing::Allocation third = ring.Allocate(RingSize / 2, 256);
+    CHECK_EQUAL(0ull, third.Offset);
+    CHECK(third.CpuAddress == first.CpuAddress);
+    CHECK_EQUAL(first.GpuAddress, third.GpuAddress);
+
+    CHECK_EQUAL(0u, ring.GrowCount());
+    CHECK_EQUAL(1u, buffers.CreatedCount());
+}
+
+// ------------------------------------------------------------------
+// A full ring is replaced by a larger one, leaving the data of the frame
+// intact in the old buffer until its fence completes.
+// ------------------------------------------------------------------
+TEST_CASE(UploadRing_Grow)
+{
+    auto factory = std::make_unique<FakeBufferFactory>();
+    FakeBufferFactory& buffers = *factory;
+    UploadRing ring(std::move(factory), RingSize);
+
+    ring.BeginFrame(0, 1);
+    UploadRing::Allocation first = ring.Allocate(RingSize, 256);
+    memset(first.CpuAddress, 0xAB, (size_t)RingSize);
+
+    UploadRing::Allocation second = ring.Allocate(1024, 256);
+    CHECK_EQUAL(1u, ring.GrowCount());
+    CHECK_EQUAL(2 * RingSize, ring.Size());
+    CHECK(BufferOf(second) != BufferOf(first));
+    CHECK_EQUAL(2u, buffers.LiveCount());
+    CHECK(first.CpuAddress[0] == 0xAB && first.CpuAddress[RingSize - 1] == 0xAB);
+
+    D3D12_GPU_VIRTUAL_ADDRESS constants = ring.CopyConstants(RingSize);
+    CHECK_EQUAL(0ull, constants % D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+    CHECK_EQUAL(BufferOf(second), constants / FakeBufferFactory::AddressSpacing);
+
+    // Grows to the next power of two multiple with room for the request.
+    ring.BeginFrame(0, 2);
+    CHECK_EQUAL(2u, buffers.LiveCount());
+    UploadRing::Allocation third = ring.Allocate(3 * RingSize, 256);
+    CHECK_EQUAL(2u, ring.GrowCount());
+    CHECK_EQUAL(4 * RingSize, ring.Size());
+    CHECK_EQUAL(0ull, third.Offset);
+    CHECK_EQUAL(3u, buffers.LiveCount());
+
+    // Each retired buffer goes with the last frame that used it.
+    ring.BeginFrame(1, 3);
+    CHECK_EQUAL(2u, buffers.LiveCount());
+    ring.BeginFrame(2, 4);
+    CHECK_EQUAL(1u, buffers.LiveCount());
+    CHECK_EQUAL(3u, buffers.CreatedCount());
+}
@@ -0,0 +1,225 @@
+//*******************************************************************
+// VisibilityCacheTests.cpp:
+//
+// The temporal visibility cache against the frustum culler it stands
+// in for. Whatever it reuses, per entry or for a whole range, it must
+// give the lists the culler gives, and a still camera must let it
+// answer ranges without walking them.
+//*******************************************************************
+#include "TestFramework.h"
+#include "Culling/VisibilityCache.h"
+
+using namespace DirectX;
+
+namespace
+{
+    // A grid of unit boxes on the ground, split into ranges like the
+    // instances of render items.
+    const UINT GridSize = 24;
+    const UINT RangeCount = 6;
+    const UINT RangeSize = GridSize * GridSize / RangeCount;
+
+    const BoundingBox UnitBox(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.5f, 0.5f, 0.5f));
+
+    XMMATRIX GridWorld(UINT index)
+    {
+        float x = ((index % GridSize) - GridSize * 0.5f) * 4.0f;
+        float z = ((index / GridSize) - GridSize * 0.5f) * 4.0f;
+        return XMMatrixTranslation(x, 0.0f, z);
+    }
+
+    void BuildGrid(InstanceBounds& bounds)
+    {
+        for (UINT i = 0; i < GridSize * GridSize; ++i)
+            bounds.Add(UnitBox, GridWorld(i));
+    }
+
+    // A camera above the grid at position, turned by yaw about the up axis.
+    struct Camera
+    {
+        VisibilityCache::CameraPose Pose;
+        FrustumCuller Culler;
+
+        Camera(const XMFLOAT3& position, float yaw)
+        {
+            XMVECTOR look = XMVectorSet(sinf(yaw), -0.3f, cosf(yaw), 0.0f);
+            XMMATRIX view = XMMatrixLookAtLH(XMLoadFloat3(&position), XMLoadFloat3(&position) + look, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+            XMMATRIX proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 1.0f, 60.0f);
+            Culler.SetViewProj(XMMatrixMultiply(view, proj));
+
+            // The basis is the transpose of the rotation part of the view.
+            XMFLOAT4X4 v;
+            XMStoreFloat4x4(&v, view);
+            Pose.Position = position;
+            Pose.Right = XMFLOAT3(v.m[0][0], v.m[1][0], v.m[2][0]);
+            Pose.Up = XMFLOAT3(v.m[0][1], v.m[1][1], v.m[2][1]);
+            Pose.Look = XMFLOAT3(v.m[0][2], v.m[1][2], v.m[2][2]);
+        }
+    };
+
+    // Cull every range with the cache and with the culler, and check both
+    // give the same lists.
+    bool CullMatches(VisibilityCache& cache, const Camera& camera, const InstanceBounds& bounds, bool& changed)
+    {
+        cache.BeginFrame(camera.Culler, camera.Pose);
+
+        bool matches = true;
+        UINT cached[RangeSize];
+        UINT reference[RangeSize];
+        for (UINT r = 0; r < RangeCount; ++r)
+        {
+            UINT cachedCount = cache.Cull(bounds, r * RangeSize, RangeSize, cached, changed);
+            UINT referenceCount = camera.Culler.Cull(bounds, r * RangeSize, RangeSize, reference);
+            matches = matches && cachedCount == referenceCount && std::equal(cached, cached + cachedCount, reference);
+        }
+        return matches;
+    }
+}
+
+TEST_CASE(VisibilityCache_SkipsStillRanges)
+{
+    InstanceBounds bounds;
+    BuildGrid(bounds);
+
+    VisibilityCache cache;
+    cache.Resize(bounds.Size());
+
+    Camera camera(XMFLOAT3(0.0f, 6.0f, -30.0f), 0.3f);
+
+    bool changed = false;
+    CHECK(CullMatches(cache, camera, bounds, changed));
+    CHECK(changed);
+    CHECK_EQUAL(0u, cache.GetStats().RangesSkipped);
+    CHECK_EQUAL(bounds.Size(), cache.GetStats().Misses);
+
+    // Nothing moved: every range is answered from its last walk.
+    changed = false;
+    CHECK(CullMatches(cache, camera, bounds, changed));
+    CHECK(!changed);
+    CHECK_EQUAL(RangeCount, cache.GetStats().RangesSkipped);
+    CHECK_EQUAL(0u, cache.GetStats().Misses);
+    CHECK_EQUAL(bounds.Size(), cache.GetStats().Hits);
+
+    // A range is walked again after BucketCount frames, still or not.
+    for (UINT frame = 2; frame < VisibilityCache::BucketCount; ++frame)
+        CHECK(CullMatches(cache, camera, bounds, changed));
+    CHECK_EQUAL(RangeCount, cache.GetStats().RangesSkipped);
+
+    CHECK(CullMatches(cache, camera, bounds, changed));
+    CHECK_EQUAL(0u, cache.GetStats().RangesSkipped);
+    CHECK(cache.GetStats().Misses > 0);
+    CHECK(!changed);
+}
+
+TEST_CASE(VisibilityCache_MovedBoundsWalkTheirRange)
+{
+    InstanceBounds bounds;
+    BuildGrid(bounds);
+
+    VisibilityCache cache;
+    cache.Resize(bounds.Size());
+
+    Camera camera(XMFLOAT3(0.0f, 6.0f, -30.0f), 0.0f);
+
+    bool changed = false;
+    CHECK(CullMatches(cache, camera, bounds, changed));
+
+    // Move a visible entry of the third range behind the camera. Only that
+    // range is walked again, and drops it.
+    UINT visible[RangeSize];
+    UINT visibleCount = camera.Culler.Cull(bounds, 2 * RangeSize, RangeSize, visible);
+    CHECK(visibleCount > 0);
+    const UINT moved = 2 * RangeSize + visible[0];
+
+    bounds.Update(moved, UnitBox, XMMatrixTranslation(0.0f, 6.0f, -60.0f));
+    cache.MarkMoved(moved);
+
+    changed = false;
+    CHECK(CullMatches(cache, camera, bounds, changed));
+    CHECK(changed);
+    CHECK_EQUAL(RangeCount - 1, cache.GetStats().RangesSkipped);
+    CHECK_EQUAL(visibleCount - 1, camera.Culler.Cull(bounds, 2 * RangeSize, RangeSize, visible));
+
+    // Invalidate forgets every range.
+    cache.Invalidate();
+    CHECK(CullMatches(cache, camera, bounds, changed));
+    CHECK_EQUAL(0u, cache.GetStats().RangesSkipped);
+    CHECK_EQUAL(bounds.Size(), cache.GetStats().Misses);
+}
+
+TEST_CASE(VisibilityCache_MatchesCullerAlongPath)
+{
+    InstanceBounds bounds;
+    BuildGrid(bounds);
+
+    VisibilityCache cache;
+    cache.Resize(bounds.Size());
+
+    // Slow walking and turning with a few sudden jumps. Every frame must
+    // give what culling from scratch gives, whatever was reused.
+    XMFLOAT3 position(0.0f, 6.0f, -30.0f);
+    float yaw = 0.0f;
+
+    bool allMatch = true;
+    UINT skipped = 0;
+    UINT hits = 0;
+    for (UINT frame = 0; frame < 400; ++frame)
+    {
+        if (frame % 100 == 99)
+        {
+            position.x += 20.0f;
+            yaw += 1.0f;
+        }
+        else if (frame % 50 < 25)
+        {
+            position.z += 0.02f;
+            yaw += 0.001f;
+        }
+
+        Camera camera(position, yaw);
+        bool changed = false;
+        allMatch = allMatch && CullMatches(cache, camera, bounds, changed);
+
+        skipped += cache.GetStats().RangesSkipped;
+        hits += cache.GetStats().Hits;
+    }
+
+    CHECK(allMatch);
+    CHECK(skipped > 0);
+    CHECK(hits > 0);
+}
+
+TEST_CASE(VisibilityCache_OverlappingRanges)
+{
+    // Ranges are meant to be the same every frame. When they are not,
+    // results must still be right.
+    InstanceBounds bounds;
+    BuildGrid(bounds);
+
+    VisibilityCache cache;
+    cache.Resize(bounds.Size());
+
+    Camera camera(XMFLOAT3(0.0f, 6.0f, -30.0f), 0.0f);
+
+    bool allMatch = true;
+    for (UINT frame = 0; frame < 4; ++frame)
+    {
+        cache.BeginFrame(camera.Culler, camera.Pose);
+
+        const UINT ranges[][2] = { { 0, 200 }, { 100, 200 }, { 0, 150 } };
+        for (const auto& range : ranges)
+        {
+            bool changed = false;
+            UINT cached[200];
+            UINT reference[200];
+            UINT cachedCount = cache.Cull(bounds, range[0], range[1], cached, changed);
+            UINT referenceCount = camera.Culler.Cull(bounds, range[0], range[1], reference);
+            allMatch = allMatch && cachedCount == referenceCount && std::equal(cached, cached + cachedCount, reference);
+        }
+
+        // An entry owned by the last range to walk it moves.
+        bounds.Update(120, UnitBox, XMMatrixTranslation(0.0f, 6.0f, frame % 2 ? -60.0f : 0.0f));
+        cache.MarkMoved(120);
+    }
+    CHECK(allMatch);
+}
@@ -0,0 +1,48 @@
+project (_PROJECT_TESTS)
+    kind "ConsoleApp"
+    language "C++"
+	cppdialect "C++17"
+	staticruntime "off"
+
+    targetdir("%{wks.location}/Build/bin/" .. _OUTPUT_DIR .. "/%{prj.name}")
+    objdir("%{wks.location}/Build/bin-int/" .. _OUTPUT_DIR .. "/%{prj.name}")
+
+	files
+	{ 
+		"**.h", "**.cpp",
+	}
+
+	includedirs
+    {
+		"%{wks.location}/Source/Core",
+		"%{IncludeDir.imgui}",
+		"%{IncludeDir.assimp}",
+    }
+	
+	-- Core's code that is tested pulls in parts that call into the
+	-- DirectX libraries, even where the tests never reach them.
+	links
+	{
+		"Core",
+		"d3d12",
+		"dxgi",
+		"d3dcompiler",
+	}
+	
+	filter "system:windows"
+		systemversion "latest"
+	
+	defines { "_CRT_SECURE_NO_WARNINGS" }
+		
+    filter "configurations:Debug"
+        defines { "WIN32", "_DEBUG", "DEBUG", "_CONSOLE" }
+        flags { "FatalWarnings" }
+		symbols "On"
+		runtime "Debug"
+
+    filter "configurations:Release"
+        defines { "WIN32", "NDEBUG", "PROFILE", "_CONSOLE" }
+        flags { "LinkTimeOptimization", "FatalWarnings" }
+		symbols "On"
+		runtime "Release"
+        optimize "On"
\ No newline at end of file
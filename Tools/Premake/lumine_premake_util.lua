@@ -4,6 +4,8 @@
 _WORKSPACE_NAME = "Lumine"
 _PROJECT_CORE = "Core"
 _PROJECT_ENGINE = "Engine"
+_PROJECT_TESTS = "Tests"
+_PROJECT_BENCHMARKS = "Benchmarks"
 
 -- _ACTION is a premake global variable and for our usage will be vs2017, vs2019, etc.
 -- Strip "vs" from this string to make a suffix for solution and project files.
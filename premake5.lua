@@ -27,3 +27,5 @@ group ""
 
 include ("Source/" .. _PROJECT_CORE)
 include ("Source/" .. _PROJECT_ENGINE)
+include ("Source/" .. _PROJECT_TESTS)
+include ("Source/" .. _PROJECT_BENCHMARKS)